@@ -4,17 +4,49 @@
  * Reference: https://www.geeksforgeeks.org/socket-programming-cc/
  * Author: Akshat Sinha
  */
+#define _GNU_SOURCE  // recvmmsg(), sendmmsg()
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>  // unix domain address
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 #include <stdlib.h>
 #include <netinet/in.h>  // internet address family
 #include <string.h>
+#include <getopt.h>
+#include <time.h>
+#include <sys/time.h>  // struct timeval
 //#include <netdb.h>  // defines the structure hostent
 
+#include "ipc_common.h"  // BUFFER_SIZE
+#include "ipc_frame.h"   // length-prefixed framing
+#include "ipc_pool.h"    // pooled I/O buffers
+#include "ipc_shm.h"     // shared-memory transport
+#include "ipc_udp.h"     // datagram batching
+#include "ipc_metrics.h" // server metrics
+#include "ipc_client.h"  // asynchronous client library
+#include "ipc_message.h" // compact binary messages
+#include "ipc_broker.h"  // publish/subscribe
+
 //#define PORT 8080
-#define BUFFER_SIZE 1024
+// requests encoded but not sent yet, in pipelined mode
+#define PIPELINE_BATCH_SIZE (64 * BUFFER_SIZE)
+// most a single read of standard input can add to the batch: a frame per byte
+// (a binary message in each, with -e), plus a full line
+#define PIPELINE_FRAME_MAX (IPC_FRAME_HEADER_SIZE + IPC_MESSAGE_HEADER_SIZE + IPC_MESSAGE_BLOB_SIZE)
+#define PIPELINE_INPUT_MAX ((BUFFER_SIZE + 1) * PIPELINE_FRAME_MAX + 2 * BUFFER_SIZE)
+// every read of a bulk reply lands in this one buffer, allocated once
+#define RECEIVE_BUFFER_SIZE (256 * 1024)
+// datagrams sent but not acknowledged yet, in UDP batch mode: small datagrams still take
+// about 1 KB of socket buffer each, more would overrun the default buffers (net.core.rmem_default)
+#define UDP_WINDOW (2 * IPC_UDP_BATCH)
+// a datagram not acknowledged after this long is counted as lost
+#define UDP_TIMEOUT_SECONDS 1
 
 void fv_logErrorEXIT(const char *cptrc_errorMessage,
                            int   pi_socket_fd) {
@@ -30,106 +62,1276 @@ void fv_logErrorEXIT(const char *cptrc_errorMessage,
     exit(EXIT_FAILURE);
 }
 
-int main(int argc, char const *argv[]) {
+/*
+ * Framed mode: send all of standard input as one request frame
+ * A regular file is streamed in BUFFER_SIZE chunks behind a header announcing its size;
+ * anything else (terminal, pipe) is collected until end of input first
+ */
+void fv_sendFramed(int pi_socket_fd, uint32_t pui_requestID) {
     //
-    if (argc < 3) {
-        fprintf(stderr, "usage %s hostname port\n", argv[0]);
+    char        lc_a1_buffer[BUFFER_SIZE];
+    struct stat lO_status;
+    //
+    if (fstat(STDIN_FILENO, &lO_status) == 0 && S_ISREG(lO_status.st_mode)) {
+        struct ipc_frameHeader lO_header;
+        unsigned char          luc_a1_header[IPC_FRAME_HEADER_SIZE];
+        uint64_t               lul_remaining = (uint64_t) lO_status.st_size;
         //
-        return EXIT_FAILURE;
+        lO_header.mus_type = IPC_FRAME_REQUEST;
+        lO_header.mui_requestID = pui_requestID;
+        lO_header.mul_length = lul_remaining;
+        fv_frameHeaderEncode(&lO_header, luc_a1_header);
+        //
+        if (fi_writeAll(pi_socket_fd, luc_a1_header, IPC_FRAME_HEADER_SIZE) < 0) {
+            fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+        }
+        while (lul_remaining > 0) {
+            ssize_t li_n = read(STDIN_FILENO, lc_a1_buffer,
+                                lul_remaining < BUFFER_SIZE ? (size_t) lul_remaining : BUFFER_SIZE);
+            //
+            if (li_n <= 0) {
+                // the file shrank under us: the announced length can no longer be met
+                fv_logErrorEXIT("ERROR reading standard input", pi_socket_fd);
+            }
+            if (fi_writeAll(pi_socket_fd, lc_a1_buffer, li_n) < 0) {
+                fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+            }
+            lul_remaining -= li_n;
+        }
+        return;
+    }
+    //
+    // a pipe or terminal: no length to announce until its end, so collect the message
+    // in pooled buffers, chained as it grows, and send them in place
+    struct ipc_buffer *lptrO_message = NULL;
+    ssize_t            li_n;
+    //
+    while ((li_n = read(STDIN_FILENO, lc_a1_buffer, BUFFER_SIZE)) > 0) {
+        if (fi_bufferAppend(&lptrO_message, lc_a1_buffer, li_n) < 0) {
+            fv_logErrorEXIT("ERROR reading standard input", pi_socket_fd);
+        }
+    }
+    //
+    struct iovec lO_a1_parts[IPC_FRAME_PARTS_MAX + 1];
+    int          li_parts = fi_bufferChainIovec(lptrO_message, lO_a1_parts, IPC_FRAME_PARTS_MAX + 1);
+    //
+    if (li_parts <= IPC_FRAME_PARTS_MAX) {
+        if (fi_frameSendv(pi_socket_fd, IPC_FRAME_REQUEST, pui_requestID, lO_a1_parts, li_parts) < 0) {
+            fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+        }
+    } else {
+        // too long to gather in one go: the header, then the buffers one by one
+        struct ipc_frameHeader lO_header;
+        unsigned char          luc_a1_header[IPC_FRAME_HEADER_SIZE];
+        //
+        lO_header.mus_type = IPC_FRAME_REQUEST;
+        lO_header.mui_requestID = pui_requestID;
+        lO_header.mul_length = fsz_bufferChainLength(lptrO_message);
+        fv_frameHeaderEncode(&lO_header, luc_a1_header);
+        //
+        if (fi_writeAll(pi_socket_fd, luc_a1_header, IPC_FRAME_HEADER_SIZE) < 0) {
+            fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+        }
+        for (const struct ipc_buffer *lptrO_part = lptrO_message;
+             lptrO_part != NULL;
+             lptrO_part = lptrO_part->mptrO_next) {
+            if (fi_writeAll(pi_socket_fd, lptrO_part->mptrc_data, lptrO_part->mui_length) < 0) {
+                fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+            }
+        }
+    }
+    fv_bufferRelease(lptrO_message);
+}
+
+// reply of the server in framed mode, filled by the parser's handlers
+struct ipc_reply {
+    char          mc_a1_text[BUFFER_SIZE];
+    size_t        msz_text;
+    int           mi_complete;
+    unsigned long mul_acknowledged;
+};
+
+static int fi_onReplyPayload(void                         *pptrv_reply,
+                             const struct ipc_frameHeader *pptrO_header,
+                             const char                   *pptrc_chunk,
+                             size_t                        psz_chunk) {
+    struct ipc_reply *lptrO_reply = pptrv_reply;
+    size_t            lsz_room = BUFFER_SIZE - 1 - lptrO_reply->msz_text;
+    //
+    (void) pptrO_header;
+    //
+    if (psz_chunk > lsz_room) {
+        psz_chunk = lsz_room;
+    }
+    memcpy(lptrO_reply->mc_a1_text + lptrO_reply->msz_text, pptrc_chunk, psz_chunk);
+    lptrO_reply->msz_text += psz_chunk;
+    //
+    return 0;
+}
+
+static int fi_onReplyEnd(void *pptrv_reply, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_reply *lptrO_reply = pptrv_reply;
+    //
+    if (pptrO_header->mus_type == IPC_FRAME_MESSAGE) {
+        // a receipt, read in place: it carries back the timestamp its note was sent with
+        const char *lptrc_receipt = lptrO_reply->mc_a1_text;
+        //
+        if (fi_messageValidate(lptrc_receipt, lptrO_reply->msz_text) < 0 ||
+            fus_messageKind(lptrc_receipt) != IPC_MESSAGE_RECEIPT) {
+            errno = EPROTO;
+            return -1;
+        }
+        printf("[SERVER #%u]: receipt for note %llu, status %u, round trip %.1f us\n",
+               pptrO_header->mui_requestID,
+               (unsigned long long) ful_messageSequence(lptrc_receipt),
+               fui_messageStatus(lptrc_receipt),
+               (ful_metricsNow() - ful_messageTimestamp(lptrc_receipt)) / 1000.0);
+    } else {
+        lptrO_reply->mc_a1_text[lptrO_reply->msz_text] = '\0';
+        printf("[SERVER #%u]: %s\n", pptrO_header->mui_requestID, lptrO_reply->mc_a1_text);
+    }
+    //
+    lptrO_reply->msz_text = 0;
+    lptrO_reply->mi_complete = 1;
+    ++lptrO_reply->mul_acknowledged;
+    //
+    return 0;
+}
+
+static const struct ipc_frameHandler gO_replyHandler = {
+    NULL,
+    fi_onReplyPayload,
+    fi_onReplyEnd
+};
+
+/*
+ * Framed mode: wait for the acknowledgement frame
+ */
+void fv_receiveFramed(int pi_socket_fd) {
+    //
+    char                   lc_a1_buffer[BUFFER_SIZE];
+    struct ipc_reply       lO_reply;
+    struct ipc_frameParser lO_parser;
+    //
+    memset(&lO_reply, 0, sizeof(lO_reply));
+    fv_frameParserInit(&lO_parser, &gO_replyHandler, &lO_reply);
+    //
+    while (!lO_reply.mi_complete) {
+        int li_n = read(pi_socket_fd, lc_a1_buffer, BUFFER_SIZE);
+        //
+        if (li_n <= 0) {
+            fv_logErrorEXIT("ERROR reading from socket", pi_socket_fd);
+        }
+        if (fi_frameParserFeed(&lO_parser, lc_a1_buffer, li_n) != 0) {
+            fv_logErrorEXIT("ERROR parsing reply", pi_socket_fd);
+        }
+    }
+}
+
+/*
+ * Pipelined mode: every line of standard input is a request frame of its own,
+ * or with pi_binary, a binary note (see ipc_message.h), all sent over this one connection
+ * Requests leave as soon as they are read, without waiting for earlier acknowledgements;
+ * poll() interleaves sending and receiving, so neither side can stall the other
+ * with a full socket buffer
+ */
+void fv_pipeline(int pi_socket_fd, int pi_binary) {
+    //
+    char     lc_a1_batch[PIPELINE_BATCH_SIZE];
+    size_t   lsz_batch = 0,
+             lsz_batchSent = 0;
+    char     lc_a1_line[BUFFER_SIZE];
+    size_t   lsz_line = 0;
+    char     lc_a1_buffer[BUFFER_SIZE];
+    uint32_t lui_requestID = 0;
+    int      li_inputOpen = 1;
+    //
+    struct ipc_reply       lO_reply;
+    struct ipc_frameParser lO_parser;
+    //
+    memset(&lO_reply, 0, sizeof(lO_reply));
+    fv_frameParserInit(&lO_parser, &gO_replyHandler, &lO_reply);
+    //
+    while (li_inputOpen || lO_reply.mul_acknowledged < lui_requestID) {
+        //
+        // move unsent requests to the front, so a whole read of input always fits behind them
+        if (lsz_batchSent > 0) {
+            memmove(lc_a1_batch, lc_a1_batch + lsz_batchSent, lsz_batch - lsz_batchSent);
+            lsz_batch -= lsz_batchSent;
+            lsz_batchSent = 0;
+        }
+        int li_room = PIPELINE_BATCH_SIZE - lsz_batch >= PIPELINE_INPUT_MAX;
+        //
+        struct pollfd lO_a1_poll[2];
+        lO_a1_poll[0].fd = (li_inputOpen && li_room) ? STDIN_FILENO : -1;
+        lO_a1_poll[0].events = POLLIN;
+        lO_a1_poll[1].fd = pi_socket_fd;
+        lO_a1_poll[1].events = POLLIN | (lsz_batch > 0 ? POLLOUT : 0);
+        //
+        if (poll(lO_a1_poll, 2, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fv_logErrorEXIT("poll", pi_socket_fd);
+        }
+        //
+        if (lO_a1_poll[0].revents & (POLLIN | POLLHUP)) {
+            ssize_t li_n = read(STDIN_FILENO, lc_a1_buffer, BUFFER_SIZE);
+            //
+            if (li_n < 0) {
+                fv_logErrorEXIT("ERROR reading standard input", pi_socket_fd);
+            }
+            if (li_n == 0) {
+                li_inputOpen = 0;
+            }
+            // split into lines: each complete line, or the rest at end of input, is a request
+            for (ssize_t i = 0; i <= li_n; ++i) {
+                int li_endOfLine = (i == li_n) ? (li_n == 0 && lsz_line > 0)
+                                               : (lc_a1_buffer[i] == '\n');
+                //
+                if (i < li_n && !li_endOfLine) {
+                    lc_a1_line[lsz_line++] = lc_a1_buffer[i];
+                    li_endOfLine = (lsz_line == BUFFER_SIZE);
+                }
+                if (li_endOfLine && pi_binary) {
+                    // the note is encoded straight behind its frame header, the line as its only blob
+                    struct ipc_frameHeader lO_header;
+                    struct iovec           lO_text = { lc_a1_line, lsz_line };
+                    //
+                    lO_header.mus_type = IPC_FRAME_MESSAGE;
+                    lO_header.mui_requestID = ++lui_requestID;
+                    lO_header.mul_length = fsz_messageEncode(lc_a1_batch + lsz_batch + IPC_FRAME_HEADER_SIZE,
+                                                             PIPELINE_BATCH_SIZE - lsz_batch - IPC_FRAME_HEADER_SIZE,
+                                                             IPC_MESSAGE_NOTE, 0,
+                                                             lui_requestID, ful_metricsNow(),
+                                                             &lO_text, 1);
+                    fv_frameHeaderEncode(&lO_header, (unsigned char *) lc_a1_batch + lsz_batch);
+                    lsz_batch += IPC_FRAME_HEADER_SIZE + lO_header.mul_length;
+                    lsz_line = 0;
+                } else if (li_endOfLine) {
+                    lsz_batch += fsz_frameEncode(lc_a1_batch + lsz_batch,
+                                                 PIPELINE_BATCH_SIZE - lsz_batch,
+                                                 IPC_FRAME_REQUEST,
+                                                 ++lui_requestID,
+                                                 lc_a1_line,
+                                                 lsz_line);
+                    lsz_line = 0;
+                }
+            }
+        }
+        //
+        if ((lO_a1_poll[1].revents & POLLOUT) && lsz_batch > 0) {
+            // everything queued so far leaves in one send()
+            ssize_t li_n = send(pi_socket_fd, lc_a1_batch, lsz_batch, MSG_NOSIGNAL | MSG_DONTWAIT);
+            //
+            if (li_n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+            }
+            if (li_n > 0) {
+                lsz_batchSent = li_n;
+            }
+        }
+        //
+        if (lO_a1_poll[1].revents & (POLLIN | POLLHUP | POLLERR)) {
+            ssize_t li_n = read(pi_socket_fd, lc_a1_buffer, BUFFER_SIZE);
+            //
+            if (li_n <= 0) {
+                fv_logErrorEXIT("ERROR reading from socket", pi_socket_fd);
+            }
+            if (fi_frameParserFeed(&lO_parser, lc_a1_buffer, li_n) != 0) {
+                fv_logErrorEXIT("ERROR parsing reply", pi_socket_fd);
+            }
+        }
+    }
+    //
+    printf("%u request(s) sent, %lu acknowledged\n", lui_requestID, lO_reply.mul_acknowledged);
+}
+
+// replies of the asynchronous mode counted so far, shared with the client library's thread
+struct ipc_asyncProgress {
+    pthread_mutex_t mO_lock;
+    pthread_cond_t  mO_changed;
+    unsigned long   mul_completed,
+                    mul_failed;
+};
+
+// called on the library's event loop thread, in whatever order the replies come back
+static void fv_onAsyncReply(void *pptrv_progress, const struct ipc_clientReply *pptrO_reply) {
+    struct ipc_asyncProgress *lptrO_progress = pptrv_progress;
+    //
+    if (pptrO_reply->mi_error != 0) {
+        fprintf(stderr, "ERROR request failed: %s\n", strerror(pptrO_reply->mi_error));
+    } else {
+        printf("[SERVER #%u]: %s\n", pptrO_reply->mui_requestID, pptrO_reply->mptrc_payload);
+    }
+    pthread_mutex_lock(&lptrO_progress->mO_lock);
+    //
+    ++lptrO_progress->mul_completed;
+    lptrO_progress->mul_failed += pptrO_reply->mi_error != 0;
+    pthread_cond_signal(&lptrO_progress->mO_changed);
+    //
+    pthread_mutex_unlock(&lptrO_progress->mO_lock);
+}
+
+/*
+ * Asynchronous mode: every line of standard input is a request of its own,
+ * handed to the client library, which spreads the requests over a pool of
+ * pi_connections persistent connections, opened as they are needed
+ * This thread never connects nor reads a socket: it only queues requests, then waits
+ * Returns the exit status: failure if any request failed
+ */
+int fi_asyncRequests(const struct sockaddr *pptrO_address, socklen_t pui_addressSize, int pi_connections) {
+    //
+    struct ipc_client *lptrO_client = fptrO_clientCreate(pptrO_address, pui_addressSize, pi_connections);
+    //
+    if (lptrO_client == NULL) {
+        fv_logErrorEXIT("ERROR creating client", -1);
+    }
+    struct ipc_asyncProgress lO_progress;
+    memset(&lO_progress, 0, sizeof(lO_progress));
+    pthread_mutex_init(&lO_progress.mO_lock, NULL);
+    pthread_cond_init(&lO_progress.mO_changed, NULL);
+    //
+    char          lc_a1_line[BUFFER_SIZE];
+    unsigned long lul_submitted = 0;
+    //
+    while (fgets(lc_a1_line, sizeof(lc_a1_line), stdin) != NULL) {
+        size_t lsz_line = strcspn(lc_a1_line, "\n");
+        //
+        if (fi_clientSubmit(lptrO_client, IPC_FRAME_REQUEST, lc_a1_line, lsz_line,
+                            fv_onAsyncReply, &lO_progress) < 0) {
+            fv_logErrorEXIT("ERROR submitting request", -1);
+        }
+        ++lul_submitted;
+    }
+    //
+    pthread_mutex_lock(&lO_progress.mO_lock);
+    //
+    while (lO_progress.mul_completed < lul_submitted) {
+        pthread_cond_wait(&lO_progress.mO_changed, &lO_progress.mO_lock);
+    }
+    pthread_mutex_unlock(&lO_progress.mO_lock);
+    //
+    fv_clientDestroy(lptrO_client);
+    //
+    printf("%lu request(s) sent over up to %d connection(s), %lu acknowledged\n",
+           lul_submitted, pi_connections, lul_submitted - lO_progress.mul_failed);
+    //
+    return lO_progress.mul_failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// bulk reply being received, filled by the parser's handlers
+struct ipc_fetch {
+    int                mi_output_fd;
+    uint16_t           mus_type;
+    unsigned long long mul_received;
+    char               mc_a1_error[BUFFER_SIZE];
+    size_t             msz_error;
+    int                mi_complete;
+};
+
+static char gc_a1_receive[RECEIVE_BUFFER_SIZE];
+
+static int fi_onFetchHeader(void *pptrv_fetch, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_fetch *lptrO_fetch = pptrv_fetch;
+    //
+    if (pptrO_header->mus_type != IPC_FRAME_DATA && pptrO_header->mus_type != IPC_FRAME_ERROR) {
+        errno = EPROTO;
+        return -1;
     }
+    lptrO_fetch->mus_type = pptrO_header->mus_type;
+    //
+    return 0;
+}
+
+static int fi_onFetchPayload(void                         *pptrv_fetch,
+                             const struct ipc_frameHeader *pptrO_header,
+                             const char                   *pptrc_chunk,
+                             size_t                        psz_chunk) {
+    struct ipc_fetch *lptrO_fetch = pptrv_fetch;
+    //
+    (void) pptrO_header;
+    //
+    if (lptrO_fetch->mus_type == IPC_FRAME_ERROR) {
+        size_t lsz_room = BUFFER_SIZE - 1 - lptrO_fetch->msz_error;
+        //
+        if (psz_chunk > lsz_room) {
+            psz_chunk = lsz_room;
+        }
+        memcpy(lptrO_fetch->mc_a1_error + lptrO_fetch->msz_error, pptrc_chunk, psz_chunk);
+        lptrO_fetch->msz_error += psz_chunk;
+        //
+        return 0;
+    }
+    //
+    lptrO_fetch->mul_received += psz_chunk;
+    //
+    // straight from the receive buffer to the output file, if there is one
+    while (lptrO_fetch->mi_output_fd >= 0 && psz_chunk > 0) {
+        ssize_t li_n = write(lptrO_fetch->mi_output_fd, pptrc_chunk, psz_chunk);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        pptrc_chunk += li_n;
+        psz_chunk -= li_n;
+    }
+    //
+    return 0;
+}
+
+static int fi_onFetchEnd(void *pptrv_fetch, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_fetch *lptrO_fetch = pptrv_fetch;
+    //
+    (void) pptrO_header;
+    //
+    lptrO_fetch->mc_a1_error[lptrO_fetch->msz_error] = '\0';
+    lptrO_fetch->mi_complete = 1;
+    //
+    return 0;
+}
+
+static const struct ipc_frameHandler gO_fetchHandler = {
+    fi_onFetchHeader,
+    fi_onFetchPayload,
+    fi_onFetchEnd
+};
+
+/*
+ * Fetch mode: ask for bulk data by name ("@<bytes>" of server memory, or a file
+ * under the server's -b directory) and stream the reply to cptrc_outputPath,
+ * or just count it if there is no output file
+ */
+void fv_fetch(int pi_socket_fd, const char *cptrc_name, const char *cptrc_outputPath) {
+    //
+    struct ipc_fetch       lO_fetch;
+    struct ipc_frameParser lO_parser;
+    struct timespec        lO_start,
+                           lO_end;
+    //
+    memset(&lO_fetch, 0, sizeof(lO_fetch));
+    lO_fetch.mi_output_fd = -1;
+    //
+    if (cptrc_outputPath != NULL &&
+        (lO_fetch.mi_output_fd = open(cptrc_outputPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) < 0) {
+        fv_logErrorEXIT("ERROR opening output", pi_socket_fd);
+    }
+    fv_frameParserInit(&lO_parser, &gO_fetchHandler, &lO_fetch);
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_start);
+    //
+    if (fi_frameSend(pi_socket_fd, IPC_FRAME_FETCH, 1, cptrc_name, strlen(cptrc_name)) < 0) {
+        fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+    }
+    //
+    while (!lO_fetch.mi_complete) {
+        ssize_t li_n = read(pi_socket_fd, gc_a1_receive, RECEIVE_BUFFER_SIZE);
+        //
+        if (li_n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (li_n <= 0) {
+            fv_logErrorEXIT("ERROR reading from socket", pi_socket_fd);
+        }
+        if (fi_frameParserFeed(&lO_parser, gc_a1_receive, li_n) != 0) {
+            fv_logErrorEXIT("ERROR receiving data", pi_socket_fd);
+        }
+    }
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_end);
+    //
+    if (lO_fetch.mi_output_fd >= 0) {
+        close(lO_fetch.mi_output_fd);
+    }
+    if (lO_fetch.mus_type == IPC_FRAME_ERROR) {
+        fprintf(stderr, "[SERVER #1]: %s\n", lO_fetch.mc_a1_error);
+        close(pi_socket_fd);
+        exit(EXIT_FAILURE);
+    }
+    //
+    double ld_seconds = (lO_end.tv_sec - lO_start.tv_sec) + (lO_end.tv_nsec - lO_start.tv_nsec) / 1e9;
+    //
+    printf("[SERVER #1]: %llu bytes received in %.3f s (%.1f MiB/s)\n",
+           lO_fetch.mul_received, ld_seconds,
+           ld_seconds > 0 ? lO_fetch.mul_received / ld_seconds / (1024 * 1024) : 0.0);
+}
+
+// an event or reply of the broker, filled by the parser's handlers
+struct ipc_event {
+    char   mc_a1_payload[IPC_BROKER_PAYLOAD_MAX + 1];
+    size_t msz_payload;
+};
+
+static int fi_onEventPayload(void                         *pptrv_event,
+                             const struct ipc_frameHeader *pptrO_header,
+                             const char                   *pptrc_chunk,
+                             size_t                        psz_chunk) {
+    struct ipc_event *lptrO_event = pptrv_event;
+    size_t            lsz_room = IPC_BROKER_PAYLOAD_MAX - lptrO_event->msz_payload;
+    //
+    (void) pptrO_header;
+    //
+    if (psz_chunk > lsz_room) {
+        psz_chunk = lsz_room;
+    }
+    memcpy(lptrO_event->mc_a1_payload + lptrO_event->msz_payload, pptrc_chunk, psz_chunk);
+    lptrO_event->msz_payload += psz_chunk;
+    //
+    return 0;
+}
+
+static int fi_onEventEnd(void *pptrv_event, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_event *lptrO_event = pptrv_event;
+    char             *lptrc_payload = lptrO_event->mc_a1_payload;
+    //
+    lptrc_payload[lptrO_event->msz_payload] = '\0';
+    lptrO_event->msz_payload = 0;
+    //
+    if (pptrO_header->mus_type == IPC_FRAME_EVENT) {
+        // topic, NUL byte, message: the topic reads as a string of its own
+        size_t lsz_topic = strlen(lptrc_payload);
+        //
+        printf("[%s]: %s\n", lptrc_payload, lsz_topic < pptrO_header->mul_length ? lptrc_payload + lsz_topic + 1 : "");
+    } else {
+        fprintf(pptrO_header->mus_type == IPC_FRAME_ERROR ? stderr : stdout,
+                "[SERVER #%u]: %s\n", pptrO_header->mui_requestID, lptrc_payload);
+    }
+    fflush(stdout);
+    //
+    return 0;
+}
 
+static const struct ipc_frameHandler gO_eventHandler = {
+    NULL,
+    fi_onEventPayload,
+    fi_onEventEnd
+};
 
-    /* [1]
-     * create a socket: one endpoint for communication
-     * communication domain: specifies implementation-dependent address family,
-     *  AF_INET: IPv4 protocol
-     * socket type: decides semantics of communication over the socket,
-     *  SOCK_STREAM: provides TCP - sequenced, reliable, bidirectional, connection-mode byte streams, and may provide a transmission mechanism for out-of-band data
-     * protocol 0: use a default protocol appropriate for the requested socket type
-     *  appears on protocol field in the IP header of a packet.
-     * returns non-negative socket file descriptor
-     */
-    printf("\n1. Client creating a socket endpoint for communication using default TCP/IPv4 protocol: ");
+static struct ipc_event gO_event;
+
+/*
+ * Subscribe mode: subscribe to every topic of the comma-separated list,
+ * then print the messages published to them until the server closes the connection
+ */
+void fv_subscribe(int pi_socket_fd, const char *cptrc_topics) {
+    //
+    struct ipc_frameParser lO_parser;
+    uint32_t               lui_requestID = 0;
+    //
+    fv_frameParserInit(&lO_parser, &gO_eventHandler, &gO_event);
+    //
+    // all requests at once: their acknowledgements come back among the first events
+    for (const char *lptrc_topic = cptrc_topics; *lptrc_topic != '\0';) {
+        size_t lsz_topic = strcspn(lptrc_topic, ",");
+        //
+        if (fi_frameSend(pi_socket_fd, IPC_FRAME_SUBSCRIBE, ++lui_requestID, lptrc_topic, lsz_topic) < 0) {
+            fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+        }
+        lptrc_topic += lsz_topic + (lptrc_topic[lsz_topic] == ',');
+    }
+    //
+    while (1) {
+        ssize_t li_n = read(pi_socket_fd, gc_a1_receive, RECEIVE_BUFFER_SIZE);
+        //
+        if (li_n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (li_n < 0) {
+            fv_logErrorEXIT("ERROR reading from socket", pi_socket_fd);
+        }
+        if (li_n == 0) {
+            printf("Server closed the connection\n");
+            return;
+        }
+        if (fi_frameParserFeed(&lO_parser, gc_a1_receive, li_n) != 0) {
+            fv_logErrorEXIT("ERROR receiving events", pi_socket_fd);
+        }
+    }
+}
+
+/*
+ * Publish mode: every line of standard input is a message published to the topic,
+ * each acknowledged with the number of subscribers it reached before the next is sent
+ */
+void fv_publish(int pi_socket_fd, const char *cptrc_topic) {
+    //
+    char         lc_a1_line[BUFFER_SIZE];
+    struct iovec lO_a1_parts[2];
+    uint32_t     lui_requestID = 0;
+    //
+    // the topic with its NUL byte, then the line: gathered into one frame, never copied together
+    lO_a1_parts[0].iov_base = (void *) cptrc_topic;
+    lO_a1_parts[0].iov_len = strlen(cptrc_topic) + 1;
+    //
+    while (fgets(lc_a1_line, BUFFER_SIZE, stdin) != NULL) {
+        lO_a1_parts[1].iov_base = lc_a1_line;
+        lO_a1_parts[1].iov_len = strcspn(lc_a1_line, "\n");
+        //
+        if (fi_frameSendv(pi_socket_fd, IPC_FRAME_PUBLISH, ++lui_requestID, lO_a1_parts, 2) < 0) {
+            fv_logErrorEXIT("ERROR writing to socket", pi_socket_fd);
+        }
+        fv_receiveFramed(pi_socket_fd);
+    }
+}
+
+/*
+ * Shared-memory mode: same message and acknowledgement,
+ * exchanged through the region of a server started with -m shm
+ */
+int fi_shmExchange(const char *cptrc_port) {
+    //
+    printf("\n1. Client attaching to the shared-memory endpoint of port %s: ", cptrc_port);
+    //
+    struct ipc_shmClient *lptrO_client = fptrO_shmConnect(cptrc_port);
+    //
+    if (lptrO_client == NULL) {
+        fv_logErrorEXIT("shm connect", -1);
+    }
+    //
+    printf("ATTACHED!");
+
+
+    printf("\nPlease enter the message: ");
+    //
+    char lc_a1_buffer[BUFFER_SIZE];
+    bzero(lc_a1_buffer, BUFFER_SIZE);
+    if (fgets(lc_a1_buffer, BUFFER_SIZE - 1, stdin) == NULL) {
+        lc_a1_buffer[0] = '\0';
+    }
+    //
+    if (fl_shmRequest(lptrO_client, lc_a1_buffer, strlen(lc_a1_buffer)) < 0) {
+        fv_logErrorEXIT("ERROR writing to shared memory", -1);
+    }
+    //
+    printf("Hello message sent\n");
+
+
+    uint32_t lui_requestID;
+    //
+    if (fl_shmReceive(lptrO_client, lc_a1_buffer, BUFFER_SIZE, &lui_requestID) < 0) {
+        fv_logErrorEXIT("ERROR reading from shared memory", -1);
+    }
+    //
+    printf("[SERVER]: %s\n", lc_a1_buffer);
+
+
+    fv_shmDisconnect(lptrO_client);
+
+    return 0;
+}
+
+/*
+ * UDP batch mode: send the message pul_count times as datagrams to a server started with -m udp,
+ * dozens per sendmmsg(), and count the acknowledgements received with recvmmsg()
+ * With pi_segmentation, each send carries up to IPC_UDP_SEGMENTS_MAX datagrams in one
+ * buffer that the kernel cuts up (GSO), and acknowledgements arrive coalesced (GRO)
+ */
+int fi_udpBatch(const char *cptrc_host, const char *cptrc_port, unsigned long pul_count, int pi_segmentation) {
+    //
+    printf("\n1. Client creating a datagram socket endpoint using UDP/IPv4 protocol: ");
+    //
+    int li_socket_fd = socket(AF_INET, SOCK_DGRAM, 0);
     //
-    int li_socket_fd = socket(AF_INET,      // internet address domain
-                              SOCK_STREAM,  // stream socket type
-                              0);           // default TCP protocol
     if (li_socket_fd < 0) {
         fv_logErrorEXIT("ERROR creating socket", li_socket_fd);
     }
     //
     printf("DONE!");
 
-    /*
-     * bind the client socket to the port number,
-     * specified in addr (custom data structure)
-     * Forcefully attaching socket to the port 8080 of the localhost
-     */
-    printf("\n2. Client binding its socket to port #PORT %s at address ", argv[2]);
+
+    printf("\n2. Client setting the Server at %s:%s as the default destination: ", cptrc_host, cptrc_port);
     //
-    // store server's address, to which to connect to
     struct sockaddr_in lO_addressServer;
     //
-    memset(&lO_addressServer,
-           '0',
-           sizeof(lO_addressServer));
-    /*
-     bzero((char *) &lO_addressServer,
-           sizeof(lO_addressServer));
-     */
-    //
+    bzero((char *) &lO_addressServer, sizeof(lO_addressServer));
     lO_addressServer.sin_family = AF_INET;
-    /*
-     * host-to-network short
-     * store numbers in memory in network byte order (big-endian machine)
-     * i.e., with the most significant byte, first
-     * for proper usage of transmitted packets by network protocols
-     */
-    lO_addressServer.sin_port = htons(atoi(argv[2]));
+    lO_addressServer.sin_port = htons(atoi(cptrc_port));
     //
-    /*
-    struct hostent *lptrO_server = gethostbyname(argv[1]);
-    if (lptrO_server == NULL) {
-        fv_logErrorEXIT("ERROR no such host\n", li_socket_fd);
+    if (inet_pton(AF_INET, cptrc_host, &lO_addressServer.sin_addr) <= 0) {
+        fv_logErrorEXIT("\nInvalid address/ Address not supported \n", li_socket_fd);
+    }
+    // no handshake: connect() only fixes the peer, and filters out datagrams from anyone else
+    if (connect(li_socket_fd, (struct sockaddr *) &lO_addressServer, sizeof(lO_addressServer)) < 0) {
+        fv_logErrorEXIT("connect", li_socket_fd);
     }
     //
-    bcopy((char *)lptrO_server->h_addr,
-          (char *)&lO_addressServer.sin_addr.s_addr,
-          lptrO_server->h_length);
-    */
-    // Convert IPv4 and IPv6 addresses from text to binary form
-    if (inet_pton(AF_INET,
-                  argv[1],
-                  &lO_addressServer.sin_addr) <= 0) {
-        fv_logErrorEXIT("\nInvalid address/ Address not supported \n", li_socket_fd);
+    struct timeval lO_timeout = { UDP_TIMEOUT_SECONDS, 0 };
+    //
+    if (setsockopt(li_socket_fd, SOL_SOCKET, SO_RCVTIMEO, &lO_timeout, sizeof(lO_timeout)) < 0 ||
+        (pi_segmentation && fi_udpEnableGRO(li_socket_fd) < 0)) {
+        fv_logErrorEXIT("setsockopt", li_socket_fd);
+    }
+    //
+    printf("DONE!");
+
+
+    printf("\nPlease enter the message: ");
+    //
+    char lc_a1_buffer[BUFFER_SIZE];
+    bzero(lc_a1_buffer, BUFFER_SIZE);
+    if (fgets(lc_a1_buffer, BUFFER_SIZE - 1, stdin) == NULL || lc_a1_buffer[0] == '\0') {
+        strcpy(lc_a1_buffer, "\n");
+    }
+    size_t lsz_message = strlen(lc_a1_buffer);
+    //
+    // the message, back to back, as many times as one GSO send may carry it
+    char *lptrc_messages = malloc(IPC_UDP_SEGMENTS_MAX * lsz_message);
+    // acknowledgements land here: one buffer per datagram, or per GRO run of them
+    size_t lsz_slot = pi_segmentation ? 64 * 1024 : BUFFER_SIZE;
+    char  *lptrc_slots = malloc(IPC_UDP_BATCH * lsz_slot);
+    //
+    if (lptrc_messages == NULL || lptrc_slots == NULL) {
+        fv_logErrorEXIT("malloc", li_socket_fd);
+    }
+    for (int i = 0; i < IPC_UDP_SEGMENTS_MAX; ++i) {
+        memcpy(lptrc_messages + i * lsz_message, lc_a1_buffer, lsz_message);
+    }
+    //
+    struct mmsghdr lO_a1_out[IPC_UDP_BATCH],
+                   lO_a1_in[IPC_UDP_BATCH];
+    struct iovec   lO_a1_outParts[IPC_UDP_BATCH],
+                   lO_a1_inParts[IPC_UDP_BATCH];
+    char           lc_a2_outControl[IPC_UDP_BATCH][IPC_UDP_CONTROL_SIZE],
+                   lc_a2_inControl[IPC_UDP_BATCH][IPC_UDP_CONTROL_SIZE];
+    //
+    memset(lO_a1_in, 0, sizeof(lO_a1_in));
+    for (int i = 0; i < IPC_UDP_BATCH; ++i) {
+        lO_a1_inParts[i].iov_base = lptrc_slots + i * lsz_slot;
+        lO_a1_inParts[i].iov_len = lsz_slot;
+        lO_a1_in[i].msg_hdr.msg_iov = &lO_a1_inParts[i];
+        lO_a1_in[i].msg_hdr.msg_iovlen = 1;
+        lO_a1_in[i].msg_hdr.msg_control = lc_a2_inControl[i];
     }
     //
-    printf("%u  %X: DONE!", lO_addressServer.sin_addr.s_addr, lO_addressServer.sin_addr.s_addr);
+    unsigned long   lul_sent = 0,
+                    lul_acknowledged = 0,
+                    lul_lost = 0;
+    struct timespec lO_start,
+                    lO_end;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_start);
+    //
+    while (lul_acknowledged + lul_lost < pul_count) {
+        //
+        // fill the window: one datagram per message, or up to IPC_UDP_SEGMENTS_MAX with GSO
+        unsigned long lul_budget = pul_count - lul_sent;
+        unsigned long lul_room = UDP_WINDOW - (lul_sent - lul_acknowledged - lul_lost);
+        unsigned      lui_messages = 0,
+                      lui_a1_datagrams[IPC_UDP_BATCH];
+        //
+        if (lul_budget > lul_room) {
+            lul_budget = lul_room;
+        }
+        while (lul_budget > 0 && lui_messages < IPC_UDP_BATCH) {
+            unsigned lui_take = pi_segmentation ? (lul_budget < IPC_UDP_SEGMENTS_MAX ? lul_budget : IPC_UDP_SEGMENTS_MAX) : 1;
+            //
+            memset(&lO_a1_out[lui_messages], 0, sizeof(lO_a1_out[lui_messages]));
+            lO_a1_outParts[lui_messages].iov_base = lptrc_messages;
+            lO_a1_outParts[lui_messages].iov_len = lui_take * lsz_message;
+            lO_a1_out[lui_messages].msg_hdr.msg_iov = &lO_a1_outParts[lui_messages];
+            lO_a1_out[lui_messages].msg_hdr.msg_iovlen = 1;
+            //
+            if (lui_take > 1) {
+                fv_udpSetSegment(&lO_a1_out[lui_messages].msg_hdr, lc_a2_outControl[lui_messages], (uint16_t) lsz_message);
+            }
+            lui_a1_datagrams[lui_messages] = lui_take;
+            lul_budget -= lui_take;
+            ++lui_messages;
+        }
+        //
+        for (unsigned lui_done = 0; lui_done < lui_messages; ) {
+            int li_n = sendmmsg(li_socket_fd, lO_a1_out + lui_done, lui_messages - lui_done, 0);
+            //
+            if (li_n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fv_logErrorEXIT("ERROR writing to socket", li_socket_fd);
+            }
+            for (int i = 0; i < li_n; ++i) {
+                lul_sent += lui_a1_datagrams[lui_done + i];
+            }
+            lui_done += li_n;
+        }
+        //
+        // collect what has arrived; wait only when the window is full or everything was sent
+        int li_wait = lul_sent - lul_acknowledged - lul_lost >= UDP_WINDOW || lul_sent == pul_count;
+        //
+        for (int i = 0; i < IPC_UDP_BATCH; ++i) {
+            lO_a1_in[i].msg_hdr.msg_controllen = IPC_UDP_CONTROL_SIZE;
+        }
+        int li_received = recvmmsg(li_socket_fd, lO_a1_in, IPC_UDP_BATCH,
+                                   li_wait ? MSG_WAITFORONE : MSG_DONTWAIT, NULL);
+        //
+        if (li_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fv_logErrorEXIT("ERROR reading from socket", li_socket_fd);
+            }
+            // timed out waiting: whatever is still unacknowledged is not coming
+            if (li_wait) {
+                lul_lost = lul_sent - lul_acknowledged;
+            }
+            continue;
+        }
+        for (int i = 0; i < li_received; ++i) {
+            lul_acknowledged += fui_udpSegments(&lO_a1_in[i].msg_hdr, lO_a1_in[i].msg_len);
+        }
+    }
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_end);
+    //
+    double ld_seconds = (lO_end.tv_sec - lO_start.tv_sec) + (lO_end.tv_nsec - lO_start.tv_nsec) / 1e9;
+    //
+    printf("%lu datagram(s) sent, %lu acknowledged, %lu lost in %.3f s (%.0f datagrams/s)\n",
+           lul_sent, lul_acknowledged, lul_lost, ld_seconds,
+           ld_seconds > 0 ? lul_acknowledged / ld_seconds : 0.0);
+    //
+    free(lptrc_messages);
+    free(lptrc_slots);
+    close(li_socket_fd);
+    //
+    return lul_lost == 0 ? 0 : EXIT_FAILURE;
+}
+
+/*
+ * Connect to a server listening on a Unix domain socket (server started with -u)
+ * Local traffic skips TCP/IP processing: no checksums, no routing
+ */
+int fi_connectLocal(const char *cptrc_path, int pi_type) {
+    //
+    printf("\n1. Client creating a socket endpoint for local communication using Unix domain %s protocol: ",
+           pi_type == SOCK_SEQPACKET ? "SEQPACKET" : "STREAM");
+    //
+    int li_socket_fd = socket(AF_UNIX, pi_type, 0);
+    //
+    if (li_socket_fd < 0) {
+        fv_logErrorEXIT("ERROR creating socket", li_socket_fd);
+    }
+    //
+    printf("DONE!");
 
 
-    printf("\n3. Client sending connection request to the Server: ");
+    printf("\n2. Client sending connection request to the Server at %s: ", cptrc_path);
+    //
+    struct sockaddr_un lO_addressServer;
+    //
+    bzero((char *) &lO_addressServer, sizeof(lO_addressServer));
+    lO_addressServer.sun_family = AF_UNIX;
+    //
+    if (strlen(cptrc_path) >= sizeof(lO_addressServer.sun_path)) {
+        errno = ENAMETOOLONG;
+        fv_logErrorEXIT("connect", li_socket_fd);
+    }
+    strcpy(lO_addressServer.sun_path, cptrc_path);
     //
-    // send connection request to the server
     if (connect(li_socket_fd,
-                (struct sockaddr *)&lO_addressServer,
+                (struct sockaddr *) &lO_addressServer,
                 sizeof(lO_addressServer)) < 0) {
         fv_logErrorEXIT("connect", li_socket_fd);
     }
     //
     printf("ESTABLISHed!");
+    //
+    return li_socket_fd;
+}
+
+/*
+ * Send the message with pi_payload_fd attached (SCM_RIGHTS):
+ * the server receives its own descriptor of the same open file,
+ * so a large payload is shared instead of copied through the socket
+ */
+ssize_t fl_sendWithDescriptor(int pi_socket_fd, const char *cptrc_message, size_t psz_length, int pi_payload_fd) {
+    //
+    struct iovec  lO_data = { (void *) cptrc_message, psz_length };
+    union {
+        struct cmsghdr mO_align;
+        char           mc_a1_space[CMSG_SPACE(sizeof(int))];
+    }             lO_control;
+    struct msghdr lO_message;
+    //
+    bzero(&lO_message, sizeof(lO_message));
+    bzero(&lO_control, sizeof(lO_control));
+    lO_message.msg_iov = &lO_data;
+    lO_message.msg_iovlen = 1;
+    lO_message.msg_control = lO_control.mc_a1_space;
+    lO_message.msg_controllen = sizeof(lO_control.mc_a1_space);
+    //
+    struct cmsghdr *lptrO_header = CMSG_FIRSTHDR(&lO_message);
+    lptrO_header->cmsg_level = SOL_SOCKET;
+    lptrO_header->cmsg_type = SCM_RIGHTS;
+    lptrO_header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(lptrO_header), &pi_payload_fd, sizeof(int));
+    //
+    return sendmsg(pi_socket_fd, &lO_message, 0);
+}
+
+void fv_usage(const char *cptrc_program) {
+    fprintf(stderr,
+            "usage %s [-f | -p | -e | -a connections | -s | -g name [-o file] | -B count [-G] | -M |\n"
+            "          -S topic[,topic] | -P topic] hostname port\n"
+            "       %s [-f | -p | -e | -a connections | -g name [-o file] | -M | -S topic[,topic] | -P topic]\n"
+            "          -u path [-q] [-d file]\n"
+            "  -f  send standard input as one length-prefixed frame\n"
+            "  -p  keep the connection open and pipeline every input line as a framed request\n"
+            "  -e  same, every line as a compact binary message, answered with a binary receipt\n"
+            "  -a  send every input line as a framed request through the asynchronous client library,\n"
+            "      over a pool of up to this many persistent connections\n"
+            "  -s  same host only: talk to a server started with -m shm through shared memory\n"
+            "  -u  connect to the Unix domain socket at path (server started with -u)\n"
+            "  -q  use SOCK_SEQPACKET instead of SOCK_STREAM for -u (plain text messages only)\n"
+            "  -d  pass the open file to the server as a descriptor along with the message (with -u)\n"
+            "  -g  fetch bulk data: \"@<bytes>\" of server memory, or a file under the server's -b directory\n"
+            "  -o  write the fetched data to file (default: only count it)\n"
+            "  -B  send the message count times as UDP datagrams, in batches (server started with -m udp)\n"
+            "  -G  with -B: send datagrams segmented (UDP GSO) and receive acknowledgements coalesced (UDP GRO)\n"
+            "  -M  same host only: print the server's metrics as JSON, without connecting to it\n"
+            "  -S  subscribe to the topics and print every message published to them (server started with -m broker)\n"
+            "  -P  publish every input line to the topic (server started with -m broker)\n",
+            cptrc_program, cptrc_program);
+}
+
+int main(int argc, char *argv[]) {
+    //
+    // send the message as a length-prefixed frame instead of a text line
+    int li_framed = 0,
+    // or pipeline one framed request per line
+        li_pipelined = 0,
+    // or one binary message per line
+        li_binary = 0,
+    // or bypass the network stack through shared memory
+        li_sharedMemory = 0;
+    // local server, its socket type, and a file to share with it by descriptor
+    const char *lptrc_unixPath = NULL,
+               *lptrc_payloadPath = NULL;
+    int         li_unixType = SOCK_STREAM;
+    // bulk data to fetch, and where to store it
+    const char *lptrc_fetchName = NULL,
+               *lptrc_outputPath = NULL;
+    // datagrams to send in UDP batch mode, and whether to let the kernel segment them
+    unsigned long lul_datagrams = 0;
+    int           li_segmentation = 0;
+    // scrape the server's metrics instead of talking to it
+    int           li_metrics = 0;
+    // or hand every line to the client library, with a pool of this many connections
+    int           li_asyncConnections = 0;
+    // or subscribe to topics of a broker, or publish to one
+    const char   *lptrc_subscribeTopics = NULL,
+                 *lptrc_publishTopic = NULL;
+    //
+    int li_option;
+    //
+    while ((li_option = getopt(argc, argv, "fpesu:qd:g:o:B:GMa:S:P:")) != -1) {
+        switch (li_option) {
+            case 'f':
+                li_framed = 1;
+                break;
+            case 'p':
+                li_pipelined = 1;
+                break;
+            case 'e':
+                li_binary = 1;
+                break;
+            case 's':
+                li_sharedMemory = 1;
+                break;
+            case 'u':
+                lptrc_unixPath = optarg;
+                break;
+            case 'q':
+                li_unixType = SOCK_SEQPACKET;
+                break;
+            case 'd':
+                lptrc_payloadPath = optarg;
+                break;
+            case 'g':
+                lptrc_fetchName = optarg;
+                break;
+            case 'o':
+                lptrc_outputPath = optarg;
+                break;
+            case 'B':
+                lul_datagrams = strtoul(optarg, NULL, 10);
+                break;
+            case 'G':
+                li_segmentation = 1;
+                break;
+            case 'M':
+                li_metrics = 1;
+                break;
+            case 'a':
+                li_asyncConnections = atoi(optarg);
+                if (li_asyncConnections < 1 || li_asyncConnections > IPC_CLIENT_CONNECTIONS_MAX) {
+                    fv_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'S':
+                lptrc_subscribeTopics = optarg;
+                break;
+            case 'P':
+                lptrc_publishTopic = optarg;
+                break;
+            default:
+                fv_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    //
+    if ((argc - optind < 2 && lptrc_unixPath == NULL) ||
+        li_framed + li_pipelined + li_binary + li_sharedMemory + (lptrc_fetchName != NULL) + (lul_datagrams > 0) + li_metrics +
+            (li_asyncConnections > 0) + (lptrc_subscribeTopics != NULL) + (lptrc_publishTopic != NULL) > 1 ||
+        (li_metrics && lptrc_payloadPath != NULL) ||
+        (lul_datagrams > 0 && (lptrc_unixPath != NULL || lptrc_payloadPath != NULL)) ||
+        (li_segmentation && lul_datagrams == 0) ||
+        (lptrc_outputPath != NULL && lptrc_fetchName == NULL) ||
+        (lptrc_unixPath != NULL && li_sharedMemory) ||
+        // records longer than the server's read buffer would be cut: frames need a byte stream
+        (li_unixType == SOCK_SEQPACKET && (li_framed || li_pipelined || li_binary || lptrc_fetchName ||
+                                           li_asyncConnections || lptrc_subscribeTopics || lptrc_publishTopic)) ||
+        (lptrc_payloadPath != NULL && (lptrc_unixPath == NULL || li_framed || li_pipelined || li_binary ||
+                                       lptrc_fetchName || li_asyncConnections ||
+                                       lptrc_subscribeTopics || lptrc_publishTopic))) {
+        fv_usage(argv[0]);
+        //
+        return EXIT_FAILURE;
+    }
+    // hostname and port follow the options
+    const char *lptrc_host = argc - optind >= 2 ? argv[optind] : NULL,
+               *lptrc_port = argc - optind >= 2 ? argv[optind + 1] : lptrc_unixPath;
+    //
+    if (li_sharedMemory) {
+        return fi_shmExchange(lptrc_port);
+    }
+    if (li_metrics) {
+        // the server's counters are read in place, it never notices
+        const struct ipc_metricsRegion *lptrO_metrics = fptrO_metricsAttach(lptrc_port);
+        //
+        if (lptrO_metrics == NULL) {
+            perror("ERROR reading the server's metrics");
+            return EXIT_FAILURE;
+        }
+        fv_metricsPrint(lptrO_metrics, stdout);
+        //
+        return 0;
+    }
+    if (lul_datagrams > 0) {
+        return fi_udpBatch(lptrc_host, lptrc_port, lul_datagrams, li_segmentation);
+    }
+    if (li_asyncConnections > 0) {
+        // the library connects by itself: it only needs the server's address
+        struct sockaddr_storage lO_address;
+        socklen_t               lui_addressSize;
+        //
+        memset(&lO_address, 0, sizeof(lO_address));
+        //
+        if (lptrc_unixPath) {
+            struct sockaddr_un *lptrO_address = (struct sockaddr_un *) &lO_address;
+            //
+            if (strlen(lptrc_unixPath) >= sizeof(lptrO_address->sun_path)) {
+                errno = ENAMETOOLONG;
+                fv_logErrorEXIT("connect", -1);
+            }
+            lptrO_address->sun_family = AF_UNIX;
+            strcpy(lptrO_address->sun_path, lptrc_unixPath);
+            lui_addressSize = sizeof(*lptrO_address);
+        } else {
+            struct sockaddr_in *lptrO_address = (struct sockaddr_in *) &lO_address;
+            //
+            lptrO_address->sin_family = AF_INET;
+            lptrO_address->sin_port = htons(atoi(lptrc_port));
+            //
+            if (inet_pton(AF_INET, lptrc_host, &lptrO_address->sin_addr) <= 0) {
+                fv_logErrorEXIT("\nInvalid address/ Address not supported \n", -1);
+            }
+            lui_addressSize = sizeof(*lptrO_address);
+        }
+        return fi_asyncRequests((struct sockaddr *) &lO_address, lui_addressSize, li_asyncConnections);
+    }
+
+
+    int li_socket_fd;
+    //
+    if (lptrc_unixPath) {
+        li_socket_fd = fi_connectLocal(lptrc_unixPath, li_unixType);
+    } else {
+        /* [1]
+         * create a socket: one endpoint for communication
+         * communication domain: specifies implementation-dependent address family,
+         *  AF_INET: IPv4 protocol
+         * socket type: decides semantics of communication over the socket,
+         *  SOCK_STREAM: provides TCP - sequenced, reliable, bidirectional, connection-mode byte streams, and may provide a transmission mechanism for out-of-band data
+         * protocol 0: use a default protocol appropriate for the requested socket type
+         *  appears on protocol field in the IP header of a packet.
+         * returns non-negative socket file descriptor
+         */
+        printf("\n1. Client creating a socket endpoint for communication using default TCP/IPv4 protocol: ");
+        //
+        li_socket_fd = socket(AF_INET,      // internet address domain
+                                  SOCK_STREAM,  // stream socket type
+                                  0);           // default TCP protocol
+        if (li_socket_fd < 0) {
+            fv_logErrorEXIT("ERROR creating socket", li_socket_fd);
+        }
+        //
+        printf("DONE!");
+
+        /*
+         * bind the client socket to the port number,
+         * specified in addr (custom data structure)
+         * Forcefully attaching socket to the port 8080 of the localhost
+         */
+        printf("\n2. Client binding its socket to port #PORT %s at address ", lptrc_port);
+        //
+        // store server's address, to which to connect to
+        struct sockaddr_in lO_addressServer;
+        //
+        memset(&lO_addressServer,
+               '0',
+               sizeof(lO_addressServer));
+        /*
+         bzero((char *) &lO_addressServer,
+               sizeof(lO_addressServer));
+         */
+        //
+        lO_addressServer.sin_family = AF_INET;
+        /*
+         * host-to-network short
+         * store numbers in memory in network byte order (big-endian machine)
+         * i.e., with the most significant byte, first
+         * for proper usage of transmitted packets by network protocols
+         */
+        lO_addressServer.sin_port = htons(atoi(lptrc_port));
+        //
+        /*
+        struct hostent *lptrO_server = gethostbyname(argv[1]);
+        if (lptrO_server == NULL) {
+            fv_logErrorEXIT("ERROR no such host\n", li_socket_fd);
+        }
+        //
+        bcopy((char *)lptrO_server->h_addr,
+              (char *)&lO_addressServer.sin_addr.s_addr,
+              lptrO_server->h_length);
+        */
+        // Convert IPv4 and IPv6 addresses from text to binary form
+        if (inet_pton(AF_INET,
+                      lptrc_host,
+                      &lO_addressServer.sin_addr) <= 0) {
+            fv_logErrorEXIT("\nInvalid address/ Address not supported \n", li_socket_fd);
+        }
+        //
+        printf("%u  %X: DONE!", lO_addressServer.sin_addr.s_addr, lO_addressServer.sin_addr.s_addr);
+
+
+        printf("\n3. Client sending connection request to the Server: ");
+        //
+        // send connection request to the server
+        if (connect(li_socket_fd,
+                    (struct sockaddr *)&lO_addressServer,
+                    sizeof(lO_addressServer)) < 0) {
+            fv_logErrorEXIT("connect", li_socket_fd);
+        }
+        //
+        printf("ESTABLISHed!");
+    } // end of TCP/IPv4 connection setup
 
     // connection is established between client and server,
     // they are ready to transfer data
     // both sides can send and receive info
 
 
+    if (li_pipelined || li_binary) {
+        printf("\nPlease enter one message per line (end with Ctrl-D):\n");
+        fflush(stdout);
+        //
+        fv_pipeline(li_socket_fd, li_binary);
+        //
+        close(li_socket_fd);
+        //
+        return 0;
+    }
+
+
+    if (lptrc_fetchName) {
+        printf("\nFetching %s\n", lptrc_fetchName);
+        //
+        fv_fetch(li_socket_fd, lptrc_fetchName, lptrc_outputPath);
+        //
+        close(li_socket_fd);
+        //
+        return 0;
+    }
+
+
+    if (lptrc_subscribeTopics) {
+        printf("\nSubscribing to %s\n", lptrc_subscribeTopics);
+        fflush(stdout);
+        //
+        fv_subscribe(li_socket_fd, lptrc_subscribeTopics);
+        //
+        close(li_socket_fd);
+        //
+        return 0;
+    }
+
+
+    if (lptrc_publishTopic) {
+        printf("\nPlease enter one message per line for %s (end with Ctrl-D):\n", lptrc_publishTopic);
+        fflush(stdout);
+        //
+        fv_publish(li_socket_fd, lptrc_publishTopic);
+        //
+        close(li_socket_fd);
+        //
+        return 0;
+    }
+
+
+    if (li_framed) {
+        printf("\nPlease enter the message (end it with Ctrl-D): ");
+        fflush(stdout);
+        //
+        fv_sendFramed(li_socket_fd, 1);
+        //
+        printf("\nFramed message sent\n");
+        //
+        fv_receiveFramed(li_socket_fd);
+        //
+        close(li_socket_fd);
+        //
+        return 0;
+    }
+
+
     printf("\nPlease enter the message: ");
     //
     char lc_a1_buffer[BUFFER_SIZE];  // = {0};
     bzero(lc_a1_buffer, BUFFER_SIZE);
     fgets(lc_a1_buffer, BUFFER_SIZE - 1, stdin);
     // char *lptrc_hello = "Hello from client";
-    int li_charRead = send(li_socket_fd, lc_a1_buffer, strlen(lc_a1_buffer), 0);
+    int li_charRead;
+    //
+    if (lptrc_payloadPath) {
+        // the payload travels as a descriptor; the message itself must carry at least one byte
+        int li_payload_fd = open(lptrc_payloadPath, O_RDONLY | O_CLOEXEC);
+        //
+        if (li_payload_fd < 0) {
+            fv_logErrorEXIT("ERROR opening payload", li_socket_fd);
+        }
+        if (lc_a1_buffer[0] == '\0') {
+            strncpy(lc_a1_buffer, lptrc_payloadPath, BUFFER_SIZE - 1);
+        }
+        li_charRead = fl_sendWithDescriptor(li_socket_fd, lc_a1_buffer, strlen(lc_a1_buffer), li_payload_fd);
+        // the server holds its own reference now
+        close(li_payload_fd);
+    } else {
+        li_charRead = send(li_socket_fd, lc_a1_buffer, strlen(lc_a1_buffer), 0);
+    }
     /*
     int li_n = write(li_socket_fd,
                   lc_a1_buffer,
@@ -142,14 +1344,14 @@ int main(int argc, char const *argv[]) {
     printf("Hello message sent\n");
 
 
-    bzero(lc_a1_buffer, BUFFER_SIZE);
-    //
+    // the same buffer takes the reply: terminating it after the bytes read is enough
     li_charRead = read(li_socket_fd,
                        lc_a1_buffer,
                        BUFFER_SIZE - 1);
     if (li_charRead < 0) {
         fv_logErrorEXIT("ERROR reading from socket", li_socket_fd);
     }
+    lc_a1_buffer[li_charRead] = '\0';
     //
     printf("[SERVER]: %s\n", lc_a1_buffer);
 
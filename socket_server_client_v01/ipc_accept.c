@@ -0,0 +1,162 @@
+/*
+ * Accepting through connection storms
+ * References:
+ *  man 2 accept4
+ *  man 7 tcp (TCP_DEFER_ACCEPT, TCP_FASTOPEN)
+ *  https://lwn.net/Articles/508865/
+ */
+#define _GNU_SOURCE  // accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "ipc_common.h"
+#include "ipc_accept.h"
+#include "ipc_metrics.h"
+#include "ipc_handoff.h"
+
+// input of a rejected client read and thrown away before closing, at most
+#define ACCEPT_REJECT_DRAIN 4096
+
+// connections in service, in a shared page so that forked servers count together
+static atomic_int *gptrO_admitted;
+static int         gi_admissionLimit;
+
+int fi_listenerTune(int pi_socketConn_fd, int pi_deferSeconds, int pi_fastOpenQueue) {
+    //
+    if (pi_deferSeconds > 0 &&
+        setsockopt(pi_socketConn_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                   &pi_deferSeconds, sizeof(pi_deferSeconds)) < 0) {
+        return -1;
+    }
+    if (pi_fastOpenQueue > 0 &&
+        setsockopt(pi_socketConn_fd, IPPROTO_TCP, TCP_FASTOPEN,
+                   &pi_fastOpenQueue, sizeof(pi_fastOpenQueue)) < 0) {
+        return -1;
+    }
+    //
+    return 0;
+}
+
+int fi_listenerNonBlocking(int pi_socketConn_fd) {
+    int li_flags = fcntl(pi_socketConn_fd, F_GETFL, 0);
+    //
+    if (li_flags < 0 ||
+        fcntl(pi_socketConn_fd, F_SETFL, li_flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    //
+    return 0;
+}
+
+int fi_acceptBatch(int pi_socketConn_fd, int *pi_a1_fds, int pi_max, int pi_flags) {
+    //
+    int li_accepted = 0;
+    //
+    while (li_accepted < pi_max) {
+        // handed over to a successor: whatever is still queued is its to accept
+        if (fi_handoffStopped()) {
+            if (li_accepted > 0) {
+                break;
+            }
+            errno = ESHUTDOWN;
+            return -1;
+        }
+        int li_socketRW_fd = accept4(pi_socketConn_fd, NULL, NULL, pi_flags);
+        //
+        if (li_socketRW_fd >= 0) {
+            pi_a1_fds[li_accepted++] = li_socketRW_fd;
+            continue;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        // what is accepted already gets served first; a real error shows up again next time
+        if (li_accepted > 0) {
+            break;
+        }
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            return -1;
+        }
+        // the queue is empty: sleep until the next connection, or the handoff
+        // (poll() skips the second entry while there is no hot restart to wait for: fd -1)
+        struct pollfd lO_a1_poll[2] = {
+            { pi_socketConn_fd, POLLIN, 0 },
+            { fi_handoffStopFd(), POLLIN, 0 }
+        };
+        //
+        if (poll(lO_a1_poll, 2, -1) < 0 && errno != EINTR) {
+            return -1;
+        }
+    }
+    //
+    return li_accepted;
+}
+
+int fi_admissionInit(int pi_limit) {
+    //
+    if (pi_limit < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    gi_admissionLimit = pi_limit;
+    //
+    if (pi_limit == 0) {
+        return 0;
+    }
+    void *lptrv_page = mmap(NULL, sizeof(atomic_int), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    //
+    if (lptrv_page == MAP_FAILED) {
+        gi_admissionLimit = 0;
+        return -1;
+    }
+    gptrO_admitted = lptrv_page;
+    atomic_init(gptrO_admitted, 0);
+    //
+    return 0;
+}
+
+int fi_admissionEnter(void) {
+    //
+    if (gi_admissionLimit == 0) {
+        return 1;
+    }
+    // optimistic: take a place, and give it back if there was none
+    if (atomic_fetch_add_explicit(gptrO_admitted, 1, memory_order_relaxed) < gi_admissionLimit) {
+        return 1;
+    }
+    atomic_fetch_sub_explicit(gptrO_admitted, 1, memory_order_relaxed);
+    //
+    return 0;
+}
+
+void fv_admissionLeave(void) {
+    //
+    // NOTE: a forked server that crashes never leaves, its place stays taken
+    if (gi_admissionLimit != 0) {
+        atomic_fetch_sub_explicit(gptrO_admitted, 1, memory_order_relaxed);
+    }
+}
+
+void fv_admissionReject(int pi_socketRW_fd) {
+    //
+    fv_metricsReject();
+    //
+    if (send(pi_socketRW_fd, IPC_REJECT, sizeof(IPC_REJECT) - 1, MSG_DONTWAIT | MSG_NOSIGNAL) < 0) {
+        fv_metricsError(errno);
+    }
+    // closing with unread input would reset the connection, and the reply could be lost with it
+    char lc_a1_discard[ACCEPT_REJECT_DRAIN];
+    //
+    while (recv(pi_socketRW_fd, lc_a1_discard, sizeof(lc_a1_discard), MSG_DONTWAIT) > 0)
+        ;
+    close(pi_socketRW_fd);
+}
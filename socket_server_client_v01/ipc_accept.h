@@ -0,0 +1,62 @@
+/*
+ * Accepting through connection storms
+ * - a listening socket tuned for bursts: TCP_DEFER_ACCEPT, TCP_FASTOPEN
+ * - accept4() draining every pending connection per wakeup, instead of one per accept()
+ * - admission control: past a limit of connections in service, new ones get a short
+ *   reject reply right away (IPC_REJECT), so the server sheds load early and cheaply
+ *   instead of letting the backlog overflow and the clients' connects time out
+ */
+#ifndef IPC_ACCEPT_H
+#define IPC_ACCEPT_H
+
+// most connections taken per fi_acceptBatch()
+#define IPC_ACCEPT_BATCH 64
+
+/*
+ * Tune a TCP listening socket; a zero argument leaves its option alone
+ * pi_deferSeconds: TCP_DEFER_ACCEPT, wake the acceptor only once the client's
+ *  first data arrived (a connection that sends nothing within that time is accepted anyway)
+ * pi_fastOpenQueue: TCP_FASTOPEN, let clients send their message with the SYN;
+ *  the length of the queue of such connections not yet completed
+ *  (also needs the server bit of the net.ipv4.tcp_fastopen sysctl)
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_listenerTune(int pi_socketConn_fd, int pi_deferSeconds, int pi_fastOpenQueue);
+
+/*
+ * Make the listening socket non-blocking, as fi_acceptBatch() wants it
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_listenerNonBlocking(int pi_socketConn_fd);
+
+/*
+ * Wait until the non-blocking listening socket has pending connections,
+ * then accept all of them, at most pi_max, into pi_a1_fds
+ * pi_flags: accept4() flags of the new sockets, e.g. SOCK_CLOEXEC
+ * Returns how many were accepted (at least 1), or -1 (with errno set;
+ * ESHUTDOWN once the socket was handed to a successor, see ipc_handoff.h)
+ */
+int fi_acceptBatch(int pi_socketConn_fd, int *pi_a1_fds, int pi_max, int pi_flags);
+
+/*
+ * Admit at most pi_limit connections in service at once, 0 for no limit
+ * The count is shared with every process forked afterwards (fork and prefork modes)
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_admissionInit(int pi_limit);
+
+/*
+ * Returns 1 if one more connection may be served (call fv_admissionLeave() once it is closed),
+ * or 0 if it must be rejected
+ */
+int fi_admissionEnter(void);
+
+void fv_admissionLeave(void);
+
+/*
+ * Reply IPC_REJECT to a connection that was not admitted, and close it
+ * Never blocks: a client that cannot take the reply at once gets none
+ */
+void fv_admissionReject(int pi_socketRW_fd);
+
+#endif  // IPC_ACCEPT_H
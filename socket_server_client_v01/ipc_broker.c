@@ -0,0 +1,677 @@
+/*
+ * Publish/subscribe serving mode
+ * References:
+ *  man 7 epoll
+ *  man 2 sendmsg
+ */
+#define _GNU_SOURCE  // accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ipc_broker.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+#include "ipc_accept.h"
+
+// number of ready events collected by a single epoll_wait()
+#define BROKER_MAX_EVENTS    256
+// bytes taken from a socket per read()
+#define BROKER_READ_SIZE     (64 * 1024)
+// queue slots beyond the depth, for the broker's own replies: those are never dropped
+#define BROKER_CONTROL_SLACK 16
+// queued frames gathered by one sendmsg()
+#define BROKER_IOVECS        64
+// heads of the topic table's chains, a power of 2
+#define BROKER_BUCKETS       4096
+
+struct ipc_brokerConnection;
+
+// a subscriber of a topic, and which of its subscriptions that is
+struct ipc_brokerMember {
+    struct ipc_brokerConnection *mptrO_connection;
+    int                          mi_subscription;
+};
+
+struct ipc_brokerTopic {
+    struct ipc_brokerTopic  *mptrO_next;  // in its chain of the table
+    uint64_t                 mul_hash;
+    size_t                   msz_name;
+    char                     mc_a1_name[IPC_BROKER_TOPIC_MAX];
+    // unordered: a leaving member's place goes to the last one
+    struct ipc_brokerMember *mptrO_a1_members;
+    unsigned                 mui_members;
+    unsigned                 mui_capacity;
+};
+
+// a topic a connection subscribed to, and where it is among the topic's members
+struct ipc_brokerSubscription {
+    struct ipc_brokerTopic *mptrO_topic;
+    unsigned                mui_member;
+};
+
+struct ipc_brokerConnection {
+    int                           mi_socketRW_fd;
+    // closed, waiting for the end of the batch to be freed; on the list of queues to send
+    int                           mi_closing;
+    int                           mi_dirty;
+    struct ipc_brokerConnection  *mptrO_nextClosed;
+    struct ipc_brokerConnection  *mptrO_nextDirty;
+    struct ipc_frameParser        mO_parser;
+    // request being read: a message goes straight into its event buffer, a topic name here
+    struct ipc_buffer            *mptrO_event;
+    char                          mc_a1_topic[IPC_BROKER_TOPIC_MAX];
+    size_t                        msz_received;
+    int                           mi_tooLarge;
+    // frames to send, oldest first: references to buffers shared with other queues
+    // (allocated with the first frame: a connection that only publishes rarely needs it)
+    struct ipc_buffer           **mptrO_a1_queue;
+    unsigned                      mui_head;
+    unsigned                      mui_queued;
+    size_t                        msz_headSent;
+    unsigned long                 mul_dropped;
+    struct ipc_brokerSubscription mO_a1_subscriptions[IPC_BROKER_SUBSCRIPTIONS_MAX];
+    int                           mi_subscriptions;
+};
+
+// set once, before the loop starts
+static int                     gi_queueDepth;
+static enum ipc_brokerOverflow ge_overflow;
+// owned by the loop's thread
+static struct ipc_brokerTopic      *gptrO_a1_buckets[BROKER_BUCKETS];
+static struct ipc_brokerConnection *gptrO_dirty;
+static struct ipc_brokerConnection *gptrO_closed;
+static char                         gc_a1_read[BROKER_READ_SIZE];
+
+/********************* TOPICS *********************/
+
+// FNV-1a
+static uint64_t ful_topicHash(const char *cptrc_name, size_t psz_name) {
+    uint64_t lul_hash = 14695981039346656037ull;
+    //
+    for (size_t i = 0; i < psz_name; ++i) {
+        lul_hash = (lul_hash ^ (unsigned char) cptrc_name[i]) * 1099511628211ull;
+    }
+    return lul_hash;
+}
+
+// Returns the topic, or NULL if there is none by that name (and pi_create is 0, or memory ran out)
+static struct ipc_brokerTopic *fptrO_topicFind(const char *cptrc_name, size_t psz_name, int pi_create) {
+    //
+    uint64_t                 lul_hash = ful_topicHash(cptrc_name, psz_name);
+    struct ipc_brokerTopic **lptrO_bucket = &gptrO_a1_buckets[lul_hash & (BROKER_BUCKETS - 1)];
+    //
+    for (struct ipc_brokerTopic *lptrO_topic = *lptrO_bucket; lptrO_topic != NULL; lptrO_topic = lptrO_topic->mptrO_next) {
+        if (lptrO_topic->mul_hash == lul_hash && lptrO_topic->msz_name == psz_name &&
+            memcmp(lptrO_topic->mc_a1_name, cptrc_name, psz_name) == 0) {
+            return lptrO_topic;
+        }
+    }
+    if (!pi_create) {
+        return NULL;
+    }
+    struct ipc_brokerTopic *lptrO_topic = calloc(1, sizeof(*lptrO_topic));
+    //
+    if (lptrO_topic == NULL) {
+        return NULL;
+    }
+    lptrO_topic->mul_hash = lul_hash;
+    lptrO_topic->msz_name = psz_name;
+    memcpy(lptrO_topic->mc_a1_name, cptrc_name, psz_name);
+    lptrO_topic->mptrO_next = *lptrO_bucket;
+    *lptrO_bucket = lptrO_topic;
+    //
+    return lptrO_topic;
+}
+
+// the last member left: the topic goes too
+static void fv_topicFree(struct ipc_brokerTopic *pptrO_topic) {
+    struct ipc_brokerTopic **lptrO_link = &gptrO_a1_buckets[pptrO_topic->mul_hash & (BROKER_BUCKETS - 1)];
+    //
+    while (*lptrO_link != pptrO_topic) {
+        lptrO_link = &(*lptrO_link)->mptrO_next;
+    }
+    *lptrO_link = pptrO_topic->mptrO_next;
+    free(pptrO_topic->mptrO_a1_members);
+    free(pptrO_topic);
+}
+
+/*
+ * Returns 0 (also if already subscribed), or -1 (errno ENOSPC for a connection
+ * with IPC_BROKER_SUBSCRIPTIONS_MAX topics already, or ENOMEM)
+ */
+static int fi_subscribe(struct ipc_brokerConnection *pptrO_connection, const char *cptrc_name, size_t psz_name) {
+    //
+    struct ipc_brokerTopic *lptrO_topic = fptrO_topicFind(cptrc_name, psz_name, 0);
+    //
+    for (int i = 0; lptrO_topic != NULL && i < pptrO_connection->mi_subscriptions; ++i) {
+        if (pptrO_connection->mO_a1_subscriptions[i].mptrO_topic == lptrO_topic) {
+            return 0;
+        }
+    }
+    if (pptrO_connection->mi_subscriptions == IPC_BROKER_SUBSCRIPTIONS_MAX) {
+        errno = ENOSPC;
+        return -1;
+    }
+    if (lptrO_topic == NULL && (lptrO_topic = fptrO_topicFind(cptrc_name, psz_name, 1)) == NULL) {
+        errno = ENOMEM;
+        return -1;
+    }
+    if (lptrO_topic->mui_members == lptrO_topic->mui_capacity) {
+        unsigned                 lui_capacity = lptrO_topic->mui_capacity ? 2 * lptrO_topic->mui_capacity : 8;
+        struct ipc_brokerMember *lptrO_a1_members = realloc(lptrO_topic->mptrO_a1_members,
+                                                            lui_capacity * sizeof(*lptrO_a1_members));
+        //
+        if (lptrO_a1_members == NULL) {
+            if (lptrO_topic->mui_members == 0) {
+                fv_topicFree(lptrO_topic);
+            }
+            errno = ENOMEM;
+            return -1;
+        }
+        lptrO_topic->mptrO_a1_members = lptrO_a1_members;
+        lptrO_topic->mui_capacity = lui_capacity;
+    }
+    int li_subscription = pptrO_connection->mi_subscriptions++;
+    //
+    lptrO_topic->mptrO_a1_members[lptrO_topic->mui_members].mptrO_connection = pptrO_connection;
+    lptrO_topic->mptrO_a1_members[lptrO_topic->mui_members].mi_subscription = li_subscription;
+    pptrO_connection->mO_a1_subscriptions[li_subscription].mptrO_topic = lptrO_topic;
+    pptrO_connection->mO_a1_subscriptions[li_subscription].mui_member = lptrO_topic->mui_members++;
+    //
+    return 0;
+}
+
+// leave the connection's pi_subscription-th topic: the last member and the last subscription fill the gaps
+static void fv_unsubscribeAt(struct ipc_brokerConnection *pptrO_connection, int pi_subscription) {
+    //
+    struct ipc_brokerSubscription *lptrO_subscription = &pptrO_connection->mO_a1_subscriptions[pi_subscription];
+    struct ipc_brokerTopic        *lptrO_topic = lptrO_subscription->mptrO_topic;
+    unsigned                       lui_last = --lptrO_topic->mui_members;
+    //
+    if (lptrO_subscription->mui_member != lui_last) {
+        struct ipc_brokerMember *lptrO_moved = &lptrO_topic->mptrO_a1_members[lui_last];
+        //
+        lptrO_topic->mptrO_a1_members[lptrO_subscription->mui_member] = *lptrO_moved;
+        lptrO_moved->mptrO_connection->mO_a1_subscriptions[lptrO_moved->mi_subscription].mui_member =
+            lptrO_subscription->mui_member;
+    }
+    if (lptrO_topic->mui_members == 0) {
+        fv_topicFree(lptrO_topic);
+    }
+    //
+    int li_last = --pptrO_connection->mi_subscriptions;
+    //
+    if (pi_subscription != li_last) {
+        *lptrO_subscription = pptrO_connection->mO_a1_subscriptions[li_last];
+        lptrO_subscription->mptrO_topic->mptrO_a1_members[lptrO_subscription->mui_member].mi_subscription =
+            pi_subscription;
+    }
+}
+
+/********************* QUEUES *********************/
+
+// freed at the end of the batch: events of this batch may still name it
+static void fv_connectionClose(struct ipc_brokerConnection *pptrO_connection) {
+    //
+    if (!pptrO_connection->mi_closing) {
+        pptrO_connection->mi_closing = 1;
+        pptrO_connection->mptrO_nextClosed = gptrO_closed;
+        gptrO_closed = pptrO_connection;
+    }
+}
+
+/*
+ * Queue a reference to the frame in the buffer (the whole of its mui_length)
+ * pi_control: a reply of the broker's own, queued even past the depth
+ * Returns 1 if queued, 0 if not (dropped, or the connection closed)
+ */
+static int fi_connectionQueue(struct ipc_brokerConnection *pptrO_connection, struct ipc_buffer *pptrO_frame, int pi_control) {
+    //
+    unsigned lui_capacity = gi_queueDepth + BROKER_CONTROL_SLACK;
+    //
+    if (pptrO_connection->mi_closing) {
+        return 0;
+    }
+    if (pptrO_connection->mptrO_a1_queue == NULL &&
+        (pptrO_connection->mptrO_a1_queue = malloc(lui_capacity * sizeof(struct ipc_buffer *))) == NULL) {
+        IPC_LOGE("malloc: %m");
+        fv_connectionClose(pptrO_connection);
+        return 0;
+    }
+    if (pptrO_connection->mui_queued >= (pi_control ? lui_capacity : (unsigned) gi_queueDepth)) {
+        // not even reading the replies to its own requests: nothing else will help
+        if (pi_control || ge_overflow == IPC_BROKER_CLOSE) {
+            IPC_LOGW("Subscriber %d too slow, %u frames behind: disconnected",
+                     pptrO_connection->mi_socketRW_fd, pptrO_connection->mui_queued);
+            fv_metricsError(ENOBUFS);
+            fv_connectionClose(pptrO_connection);
+            return 0;
+        }
+        if (pptrO_connection->mul_dropped++ == 0) {
+            IPC_LOGW("Subscriber %d too slow, %u frames behind: dropping messages",
+                     pptrO_connection->mi_socketRW_fd, pptrO_connection->mui_queued);
+        }
+        return 0;
+    }
+    fv_bufferRetain(pptrO_frame);
+    pptrO_connection->mptrO_a1_queue[(pptrO_connection->mui_head + pptrO_connection->mui_queued++) % lui_capacity] =
+        pptrO_frame;
+    //
+    // sent once the batch of events is handled: everything queued meanwhile leaves together
+    if (!pptrO_connection->mi_dirty) {
+        pptrO_connection->mi_dirty = 1;
+        pptrO_connection->mptrO_nextDirty = gptrO_dirty;
+        gptrO_dirty = pptrO_connection;
+    }
+    return 1;
+}
+
+// send as much of the queue as the socket takes, each frame from wherever its buffer lies
+static void fv_connectionFlush(struct ipc_brokerConnection *pptrO_connection) {
+    //
+    unsigned lui_capacity = gi_queueDepth + BROKER_CONTROL_SLACK;
+    //
+    while (pptrO_connection->mui_queued > 0) {
+        struct iovec  lO_a1_parts[BROKER_IOVECS];
+        struct msghdr lO_message;
+        int           li_parts = 0;
+        //
+        for (; li_parts < BROKER_IOVECS && (unsigned) li_parts < pptrO_connection->mui_queued; ++li_parts) {
+            struct ipc_buffer *lptrO_frame =
+                pptrO_connection->mptrO_a1_queue[(pptrO_connection->mui_head + li_parts) % lui_capacity];
+            size_t             lsz_skip = li_parts == 0 ? pptrO_connection->msz_headSent : 0;
+            //
+            lO_a1_parts[li_parts].iov_base = lptrO_frame->mptrc_data + lsz_skip;
+            lO_a1_parts[li_parts].iov_len = lptrO_frame->mui_length - lsz_skip;
+        }
+        memset(&lO_message, 0, sizeof(lO_message));
+        lO_message.msg_iov = lO_a1_parts;
+        lO_message.msg_iovlen = li_parts;
+        //
+        // MSG_NOSIGNAL: a vanished subscriber must not kill the whole broker with SIGPIPE
+        ssize_t li_n = sendmsg(pptrO_connection->mi_socketRW_fd, &lO_message, MSG_NOSIGNAL);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                IPC_LOGE("ERROR writing to socket: %m");
+                fv_metricsError(errno);
+                fv_connectionClose(pptrO_connection);
+            }
+            // otherwise the socket buffer is full: the next EPOLLOUT edge brings the connection back
+            return;
+        }
+        // every frame sent whole drops its reference; the buffer goes back to the pool with the last one
+        size_t   lsz_sent = li_n;
+        unsigned lui_frames = 0;
+        //
+        while (li_n > 0) {
+            struct ipc_buffer *lptrO_frame = pptrO_connection->mptrO_a1_queue[pptrO_connection->mui_head];
+            size_t             lsz_left = lptrO_frame->mui_length - pptrO_connection->msz_headSent;
+            //
+            if ((size_t) li_n < lsz_left) {
+                pptrO_connection->msz_headSent += li_n;
+                break;
+            }
+            li_n -= lsz_left;
+            fv_bufferRelease(lptrO_frame);
+            pptrO_connection->mui_head = (pptrO_connection->mui_head + 1) % lui_capacity;
+            --pptrO_connection->mui_queued;
+            pptrO_connection->msz_headSent = 0;
+            ++lui_frames;
+        }
+        fv_metricsSend(pptrO_connection->mi_socketRW_fd, lsz_sent, lui_frames);
+    }
+}
+
+// a reply frame of the broker's own, in a buffer of its own
+static void fv_connectionReply(struct ipc_brokerConnection *pptrO_connection,
+                               uint16_t                     pus_type,
+                               uint32_t                     pui_requestID,
+                               const char                  *cptrc_text) {
+    //
+    size_t             lsz_text = strlen(cptrc_text);
+    struct ipc_buffer *lptrO_frame = fptrO_bufferGet(IPC_FRAME_HEADER_SIZE + lsz_text);
+    //
+    if (lptrO_frame == NULL) {
+        IPC_LOGE("ERROR allocating buffer: %m");
+        fv_connectionClose(pptrO_connection);
+        return;
+    }
+    lptrO_frame->mui_length = fsz_frameEncode(lptrO_frame->mptrc_data, lptrO_frame->mui_capacity,
+                                              pus_type, pui_requestID, cptrc_text, lsz_text);
+    fi_connectionQueue(pptrO_connection, lptrO_frame, 1);
+    fv_bufferRelease(lptrO_frame);
+}
+
+/********************* REQUESTS *********************/
+
+static int fi_onRequestHeader(void *pptrv_connection, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_brokerConnection *lptrO_connection = pptrv_connection;
+    //
+    lptrO_connection->msz_received = 0;
+    //
+    switch (pptrO_header->mus_type) {
+        case IPC_FRAME_PUBLISH:
+            lptrO_connection->mi_tooLarge = pptrO_header->mul_length > IPC_BROKER_PAYLOAD_MAX;
+            //
+            // the event is built where the message lands: its header goes in front, later
+            if (!lptrO_connection->mi_tooLarge &&
+                (lptrO_connection->mptrO_event =
+                     fptrO_bufferGet(IPC_FRAME_HEADER_SIZE + pptrO_header->mul_length)) == NULL) {
+                return -1;
+            }
+            return 0;
+        case IPC_FRAME_SUBSCRIBE:
+        case IPC_FRAME_UNSUBSCRIBE:
+            lptrO_connection->mi_tooLarge = pptrO_header->mul_length > IPC_BROKER_TOPIC_MAX;
+            return 0;
+        default:
+            errno = EPROTO;
+            return -1;
+    }
+}
+
+static int fi_onRequestPayload(void                         *pptrv_connection,
+                               const struct ipc_frameHeader *pptrO_header,
+                               const char                   *pptrc_chunk,
+                               size_t                        psz_chunk) {
+    struct ipc_brokerConnection *lptrO_connection = pptrv_connection;
+    //
+    if (lptrO_connection->mi_tooLarge) {
+        return 0;
+    }
+    if (pptrO_header->mus_type == IPC_FRAME_PUBLISH) {
+        memcpy(lptrO_connection->mptrO_event->mptrc_data + IPC_FRAME_HEADER_SIZE + lptrO_connection->msz_received,
+               pptrc_chunk, psz_chunk);
+    } else {
+        memcpy(lptrO_connection->mc_a1_topic + lptrO_connection->msz_received, pptrc_chunk, psz_chunk);
+    }
+    lptrO_connection->msz_received += psz_chunk;
+    //
+    return 0;
+}
+
+// deliver the message to every subscriber of its topic: one buffer, a reference per queue
+static void fv_publish(struct ipc_brokerConnection *pptrO_connection, const struct ipc_frameHeader *pptrO_header) {
+    //
+    struct ipc_buffer *lptrO_event = pptrO_connection->mptrO_event;
+    const char        *lptrc_payload = lptrO_event->mptrc_data + IPC_FRAME_HEADER_SIZE;
+    const char        *lptrc_end = memchr(lptrc_payload, '\0',
+                                          pptrO_header->mul_length < IPC_BROKER_TOPIC_MAX + 1
+                                              ? pptrO_header->mul_length : IPC_BROKER_TOPIC_MAX + 1);
+    //
+    pptrO_connection->mptrO_event = NULL;
+    //
+    if (lptrc_end == NULL || lptrc_end == lptrc_payload) {
+        fv_connectionReply(pptrO_connection, IPC_FRAME_ERROR, pptrO_header->mui_requestID,
+                           "ERROR publish payload: topic, NUL byte, message");
+        fv_bufferRelease(lptrO_event);
+        return;
+    }
+    struct ipc_frameHeader  lO_header;
+    struct ipc_brokerTopic *lptrO_topic = fptrO_topicFind(lptrc_payload, lptrc_end - lptrc_payload, 0);
+    unsigned                lui_delivered = 0;
+    //
+    lO_header.mus_type = IPC_FRAME_EVENT;
+    lO_header.mui_requestID = 0;
+    lO_header.mul_length = pptrO_header->mul_length;
+    fv_frameHeaderEncode(&lO_header, (unsigned char *) lptrO_event->mptrc_data);
+    lptrO_event->mui_length = IPC_FRAME_HEADER_SIZE + pptrO_header->mul_length;
+    //
+    for (unsigned i = 0; lptrO_topic != NULL && i < lptrO_topic->mui_members; ++i) {
+        lui_delivered += fi_connectionQueue(lptrO_topic->mptrO_a1_members[i].mptrO_connection, lptrO_event, 0);
+    }
+    fv_bufferRelease(lptrO_event);
+    //
+    IPC_LOGD("[Client #%u]: published to %.*s, %u subscriber(s)", pptrO_header->mui_requestID,
+             (int) (lptrc_end - lptrc_payload), lptrc_payload, lui_delivered);
+    //
+    char lc_a1_reply[64];
+    //
+    snprintf(lc_a1_reply, sizeof(lc_a1_reply), "Published to %u subscriber(s)", lui_delivered);
+    fv_connectionReply(pptrO_connection, IPC_FRAME_ACK, pptrO_header->mui_requestID, lc_a1_reply);
+}
+
+static int fi_onRequestEnd(void *pptrv_connection, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_brokerConnection *lptrO_connection = pptrv_connection;
+    //
+    if (lptrO_connection->mi_tooLarge) {
+        fv_connectionReply(lptrO_connection, IPC_FRAME_ERROR, pptrO_header->mui_requestID,
+                           pptrO_header->mus_type == IPC_FRAME_PUBLISH ? "ERROR message too large"
+                                                                       : "ERROR topic too long");
+        return 0;
+    }
+    if (pptrO_header->mus_type == IPC_FRAME_PUBLISH) {
+        fv_publish(lptrO_connection, pptrO_header);
+        return 0;
+    }
+    //
+    const char *lptrc_topic = lptrO_connection->mc_a1_topic;
+    size_t      lsz_topic = lptrO_connection->msz_received;
+    char        lc_a1_reply[32 + IPC_BROKER_TOPIC_MAX];
+    //
+    if (lsz_topic == 0 || memchr(lptrc_topic, '\0', lsz_topic) != NULL) {
+        fv_connectionReply(lptrO_connection, IPC_FRAME_ERROR, pptrO_header->mui_requestID, "ERROR invalid topic");
+        return 0;
+    }
+    if (pptrO_header->mus_type == IPC_FRAME_SUBSCRIBE) {
+        if (fi_subscribe(lptrO_connection, lptrc_topic, lsz_topic) < 0) {
+            snprintf(lc_a1_reply, sizeof(lc_a1_reply), "ERROR subscribing: %s", strerror(errno));
+            fv_connectionReply(lptrO_connection, IPC_FRAME_ERROR, pptrO_header->mui_requestID, lc_a1_reply);
+            return 0;
+        }
+        IPC_LOGI("[Client #%u]: subscribed to %.*s", pptrO_header->mui_requestID, (int) lsz_topic, lptrc_topic);
+        snprintf(lc_a1_reply, sizeof(lc_a1_reply), "Subscribed to %.*s", (int) lsz_topic, lptrc_topic);
+    } else {
+        struct ipc_brokerTopic *lptrO_topic = fptrO_topicFind(lptrc_topic, lsz_topic, 0);
+        //
+        for (int i = 0; lptrO_topic != NULL && i < lptrO_connection->mi_subscriptions; ++i) {
+            if (lptrO_connection->mO_a1_subscriptions[i].mptrO_topic == lptrO_topic) {
+                fv_unsubscribeAt(lptrO_connection, i);
+                break;
+            }
+        }
+        snprintf(lc_a1_reply, sizeof(lc_a1_reply), "Unsubscribed from %.*s", (int) lsz_topic, lptrc_topic);
+    }
+    fv_connectionReply(lptrO_connection, IPC_FRAME_ACK, pptrO_header->mui_requestID, lc_a1_reply);
+    //
+    return 0;
+}
+
+static const struct ipc_frameHandler gO_requestHandler = {
+    fi_onRequestHeader,
+    fi_onRequestPayload,
+    fi_onRequestEnd
+};
+
+/********************* LOOP *********************/
+
+// read and handle every request there is: edge-triggered epoll reports readiness only once
+static void fv_connectionRead(struct ipc_brokerConnection *pptrO_connection) {
+    //
+    while (!pptrO_connection->mi_closing) {
+        ssize_t li_n = read(pptrO_connection->mi_socketRW_fd, gc_a1_read, BROKER_READ_SIZE);
+        //
+        if (li_n > 0) {
+            fv_metricsRead(pptrO_connection->mi_socketRW_fd, li_n);
+            //
+            if (fi_frameParserFeed(&pptrO_connection->mO_parser, gc_a1_read, li_n) != 0) {
+                IPC_LOGE("ERROR serving frame: %m");
+                fv_metricsError(errno);
+                fv_connectionClose(pptrO_connection);
+            }
+            continue;
+        }
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            IPC_LOGE("ERROR reading from socket: %m");
+            fv_metricsError(errno);
+        }
+        // client closed the connection
+        fv_connectionClose(pptrO_connection);
+    }
+}
+
+static void fv_connectionFree(struct ipc_brokerConnection *pptrO_connection) {
+    //
+    unsigned lui_capacity = gi_queueDepth + BROKER_CONTROL_SLACK;
+    //
+    while (pptrO_connection->mi_subscriptions > 0) {
+        fv_unsubscribeAt(pptrO_connection, pptrO_connection->mi_subscriptions - 1);
+    }
+    for (; pptrO_connection->mui_queued > 0; --pptrO_connection->mui_queued) {
+        fv_bufferRelease(pptrO_connection->mptrO_a1_queue[pptrO_connection->mui_head]);
+        pptrO_connection->mui_head = (pptrO_connection->mui_head + 1) % lui_capacity;
+    }
+    if (pptrO_connection->mul_dropped > 0) {
+        IPC_LOGI("Subscriber %d missed %lu message(s)", pptrO_connection->mi_socketRW_fd, pptrO_connection->mul_dropped);
+    }
+    fv_bufferRelease(pptrO_connection->mptrO_event);
+    free(pptrO_connection->mptrO_a1_queue);
+    fv_metricsClose(pptrO_connection->mi_socketRW_fd);
+    fv_admissionLeave();
+    // closing the descriptor also removes it from the epoll interest list
+    close(pptrO_connection->mi_socketRW_fd);
+    free(pptrO_connection);
+}
+
+// drain the accept queue of the listening socket
+static void fv_acceptAll(int pi_epoll_fd, int pi_socketConn_fd) {
+    //
+    while (1) {
+        int li_socketRW_fd = accept4(pi_socketConn_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        //
+        if (li_socketRW_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                IPC_LOGE("accept4: %m");
+                fv_metricsError(errno);
+            }
+            return;
+        }
+        // <optional>
+        // at the limit: turned away before it costs any bookkeeping
+        if (!fi_admissionEnter()) {
+            fv_admissionReject(li_socketRW_fd);
+            continue;
+        }
+        struct ipc_brokerConnection *lptrO_connection = calloc(1, sizeof(*lptrO_connection));
+        //
+        if (lptrO_connection == NULL) {
+            IPC_LOGE("calloc: %m");
+            close(li_socketRW_fd);
+            fv_admissionLeave();
+            continue;
+        }
+        fv_metricsAccept(li_socketRW_fd);
+        lptrO_connection->mi_socketRW_fd = li_socketRW_fd;
+        fv_frameParserInit(&lptrO_connection->mO_parser, &gO_requestHandler, lptrO_connection);
+        //
+        // both directions once: a subscriber is written to far more than it is read from
+        struct epoll_event lO_event;
+        lO_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        lO_event.data.ptr = lptrO_connection;
+        //
+        if (epoll_ctl(pi_epoll_fd, EPOLL_CTL_ADD, li_socketRW_fd, &lO_event) < 0) {
+            IPC_LOGE("epoll_ctl: %m");
+            fv_connectionFree(lptrO_connection);
+        }
+    }
+}
+
+int fi_brokerServe(int pi_socketConn_fd, int pi_queueDepth, enum ipc_brokerOverflow pe_overflow) {
+    //
+    gi_queueDepth = pi_queueDepth;
+    ge_overflow = pe_overflow;
+    //
+    // the listening socket must not block either, or draining its queue would hang
+    int li_flags = fcntl(pi_socketConn_fd, F_GETFL, 0);
+    //
+    if (li_flags < 0 || fcntl(pi_socketConn_fd, F_SETFL, li_flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    int li_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    //
+    if (li_epoll_fd < 0) {
+        return -1;
+    }
+    // the listening socket is the only entry without a connection attached
+    struct epoll_event lO_event;
+    lO_event.events = EPOLLIN | EPOLLET;
+    lO_event.data.ptr = NULL;
+    //
+    if (epoll_ctl(li_epoll_fd, EPOLL_CTL_ADD, pi_socketConn_fd, &lO_event) < 0) {
+        close(li_epoll_fd);
+        return -1;
+    }
+    //
+    struct epoll_event lO_a1_events[BROKER_MAX_EVENTS];
+    //
+    while (1) {
+        int li_ready = epoll_wait(li_epoll_fd, lO_a1_events, BROKER_MAX_EVENTS, -1);
+        //
+        if (li_ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(li_epoll_fd);
+            return -1;
+        }
+        for (int i = 0; i < li_ready; ++i) {
+            struct ipc_brokerConnection *lptrO_connection = lO_a1_events[i].data.ptr;
+            //
+            if (lptrO_connection == NULL) {
+                fv_acceptAll(li_epoll_fd, pi_socketConn_fd);
+                continue;
+            }
+            if (lptrO_connection->mi_closing) {
+                continue;
+            }
+            if (lO_a1_events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                fv_connectionRead(lptrO_connection);
+            }
+            // room in the socket buffer again: whatever is queued goes out below
+            if ((lO_a1_events[i].events & EPOLLOUT) && lptrO_connection->mui_queued > 0 &&
+                !lptrO_connection->mi_dirty) {
+                lptrO_connection->mi_dirty = 1;
+                lptrO_connection->mptrO_nextDirty = gptrO_dirty;
+                gptrO_dirty = lptrO_connection;
+            }
+        }
+        // every queue that got frames in this batch, sent once for all of them
+        while (gptrO_dirty != NULL) {
+            struct ipc_brokerConnection *lptrO_connection = gptrO_dirty;
+            //
+            gptrO_dirty = lptrO_connection->mptrO_nextDirty;
+            lptrO_connection->mi_dirty = 0;
+            //
+            if (!lptrO_connection->mi_closing) {
+                fv_connectionFlush(lptrO_connection);
+            }
+        }
+        while (gptrO_closed != NULL) {
+            struct ipc_brokerConnection *lptrO_connection = gptrO_closed;
+            //
+            gptrO_closed = lptrO_connection->mptrO_nextClosed;
+            fv_connectionFree(lptrO_connection);
+        }
+    } // end of event loop
+}
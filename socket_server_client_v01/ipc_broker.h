@@ -0,0 +1,43 @@
+/*
+ * Publish/subscribe serving mode: the server as a local message broker
+ * Framed clients subscribe to topics (IPC_FRAME_SUBSCRIBE, the payload names one)
+ * and publish to them (IPC_FRAME_PUBLISH, the payload is a topic, a NUL byte, then
+ * the message); every subscriber of the topic receives the message as an
+ * IPC_FRAME_EVENT frame carrying the same payload
+ * A published message is read straight into one pooled buffer, behind room for the
+ * event header, and encoded there once: the queue of every subscriber holds a reference
+ * to that buffer, not a copy, and each queue leaves with one gathering sendmsg();
+ * the buffer returns to the pool once the last subscriber has sent it
+ * A subscriber queues at most so many messages; one falling further behind either
+ * misses the messages that do not fit (drop) or is disconnected (close), so that
+ * no slow consumer holds up the others, or the memory of the broker
+ * One thread, one edge-triggered epoll instance, like the event-loop serving mode
+ */
+#ifndef IPC_BROKER_H
+#define IPC_BROKER_H
+
+#include "ipc_frame.h"
+#include "ipc_pool.h"
+
+// longest topic name, and most topics a connection subscribes to
+#define IPC_BROKER_TOPIC_MAX         64
+#define IPC_BROKER_SUBSCRIPTIONS_MAX 16
+// largest publish payload (topic, NUL and message): one pooled buffer with the event header
+#define IPC_BROKER_PAYLOAD_MAX       (IPC_POOL_LARGEST - IPC_FRAME_HEADER_SIZE)
+// messages a subscriber may have waiting, unless told otherwise
+#define IPC_BROKER_QUEUE_DEPTH       1024
+
+// what happens to a subscriber whose queue is full
+enum ipc_brokerOverflow {
+    IPC_BROKER_DROP,   // the message is not delivered to it
+    IPC_BROKER_CLOSE   // it is disconnected
+};
+
+/*
+ * Serve all connections arriving on the listening socket, pi_socketConn_fd, from one thread
+ * pi_queueDepth: messages a subscriber may have waiting, at most
+ * Returns only if the loop cannot be set up (-1, with errno set)
+ */
+int fi_brokerServe(int pi_socketConn_fd, int pi_queueDepth, enum ipc_brokerOverflow pe_overflow);
+
+#endif  // IPC_BROKER_H
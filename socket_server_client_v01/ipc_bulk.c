@@ -0,0 +1,451 @@
+/*
+ * Bulk responses without kernel/user copies
+ * Every MSG_ZEROCOPY send() is numbered by the kernel, per socket; once the data
+ * has left, a notification for a range of those numbers is queued on the socket's
+ * error queue, and only then may the buffer be reused or freed
+ * References:
+ *  https://www.kernel.org/doc/html/latest/networking/msg_zerocopy.html
+ *  man 2 sendfile, splice, openat2
+ */
+#define _GNU_SOURCE  // splice(), pipe2()
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/errqueue.h>
+#include <linux/openat2.h>
+
+#include "ipc_bulk.h"
+#include "ipc_frame.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+
+// directory files are served from, -1 if file serving is off
+static int         gi_root_fd = -1;
+// read-only region served to "@<bytes>" requests, created by the first of them (NULL if it could not be)
+static const char     *gptrc_memory = NULL;
+static pthread_once_t  gO_memoryOnce = PTHREAD_ONCE_INIT;
+
+int fi_bulkInit(const char *cptrc_root) {
+    //
+    if (cptrc_root != NULL &&
+        (gi_root_fd = open(cptrc_root, O_PATH | O_DIRECTORY | O_CLOEXEC)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+static void fv_memoryCreate(void) {
+    //
+    char *lptrc_memory = mmap(NULL, IPC_BULK_MEMORY_SIZE, PROT_READ | PROT_WRITE,
+                              MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    //
+    if (lptrc_memory == MAP_FAILED) {
+        IPC_LOGE("ERROR creating the bulk memory region: %m");
+        return;
+    }
+    // recognisable content: 64-character lines of the alphabet, the first one doubled until full
+    for (size_t i = 0; i < 64; ++i) {
+        lptrc_memory[i] = (i == 63) ? '\n' : (char) ('a' + i % 26);
+    }
+    for (size_t lsz_filled = 64; lsz_filled < IPC_BULK_MEMORY_SIZE; lsz_filled *= 2) {
+        memcpy(lptrc_memory + lsz_filled, lptrc_memory, lsz_filled);
+    }
+    // nobody may write to pages the kernel could still be sending from
+    mprotect(lptrc_memory, IPC_BULK_MEMORY_SIZE, PROT_READ);
+    gptrc_memory = lptrc_memory;
+}
+
+// progress of the MSG_ZEROCOPY sends on one socket
+struct ipc_zerocopy {
+    unsigned mui_issued;
+    unsigned mui_completed;
+    int      mi_copied;
+};
+
+/*
+ * Collect completion notifications from the socket's error queue:
+ * all that are there already or, with pi_wait, at least one
+ */
+static int fi_zerocopyReap(int pi_socket_fd, struct ipc_zerocopy *pptrO_state, int pi_wait) {
+    //
+    char          lc_a1_control[CMSG_SPACE(sizeof(struct sock_extended_err) + sizeof(struct sockaddr_in6))];
+    struct msghdr lO_message;
+    //
+    while (1) {
+        memset(&lO_message, 0, sizeof(lO_message));
+        lO_message.msg_control = lc_a1_control;
+        lO_message.msg_controllen = sizeof(lc_a1_control);
+        //
+        if (recvmsg(pi_socket_fd, &lO_message, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            if (!pi_wait) {
+                return 0;
+            }
+            // a queued notification, like a socket error, is reported as POLLERR
+            struct pollfd lO_poll = { pi_socket_fd, 0, 0 };
+            //
+            if (poll(&lO_poll, 1, -1) < 0 && errno != EINTR) {
+                return -1;
+            }
+            int       li_error = 0;
+            socklen_t lui_size = sizeof(li_error);
+            //
+            if (getsockopt(pi_socket_fd, SOL_SOCKET, SO_ERROR, &li_error, &lui_size) == 0 && li_error != 0) {
+                errno = li_error;
+                return -1;
+            }
+            continue;
+        }
+        //
+        for (struct cmsghdr *lptrO_header = CMSG_FIRSTHDR(&lO_message);
+             lptrO_header != NULL;
+             lptrO_header = CMSG_NXTHDR(&lO_message, lptrO_header)) {
+            if (!(lptrO_header->cmsg_level == SOL_IP && lptrO_header->cmsg_type == IP_RECVERR) &&
+                !(lptrO_header->cmsg_level == SOL_IPV6 && lptrO_header->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            struct sock_extended_err lO_error;
+            memcpy(&lO_error, CMSG_DATA(lptrO_header), sizeof(lO_error));
+            //
+            if (lO_error.ee_errno != 0 || lO_error.ee_origin != SO_EE_ORIGIN_ZEROCOPY) {
+                continue;
+            }
+            // sends ee_info to ee_data (inclusive) are done with their pages
+            pptrO_state->mui_completed += lO_error.ee_data - lO_error.ee_info + 1;
+            // the kernel had to copy after all, e.g. for a loopback receiver
+            if (lO_error.ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                pptrO_state->mi_copied = 1;
+            }
+        }
+        //
+        if (pi_wait) {
+            return 0;
+        }
+    }
+}
+
+int fi_bulkSendBuffer(int pi_socket_fd, const void *pptrv_data, size_t psz_length) {
+    //
+    const char *lptrc_data = pptrv_data;
+    int         li_enable = 1;
+    //
+    if (psz_length < IPC_BULK_ZEROCOPY_MIN ||
+        setsockopt(pi_socket_fd, SOL_SOCKET, SO_ZEROCOPY, &li_enable, sizeof(li_enable)) < 0) {
+        return fi_writeAll(pi_socket_fd, pptrv_data, psz_length);
+    }
+    //
+    struct ipc_zerocopy lO_state = { 0, 0, 0 };
+    //
+    while (psz_length > 0) {
+        ssize_t li_n = send(pi_socket_fd, lptrc_data, psz_length, MSG_ZEROCOPY | MSG_NOSIGNAL);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // too many pages pinned for this socket: wait until earlier sends release some
+            if (errno == ENOBUFS && lO_state.mui_completed < lO_state.mui_issued) {
+                if (fi_zerocopyReap(pi_socket_fd, &lO_state, 1) < 0) {
+                    return -1;
+                }
+                continue;
+            }
+            return -1;
+        }
+        ++lO_state.mui_issued;
+        lptrc_data += li_n;
+        psz_length -= li_n;
+        //
+        if (fi_zerocopyReap(pi_socket_fd, &lO_state, 0) < 0) {
+            return -1;
+        }
+    }
+    // the buffer belongs to the kernel until every send has completed
+    while (lO_state.mui_completed < lO_state.mui_issued) {
+        if (fi_zerocopyReap(pi_socket_fd, &lO_state, 1) < 0) {
+            return -1;
+        }
+    }
+    //
+    return !lO_state.mi_copied;
+}
+
+// splice() the file into a pipe, and the pipe into the socket: the pages are moved, not copied
+static int fi_bulkSplice(int pi_socket_fd, int pi_file_fd, off_t pl_offset, uint64_t pul_length) {
+    //
+    int li_a1_pipe[2];
+    //
+    if (pipe2(li_a1_pipe, O_CLOEXEC) < 0) {
+        return -1;
+    }
+    //
+    int li_result = 0;
+    //
+    while (pul_length > 0 && li_result == 0) {
+        ssize_t li_in = splice(pi_file_fd, &pl_offset, li_a1_pipe[1], NULL,
+                               pul_length, SPLICE_F_MOVE | SPLICE_F_MORE);
+        //
+        if (li_in < 0 && errno == EINTR) {
+            continue;
+        }
+        if (li_in <= 0) {
+            if (li_in == 0) {
+                errno = ENODATA;
+            }
+            li_result = -1;
+            break;
+        }
+        pul_length -= li_in;
+        //
+        while (li_in > 0) {
+            ssize_t li_out = splice(li_a1_pipe[0], NULL, pi_socket_fd, NULL, li_in,
+                                    SPLICE_F_MOVE | (pul_length > 0 ? SPLICE_F_MORE : 0));
+            //
+            if (li_out < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                li_result = -1;
+                break;
+            }
+            li_in -= li_out;
+        }
+    }
+    //
+    int li_error = errno;
+    close(li_a1_pipe[0]);
+    close(li_a1_pipe[1]);
+    errno = li_error;
+    //
+    return li_result;
+}
+
+int fi_bulkSendFile(int pi_socket_fd, int pi_file_fd, uint64_t pul_length) {
+    //
+    off_t ll_offset = 0;
+    //
+    while (pul_length > 0) {
+        ssize_t li_n = sendfile(pi_socket_fd, pi_file_fd, &ll_offset, pul_length);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // this file system cannot feed sendfile()
+            if (errno == EINVAL || errno == ENOSYS) {
+                return fi_bulkSplice(pi_socket_fd, pi_file_fd, ll_offset, pul_length);
+            }
+            return -1;
+        }
+        if (li_n == 0) {
+            // the file shrank under us: the announced length can no longer be met
+            errno = ENODATA;
+            return -1;
+        }
+        pul_length -= li_n;
+    }
+    //
+    return 0;
+}
+
+// announce the data frame; MSG_MORE holds the header back to leave with the first payload bytes
+static int fi_bulkHeader(int pi_socket_fd, uint32_t pui_requestID, uint64_t pul_length) {
+    //
+    struct ipc_frameHeader lO_header;
+    unsigned char          luc_a1_header[IPC_FRAME_HEADER_SIZE];
+    size_t                 lsz_sent = 0;
+    //
+    lO_header.mus_type = IPC_FRAME_DATA;
+    lO_header.mui_requestID = pui_requestID;
+    lO_header.mul_length = pul_length;
+    fv_frameHeaderEncode(&lO_header, luc_a1_header);
+    //
+    while (lsz_sent < IPC_FRAME_HEADER_SIZE) {
+        ssize_t li_n = send(pi_socket_fd, luc_a1_header + lsz_sent, IPC_FRAME_HEADER_SIZE - lsz_sent,
+                            MSG_NOSIGNAL | (pul_length > 0 ? MSG_MORE : 0));
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        lsz_sent += li_n;
+    }
+    //
+    return 0;
+}
+
+static int fi_bulkRefuse(int pi_socket_fd, uint32_t pui_requestID, const char *cptrc_reason) {
+    IPC_LOGI("[Bulk #%u]: refused, %s", pui_requestID, cptrc_reason);
+    //
+    if (fi_frameSend(pi_socket_fd, IPC_FRAME_ERROR, pui_requestID, cptrc_reason, strlen(cptrc_reason)) < 0) {
+        return -1;
+    }
+    fv_metricsSend(pi_socket_fd, IPC_FRAME_HEADER_SIZE + strlen(cptrc_reason), 1);
+    //
+    return 0;
+}
+
+// only plain relative paths stay inside the served directory (a first, cheap check: see fi_openBeneath())
+static int fi_nameBeneath(const char *cptrc_name) {
+    //
+    if (cptrc_name[0] == '\0' || cptrc_name[0] == '/') {
+        return 0;
+    }
+    for (const char *lptrc_part = cptrc_name; lptrc_part != NULL; ) {
+        if (strncmp(lptrc_part, "..", 2) == 0 && (lptrc_part[2] == '/' || lptrc_part[2] == '\0')) {
+            return 0;
+        }
+        lptrc_part = strchr(lptrc_part, '/');
+        if (lptrc_part != NULL) {
+            ++lptrc_part;
+        }
+    }
+    //
+    return 1;
+}
+
+/*
+ * Open the file at cptrc_name, relative to the served directory, for reading, following no symbolic
+ * link on the way: a link anywhere in the path (link/etc/passwd) could lead out of the directory
+ * Returns the descriptor, or -1 (with errno set; ELOOP for a symbolic link)
+ */
+static int fi_openBeneath(const char *cptrc_name) {
+    //
+    struct open_how lO_how;
+    //
+    memset(&lO_how, 0, sizeof(lO_how));
+    lO_how.flags = O_RDONLY | O_CLOEXEC;
+    lO_how.resolve = RESOLVE_BENEATH | RESOLVE_NO_SYMLINKS;
+    //
+    int li_file_fd = (int) syscall(SYS_openat2, gi_root_fd, cptrc_name, &lO_how, sizeof(lO_how));
+    //
+    if (li_file_fd >= 0 || errno != ENOSYS) {
+        return li_file_fd;
+    }
+    // before Linux 5.6: one component at a time, each directory opened without following a link
+    char lc_a1_name[PATH_MAX];
+    int  li_dir_fd = gi_root_fd;
+    //
+    if (strlen(cptrc_name) >= sizeof(lc_a1_name)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(lc_a1_name, cptrc_name);
+    //
+    char *lptrc_part = lc_a1_name;
+    char *lptrc_slash;
+    //
+    while ((lptrc_slash = strchr(lptrc_part, '/')) != NULL) {
+        *lptrc_slash = '\0';
+        //
+        int li_next_fd = lptrc_slash == lptrc_part ? li_dir_fd
+                                                   : openat(li_dir_fd, lptrc_part, O_PATH | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        //
+        if (li_next_fd != li_dir_fd && li_dir_fd != gi_root_fd) {
+            close(li_dir_fd);
+        }
+        if (li_next_fd < 0) {
+            return -1;
+        }
+        li_dir_fd = li_next_fd;
+        lptrc_part = lptrc_slash + 1;
+    }
+    li_file_fd = openat(li_dir_fd, lptrc_part, O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    //
+    if (li_dir_fd != gi_root_fd) {
+        int li_error = errno;
+        close(li_dir_fd);
+        errno = li_error;
+    }
+    return li_file_fd;
+}
+
+int fi_bulkServe(int pi_socket_fd, uint32_t pui_requestID, const char *cptrc_name) {
+    //
+    if (cptrc_name[0] == '@') {
+        char              *lptrc_end;
+        unsigned long long lul_size = strtoull(cptrc_name + 1, &lptrc_end, 10);
+        //
+        // a server nobody fetches memory from never pays for it (a forked connection: for its own copy)
+        pthread_once(&gO_memoryOnce, fv_memoryCreate);
+        //
+        if (gptrc_memory == NULL || lptrc_end == cptrc_name + 1 || *lptrc_end != '\0' ||
+            lul_size > IPC_BULK_MEMORY_SIZE) {
+            return fi_bulkRefuse(pi_socket_fd, pui_requestID, "no such memory region");
+        }
+        //
+        int li_zeroCopy;
+        //
+        if (fi_bulkHeader(pi_socket_fd, pui_requestID, lul_size) < 0 ||
+            (li_zeroCopy = fi_bulkSendBuffer(pi_socket_fd, gptrc_memory, lul_size)) < 0) {
+            return -1;
+        }
+        //
+        fv_metricsSend(pi_socket_fd, IPC_FRAME_HEADER_SIZE + lul_size, 1);
+        IPC_LOGI("[Bulk #%u]: %llu bytes of memory sent %s", pui_requestID, lul_size,
+                 li_zeroCopy ? "without copying (MSG_ZEROCOPY)" : "by copying");
+        //
+        return 0;
+    }
+    //
+    if (gi_root_fd < 0) {
+        return fi_bulkRefuse(pi_socket_fd, pui_requestID, "no directory is served (start the server with -b)");
+    }
+    if (!fi_nameBeneath(cptrc_name)) {
+        return fi_bulkRefuse(pi_socket_fd, pui_requestID, "invalid name");
+    }
+    //
+    int         li_file_fd = fi_openBeneath(cptrc_name);
+    struct stat lO_status;
+    //
+    if (li_file_fd < 0 || fstat(li_file_fd, &lO_status) < 0) {
+        int li_result = fi_bulkRefuse(pi_socket_fd, pui_requestID, strerror(errno));
+        //
+        if (li_file_fd >= 0) {
+            close(li_file_fd);
+        }
+        return li_result;
+    }
+    if (!S_ISREG(lO_status.st_mode)) {
+        close(li_file_fd);
+        //
+        return fi_bulkRefuse(pi_socket_fd, pui_requestID, "not a regular file");
+    }
+    //
+    int li_result = fi_bulkHeader(pi_socket_fd, pui_requestID, lO_status.st_size);
+    //
+    if (li_result == 0) {
+        li_result = fi_bulkSendFile(pi_socket_fd, li_file_fd, lO_status.st_size);
+    }
+    //
+    int li_error = errno;
+    close(li_file_fd);
+    errno = li_error;
+    //
+    if (li_result == 0) {
+        fv_metricsSend(pi_socket_fd, IPC_FRAME_HEADER_SIZE + lO_status.st_size, 1);
+        IPC_LOGI("[Bulk #%u]: %s, %lld bytes sent from the page cache",
+                 pui_requestID, cptrc_name, (long long) lO_status.st_size);
+    }
+    //
+    return li_result;
+}
@@ -0,0 +1,52 @@
+/*
+ * Bulk responses: a file or a memory region streamed to a framed client
+ * without copying it through user space
+ *  - file-backed data goes out with sendfile(), page cache straight to the socket
+ *    (or with splice() through a pipe where sendfile() is not supported)
+ *  - large in-memory buffers go out with send(MSG_ZEROCOPY): the kernel pins the
+ *    pages instead of copying them, and reports on the socket's error queue when done
+ * A client asks with an IPC_FRAME_FETCH frame whose payload names what it wants:
+ *  "@<bytes>"  the first <bytes> of the server's in-memory region
+ *  "<path>"    a regular file, relative to the directory given to fi_bulkInit()
+ */
+#ifndef IPC_BULK_H
+#define IPC_BULK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// smaller buffers are cheaper to copy than to pin and wait for a completion
+#define IPC_BULK_ZEROCOPY_MIN (16 * 1024)
+// size of the in-memory region served to "@<bytes>" requests
+#define IPC_BULK_MEMORY_SIZE  (64 * 1024 * 1024)
+
+/*
+ * Unless cptrc_root is NULL, open the directory files are served from; call once,
+ * before serving (forked workers inherit it)
+ * The in-memory region is only created by the first "@<bytes>" request
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_bulkInit(const char *cptrc_root);
+
+/*
+ * Answer fetch request pui_requestID for cptrc_name with an IPC_FRAME_DATA frame,
+ * or with an IPC_FRAME_ERROR frame saying why it cannot be served
+ * Returns 0, or -1 (with errno set) if the connection failed mid-transfer
+ */
+int fi_bulkServe(int pi_socket_fd, uint32_t pui_requestID, const char *cptrc_name);
+
+/*
+ * Write pul_length bytes of the file from its start, with sendfile()
+ * Returns 0, or -1 (with errno set; ENODATA if the file shrank)
+ */
+int fi_bulkSendFile(int pi_socket_fd, int pi_file_fd, uint64_t pul_length);
+
+/*
+ * Write the buffer with MSG_ZEROCOPY if it is large enough and the socket supports it
+ * (AF_UNIX sockets do not), otherwise with plain copying send()s
+ * Returns only once the kernel has released the buffer: 1 if no byte was copied,
+ * 0 if it was (loopback traffic always is), or -1 (with errno set)
+ */
+int fi_bulkSendBuffer(int pi_socket_fd, const void *pptrv_data, size_t psz_length);
+
+#endif  // IPC_BULK_H
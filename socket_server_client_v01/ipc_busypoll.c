@@ -0,0 +1,222 @@
+/*
+ * Low-latency serving
+ * References:
+ *  https://docs.kernel.org/networking/napi.html (busy polling)
+ *  man 7 socket (SO_BUSY_POLL, SO_PREFER_BUSY_POLL)
+ *  https://docs.kernel.org/admin-guide/kernel-parameters.html (isolcpus)
+ */
+#define _GNU_SOURCE  // CPU_SET() and friends, pthread_setaffinity_np()
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "ipc_busypoll.h"
+#include "ipc_log.h"
+
+#ifndef SO_PREFER_BUSY_POLL
+#define SO_PREFER_BUSY_POLL 69
+#endif
+
+// where the kernel lists the CPUs isolated from the scheduler (isolcpus=)
+#define BUSYPOLL_ISOLATED_PATH "/sys/devices/system/cpu/isolated"
+
+// set once, before any connection is served
+static uint64_t gul_spinNanoseconds;
+static int      gi_spinMicroseconds;
+static int      gi_a1_cpus[CPU_SETSIZE];
+static int      gi_cpus;
+
+// tell the core a spin-wait is going on: saves power, and yields to a hyperthread sibling
+static inline void fv_cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static uint64_t ful_busyPollNow(void) {
+    struct timespec lO_time;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_time);
+    //
+    return (uint64_t) lO_time.tv_sec * 1000000000ull + lO_time.tv_nsec;
+}
+
+/*
+ * Parse a CPU list such as "0-3,8,10-11" into pptrO_set
+ * Returns 0, or -1 (errno EINVAL)
+ */
+static int fi_cpuListParse(const char *cptrc_list, cpu_set_t *pptrO_set) {
+    //
+    CPU_ZERO(pptrO_set);
+    //
+    while (*cptrc_list != '\0' && *cptrc_list != '\n') {
+        char *lptrc_end;
+        long  ll_first = strtol(cptrc_list, &lptrc_end, 10),
+              ll_last = ll_first;
+        //
+        if (lptrc_end == cptrc_list) {
+            break;
+        }
+        if (*lptrc_end == '-') {
+            cptrc_list = lptrc_end + 1;
+            ll_last = strtol(cptrc_list, &lptrc_end, 10);
+            if (lptrc_end == cptrc_list) {
+                break;
+            }
+        }
+        if (ll_first < 0 || ll_last >= CPU_SETSIZE || ll_first > ll_last) {
+            break;
+        }
+        for (long i = ll_first; i <= ll_last; ++i) {
+            CPU_SET(i, pptrO_set);
+        }
+        cptrc_list = lptrc_end;
+        if (*cptrc_list != ',') {
+            break;
+        }
+        ++cptrc_list;
+    }
+    if ((*cptrc_list != '\0' && *cptrc_list != '\n') || CPU_COUNT(pptrO_set) == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    //
+    return 0;
+}
+
+int fi_busyPollInit(int pi_spinMicroseconds, const char *cptrc_cpus) {
+    //
+    if (pi_spinMicroseconds < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    gi_spinMicroseconds = pi_spinMicroseconds;
+    gul_spinNanoseconds = (uint64_t) pi_spinMicroseconds * 1000;
+    //
+    if (cptrc_cpus == NULL) {
+        return 0;
+    }
+    //
+    char lc_a1_isolated[4096];
+    //
+    if (strcmp(cptrc_cpus, "isolated") == 0) {
+        FILE *lptrO_file = fopen(BUSYPOLL_ISOLATED_PATH, "r");
+        //
+        if (lptrO_file == NULL) {
+            return -1;
+        }
+        if (fgets(lc_a1_isolated, sizeof(lc_a1_isolated), lptrO_file) == NULL) {
+            // no CPU is isolated
+            lc_a1_isolated[0] = '\0';
+        }
+        fclose(lptrO_file);
+        cptrc_cpus = lc_a1_isolated;
+    }
+    //
+    cpu_set_t lO_cpuSet;
+    //
+    if (fi_cpuListParse(cptrc_cpus, &lO_cpuSet) < 0) {
+        return -1;
+    }
+    // threads and processes started from now on stay on these CPUs
+    if (sched_setaffinity(0, sizeof(lO_cpuSet), &lO_cpuSet) < 0) {
+        return -1;
+    }
+    gi_cpus = 0;
+    //
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &lO_cpuSet)) {
+            gi_a1_cpus[gi_cpus++] = i;
+        }
+    }
+    //
+    return 0;
+}
+
+void fv_busyPollSocket(int pi_socket_fd) {
+    //
+    int li_enable = 1;
+    //
+    // a reply must leave at once, not wait for earlier data to be acknowledged (Nagle)
+    // (fails harmlessly on a Unix domain socket)
+    setsockopt(pi_socket_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+    //
+    if (gi_spinMicroseconds == 0) {
+        return;
+    }
+    // raising SO_BUSY_POLL above net.core.busy_read takes CAP_NET_ADMIN: warn once, carry on
+    static int si_warned;
+    //
+    if ((setsockopt(pi_socket_fd, SOL_SOCKET, SO_BUSY_POLL,
+                    &gi_spinMicroseconds, sizeof(gi_spinMicroseconds)) < 0 ||
+         setsockopt(pi_socket_fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                    &li_enable, sizeof(li_enable)) < 0) &&
+        !si_warned) {
+        si_warned = 1;
+        IPC_LOGW("Kernel busy polling unavailable, spinning in user space only: %m");
+    }
+}
+
+void fv_busyPollPin(int pi_index) {
+    //
+    if (gi_cpus == 0) {
+        return;
+    }
+    cpu_set_t lO_cpuSet;
+    CPU_ZERO(&lO_cpuSet);
+    CPU_SET(gi_a1_cpus[pi_index % gi_cpus], &lO_cpuSet);
+    //
+    int li_error = pthread_setaffinity_np(pthread_self(), sizeof(lO_cpuSet), &lO_cpuSet);
+    //
+    if (li_error != 0) {
+        errno = li_error;
+        IPC_LOGE("pthread_setaffinity_np: %m");
+    }
+}
+
+ssize_t fl_busyPollRecvmsg(int pi_socket_fd, struct msghdr *pptrO_message, int pi_flags) {
+    //
+    if (gul_spinNanoseconds > 0) {
+        uint64_t lul_deadline = 0;
+        //
+        while (1) {
+            ssize_t li_n = recvmsg(pi_socket_fd, pptrO_message, pi_flags | MSG_DONTWAIT);
+            //
+            if (li_n >= 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                return li_n;
+            }
+            // the clock is read only once nothing was there: a ready socket costs one call
+            uint64_t lul_now = ful_busyPollNow();
+            //
+            if (lul_deadline == 0) {
+                lul_deadline = lul_now + gul_spinNanoseconds;
+            } else if (lul_now >= lul_deadline) {
+                break;
+            }
+            fv_cpuRelax();
+        }
+    }
+    // nothing came while spinning: sleep until something does
+    return recvmsg(pi_socket_fd, pptrO_message, pi_flags);
+}
+
+ssize_t fl_busyPollRecv(int pi_socket_fd, void *pptrv_buffer, size_t psz_length, int pi_flags) {
+    struct iovec  lO_data = { pptrv_buffer, psz_length };
+    struct msghdr lO_message;
+    //
+    memset(&lO_message, 0, sizeof(lO_message));
+    lO_message.msg_iov = &lO_data;
+    lO_message.msg_iovlen = 1;
+    //
+    return fl_busyPollRecvmsg(pi_socket_fd, &lO_message, pi_flags);
+}
@@ -0,0 +1,45 @@
+/*
+ * Low-latency serving
+ * Blocking in read() costs a sleep and a wakeup per message: the scheduler's
+ * wakeup latency, and often a cold cache, land on every request
+ * For the lowest latency, a connection's thread instead spins on a non-blocking receive
+ * for a while before it blocks, on a core of its own that nothing else runs on
+ * (e.g., one isolated with isolcpus= or cpusets), and asks the kernel to busy-poll
+ * the device queue too (SO_BUSY_POLL, SO_PREFER_BUSY_POLL: NAPI devices only, not loopback)
+ * Spinning trades a whole core per serving thread for latency: off by default
+ */
+#ifndef IPC_BUSYPOLL_H
+#define IPC_BUSYPOLL_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+
+/*
+ * pi_spinMicroseconds: how long a receive spins before it blocks, 0 to block at once
+ * cptrc_cpus: CPUs to run on, e.g. "2-3,6", or "isolated" for the kernel's isolated ones;
+ *  the process is confined to them, and every serving thread is pinned to one (round-robin)
+ *  NULL: no pinning
+ * Returns 0, or -1 (with errno set; EINVAL for a list naming no usable CPU)
+ */
+int fi_busyPollInit(int pi_spinMicroseconds, const char *cptrc_cpus);
+
+/*
+ * Tune a connected socket for latency: TCP_NODELAY, and with spinning enabled,
+ * SO_BUSY_POLL for as long as the spin, and SO_PREFER_BUSY_POLL
+ * Best effort: an option the kernel refuses (e.g., without CAP_NET_ADMIN) is left out
+ */
+void fv_busyPollSocket(int pi_socket_fd);
+
+// pin the calling thread to the pi_index-th CPU given to fi_busyPollInit(), if any
+void fv_busyPollPin(int pi_index);
+
+/*
+ * recvmsg(), spinning on MSG_DONTWAIT for up to the configured time
+ * before blocking (on a blocking socket)
+ */
+ssize_t fl_busyPollRecvmsg(int pi_socket_fd, struct msghdr *pptrO_message, int pi_flags);
+
+// recv(), the same way
+ssize_t fl_busyPollRecv(int pi_socket_fd, void *pptrv_buffer, size_t psz_length, int pi_flags);
+
+#endif  // IPC_BUSYPOLL_H
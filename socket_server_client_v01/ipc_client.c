@@ -0,0 +1,712 @@
+/*
+ * Asynchronous client library
+ * Threads:
+ *  - application threads append requests to a queue, behind one lock,
+ *    and wake the loop through an eventfd when the queue was empty
+ *  - the loop thread owns everything else: connections, requests in flight, and their slots
+ * A request in flight holds a slot of a fixed table; its request ID is the slot index,
+ * plus a generation in the upper bits, so a reply finds its request in one lookup
+ * and a stale or foreign ID is told apart
+ * References:
+ *  man 7 epoll
+ *  man 2 eventfd
+ */
+#define _GNU_SOURCE  // SOCK_NONBLOCK and friends
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "ipc_client.h"
+#include "ipc_frame.h"
+#include "ipc_pool.h"
+
+// number of ready events collected by a single epoll_wait()
+#define CLIENT_MAX_EVENTS 64
+// request ID bits that index the slot table
+#define CLIENT_SLOT_BITS  12
+#define CLIENT_SLOT_MASK  (IPC_CLIENT_INFLIGHT_MAX - 1)
+
+_Static_assert(IPC_CLIENT_INFLIGHT_MAX == 1 << CLIENT_SLOT_BITS, "slot bits must match the slot table");
+
+// a request not in flight yet
+struct ipc_clientRequest {
+    struct ipc_clientRequest *mptrO_next;
+    // room for the header, then the payload
+    struct ipc_buffer        *mptrO_frame;
+    uint16_t                  mus_type;
+    uint64_t                  mul_length;
+    void                    (*mpf_done)(void *, const struct ipc_clientReply *);
+    void                     *mptrv_context;
+};
+
+// a request in flight
+struct ipc_clientSlot {
+    uint32_t mui_requestID;
+    // index of the connection it went to, -1 while the slot is free
+    int      mi_connection;
+    void   (*mpf_done)(void *, const struct ipc_clientReply *);
+    void    *mptrv_context;
+};
+
+struct ipc_clientConnection {
+    struct ipc_client     *mptrO_client;
+    int                    mi_index;
+    int                    mi_socket_fd;  // -1: closed
+    int                    mi_connecting;
+    unsigned               mui_inFlight;
+    // frames not completely sent yet, and how much of the first buffer is
+    struct ipc_buffer     *mptrO_outHead,
+                          *mptrO_outTail;
+    size_t                 msz_outSent;
+    // reply being received
+    struct ipc_frameParser mO_parser;
+    char                  *mptrc_reply;
+    size_t                 msz_reply,
+                           msz_replyCapacity;
+};
+
+struct ipc_client {
+    struct sockaddr_storage     mO_address;
+    socklen_t                   mui_addressSize;
+    int                         mi_epoll_fd,
+                                mi_wake_fd;
+    pthread_t                   mO_thread;
+    atomic_int                  mi_stop;
+    // filled by any thread
+    pthread_mutex_t             mO_lock;
+    struct ipc_clientRequest   *mptrO_queueHead,
+                               *mptrO_queueTail;
+    // the loop thread's own: requests taken from the queue, waiting for a slot
+    struct ipc_clientRequest   *mptrO_waitHead,
+                               *mptrO_waitTail;
+    int                         mi_connections;
+    struct ipc_clientConnection mO_a1_connections[IPC_CLIENT_CONNECTIONS_MAX];
+    struct ipc_clientSlot       mO_a1_slots[IPC_CLIENT_INFLIGHT_MAX];
+    // free slots, as a stack
+    int                         mi_a1_free[IPC_CLIENT_INFLIGHT_MAX];
+    int                         mi_free;
+};
+
+static void fv_fail(const struct ipc_clientRequest *pptrO_request, int pi_error) {
+    struct ipc_clientReply lO_reply;
+    //
+    memset(&lO_reply, 0, sizeof(lO_reply));
+    lO_reply.mi_error = pi_error;
+    pptrO_request->mpf_done(pptrO_request->mptrv_context, &lO_reply);
+}
+
+static void fv_requestFree(struct ipc_clientRequest *pptrO_request) {
+    if (pptrO_request->mptrO_frame != NULL) {
+        fv_bufferRelease(pptrO_request->mptrO_frame);
+    }
+    free(pptrO_request);
+}
+
+/*
+ * The request in slot pi_slot is done: free the slot first,
+ * so that the callback may already submit the next request
+ */
+static void fv_slotComplete(struct ipc_client *pptrO_client, int pi_slot, const struct ipc_clientReply *pptrO_reply) {
+    struct ipc_clientSlot *lptrO_slot = &pptrO_client->mO_a1_slots[pi_slot];
+    void                 (*lpf_done)(void *, const struct ipc_clientReply *) = lptrO_slot->mpf_done;
+    void                  *lptrv_context = lptrO_slot->mptrv_context;
+    //
+    --pptrO_client->mO_a1_connections[lptrO_slot->mi_connection].mui_inFlight;
+    lptrO_slot->mi_connection = -1;
+    // next generation: a late reply to the old ID no longer matches
+    lptrO_slot->mui_requestID += IPC_CLIENT_INFLIGHT_MAX;
+    pptrO_client->mi_a1_free[pptrO_client->mi_free++] = pi_slot;
+    //
+    lpf_done(lptrv_context, pptrO_reply);
+}
+
+/*
+ * The connection broke (or the client is being destroyed):
+ * close it, and fail every request that went to it
+ */
+static void fv_connectionFail(struct ipc_clientConnection *pptrO_connection, int pi_error) {
+    struct ipc_client *lptrO_client = pptrO_connection->mptrO_client;
+    //
+    if (pptrO_connection->mi_socket_fd >= 0) {
+        // closing the descriptor also removes it from the epoll interest list
+        close(pptrO_connection->mi_socket_fd);
+        pptrO_connection->mi_socket_fd = -1;
+    }
+    if (pptrO_connection->mptrO_outHead != NULL) {
+        fv_bufferRelease(pptrO_connection->mptrO_outHead);
+    }
+    pptrO_connection->mptrO_outHead = pptrO_connection->mptrO_outTail = NULL;
+    pptrO_connection->msz_outSent = 0;
+    pptrO_connection->mi_connecting = 0;
+    //
+    struct ipc_clientReply lO_reply;
+    memset(&lO_reply, 0, sizeof(lO_reply));
+    lO_reply.mi_error = pi_error;
+    //
+    for (int i = 0; i < IPC_CLIENT_INFLIGHT_MAX && pptrO_connection->mui_inFlight > 0; ++i) {
+        if (lptrO_client->mO_a1_slots[i].mi_connection == pptrO_connection->mi_index) {
+            fv_slotComplete(lptrO_client, i, &lO_reply);
+        }
+    }
+}
+
+static int fi_onReplyHeader(void *pptrv_connection, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_clientConnection *lptrO_connection = pptrv_connection;
+    struct ipc_clientSlot       *lptrO_slot =
+        &lptrO_connection->mptrO_client->mO_a1_slots[pptrO_header->mui_requestID & CLIENT_SLOT_MASK];
+    //
+    // only the requests sent on this connection can be answered on it
+    if (lptrO_slot->mi_connection != lptrO_connection->mi_index ||
+        lptrO_slot->mui_requestID != pptrO_header->mui_requestID) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (pptrO_header->mul_length > IPC_CLIENT_REPLY_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    // one more byte for the NUL
+    if (pptrO_header->mul_length + 1 > lptrO_connection->msz_replyCapacity) {
+        char *lptrc_reply = realloc(lptrO_connection->mptrc_reply, pptrO_header->mul_length + 1);
+        //
+        if (lptrc_reply == NULL) {
+            return -1;
+        }
+        lptrO_connection->mptrc_reply = lptrc_reply;
+        lptrO_connection->msz_replyCapacity = pptrO_header->mul_length + 1;
+    }
+    lptrO_connection->msz_reply = 0;
+    //
+    return 0;
+}
+
+static int fi_onReplyPayload(void                         *pptrv_connection,
+                             const struct ipc_frameHeader *pptrO_header,
+                             const char                   *pptrc_chunk,
+                             size_t                        psz_chunk) {
+    struct ipc_clientConnection *lptrO_connection = pptrv_connection;
+    //
+    (void) pptrO_header;
+    //
+    memcpy(lptrO_connection->mptrc_reply + lptrO_connection->msz_reply, pptrc_chunk, psz_chunk);
+    lptrO_connection->msz_reply += psz_chunk;
+    //
+    return 0;
+}
+
+static int fi_onReplyEnd(void *pptrv_connection, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_clientConnection *lptrO_connection = pptrv_connection;
+    struct ipc_clientReply       lO_reply;
+    //
+    lO_reply.mi_error = 0;
+    lO_reply.mus_type = pptrO_header->mus_type;
+    lO_reply.mui_requestID = pptrO_header->mui_requestID;
+    lO_reply.mptrc_payload = lptrO_connection->mptrc_reply;
+    lO_reply.msz_length = lptrO_connection->msz_reply;
+    lptrO_connection->mptrc_reply[lptrO_connection->msz_reply] = '\0';
+    fv_slotComplete(lptrO_connection->mptrO_client, pptrO_header->mui_requestID & CLIENT_SLOT_MASK, &lO_reply);
+    //
+    return 0;
+}
+
+static const struct ipc_frameHandler gO_clientHandler = {
+    fi_onReplyHeader,
+    fi_onReplyPayload,
+    fi_onReplyEnd
+};
+
+// start connecting without waiting for it; epoll reports when it is done
+static int fi_connectionOpen(struct ipc_clientConnection *pptrO_connection) {
+    struct ipc_client *lptrO_client = pptrO_connection->mptrO_client;
+    int                li_socket_fd = socket(lptrO_client->mO_address.ss_family,
+                                             SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                                             0);
+    //
+    if (li_socket_fd < 0) {
+        return -1;
+    }
+    // a request must not wait for the previous one to be acknowledged by TCP (Nagle)
+    if (lptrO_client->mO_address.ss_family == AF_INET) {
+        int li_enable = 1;
+        setsockopt(li_socket_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+    }
+    //
+    pptrO_connection->mi_connecting = 0;
+    //
+    if (connect(li_socket_fd, (const struct sockaddr *) &lptrO_client->mO_address, lptrO_client->mui_addressSize) < 0) {
+        if (errno != EINPROGRESS) {
+            int li_errno = errno;
+            close(li_socket_fd);
+            errno = li_errno;
+            return -1;
+        }
+        pptrO_connection->mi_connecting = 1;
+    }
+    //
+    // ask for both directions once, so the connection never has to be re-armed
+    struct epoll_event lO_event;
+    lO_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    lO_event.data.ptr = pptrO_connection;
+    //
+    if (epoll_ctl(lptrO_client->mi_epoll_fd, EPOLL_CTL_ADD, li_socket_fd, &lO_event) < 0) {
+        int li_errno = errno;
+        close(li_socket_fd);
+        errno = li_errno;
+        return -1;
+    }
+    pptrO_connection->mi_socket_fd = li_socket_fd;
+    fv_frameParserInit(&pptrO_connection->mO_parser, &gO_clientHandler, pptrO_connection);
+    //
+    return 0;
+}
+
+/*
+ * Hand as much of the pending output as the socket takes to the kernel,
+ * as many frames per system call as fit into one iovec array
+ */
+static void fv_connectionFlush(struct ipc_clientConnection *pptrO_connection) {
+    //
+    while (pptrO_connection->mptrO_outHead != NULL && !pptrO_connection->mi_connecting) {
+        struct iovec lO_a1_parts[IPC_FRAME_PARTS_MAX];
+        int          li_parts = fi_bufferChainIovec(pptrO_connection->mptrO_outHead,
+                                                    lO_a1_parts, IPC_FRAME_PARTS_MAX);
+        //
+        lO_a1_parts[0].iov_base = (char *) lO_a1_parts[0].iov_base + pptrO_connection->msz_outSent;
+        lO_a1_parts[0].iov_len -= pptrO_connection->msz_outSent;
+        //
+        struct msghdr lO_message;
+        memset(&lO_message, 0, sizeof(lO_message));
+        lO_message.msg_iov = lO_a1_parts;
+        lO_message.msg_iovlen = li_parts;
+        //
+        ssize_t li_n = sendmsg(pptrO_connection->mi_socket_fd, &lO_message, MSG_NOSIGNAL | MSG_DONTWAIT);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // the socket buffer is full: the next EPOLLOUT edge resumes
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fv_connectionFail(pptrO_connection, errno);
+            }
+            return;
+        }
+        // return the buffers sent in full to the pool, one at a time: the chain goes on
+        size_t lsz_sent = pptrO_connection->msz_outSent + li_n;
+        //
+        while (pptrO_connection->mptrO_outHead != NULL &&
+               lsz_sent >= pptrO_connection->mptrO_outHead->mui_length) {
+            struct ipc_buffer *lptrO_sent = pptrO_connection->mptrO_outHead;
+            //
+            lsz_sent -= lptrO_sent->mui_length;
+            pptrO_connection->mptrO_outHead = lptrO_sent->mptrO_next;
+            lptrO_sent->mptrO_next = NULL;
+            fv_bufferRelease(lptrO_sent);
+        }
+        if (pptrO_connection->mptrO_outHead == NULL) {
+            pptrO_connection->mptrO_outTail = NULL;
+        }
+        pptrO_connection->msz_outSent = lsz_sent;
+    }
+}
+
+// read every reply that is there, until the socket would block
+static void fv_connectionReceive(struct ipc_clientConnection *pptrO_connection) {
+    //
+    // borrowed only for the reads, like the servers' buffers
+    struct ipc_buffer *lptrO_buffer = fptrO_bufferGet(IPC_POOL_LARGEST);
+    //
+    if (lptrO_buffer == NULL) {
+        fv_connectionFail(pptrO_connection, errno);
+        return;
+    }
+    while (pptrO_connection->mi_socket_fd >= 0) {
+        ssize_t li_n = read(pptrO_connection->mi_socket_fd, lptrO_buffer->mptrc_data, lptrO_buffer->mui_capacity);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                fv_connectionFail(pptrO_connection, errno);
+            }
+            break;
+        }
+        // the server closed: whatever is in flight on this connection is lost
+        if (li_n == 0) {
+            fv_connectionFail(pptrO_connection, ECONNRESET);
+            break;
+        }
+        if (fi_frameParserFeed(&pptrO_connection->mO_parser, lptrO_buffer->mptrc_data, li_n) != 0) {
+            fv_connectionFail(pptrO_connection, errno);
+            break;
+        }
+    }
+    fv_bufferRelease(lptrO_buffer);
+}
+
+static void fv_connectionEvents(struct ipc_clientConnection *pptrO_connection, uint32_t pui_events) {
+    //
+    if (pptrO_connection->mi_socket_fd < 0) {
+        return;
+    }
+    // a non-blocking connect() is done once the socket is writable, or failed
+    if (pptrO_connection->mi_connecting) {
+        if (!(pui_events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+            return;
+        }
+        int       li_error = 0;
+        socklen_t lui_size = sizeof(li_error);
+        //
+        getsockopt(pptrO_connection->mi_socket_fd, SOL_SOCKET, SO_ERROR, &li_error, &lui_size);
+        //
+        if (li_error != 0) {
+            fv_connectionFail(pptrO_connection, li_error);
+            return;
+        }
+        pptrO_connection->mi_connecting = 0;
+    }
+    if (pui_events & EPOLLOUT) {
+        fv_connectionFlush(pptrO_connection);
+    }
+    if (pui_events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        fv_connectionReceive(pptrO_connection);
+    }
+}
+
+/*
+ * Send the waiting requests, as long as there are free slots,
+ * each to the connection of the pool with the fewest in flight
+ * Closed connections have none: the pool fills up before any connection is shared
+ */
+static void fv_clientDispatch(struct ipc_client *pptrO_client) {
+    //
+    // take the whole queue at once: the lock is held for two pointer moves
+    pthread_mutex_lock(&pptrO_client->mO_lock);
+    //
+    if (pptrO_client->mptrO_queueHead != NULL) {
+        if (pptrO_client->mptrO_waitTail != NULL) {
+            pptrO_client->mptrO_waitTail->mptrO_next = pptrO_client->mptrO_queueHead;
+        } else {
+            pptrO_client->mptrO_waitHead = pptrO_client->mptrO_queueHead;
+        }
+        pptrO_client->mptrO_waitTail = pptrO_client->mptrO_queueTail;
+        pptrO_client->mptrO_queueHead = pptrO_client->mptrO_queueTail = NULL;
+    }
+    pthread_mutex_unlock(&pptrO_client->mO_lock);
+    //
+    while (pptrO_client->mptrO_waitHead != NULL && pptrO_client->mi_free > 0) {
+        struct ipc_clientRequest *lptrO_request = pptrO_client->mptrO_waitHead;
+        //
+        pptrO_client->mptrO_waitHead = lptrO_request->mptrO_next;
+        if (pptrO_client->mptrO_waitHead == NULL) {
+            pptrO_client->mptrO_waitTail = NULL;
+        }
+        //
+        struct ipc_clientConnection *lptrO_connection = &pptrO_client->mO_a1_connections[0];
+        //
+        for (int i = 1; i < pptrO_client->mi_connections; ++i) {
+            if (pptrO_client->mO_a1_connections[i].mui_inFlight < lptrO_connection->mui_inFlight) {
+                lptrO_connection = &pptrO_client->mO_a1_connections[i];
+            }
+        }
+        if (lptrO_connection->mi_socket_fd < 0 && fi_connectionOpen(lptrO_connection) < 0) {
+            fv_fail(lptrO_request, errno);
+            fv_requestFree(lptrO_request);
+            continue;
+        }
+        //
+        int                    li_slot = pptrO_client->mi_a1_free[--pptrO_client->mi_free];
+        struct ipc_clientSlot *lptrO_slot = &pptrO_client->mO_a1_slots[li_slot];
+        //
+        lptrO_slot->mi_connection = lptrO_connection->mi_index;
+        lptrO_slot->mpf_done = lptrO_request->mpf_done;
+        lptrO_slot->mptrv_context = lptrO_request->mptrv_context;
+        ++lptrO_connection->mui_inFlight;
+        //
+        // the header is only complete now that the request has an ID
+        struct ipc_frameHeader lO_header;
+        lO_header.mus_type = lptrO_request->mus_type;
+        lO_header.mui_requestID = lptrO_slot->mui_requestID;
+        lO_header.mul_length = lptrO_request->mul_length;
+        fv_frameHeaderEncode(&lO_header, (unsigned char *) lptrO_request->mptrO_frame->mptrc_data);
+        //
+        // the frame's buffers join the connection's output as they are: nothing is copied
+        struct ipc_buffer *lptrO_last = lptrO_request->mptrO_frame;
+        //
+        while (lptrO_last->mptrO_next != NULL) {
+            lptrO_last = lptrO_last->mptrO_next;
+        }
+        if (lptrO_connection->mptrO_outTail != NULL) {
+            lptrO_connection->mptrO_outTail->mptrO_next = lptrO_request->mptrO_frame;
+        } else {
+            lptrO_connection->mptrO_outHead = lptrO_request->mptrO_frame;
+        }
+        lptrO_connection->mptrO_outTail = lptrO_last;
+        lptrO_request->mptrO_frame = NULL;
+        fv_requestFree(lptrO_request);
+    }
+    //
+    // everything dispatched by this round leaves together, a system call per connection
+    for (int i = 0; i < pptrO_client->mi_connections; ++i) {
+        if (pptrO_client->mO_a1_connections[i].mptrO_outHead != NULL) {
+            fv_connectionFlush(&pptrO_client->mO_a1_connections[i]);
+        }
+    }
+}
+
+static void *fptrv_clientLoop(void *pptrv_client) {
+    struct ipc_client *lptrO_client = pptrv_client;
+    struct epoll_event lO_a1_events[CLIENT_MAX_EVENTS];
+    //
+    while (!atomic_load_explicit(&lptrO_client->mi_stop, memory_order_acquire)) {
+        int li_ready = epoll_wait(lptrO_client->mi_epoll_fd, lO_a1_events, CLIENT_MAX_EVENTS, -1);
+        //
+        for (int i = 0; i < li_ready; ++i) {
+            if (lO_a1_events[i].data.ptr == NULL) {
+                uint64_t lul_wakeups;
+                //
+                if (read(lptrO_client->mi_wake_fd, &lul_wakeups, sizeof(lul_wakeups)) < 0) {
+                    // EAGAIN: the counter was read already
+                }
+                continue;
+            }
+            fv_connectionEvents(lO_a1_events[i].data.ptr, lO_a1_events[i].events);
+        }
+        // replies freed slots, or new requests were queued
+        fv_clientDispatch(lptrO_client);
+    }
+    //
+    return NULL;
+}
+
+struct ipc_client *fptrO_clientCreate(const struct sockaddr *pptrO_address,
+                                      socklen_t              pui_addressSize,
+                                      int                    pi_connections) {
+    //
+    if (pi_connections < 1 || pi_connections > IPC_CLIENT_CONNECTIONS_MAX ||
+        pui_addressSize > sizeof(struct sockaddr_storage)) {
+        errno = EINVAL;
+        return NULL;
+    }
+    struct ipc_client *lptrO_client = calloc(1, sizeof(*lptrO_client));
+    //
+    if (lptrO_client == NULL) {
+        return NULL;
+    }
+    memcpy(&lptrO_client->mO_address, pptrO_address, pui_addressSize);
+    lptrO_client->mui_addressSize = pui_addressSize;
+    lptrO_client->mi_connections = pi_connections;
+    atomic_init(&lptrO_client->mi_stop, 0);
+    pthread_mutex_init(&lptrO_client->mO_lock, NULL);
+    //
+    for (int i = 0; i < pi_connections; ++i) {
+        lptrO_client->mO_a1_connections[i].mptrO_client = lptrO_client;
+        lptrO_client->mO_a1_connections[i].mi_index = i;
+        lptrO_client->mO_a1_connections[i].mi_socket_fd = -1;
+    }
+    // popped from the top: slot 0 goes first
+    for (int i = 0; i < IPC_CLIENT_INFLIGHT_MAX; ++i) {
+        lptrO_client->mO_a1_slots[i].mui_requestID = i;
+        lptrO_client->mO_a1_slots[i].mi_connection = -1;
+        lptrO_client->mi_a1_free[i] = IPC_CLIENT_INFLIGHT_MAX - 1 - i;
+    }
+    lptrO_client->mi_free = IPC_CLIENT_INFLIGHT_MAX;
+    //
+    lptrO_client->mi_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    lptrO_client->mi_wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    //
+    struct epoll_event lO_event;
+    lO_event.events = EPOLLIN;
+    lO_event.data.ptr = NULL;
+    //
+    int li_error = 0;
+    //
+    if (lptrO_client->mi_epoll_fd < 0 || lptrO_client->mi_wake_fd < 0 ||
+        epoll_ctl(lptrO_client->mi_epoll_fd, EPOLL_CTL_ADD, lptrO_client->mi_wake_fd, &lO_event) < 0) {
+        li_error = errno;
+    } else {
+        li_error = pthread_create(&lptrO_client->mO_thread, NULL, fptrv_clientLoop, lptrO_client);
+    }
+    if (li_error != 0) {
+        if (lptrO_client->mi_epoll_fd >= 0) {
+            close(lptrO_client->mi_epoll_fd);
+        }
+        if (lptrO_client->mi_wake_fd >= 0) {
+            close(lptrO_client->mi_wake_fd);
+        }
+        pthread_mutex_destroy(&lptrO_client->mO_lock);
+        free(lptrO_client);
+        errno = li_error;
+        return NULL;
+    }
+    //
+    return lptrO_client;
+}
+
+void fv_clientDestroy(struct ipc_client *pptrO_client) {
+    //
+    uint64_t lul_wakeup = 1;
+    //
+    atomic_store_explicit(&pptrO_client->mi_stop, 1, memory_order_release);
+    if (write(pptrO_client->mi_wake_fd, &lul_wakeup, sizeof(lul_wakeup)) < 0) {
+        // EAGAIN: the loop has a wakeup pending anyway
+    }
+    pthread_join(pptrO_client->mO_thread, NULL);
+    //
+    // the loop is gone: this thread owns everything now
+    for (int i = 0; i < pptrO_client->mi_connections; ++i) {
+        fv_connectionFail(&pptrO_client->mO_a1_connections[i], ECANCELED);
+        free(pptrO_client->mO_a1_connections[i].mptrc_reply);
+    }
+    struct ipc_clientRequest *lptrO_a1_lists[2] = { pptrO_client->mptrO_waitHead, pptrO_client->mptrO_queueHead };
+    //
+    for (int i = 0; i < 2; ++i) {
+        while (lptrO_a1_lists[i] != NULL) {
+            struct ipc_clientRequest *lptrO_request = lptrO_a1_lists[i];
+            //
+            lptrO_a1_lists[i] = lptrO_request->mptrO_next;
+            fv_fail(lptrO_request, ECANCELED);
+            fv_requestFree(lptrO_request);
+        }
+    }
+    close(pptrO_client->mi_epoll_fd);
+    close(pptrO_client->mi_wake_fd);
+    pthread_mutex_destroy(&pptrO_client->mO_lock);
+    free(pptrO_client);
+}
+
+int fi_clientSubmit(struct ipc_client *pptrO_client,
+                    uint16_t           pus_type,
+                    const void        *pptrv_payload,
+                    size_t             psz_length,
+                    void             (*pf_done)(void *pptrv_context, const struct ipc_clientReply *pptrO_reply),
+                    void              *pptrv_context) {
+    //
+    if (atomic_load_explicit(&pptrO_client->mi_stop, memory_order_acquire)) {
+        errno = ESHUTDOWN;
+        return -1;
+    }
+    struct ipc_clientRequest *lptrO_request = malloc(sizeof(*lptrO_request));
+    //
+    if (lptrO_request == NULL) {
+        return -1;
+    }
+    // the first buffer fits the whole frame when it can, and always the header
+    size_t lsz_frame = IPC_FRAME_HEADER_SIZE + psz_length;
+    //
+    lptrO_request->mptrO_next = NULL;
+    lptrO_request->mptrO_frame = fptrO_bufferGet(lsz_frame < IPC_POOL_LARGEST ? lsz_frame : IPC_POOL_LARGEST);
+    lptrO_request->mus_type = pus_type;
+    lptrO_request->mul_length = psz_length;
+    lptrO_request->mpf_done = pf_done;
+    lptrO_request->mptrv_context = pptrv_context;
+    //
+    if (lptrO_request->mptrO_frame == NULL) {
+        free(lptrO_request);
+        return -1;
+    }
+    // header room, filled in once the request has an ID
+    lptrO_request->mptrO_frame->mui_length = IPC_FRAME_HEADER_SIZE;
+    //
+    if (fi_bufferAppend(&lptrO_request->mptrO_frame, pptrv_payload, psz_length) < 0) {
+        fv_requestFree(lptrO_request);
+        return -1;
+    }
+    //
+    pthread_mutex_lock(&pptrO_client->mO_lock);
+    //
+    int li_wasEmpty = pptrO_client->mptrO_queueHead == NULL;
+    //
+    if (li_wasEmpty) {
+        pptrO_client->mptrO_queueHead = lptrO_request;
+    } else {
+        pptrO_client->mptrO_queueTail->mptrO_next = lptrO_request;
+    }
+    pptrO_client->mptrO_queueTail = lptrO_request;
+    //
+    pthread_mutex_unlock(&pptrO_client->mO_lock);
+    //
+    // a queue that was not empty has a wakeup on its way already
+    if (li_wasEmpty) {
+        uint64_t lul_wakeup = 1;
+        //
+        if (write(pptrO_client->mi_wake_fd, &lul_wakeup, sizeof(lul_wakeup)) < 0) {
+            // EAGAIN: the counter is saturated, the loop is awake anyway
+        }
+    }
+    //
+    return 0;
+}
+
+static void fv_futureComplete(void *pptrv_future, const struct ipc_clientReply *pptrO_reply) {
+    struct ipc_clientFuture *lptrO_future = pptrv_future;
+    //
+    pthread_mutex_lock(&lptrO_future->mO_lock);
+    //
+    lptrO_future->mO_reply = *pptrO_reply;
+    //
+    if (pptrO_reply->mi_error == 0) {
+        // the connection's reply buffer is reused by the next reply: keep a copy
+        char *lptrc_payload = malloc(pptrO_reply->msz_length + 1);
+        //
+        if (lptrc_payload == NULL) {
+            lptrO_future->mO_reply.mi_error = ENOMEM;
+            lptrO_future->mO_reply.mptrc_payload = NULL;
+        } else {
+            memcpy(lptrc_payload, pptrO_reply->mptrc_payload, pptrO_reply->msz_length + 1);
+            lptrO_future->mO_reply.mptrc_payload = lptrc_payload;
+        }
+    }
+    lptrO_future->mi_done = 1;
+    pthread_cond_signal(&lptrO_future->mO_done);
+    //
+    pthread_mutex_unlock(&lptrO_future->mO_lock);
+}
+
+int fi_clientCall(struct ipc_client       *pptrO_client,
+                  uint16_t                 pus_type,
+                  const void              *pptrv_payload,
+                  size_t                   psz_length,
+                  struct ipc_clientFuture *pptrO_future) {
+    //
+    memset(&pptrO_future->mO_reply, 0, sizeof(pptrO_future->mO_reply));
+    pptrO_future->mi_done = 0;
+    pthread_mutex_init(&pptrO_future->mO_lock, NULL);
+    pthread_cond_init(&pptrO_future->mO_done, NULL);
+    //
+    if (fi_clientSubmit(pptrO_client, pus_type, pptrv_payload, psz_length, fv_futureComplete, pptrO_future) < 0) {
+        int li_errno = errno;
+        pthread_cond_destroy(&pptrO_future->mO_done);
+        pthread_mutex_destroy(&pptrO_future->mO_lock);
+        errno = li_errno;
+        return -1;
+    }
+    //
+    return 0;
+}
+
+const struct ipc_clientReply *fptrO_clientWait(struct ipc_clientFuture *pptrO_future) {
+    //
+    pthread_mutex_lock(&pptrO_future->mO_lock);
+    //
+    while (!pptrO_future->mi_done) {
+        pthread_cond_wait(&pptrO_future->mO_done, &pptrO_future->mO_lock);
+    }
+    pthread_mutex_unlock(&pptrO_future->mO_lock);
+    //
+    return &pptrO_future->mO_reply;
+}
+
+void fv_clientFutureRelease(struct ipc_clientFuture *pptrO_future) {
+    free((char *) pptrO_future->mO_reply.mptrc_payload);
+    pthread_cond_destroy(&pptrO_future->mO_done);
+    pthread_mutex_destroy(&pptrO_future->mO_lock);
+}
@@ -0,0 +1,95 @@
+/*
+ * Asynchronous client library
+ * A pool of persistent framed connections to one server, driven by an epoll loop
+ * on a thread of its own: application threads only queue requests, and get the replies
+ * through a callback or a future, without ever connecting or blocking on read() themselves
+ * Each request goes to the connection of the pool with the fewest requests in flight,
+ * pipelined behind the others; replies are matched to their requests by request ID,
+ * in whatever order they come back
+ * Connections are opened (without blocking) when first needed; a connection that breaks
+ * fails its requests in flight with the error, and is opened again for the next ones
+ */
+#ifndef IPC_CLIENT_H
+#define IPC_CLIENT_H
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// most connections in a pool
+#define IPC_CLIENT_CONNECTIONS_MAX 64
+// most requests in flight per client, a power of 2; more wait in the queue
+#define IPC_CLIENT_INFLIGHT_MAX    4096
+// largest reply payload accepted; a larger one breaks its connection (EMSGSIZE)
+#define IPC_CLIENT_REPLY_MAX       (64 * 1024 * 1024)
+
+struct ipc_client;
+
+// outcome of one request
+struct ipc_clientReply {
+    // 0, or the errno of the failure (the other fields are then unset)
+    int         mi_error;
+    // reply frame: e.g., IPC_FRAME_ACK, IPC_FRAME_DATA or IPC_FRAME_ERROR
+    uint16_t    mus_type;
+    uint32_t    mui_requestID;
+    // NUL-terminated for convenience; in a callback, valid until it returns
+    const char *mptrc_payload;
+    size_t      msz_length;
+};
+
+// a reply to wait for, see fi_clientCall()
+struct ipc_clientFuture {
+    pthread_mutex_t        mO_lock;
+    pthread_cond_t         mO_done;
+    int                    mi_done;
+    // payload copied, owned by the future
+    struct ipc_clientReply mO_reply;
+};
+
+/*
+ * Create a pool of up to pi_connections connections to the server at pptrO_address
+ * (TCP or Unix domain stream socket) and start its event loop
+ * Returns NULL (with errno set)
+ */
+struct ipc_client *fptrO_clientCreate(const struct sockaddr *pptrO_address,
+                                      socklen_t              pui_addressSize,
+                                      int                    pi_connections);
+
+/*
+ * Stop the event loop and close the pool
+ * Requests not answered by then complete with ECANCELED, on the calling thread
+ */
+void fv_clientDestroy(struct ipc_client *pptrO_client);
+
+/*
+ * Queue a request frame; safe from any thread, including from a callback
+ * The payload is copied: the caller may reuse it at once
+ * pf_done is called exactly once, on the event loop thread, with the reply or the failure;
+ * it must not block
+ * Returns 0, or -1 (with errno set; pf_done is then never called)
+ */
+int fi_clientSubmit(struct ipc_client *pptrO_client,
+                    uint16_t           pus_type,
+                    const void        *pptrv_payload,
+                    size_t             psz_length,
+                    void             (*pf_done)(void *pptrv_context, const struct ipc_clientReply *pptrO_reply),
+                    void              *pptrv_context);
+
+/*
+ * Same, completing pptrO_future instead of calling back
+ * Wait for it with fptrO_clientWait(), then give it back with fv_clientFutureRelease()
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_clientCall(struct ipc_client       *pptrO_client,
+                  uint16_t                 pus_type,
+                  const void              *pptrv_payload,
+                  size_t                   psz_length,
+                  struct ipc_clientFuture *pptrO_future);
+
+// block until the future is complete; its reply stays valid until it is released
+const struct ipc_clientReply *fptrO_clientWait(struct ipc_clientFuture *pptrO_future);
+
+void fv_clientFutureRelease(struct ipc_clientFuture *pptrO_future);
+
+#endif  // IPC_CLIENT_H
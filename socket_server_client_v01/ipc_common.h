@@ -0,0 +1,16 @@
+/*
+ * Definitions shared by the client, the servers and their serving modes
+ */
+#ifndef IPC_COMMON_H
+#define IPC_COMMON_H
+
+// size of the buffer that a single message is read into
+#define BUFFER_SIZE 1024
+
+// reply sent back to the client for every message the server receives
+#define IPC_ACKNOWLEDGE "I received your message."
+
+// reply sent instead, and the connection closed, when the server is at its connection limit
+#define IPC_REJECT "Server busy, try again later."
+
+#endif  // IPC_COMMON_H
@@ -0,0 +1,351 @@
+/*
+ * Event-loop serving mode
+ * One process, one thread, one edge-triggered epoll instance
+ * All sockets are non-blocking, so a slow client never stalls the others
+ * Deadlines (-T) run on a timing wheel, checked after every batch of events
+ * References:
+ *  man 7 epoll
+ *  man 2 accept4
+ */
+#define _GNU_SOURCE  // accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#include "ipc_common.h"
+#include "ipc_epoll.h"
+#include "ipc_pool.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+#include "ipc_accept.h"
+#include "ipc_service.h"
+#include "ipc_handoff.h"
+#include "ipc_kv.h"
+#include "ipc_timer.h"
+
+// number of ready events collected by a single epoll_wait()
+#define EPOLL_MAX_EVENTS 256
+
+// connections open, for a hot restart to wait for
+static int gi_connections;
+// event tag of the handoff notification, told apart from connections by its address
+static int gi_handoffTag;
+// deadlines of the connections (with -T)
+static struct ipc_timerWheel gO_wheel;
+
+// states a connection moves through, in this order
+enum ipc_connectionState {
+    IPC_CONN_READING,   // waiting for the client's message
+    IPC_CONN_WRITING,   // sending the acknowledgement (or a key-value result) back
+    IPC_CONN_CLOSED     // done, the socket can be released
+};
+
+// per-connection bookkeeping, owned by the event loop
+struct ipc_connection {
+    int                      mi_socketRW_fd;
+    enum ipc_connectionState me_state;
+    // bytes of the acknowledgement already sent
+    size_t                   msz_sent;
+    // no buffer of its own: an idle connection costs this struct and nothing more;
+    // only the result of a key-value command borrows one, until it is sent (NULL: acknowledge)
+    struct ipc_buffer       *mptrO_reply;
+    size_t                   msz_reply;
+    // the deadline of the state it is in (with -T)
+    struct ipc_timer         mO_deadline;
+};
+
+/*
+ * <optional>
+ * every connection holds one descriptor,
+ * so lift the soft limit on open files up to the hard limit
+ */
+static void fv_raiseFileLimit(void) {
+    struct rlimit lO_limit;
+    //
+    if (getrlimit(RLIMIT_NOFILE, &lO_limit) == 0 &&
+        lO_limit.rlim_cur < lO_limit.rlim_max) {
+        lO_limit.rlim_cur = lO_limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &lO_limit);
+    }
+}
+
+static void fv_connectionClose(struct ipc_connection *pptrO_connection) {
+    fv_metricsClose(pptrO_connection->mi_socketRW_fd);
+    fv_admissionLeave();
+    --gi_connections;
+    fv_timerCancel(&gO_wheel, &pptrO_connection->mO_deadline);
+    // closing the descriptor also removes it from the epoll interest list
+    close(pptrO_connection->mi_socketRW_fd);
+    fv_bufferRelease(pptrO_connection->mptrO_reply);
+    free(pptrO_connection);
+}
+
+/*
+ * Move the connection as far as it can go without blocking
+ * Edge-triggered epoll reports readiness only once,
+ * so every step runs until it completes or the kernel answers EAGAIN
+ */
+static void fv_connectionAdvance(struct ipc_connection *pptrO_connection) {
+    //
+    if (pptrO_connection->me_state == IPC_CONN_READING) {
+        // borrowed only for the read and the print that follows it
+        struct ipc_buffer *lptrO_buffer = fptrO_bufferGet(BUFFER_SIZE);
+        //
+        if (lptrO_buffer == NULL) {
+            IPC_LOGE("ERROR allocating buffer: %m");
+            fv_connectionClose(pptrO_connection);
+            return;
+        }
+        // like fv_serve(), whatever the first read returns is the message
+        ssize_t li_n = read(pptrO_connection->mi_socketRW_fd,
+                            lptrO_buffer->mptrc_data,
+                            BUFFER_SIZE - 1);
+        //
+        if (li_n > 0) {
+            fv_metricsRead(pptrO_connection->mi_socketRW_fd, li_n);
+            lptrO_buffer->mptrc_data[li_n] = '\0';
+            IPC_LOGI("[Client]: %s", lptrO_buffer->mptrc_data);
+            //
+            // a key-value command (with -K): its result is sent instead of the acknowledgement
+            if (fi_kvEnabled() && (pptrO_connection->mptrO_reply = fptrO_bufferGet(BUFFER_SIZE)) != NULL) {
+                pptrO_connection->msz_reply = fsz_kvExecute(lptrO_buffer->mptrc_data, li_n,
+                                                            pptrO_connection->mptrO_reply->mptrc_data, BUFFER_SIZE);
+                if (pptrO_connection->msz_reply == 0) {
+                    fv_bufferRelease(pptrO_connection->mptrO_reply);
+                    pptrO_connection->mptrO_reply = NULL;
+                }
+            }
+            // simulated work holds up every other connection too, as real work would here
+            fv_serviceSimulate();
+        }
+        fv_bufferRelease(lptrO_buffer);
+        //
+        if (li_n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                // nothing to read yet, wait for the next EPOLLIN edge
+                return;
+            }
+            IPC_LOGE("ERROR reading from socket: %m");
+            fv_metricsError(errno);
+            pptrO_connection->me_state = IPC_CONN_CLOSED;
+        } else if (li_n == 0) {
+            // client went away without sending anything
+            pptrO_connection->me_state = IPC_CONN_CLOSED;
+        } else {
+            pptrO_connection->msz_sent = 0;
+            pptrO_connection->me_state = IPC_CONN_WRITING;
+            //
+            // from now on, the client has so long to take the reply
+            if (fi_timeoutWrite() > 0) {
+                fv_timerArm(&gO_wheel, &pptrO_connection->mO_deadline, fi_timeoutWrite());
+            } else {
+                fv_timerCancel(&gO_wheel, &pptrO_connection->mO_deadline);
+            }
+        }
+    }
+    //
+    if (pptrO_connection->me_state == IPC_CONN_WRITING) {
+        const char *lptrc_acknowledge = IPC_ACKNOWLEDGE;
+        size_t      lsz_length = strlen(lptrc_acknowledge);
+        //
+        if (pptrO_connection->mptrO_reply != NULL) {
+            lptrc_acknowledge = pptrO_connection->mptrO_reply->mptrc_data;
+            lsz_length = pptrO_connection->msz_reply;
+        }
+        //
+        while (pptrO_connection->msz_sent < lsz_length) {
+            // MSG_NOSIGNAL: a vanished client must not kill the whole server with SIGPIPE
+            ssize_t li_n = send(pptrO_connection->mi_socketRW_fd,
+                                lptrc_acknowledge + pptrO_connection->msz_sent,
+                                lsz_length - pptrO_connection->msz_sent,
+                                MSG_NOSIGNAL);
+            //
+            if (li_n < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                    // socket buffer is full, wait for the next EPOLLOUT edge
+                    return;
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                IPC_LOGE("ERROR writing to socket: %m");
+                fv_metricsError(errno);
+                pptrO_connection->me_state = IPC_CONN_CLOSED;
+                break;
+            }
+            pptrO_connection->msz_sent += li_n;
+        }
+        //
+        if (pptrO_connection->me_state == IPC_CONN_WRITING) {
+            fv_metricsSend(pptrO_connection->mi_socketRW_fd, lsz_length, 1);
+            IPC_LOGI("Acknowledgement message sent");
+            pptrO_connection->me_state = IPC_CONN_CLOSED;
+        }
+    }
+    //
+    if (pptrO_connection->me_state == IPC_CONN_CLOSED) {
+        fv_connectionClose(pptrO_connection);
+    }
+}
+
+// a deadline passed: the client is too slow, or gone without a word
+static void fv_connectionExpire(struct ipc_timer *pptrO_timer, void *pptrv_context) {
+    struct ipc_connection *lptrO_connection = IPC_TIMER_OWNER(pptrO_timer, struct ipc_connection, mO_deadline);
+    //
+    (void) pptrv_context;
+    IPC_LOGI("Connection %s for too long, closed",
+             lptrO_connection->me_state == IPC_CONN_READING ? "idle" : "not taking its reply");
+    fv_metricsError(ETIMEDOUT);
+    fv_connectionClose(lptrO_connection);
+}
+
+/*
+ * Drain the accept queue of the listening socket
+ * With edge-triggered notification, one wakeup may stand for many pending connections
+ */
+static void fv_acceptAll(int pi_epoll_fd, int pi_socketConn_fd) {
+    //
+    while (1) {
+        // accepted sockets are non-blocking from the start, no extra fcntl() needed
+        int li_socketRW_fd = accept4(pi_socketConn_fd,
+                                     NULL,
+                                     NULL,
+                                     SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (li_socketRW_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // e.g., EMFILE: keep serving the connections already open
+                IPC_LOGE("accept4: %m");
+                fv_metricsError(errno);
+            }
+            return;
+        }
+        // <optional>
+        // at the limit: turned away before it costs any bookkeeping
+        if (!fi_admissionEnter()) {
+            fv_admissionReject(li_socketRW_fd);
+            continue;
+        }
+        //
+        struct ipc_connection *lptrO_connection = malloc(sizeof(*lptrO_connection));
+        //
+        if (lptrO_connection == NULL) {
+            IPC_LOGE("malloc: %m");
+            close(li_socketRW_fd);
+            fv_admissionLeave();
+            continue;
+        }
+        fv_metricsAccept(li_socketRW_fd);
+        ++gi_connections;
+        lptrO_connection->mi_socketRW_fd = li_socketRW_fd;
+        lptrO_connection->me_state = IPC_CONN_READING;
+        lptrO_connection->msz_sent = 0;
+        lptrO_connection->mptrO_reply = NULL;
+        lptrO_connection->mO_deadline.mptrO_next = NULL;
+        //
+        // a client that connects and sends nothing holds its descriptor only so long
+        if (fi_timeoutIdle() > 0) {
+            fv_timerArm(&gO_wheel, &lptrO_connection->mO_deadline, fi_timeoutIdle());
+        }
+        //
+        // ask for both directions once, so the state machine never has to re-arm
+        struct epoll_event lO_event;
+        lO_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        lO_event.data.ptr = lptrO_connection;
+        //
+        if (epoll_ctl(pi_epoll_fd, EPOLL_CTL_ADD, li_socketRW_fd, &lO_event) < 0) {
+            IPC_LOGE("epoll_ctl: %m");
+            fv_connectionClose(lptrO_connection);
+        }
+    }
+}
+
+int fi_epollServe(int pi_socketConn_fd) {
+    //
+    fv_raiseFileLimit();
+    //
+    // the listening socket must not block either, or draining its queue would hang
+    int li_flags = fcntl(pi_socketConn_fd, F_GETFL, 0);
+    //
+    if (li_flags < 0 ||
+        fcntl(pi_socketConn_fd, F_SETFL, li_flags | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    //
+    int li_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    //
+    if (li_epoll_fd < 0) {
+        return -1;
+    }
+    //
+    // the listening socket is the only entry without a connection attached
+    struct epoll_event lO_event;
+    lO_event.events = EPOLLIN | EPOLLET;
+    lO_event.data.ptr = NULL;
+    //
+    if (epoll_ctl(li_epoll_fd, EPOLL_CTL_ADD, pi_socketConn_fd, &lO_event) < 0) {
+        close(li_epoll_fd);
+        return -1;
+    }
+    //
+    // <optional>
+    // hot restart: once the listening socket is handed over, stop accepting
+    lO_event.events = EPOLLIN;
+    lO_event.data.ptr = &gi_handoffTag;
+    //
+    if (fi_handoffStopFd() >= 0 &&
+        epoll_ctl(li_epoll_fd, EPOLL_CTL_ADD, fi_handoffStopFd(), &lO_event) < 0) {
+        close(li_epoll_fd);
+        return -1;
+    }
+    //
+    struct epoll_event lO_a1_events[EPOLL_MAX_EVENTS];
+    int                li_accepting = 1;
+    //
+    fv_timerWheelInit(&gO_wheel, ful_timerNow());
+    //
+    // after a handoff, only until the connections still open are done
+    while (li_accepting || gi_connections > 0) {
+        // without deadlines, or none armed, the wait is unbounded
+        int li_ready = epoll_wait(li_epoll_fd, lO_a1_events, EPOLL_MAX_EVENTS,
+                                  fi_timerWheelTimeout(&gO_wheel, ful_timerNow()));
+        //
+        if (li_ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            close(li_epoll_fd);
+            return -1;
+        }
+        //
+        for (int i = 0; i < li_ready; ++i) {
+            if (lO_a1_events[i].data.ptr == NULL) {
+                if (li_accepting) {
+                    fv_acceptAll(li_epoll_fd, pi_socketConn_fd);
+                }
+            } else if (lO_a1_events[i].data.ptr == &gi_handoffTag) {
+                // the successor accepts from the same socket: leave the rest of the queue to it
+                epoll_ctl(li_epoll_fd, EPOLL_CTL_DEL, pi_socketConn_fd, NULL);
+                epoll_ctl(li_epoll_fd, EPOLL_CTL_DEL, fi_handoffStopFd(), NULL);
+                li_accepting = 0;
+            } else {
+                fv_connectionAdvance(lO_a1_events[i].data.ptr);
+            }
+        }
+        // every deadline passed meanwhile, in one go: none of the events above refers to them any more
+        ful_timerWheelAdvance(&gO_wheel, ful_timerNow(), fv_connectionExpire, NULL);
+    } // end of event loop
+    //
+    close(li_epoll_fd);
+    //
+    return 0;
+}
@@ -0,0 +1,21 @@
+/*
+ * Event-loop serving mode
+ * A single process multiplexes every connection with an edge-triggered epoll
+ * instance, instead of forking off a new process for each one
+ */
+#ifndef IPC_EPOLL_H
+#define IPC_EPOLL_H
+
+/*
+ * Serve all connections arriving on the listening socket, pi_socketConn_fd,
+ * from one thread of this process
+ * Each connection is driven by a small state machine,
+ *  READING -> WRITING -> closed,
+ * that behaves like fv_serve(): one message is read, printed and acknowledged
+ * A connection past its idle or write deadline (see ipc_timer.h) is closed
+ * Runs until the listening socket is handed to a successor (see ipc_handoff.h), then returns 0
+ * once the connections still open are done; returns -1 (with errno set) if the loop cannot be set up
+ */
+int fi_epollServe(int pi_socketConn_fd);
+
+#endif  // IPC_EPOLL_H
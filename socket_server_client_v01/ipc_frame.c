@@ -0,0 +1,251 @@
+/*
+ * Length-prefixed framing of messages on a byte stream
+ * The parser is a two-state machine, HEADER -> PAYLOAD -> HEADER ...,
+ * that never buffers a payload: it hands out each chunk as soon as it is fed,
+ * so a frame of any size can be streamed through a BUFFER_SIZE read buffer
+ */
+#define _DEFAULT_SOURCE  // htobe64() and friends
+#include <endian.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ipc_frame.h"
+
+void fv_frameHeaderEncode(const struct ipc_frameHeader *pptrO_header,
+                          unsigned char                 puc_a1_out[IPC_FRAME_HEADER_SIZE]) {
+    uint16_t lus_type = htobe16(pptrO_header->mus_type);
+    uint32_t lui_requestID = htobe32(pptrO_header->mui_requestID);
+    uint64_t lul_length = htobe64(pptrO_header->mul_length);
+    //
+    puc_a1_out[0] = IPC_FRAME_MAGIC;
+    puc_a1_out[1] = IPC_FRAME_VERSION;
+    memcpy(puc_a1_out + 2, &lus_type, sizeof(lus_type));
+    memcpy(puc_a1_out + 4, &lui_requestID, sizeof(lui_requestID));
+    memcpy(puc_a1_out + 8, &lul_length, sizeof(lul_length));
+}
+
+int fi_frameHeaderDecode(const unsigned char     puc_a1_in[IPC_FRAME_HEADER_SIZE],
+                         struct ipc_frameHeader *pptrO_header) {
+    //
+    if (puc_a1_in[0] != IPC_FRAME_MAGIC || puc_a1_in[1] != IPC_FRAME_VERSION) {
+        return -1;
+    }
+    //
+    uint16_t lus_type;
+    uint32_t lui_requestID;
+    uint64_t lul_length;
+    //
+    memcpy(&lus_type, puc_a1_in + 2, sizeof(lus_type));
+    memcpy(&lui_requestID, puc_a1_in + 4, sizeof(lui_requestID));
+    memcpy(&lul_length, puc_a1_in + 8, sizeof(lul_length));
+    //
+    pptrO_header->mus_type = be16toh(lus_type);
+    pptrO_header->mui_requestID = be32toh(lui_requestID);
+    pptrO_header->mul_length = be64toh(lul_length);
+    //
+    return 0;
+}
+
+void fv_frameParserInit(struct ipc_frameParser        *pptrO_parser,
+                        const struct ipc_frameHandler *pptrO_handler,
+                        void                          *pptrv_context) {
+    memset(pptrO_parser, 0, sizeof(*pptrO_parser));
+    pptrO_parser->mptrO_handler = pptrO_handler;
+    pptrO_parser->mptrv_context = pptrv_context;
+}
+
+// the frame in progress is complete: report it and go back to expecting a header
+static int fi_frameEnd(struct ipc_frameParser *pptrO_parser) {
+    pptrO_parser->mi_inPayload = 0;
+    pptrO_parser->msz_headerFilled = 0;
+    //
+    if (pptrO_parser->mptrO_handler->mpf_onEnd != NULL) {
+        return pptrO_parser->mptrO_handler->mpf_onEnd(pptrO_parser->mptrv_context,
+                                                      &pptrO_parser->mO_header);
+    }
+    return 0;
+}
+
+int fi_frameParserFeed(struct ipc_frameParser *pptrO_parser,
+                       const char             *pptrc_data,
+                       size_t                  psz_length) {
+    const struct ipc_frameHandler *lptrO_handler = pptrO_parser->mptrO_handler;
+    int                            li_result;
+    //
+    while (psz_length > 0) {
+        //
+        if (!pptrO_parser->mi_inPayload) {
+            // collect the header, it may arrive split over several reads
+            size_t lsz_take = IPC_FRAME_HEADER_SIZE - pptrO_parser->msz_headerFilled;
+            if (lsz_take > psz_length) {
+                lsz_take = psz_length;
+            }
+            memcpy(pptrO_parser->muc_a1_header + pptrO_parser->msz_headerFilled, pptrc_data, lsz_take);
+            pptrO_parser->msz_headerFilled += lsz_take;
+            pptrc_data += lsz_take;
+            psz_length -= lsz_take;
+            //
+            if (pptrO_parser->msz_headerFilled < IPC_FRAME_HEADER_SIZE) {
+                return 0;
+            }
+            //
+            if (fi_frameHeaderDecode(pptrO_parser->muc_a1_header, &pptrO_parser->mO_header) < 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            pptrO_parser->mul_remaining = pptrO_parser->mO_header.mul_length;
+            pptrO_parser->mi_inPayload = 1;
+            //
+            if (lptrO_handler->mpf_onHeader != NULL &&
+                (li_result = lptrO_handler->mpf_onHeader(pptrO_parser->mptrv_context,
+                                                         &pptrO_parser->mO_header)) != 0) {
+                return li_result;
+            }
+            //
+            // an empty payload ends the frame right away
+            if (pptrO_parser->mul_remaining == 0 &&
+                (li_result = fi_frameEnd(pptrO_parser)) != 0) {
+                return li_result;
+            }
+            continue;
+        }
+        //
+        // payload: hand out as much of it as this buffer holds, without copying
+        size_t lsz_chunk = psz_length;
+        if (lsz_chunk > pptrO_parser->mul_remaining) {
+            lsz_chunk = (size_t) pptrO_parser->mul_remaining;
+        }
+        pptrO_parser->mul_remaining -= lsz_chunk;
+        //
+        if (lptrO_handler->mpf_onPayload != NULL &&
+            (li_result = lptrO_handler->mpf_onPayload(pptrO_parser->mptrv_context,
+                                                      &pptrO_parser->mO_header,
+                                                      pptrc_data, lsz_chunk)) != 0) {
+            return li_result;
+        }
+        pptrc_data += lsz_chunk;
+        psz_length -= lsz_chunk;
+        //
+        if (pptrO_parser->mul_remaining == 0 &&
+            (li_result = fi_frameEnd(pptrO_parser)) != 0) {
+            return li_result;
+        }
+    }
+    //
+    return 0;
+}
+
+size_t fsz_frameEncode(void       *pptrv_out,
+                       size_t      psz_room,
+                       uint16_t    pus_type,
+                       uint32_t    pui_requestID,
+                       const void *pptrv_payload,
+                       uint64_t    pul_length) {
+    //
+    if (psz_room < IPC_FRAME_HEADER_SIZE || psz_room - IPC_FRAME_HEADER_SIZE < pul_length) {
+        return 0;
+    }
+    //
+    struct ipc_frameHeader lO_header;
+    //
+    lO_header.mus_type = pus_type;
+    lO_header.mui_requestID = pui_requestID;
+    lO_header.mul_length = pul_length;
+    fv_frameHeaderEncode(&lO_header, pptrv_out);
+    //
+    if (pul_length > 0) {
+        memcpy((unsigned char *) pptrv_out + IPC_FRAME_HEADER_SIZE, pptrv_payload, (size_t) pul_length);
+    }
+    //
+    return IPC_FRAME_HEADER_SIZE + (size_t) pul_length;
+}
+
+int fi_writeAll(int pi_socket_fd, const void *pptrv_data, size_t psz_length) {
+    const char *lptrc_data = pptrv_data;
+    //
+    while (psz_length > 0) {
+        ssize_t li_n = send(pi_socket_fd, lptrc_data, psz_length, MSG_NOSIGNAL);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        lptrc_data += li_n;
+        psz_length -= li_n;
+    }
+    //
+    return 0;
+}
+
+int fi_frameSendv(int                 pi_socket_fd,
+                  uint16_t            pus_type,
+                  uint32_t            pui_requestID,
+                  const struct iovec *pptrO_a1_parts,
+                  int                 pi_parts) {
+    //
+    if (pi_parts < 0 || pi_parts > IPC_FRAME_PARTS_MAX) {
+        errno = EINVAL;
+        return -1;
+    }
+    //
+    struct ipc_frameHeader lO_header;
+    unsigned char          luc_a1_header[IPC_FRAME_HEADER_SIZE];
+    struct iovec           lO_a1_parts[1 + IPC_FRAME_PARTS_MAX];
+    //
+    lO_header.mus_type = pus_type;
+    lO_header.mui_requestID = pui_requestID;
+    lO_header.mul_length = 0;
+    lO_a1_parts[0].iov_base = luc_a1_header;
+    lO_a1_parts[0].iov_len = IPC_FRAME_HEADER_SIZE;
+    //
+    for (int i = 0; i < pi_parts; ++i) {
+        lO_a1_parts[1 + i] = pptrO_a1_parts[i];
+        lO_header.mul_length += pptrO_a1_parts[i].iov_len;
+    }
+    fv_frameHeaderEncode(&lO_header, luc_a1_header);
+    //
+    // header and payload leave in one system call (and one segment, if they fit)
+    struct msghdr lO_message;
+    memset(&lO_message, 0, sizeof(lO_message));
+    lO_message.msg_iov = lO_a1_parts;
+    lO_message.msg_iovlen = 1 + pi_parts;
+    //
+    while (lO_message.msg_iovlen > 0) {
+        ssize_t li_n = sendmsg(pi_socket_fd, &lO_message, MSG_NOSIGNAL);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // after a short write, resume where it stopped: skip the parts sent, trim the one cut
+        while (lO_message.msg_iovlen > 0 && (size_t) li_n >= lO_message.msg_iov->iov_len) {
+            li_n -= lO_message.msg_iov->iov_len;
+            ++lO_message.msg_iov;
+            --lO_message.msg_iovlen;
+        }
+        if (lO_message.msg_iovlen > 0) {
+            lO_message.msg_iov->iov_base = (char *) lO_message.msg_iov->iov_base + li_n;
+            lO_message.msg_iov->iov_len -= li_n;
+        }
+    }
+    //
+    return 0;
+}
+
+int fi_frameSend(int         pi_socket_fd,
+                 uint16_t    pus_type,
+                 uint32_t    pui_requestID,
+                 const void *pptrv_payload,
+                 uint64_t    pul_length) {
+    //
+    struct iovec lO_payload = { (void *) pptrv_payload, (size_t) pul_length };
+    //
+    return fi_frameSendv(pi_socket_fd, pus_type, pui_requestID, &lO_payload, pul_length > 0 ? 1 : 0);
+}
@@ -0,0 +1,132 @@
+/*
+ * Length-prefixed framing of messages on a byte stream
+ * Every message is a fixed 16-byte header followed by its payload:
+ *
+ *  0      1        2        4             8                      16
+ *  +------+--------+--------+-------------+----------------------+---------...
+ *  | 0xC1 | version|  type  | request ID  |   payload length     | payload
+ *  +------+--------+--------+-------------+----------------------+---------...
+ *
+ * All header fields are in network byte order (BIG-endian)
+ * The magic byte is never the first byte of a text message, so a server can
+ * tell a framed client from one sending a plain text line
+ */
+#ifndef IPC_FRAME_H
+#define IPC_FRAME_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#define IPC_FRAME_MAGIC       0xC1
+#define IPC_FRAME_VERSION     1
+#define IPC_FRAME_HEADER_SIZE 16
+// most payload pieces fi_frameSendv() gathers (the header takes one more iovec)
+#define IPC_FRAME_PARTS_MAX   64
+
+// what a frame carries
+enum ipc_frameType {
+    IPC_FRAME_REQUEST = 1,  // message from a client
+    IPC_FRAME_ACK     = 2,  // server's acknowledgement of a request, same request ID
+    IPC_FRAME_FETCH   = 3,  // client asks for bulk data, the payload names it
+    IPC_FRAME_DATA    = 4,  // the bulk data fetched, same request ID
+    IPC_FRAME_ERROR   = 5,  // a request could not be served, the payload says why
+    IPC_FRAME_MESSAGE = 6,  // a binary message (see ipc_message.h); answered by one, same request ID
+    // publish/subscribe (see ipc_broker.h); the server ACKs each request, same request ID
+    IPC_FRAME_SUBSCRIBE   = 7,  // the payload names a topic
+    IPC_FRAME_UNSUBSCRIBE = 8,
+    IPC_FRAME_PUBLISH     = 9,  // the payload is a topic, a NUL byte, then the message
+    IPC_FRAME_EVENT       = 10  // a message published to a topic subscribed to, request ID 0
+};
+
+struct ipc_frameHeader {
+    uint16_t mus_type;
+    uint32_t mui_requestID;
+    uint64_t mul_length;
+};
+
+// called by the parser; a non-zero return stops parsing and is passed back to the caller
+struct ipc_frameHandler {
+    // a header was parsed, mul_length payload bytes will follow
+    int (*mpf_onHeader)(void *pptrv_context, const struct ipc_frameHeader *pptrO_header);
+    // the next chunk of the payload, pointing into the buffer that was fed
+    int (*mpf_onPayload)(void *pptrv_context, const struct ipc_frameHeader *pptrO_header,
+                         const char *pptrc_chunk, size_t psz_chunk);
+    // the whole payload was delivered
+    int (*mpf_onEnd)(void *pptrv_context, const struct ipc_frameHeader *pptrO_header);
+};
+
+// incremental parser state, one per connection
+struct ipc_frameParser {
+    const struct ipc_frameHandler *mptrO_handler;
+    void                          *mptrv_context;
+    // header bytes received so far
+    unsigned char                  muc_a1_header[IPC_FRAME_HEADER_SIZE];
+    size_t                         msz_headerFilled;
+    // header of the frame in progress, and how much of its payload is still to come
+    struct ipc_frameHeader         mO_header;
+    uint64_t                       mul_remaining;
+    int                            mi_inPayload;
+};
+
+void fv_frameHeaderEncode(const struct ipc_frameHeader *pptrO_header,
+                          unsigned char                 puc_a1_out[IPC_FRAME_HEADER_SIZE]);
+
+/*
+ * Returns -1 if the bytes are not a header this version understands
+ */
+int fi_frameHeaderDecode(const unsigned char     puc_a1_in[IPC_FRAME_HEADER_SIZE],
+                         struct ipc_frameHeader *pptrO_header);
+
+void fv_frameParserInit(struct ipc_frameParser        *pptrO_parser,
+                        const struct ipc_frameHandler *pptrO_handler,
+                        void                          *pptrv_context);
+
+/*
+ * Feed the next psz_length bytes read from the stream, however they were split
+ * Handlers are called for every header, payload chunk and frame end found
+ * Returns 0, the first non-zero handler result, or -1 (errno EPROTO) on a malformed header
+ */
+int fi_frameParserFeed(struct ipc_frameParser *pptrO_parser,
+                       const char             *pptrc_data,
+                       size_t                  psz_length);
+
+/*
+ * Encode one whole frame, header and payload, into pptrv_out
+ * Returns the number of bytes written, or 0 if they do not fit into psz_room
+ */
+size_t fsz_frameEncode(void       *pptrv_out,
+                       size_t      psz_room,
+                       uint16_t    pus_type,
+                       uint32_t    pui_requestID,
+                       const void *pptrv_payload,
+                       uint64_t    pul_length);
+
+/*
+ * Write all psz_length bytes to a blocking socket, resuming after short writes
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_writeAll(int pi_socket_fd, const void *pptrv_data, size_t psz_length);
+
+/*
+ * Write one whole frame, header and payload, with a single gathering write when possible
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_frameSend(int         pi_socket_fd,
+                 uint16_t    pus_type,
+                 uint32_t    pui_requestID,
+                 const void *pptrv_payload,
+                 uint64_t    pul_length);
+
+/*
+ * Same, with a payload gathered from pi_parts pieces (at most IPC_FRAME_PARTS_MAX),
+ * e.g. a chain of pooled buffers (see fi_bufferChainIovec())
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_frameSendv(int                 pi_socket_fd,
+                  uint16_t            pus_type,
+                  uint32_t            pui_requestID,
+                  const struct iovec *pptrO_a1_parts,
+                  int                 pi_parts);
+
+#endif  // IPC_FRAME_H
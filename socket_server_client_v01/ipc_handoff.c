@@ -0,0 +1,236 @@
+/*
+ * Hot restart: handing the listening socket to a new server
+ * References:
+ *  man 7 unix (SCM_RIGHTS)
+ *  https://engineering.fb.com/2020/10/21/production-engineering/zero-downtime-release/
+ */
+#define _GNU_SOURCE  // accept4()
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ipc_handoff.h"
+#include "ipc_log.h"
+
+// one byte goes along with the descriptor, and one comes back once the successor serves
+#define HANDOFF_LISTENER 'L'
+#define HANDOFF_READY    'R'
+
+static atomic_int gi_stopped;
+static int        gi_stop_fd = -1;
+// control connection to the predecessor, until it is told this server serves
+static int        gi_predecessor_fd = -1;
+
+static int fi_handoffAddress(const char *cptrc_path, struct sockaddr_un *pptrO_address) {
+    //
+    memset(pptrO_address, 0, sizeof(*pptrO_address));
+    pptrO_address->sun_family = AF_UNIX;
+    //
+    if (strlen(cptrc_path) >= sizeof(pptrO_address->sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(pptrO_address->sun_path, cptrc_path);
+    //
+    return 0;
+}
+
+int fi_handoffInherit(const char *cptrc_path) {
+    //
+    struct sockaddr_un lO_address;
+    //
+    if (fi_handoffAddress(cptrc_path, &lO_address) < 0) {
+        return -1;
+    }
+    int li_control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    //
+    if (li_control_fd < 0) {
+        return -1;
+    }
+    if (connect(li_control_fd, (struct sockaddr *) &lO_address, sizeof(lO_address)) < 0) {
+        close(li_control_fd);
+        return -1;
+    }
+    //
+    char          lc_tag;
+    struct iovec  lO_data = { &lc_tag, 1 };
+    union {
+        struct cmsghdr mO_align;
+        char           mc_a1_space[CMSG_SPACE(sizeof(int))];
+    }             lO_control;
+    struct msghdr lO_message;
+    //
+    memset(&lO_message, 0, sizeof(lO_message));
+    lO_message.msg_iov = &lO_data;
+    lO_message.msg_iovlen = 1;
+    lO_message.msg_control = lO_control.mc_a1_space;
+    lO_message.msg_controllen = sizeof(lO_control.mc_a1_space);
+    //
+    ssize_t li_n;
+    //
+    while ((li_n = recvmsg(li_control_fd, &lO_message, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+        ;
+    struct cmsghdr *lptrO_header = li_n == 1 ? CMSG_FIRSTHDR(&lO_message) : NULL;
+    //
+    if (lc_tag != HANDOFF_LISTENER || lptrO_header == NULL ||
+        lptrO_header->cmsg_level != SOL_SOCKET || lptrO_header->cmsg_type != SCM_RIGHTS) {
+        close(li_control_fd);
+        if (li_n >= 0) {
+            errno = EPROTO;
+        }
+        return -1;
+    }
+    int li_socketConn_fd;
+    memcpy(&li_socketConn_fd, CMSG_DATA(lptrO_header), sizeof(li_socketConn_fd));
+    //
+    // answered from fi_handoffServe(), once this server is about to accept
+    gi_predecessor_fd = li_control_fd;
+    //
+    return li_socketConn_fd;
+}
+
+// hand the listener to one successor; returns 1 if it took over
+static int fi_handoffOne(int pi_successor_fd, int pi_socketConn_fd) {
+    //
+    char          lc_tag = HANDOFF_LISTENER;
+    struct iovec  lO_data = { &lc_tag, 1 };
+    union {
+        struct cmsghdr mO_align;
+        char           mc_a1_space[CMSG_SPACE(sizeof(int))];
+    }             lO_control;
+    struct msghdr lO_message;
+    //
+    memset(&lO_message, 0, sizeof(lO_message));
+    memset(&lO_control, 0, sizeof(lO_control));
+    lO_message.msg_iov = &lO_data;
+    lO_message.msg_iovlen = 1;
+    lO_message.msg_control = lO_control.mc_a1_space;
+    lO_message.msg_controllen = sizeof(lO_control.mc_a1_space);
+    //
+    struct cmsghdr *lptrO_header = CMSG_FIRSTHDR(&lO_message);
+    lptrO_header->cmsg_level = SOL_SOCKET;
+    lptrO_header->cmsg_type = SCM_RIGHTS;
+    lptrO_header->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(lptrO_header), &pi_socketConn_fd, sizeof(int));
+    //
+    if (sendmsg(pi_successor_fd, &lO_message, MSG_NOSIGNAL) != 1) {
+        return 0;
+    }
+    // both now accept from the same queue; this one stops only once the successor serves,
+    // so that a successor failing to start leaves the service as it was
+    ssize_t li_n;
+    //
+    while ((li_n = read(pi_successor_fd, &lc_tag, 1)) < 0 && errno == EINTR)
+        ;
+    return li_n == 1 && lc_tag == HANDOFF_READY;
+}
+
+static void *fptrv_handoffRun(void *pptrv_arguments) {
+    int *lptri_a1_fds = pptrv_arguments;
+    int  li_control_fd = lptri_a1_fds[0],
+         li_socketConn_fd = lptri_a1_fds[1];
+    //
+    free(pptrv_arguments);
+    //
+    while (1) {
+        int li_successor_fd = accept4(li_control_fd, NULL, NULL, SOCK_CLOEXEC);
+        //
+        if (li_successor_fd < 0) {
+            if (errno != EINTR && errno != ECONNABORTED) {
+                IPC_LOGE("hot restart: accept: %m");
+                return NULL;
+            }
+            continue;
+        }
+        int li_tookOver = fi_handoffOne(li_successor_fd, li_socketConn_fd);
+        //
+        close(li_successor_fd);
+        //
+        if (li_tookOver) {
+            break;
+        }
+        IPC_LOGW("hot restart: successor went away before serving, serving on");
+    }
+    // the path belongs to the successor's control socket now
+    close(li_control_fd);
+    //
+    IPC_LOGI("hot restart: listener handed over, finishing the connections in service");
+    atomic_store(&gi_stopped, 1);
+    //
+    uint64_t lul_one = 1;
+    //
+    if (write(gi_stop_fd, &lul_one, sizeof(lul_one)) < 0) {
+        IPC_LOGE("hot restart: eventfd: %m");
+    }
+    // a connection that never ends must not keep the old server around forever
+    sleep(IPC_HANDOFF_DRAIN_SECONDS);
+    IPC_LOGW("hot restart: connections still in service after %d s, exiting", IPC_HANDOFF_DRAIN_SECONDS);
+    exit(EXIT_SUCCESS);
+}
+
+int fi_handoffServe(const char *cptrc_path, int pi_socketConn_fd) {
+    //
+    struct sockaddr_un lO_address;
+    //
+    if (fi_handoffAddress(cptrc_path, &lO_address) < 0) {
+        return -1;
+    }
+    int *lptri_a1_fds = malloc(2 * sizeof(int));
+    int  li_control_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    //
+    gi_stop_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    //
+    // the predecessor's socket file, or a stale one, is replaced: it keeps its own socket open
+    unlink(cptrc_path);
+    //
+    if (lptri_a1_fds == NULL || li_control_fd < 0 || gi_stop_fd < 0 ||
+        bind(li_control_fd, (struct sockaddr *) &lO_address, sizeof(lO_address)) < 0 ||
+        listen(li_control_fd, 1) < 0) {
+        free(lptri_a1_fds);
+        if (li_control_fd >= 0) {
+            close(li_control_fd);
+        }
+        return -1;
+    }
+    lptri_a1_fds[0] = li_control_fd;
+    lptri_a1_fds[1] = pi_socketConn_fd;
+    //
+    pthread_t lO_thread;
+    int       li_error = pthread_create(&lO_thread, NULL, fptrv_handoffRun, lptri_a1_fds);
+    //
+    if (li_error != 0) {
+        free(lptri_a1_fds);
+        close(li_control_fd);
+        errno = li_error;
+        return -1;
+    }
+    pthread_detach(lO_thread);
+    //
+    // only now may the predecessor stop: this server is about to accept
+    if (gi_predecessor_fd >= 0) {
+        char lc_tag = HANDOFF_READY;
+        //
+        if (write(gi_predecessor_fd, &lc_tag, 1) != 1) {
+            IPC_LOGW("hot restart: predecessor gone: %m");
+        }
+        close(gi_predecessor_fd);
+        gi_predecessor_fd = -1;
+    }
+    //
+    return 0;
+}
+
+int fi_handoffStopped(void) {
+    return atomic_load_explicit(&gi_stopped, memory_order_relaxed);
+}
+
+int fi_handoffStopFd(void) {
+    return gi_stop_fd;
+}
@@ -0,0 +1,44 @@
+/*
+ * Hot restart: handing the listening socket to a new server
+ * A server started with a control path listens there, on a Unix domain socket,
+ * for its successor. The successor (the same server, e.g. a new build, started with
+ * the same path) connects, receives the live listening socket with SCM_RIGHTS, and
+ * serves it at once; connections waiting in the backlog are never dropped or refused,
+ * since the socket itself never closes. Once the successor reports it is serving,
+ * the old server stops accepting, finishes the connections it has, and exits
+ *
+ *  old server                     successor
+ *  serving, control path bound
+ *                        <------- connect(control path)
+ *  listener (SCM_RIGHTS) ------->
+ *                                 binds the control path anew, for the next restart
+ *                        <------- "ready"
+ *  stops accepting, drains        accepting
+ */
+#ifndef IPC_HANDOFF_H
+#define IPC_HANDOFF_H
+
+// an old server still draining connections this long after the handoff exits anyway
+#define IPC_HANDOFF_DRAIN_SECONDS 30
+
+/*
+ * Take over the listening socket of the server serving at cptrc_path
+ * Returns the listening socket, or -1 (errno ENOENT or ECONNREFUSED when no server is
+ * there: start cold; anything else is an error)
+ */
+int fi_handoffInherit(const char *cptrc_path);
+
+/*
+ * Bind the control socket at cptrc_path, tell the predecessor (if any) that this server
+ * serves now, and start a thread handing pi_socketConn_fd to the next successor
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_handoffServe(const char *cptrc_path, int pi_socketConn_fd);
+
+// 1 once the listening socket was handed over: stop accepting, finish what is in service
+int fi_handoffStopped(void);
+
+// readable once the listening socket was handed over, for poll() or epoll; -1 without a control path
+int fi_handoffStopFd(void);
+
+#endif  // IPC_HANDOFF_H
@@ -0,0 +1,156 @@
+/*
+ * Latency histogram in the style of HdrHistogram
+ * A value v >= HISTOGRAM_SUB_BUCKETS with its highest bit at position msb is
+ * kept as (v >> shift), shift = msb - 7: a number in [HALF, SUB), i.e. its top
+ * 8 bits; each shift owns HISTOGRAM_HALF_BUCKETS buckets after the exact ones
+ * References:
+ *  http://hdrhistogram.org/
+ */
+#include <string.h>
+
+#include "ipc_histogram.h"
+
+static unsigned fui_histogramIndex(uint64_t pul_value) {
+    //
+    if (pul_value < HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned) pul_value;
+    }
+    unsigned lui_shift = 63 - __builtin_clzll(pul_value) - 7;
+    //
+    if (lui_shift > HISTOGRAM_MAX_SHIFT) {
+        return HISTOGRAM_BUCKETS - 1;
+    }
+    return HISTOGRAM_SUB_BUCKETS + (lui_shift - 1) * HISTOGRAM_HALF_BUCKETS +
+           (unsigned) (pul_value >> lui_shift) - HISTOGRAM_HALF_BUCKETS;
+}
+
+// highest value that falls into bucket pui_index
+static uint64_t ful_histogramValue(unsigned pui_index) {
+    //
+    if (pui_index < HISTOGRAM_SUB_BUCKETS) {
+        return pui_index;
+    }
+    unsigned lui_shift = (pui_index - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_HALF_BUCKETS + 1;
+    uint64_t lul_sub = (pui_index - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_HALF_BUCKETS + HISTOGRAM_HALF_BUCKETS;
+    //
+    return ((lul_sub + 1) << lui_shift) - 1;
+}
+
+void fv_histogramInit(struct ipc_histogram *pptrO_histogram) {
+    memset(pptrO_histogram, 0, sizeof(*pptrO_histogram));
+    pptrO_histogram->mul_min = UINT64_MAX;
+}
+
+void fv_histogramRecord(struct ipc_histogram *pptrO_histogram, uint64_t pul_value) {
+    //
+    ++pptrO_histogram->mul_a1_counts[fui_histogramIndex(pul_value)];
+    ++pptrO_histogram->mul_total;
+    pptrO_histogram->mul_sum += pul_value;
+    //
+    if (pul_value < pptrO_histogram->mul_min) {
+        pptrO_histogram->mul_min = pul_value;
+    }
+    if (pul_value > pptrO_histogram->mul_max) {
+        pptrO_histogram->mul_max = pul_value;
+    }
+}
+
+void fv_histogramMerge(struct ipc_histogram       *pptrO_histogram,
+                       const struct ipc_histogram *pptrO_other) {
+    //
+    for (unsigned i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        pptrO_histogram->mul_a1_counts[i] += pptrO_other->mul_a1_counts[i];
+    }
+    pptrO_histogram->mul_total += pptrO_other->mul_total;
+    pptrO_histogram->mul_sum += pptrO_other->mul_sum;
+    //
+    if (pptrO_other->mul_min < pptrO_histogram->mul_min) {
+        pptrO_histogram->mul_min = pptrO_other->mul_min;
+    }
+    if (pptrO_other->mul_max > pptrO_histogram->mul_max) {
+        pptrO_histogram->mul_max = pptrO_other->mul_max;
+    }
+}
+
+/*
+ * Walk the buckets up to the one holding the pd_percentile-th value,
+ * and report how many values it and the buckets below it hold
+ */
+static uint64_t ful_histogramWalk(const struct ipc_histogram *pptrO_histogram,
+                                  double                      pd_percentile,
+                                  uint64_t                   *pptrul_cumulative) {
+    //
+    uint64_t lul_target = (uint64_t) (pd_percentile / 100.0 * pptrO_histogram->mul_total + 0.5),
+             lul_cumulative = 0;
+    //
+    if (lul_target < 1) {
+        lul_target = 1;
+    }
+    if (lul_target > pptrO_histogram->mul_total) {
+        lul_target = pptrO_histogram->mul_total;
+    }
+    //
+    for (unsigned i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+        lul_cumulative += pptrO_histogram->mul_a1_counts[i];
+        //
+        if (lul_cumulative >= lul_target) {
+            uint64_t lul_value = ful_histogramValue(i);
+            //
+            *pptrul_cumulative = lul_cumulative;
+            // the bucket may stand for more than was ever recorded
+            return lul_value < pptrO_histogram->mul_max ? lul_value : pptrO_histogram->mul_max;
+        }
+    }
+    //
+    *pptrul_cumulative = lul_cumulative;
+    return pptrO_histogram->mul_max;
+}
+
+uint64_t ful_histogramPercentile(const struct ipc_histogram *pptrO_histogram, double pd_percentile) {
+    //
+    uint64_t lul_cumulative;
+    //
+    if (pptrO_histogram->mul_total == 0) {
+        return 0;
+    }
+    return ful_histogramWalk(pptrO_histogram, pd_percentile, &lul_cumulative);
+}
+
+void fv_histogramPrint(const struct ipc_histogram *pptrO_histogram,
+                       FILE                       *pptrO_stream,
+                       int                         pi_ticksPerHalf,
+                       double                      pd_scale) {
+    //
+    fprintf(pptrO_stream, "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+    //
+    if (pptrO_histogram->mul_total == 0) {
+        return;
+    }
+    //
+    uint64_t lul_cumulative;
+    double   ld_remaining = 100.0;
+    //
+    // each half of the remaining distance to 100% gets pi_ticksPerHalf lines,
+    // until it is smaller than one recorded value
+    while (ld_remaining * pptrO_histogram->mul_total >= 100.0) {
+        for (int t = 0; t < pi_ticksPerHalf; ++t) {
+            double   ld_percentile = 100.0 - ld_remaining + ld_remaining / 2 * t / pi_ticksPerHalf;
+            uint64_t lul_value = ful_histogramWalk(pptrO_histogram, ld_percentile, &lul_cumulative);
+            //
+            fprintf(pptrO_stream, "%12.3f %14.12f %10llu %14.2f\n",
+                    lul_value / pd_scale, ld_percentile / 100.0,
+                    (unsigned long long) lul_cumulative, 100.0 / (100.0 - ld_percentile));
+        }
+        ld_remaining /= 2;
+    }
+    //
+    fprintf(pptrO_stream, "%12.3f %14.12f %10llu %14s\n",
+            pptrO_histogram->mul_max / pd_scale, 1.0,
+            (unsigned long long) pptrO_histogram->mul_total, "inf");
+    fprintf(pptrO_stream, "#[Mean    = %12.3f, Max   = %12.3f, Min = %12.3f]\n"
+                          "#[Total count    = %12llu]\n",
+            (double) pptrO_histogram->mul_sum / pptrO_histogram->mul_total / pd_scale,
+            pptrO_histogram->mul_max / pd_scale,
+            pptrO_histogram->mul_min / pd_scale,
+            (unsigned long long) pptrO_histogram->mul_total);
+}
@@ -0,0 +1,54 @@
+/*
+ * Latency histogram in the style of HdrHistogram
+ * Buckets are log-linear: every power of two is split into HISTOGRAM_HALF_BUCKETS
+ * equal sub-buckets, so any recorded value is kept to within 1/128 (< 0.8%)
+ * of itself, from 1 ns up to about 36 minutes, in a fixed array of counters:
+ * recording is an index computation and an increment, no allocation, no lock
+ * One histogram per thread; merge them once the threads are done
+ */
+#ifndef IPC_HISTOGRAM_H
+#define IPC_HISTOGRAM_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// values below this are counted exactly
+#define HISTOGRAM_SUB_BUCKETS  256
+#define HISTOGRAM_HALF_BUCKETS (HISTOGRAM_SUB_BUCKETS / 2)
+// values up to 2^41 - 1 (ns) are told apart, larger ones land in the last bucket
+#define HISTOGRAM_MAX_SHIFT    33
+#define HISTOGRAM_BUCKETS      (HISTOGRAM_SUB_BUCKETS + HISTOGRAM_MAX_SHIFT * HISTOGRAM_HALF_BUCKETS)
+
+struct ipc_histogram {
+    uint64_t mul_a1_counts[HISTOGRAM_BUCKETS];
+    uint64_t mul_total;
+    uint64_t mul_sum;
+    uint64_t mul_min;
+    uint64_t mul_max;
+};
+
+void fv_histogramInit(struct ipc_histogram *pptrO_histogram);
+
+void fv_histogramRecord(struct ipc_histogram *pptrO_histogram, uint64_t pul_value);
+
+// add every count of pptrO_other to pptrO_histogram
+void fv_histogramMerge(struct ipc_histogram       *pptrO_histogram,
+                       const struct ipc_histogram *pptrO_other);
+
+/*
+ * Smallest value that pd_percentile percent (0-100) of the recorded values do not exceed,
+ * reported as the highest value its bucket stands for; 0 if nothing was recorded
+ */
+uint64_t ful_histogramPercentile(const struct ipc_histogram *pptrO_histogram, double pd_percentile);
+
+/*
+ * Print the percentile distribution, one line per percentile step, halving
+ * the distance to 100% every pi_ticksPerHalf lines (like HdrHistogram's
+ * outputPercentileDistribution), with values divided by pd_scale
+ */
+void fv_histogramPrint(const struct ipc_histogram *pptrO_histogram,
+                       FILE                       *pptrO_stream,
+                       int                         pi_ticksPerHalf,
+                       double                      pd_scale);
+
+#endif  // IPC_HISTOGRAM_H
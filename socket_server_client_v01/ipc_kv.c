@@ -0,0 +1,452 @@
+/*
+ * In-memory key-value store
+ * References:
+ *  https://www.kernel.org/doc/html/latest/locking/seqlock.html
+ *  https://en.wikipedia.org/wiki/Linear_probing#Deletion (backward shift)
+ *  https://en.wikipedia.org/wiki/Page_replacement_algorithm#Clock
+ *  man 3 pthread_mutexattr_setrobust
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ipc_kv.h"
+
+#define CACHE_LINE_SIZE 64
+// most shards, and fewest slots in one: a small budget gets fewer shards
+#define KV_SHARDS          64
+#define KV_SHARD_SLOTS_MIN 64
+// spins of a reader on a shard being written before yielding the CPU to the writer
+#define KV_SPINS           128
+
+// one entry; the hash and the lengths share the first cache line with the key's first bytes
+struct ipc_kvSlot {
+    _Alignas(CACHE_LINE_SIZE) uint64_t mul_hash;  // 0: empty
+    uint16_t                           mus_key;
+    uint16_t                           mus_value;
+    // read since the CLOCK hand last passed
+    atomic_uchar                       muc_referenced;
+    // key, then value
+    char                               mc_a1_data[IPC_KV_SLOT_SIZE - 16];
+};
+
+_Static_assert(sizeof(struct ipc_kvSlot) == IPC_KV_SLOT_SIZE, "slot size");
+
+// a shard's own cache line: writers on other shards do not disturb it
+struct ipc_kvShard {
+    // odd while a writer is changing the shard
+    _Alignas(CACHE_LINE_SIZE) atomic_uint mui_sequence;
+    // shared by the processes of the fork and prefork modes, robust against their death
+    pthread_mutex_t                       mO_lock;
+    // slots in use, and where the CLOCK hand is; changed under the lock only
+    unsigned                              mui_used;
+    unsigned                              mui_hand;
+};
+
+// set once by fi_kvInit(), before any worker starts
+static struct ipc_kvShard *gptrO_shards;
+static struct ipc_kvSlot  *gptrO_slots;
+static unsigned            gui_shards;
+static unsigned            gui_slots;
+static unsigned            gui_fillMax;
+
+static inline void fv_kvRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+// FNV-1a, then the splitmix64 finalizer: shard and slot come from different bits of it
+static uint64_t ful_kvHash(const void *pptrv_key, size_t psz_key) {
+    const unsigned char *lptruc_key = pptrv_key;
+    uint64_t             lul_hash = 0xcbf29ce484222325ull;
+    //
+    for (size_t i = 0; i < psz_key; ++i) {
+        lul_hash = (lul_hash ^ lptruc_key[i]) * 0x100000001b3ull;
+    }
+    lul_hash = (lul_hash ^ (lul_hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    lul_hash = (lul_hash ^ (lul_hash >> 27)) * 0x94d049bb133111ebull;
+    lul_hash ^= lul_hash >> 31;
+    //
+    // 0 marks an empty slot
+    return lul_hash != 0 ? lul_hash : 1;
+}
+
+int fi_kvInit(size_t psz_budget) {
+    //
+    if (psz_budget == 0) {
+        return 0;
+    }
+    size_t   lsz_slots = psz_budget / IPC_KV_SLOT_SIZE;
+    unsigned lui_shards = KV_SHARDS;
+    //
+    while (lui_shards > 1 && lsz_slots / lui_shards < KV_SHARD_SLOTS_MIN) {
+        lui_shards /= 2;
+    }
+    if (lsz_slots / lui_shards < KV_SHARD_SLOTS_MIN) {
+        errno = EINVAL;
+        return -1;
+    }
+    // a power of 2 per shard: the slot index is a mask of the hash
+    size_t lsz_perShard = KV_SHARD_SLOTS_MIN;
+    //
+    while (lsz_perShard * 2 <= lsz_slots / lui_shards && lsz_perShard * 2 <= UINT32_MAX / 2) {
+        lsz_perShard *= 2;
+    }
+    size_t lsz_shards = lui_shards * sizeof(struct ipc_kvShard),
+           lsz_size = lsz_shards + lui_shards * lsz_perShard * sizeof(struct ipc_kvSlot);
+    //
+    // zero-filled: every slot empty
+    char *lptrc_table = mmap(NULL, lsz_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    //
+    if (lptrc_table == MAP_FAILED) {
+        return -1;
+    }
+    pthread_mutexattr_t lO_attributes;
+    int                 li_error = pthread_mutexattr_init(&lO_attributes);
+    //
+    if (li_error == 0) {
+        li_error = pthread_mutexattr_setpshared(&lO_attributes, PTHREAD_PROCESS_SHARED);
+    }
+    if (li_error == 0) {
+        li_error = pthread_mutexattr_setrobust(&lO_attributes, PTHREAD_MUTEX_ROBUST);
+    }
+    for (unsigned i = 0; li_error == 0 && i < lui_shards; ++i) {
+        li_error = pthread_mutex_init(&((struct ipc_kvShard *) lptrc_table)[i].mO_lock, &lO_attributes);
+    }
+    pthread_mutexattr_destroy(&lO_attributes);
+    //
+    if (li_error != 0) {
+        munmap(lptrc_table, lsz_size);
+        errno = li_error;
+        return -1;
+    }
+    gptrO_shards = (struct ipc_kvShard *) lptrc_table;
+    gptrO_slots = (struct ipc_kvSlot *) (lptrc_table + lsz_shards);
+    gui_shards = lui_shards;
+    gui_slots = (unsigned) lsz_perShard;
+    // linear probing slows down sharply when fuller than that
+    gui_fillMax = gui_slots / 4 * 3;
+    //
+    return 0;
+}
+
+int fi_kvEnabled(void) {
+    return gptrO_shards != NULL;
+}
+
+static struct ipc_kvShard *fptrO_kvShard(uint64_t pul_hash, struct ipc_kvSlot **pptrO_slots) {
+    unsigned lui_shard = (unsigned) (pul_hash >> 32) & (gui_shards - 1);
+    //
+    *pptrO_slots = gptrO_slots + (size_t) lui_shard * gui_slots;
+    //
+    return &gptrO_shards[lui_shard];
+}
+
+/*
+ * The slot holding the key, or else the empty slot its probe ends on
+ * NULL only while a writer is changing the shard under a reader (the reader retries)
+ */
+static struct ipc_kvSlot *fptrO_kvFind(struct ipc_kvSlot *pptrO_slots, uint64_t pul_hash,
+                                       const void *pptrv_key, size_t psz_key) {
+    unsigned lui_mask = gui_slots - 1,
+             lui_index = (unsigned) pul_hash & lui_mask;
+    //
+    for (unsigned i = 0; i < gui_slots; ++i, lui_index = (lui_index + 1) & lui_mask) {
+        struct ipc_kvSlot *lptrO_slot = &pptrO_slots[lui_index];
+        uint64_t           lul_hash = lptrO_slot->mul_hash;
+        //
+        if (lul_hash == 0) {
+            return lptrO_slot;
+        }
+        // the key is read only for a matching hash: almost every probe stays in one cache line
+        if (lul_hash == pul_hash && lptrO_slot->mus_key == psz_key &&
+            memcmp(lptrO_slot->mc_a1_data, pptrv_key, psz_key) == 0) {
+            return lptrO_slot;
+        }
+    }
+    return NULL;
+}
+
+// pi_error: what locking the shard returned, 0 or EOWNERDEAD
+static void fv_kvLocked(struct ipc_kvShard *pptrO_shard, struct ipc_kvSlot *pptrO_slots, int pi_error) {
+    //
+    unsigned lui_sequence = atomic_load_explicit(&pptrO_shard->mui_sequence, memory_order_relaxed);
+    //
+    // readers see an odd sequence from now on, and wait or retry;
+    // it is odd already if the previous holder died while writing
+    if ((lui_sequence & 1) == 0) {
+        atomic_store_explicit(&pptrO_shard->mui_sequence, lui_sequence + 1, memory_order_relaxed);
+    }
+    atomic_thread_fence(memory_order_release);
+    //
+    // the previous holder died holding the lock: what it was changing cannot be trusted, start over empty
+    if (pi_error == EOWNERDEAD) {
+        for (unsigned i = 0; i < gui_slots; ++i) {
+            pptrO_slots[i].mul_hash = 0;
+        }
+        pptrO_shard->mui_used = 0;
+        pptrO_shard->mui_hand = 0;
+        pthread_mutex_consistent(&pptrO_shard->mO_lock);
+    }
+}
+
+static void fv_kvLock(struct ipc_kvShard *pptrO_shard, struct ipc_kvSlot *pptrO_slots) {
+    fv_kvLocked(pptrO_shard, pptrO_slots, pthread_mutex_lock(&pptrO_shard->mO_lock));
+}
+
+static void fv_kvUnlock(struct ipc_kvShard *pptrO_shard) {
+    unsigned lui_sequence = atomic_load_explicit(&pptrO_shard->mui_sequence, memory_order_relaxed);
+    //
+    atomic_store_explicit(&pptrO_shard->mui_sequence, lui_sequence + 1, memory_order_release);
+    pthread_mutex_unlock(&pptrO_shard->mO_lock);
+}
+
+/*
+ * Empty the slot at pui_hole, then shift back every entry behind it that the hole
+ * would cut off from its home slot: every probe still finds what it looks for
+ */
+static void fv_kvRemove(struct ipc_kvSlot *pptrO_slots, unsigned pui_hole) {
+    unsigned lui_mask = gui_slots - 1;
+    //
+    for (unsigned j = (pui_hole + 1) & lui_mask; pptrO_slots[j].mul_hash != 0; j = (j + 1) & lui_mask) {
+        unsigned lui_home = (unsigned) pptrO_slots[j].mul_hash & lui_mask;
+        //
+        // the hole lies between the entry's home and where it sits now
+        if (((j - lui_home) & lui_mask) >= ((j - pui_hole) & lui_mask)) {
+            struct ipc_kvSlot *lptrO_to = &pptrO_slots[pui_hole],
+                              *lptrO_from = &pptrO_slots[j];
+            //
+            lptrO_to->mul_hash = lptrO_from->mul_hash;
+            lptrO_to->mus_key = lptrO_from->mus_key;
+            lptrO_to->mus_value = lptrO_from->mus_value;
+            memcpy(lptrO_to->mc_a1_data, lptrO_from->mc_a1_data, lptrO_from->mus_key + lptrO_from->mus_value);
+            atomic_store_explicit(&lptrO_to->muc_referenced,
+                                  atomic_load_explicit(&lptrO_from->muc_referenced, memory_order_relaxed),
+                                  memory_order_relaxed);
+            pui_hole = j;
+        }
+    }
+    pptrO_slots[pui_hole].mul_hash = 0;
+}
+
+// CLOCK: the first entry the hand reaches that was not read since it last came by
+static void fv_kvEvict(struct ipc_kvShard *pptrO_shard, struct ipc_kvSlot *pptrO_slots) {
+    //
+    while (1) {
+        unsigned           lui_index = pptrO_shard->mui_hand;
+        struct ipc_kvSlot *lptrO_slot = &pptrO_slots[lui_index];
+        //
+        pptrO_shard->mui_hand = (lui_index + 1) & (gui_slots - 1);
+        //
+        if (lptrO_slot->mul_hash == 0) {
+            continue;
+        }
+        if (atomic_load_explicit(&lptrO_slot->muc_referenced, memory_order_relaxed)) {
+            atomic_store_explicit(&lptrO_slot->muc_referenced, 0, memory_order_relaxed);
+            continue;
+        }
+        fv_kvRemove(pptrO_slots, lui_index);
+        --pptrO_shard->mui_used;
+        //
+        return;
+    }
+}
+
+long fl_kvGet(const void *pptrv_key, size_t psz_key, void *pptrv_value, size_t psz_room) {
+    //
+    if (gptrO_shards == NULL || psz_key == 0 || psz_key > IPC_KV_KEY_MAX) {
+        return -1;
+    }
+    uint64_t            lul_hash = ful_kvHash(pptrv_key, psz_key);
+    struct ipc_kvSlot  *lptrO_slots;
+    struct ipc_kvShard *lptrO_shard = fptrO_kvShard(lul_hash, &lptrO_slots);
+    //
+    for (int i = 0; ; ) {
+        unsigned lui_sequence = atomic_load_explicit(&lptrO_shard->mui_sequence, memory_order_acquire);
+        //
+        if (lui_sequence & 1) {
+            if (++i == KV_SPINS) {
+                // a writer that died mid-change left the sequence odd: only its lock tells, and repairs it
+                int li_error = pthread_mutex_trylock(&lptrO_shard->mO_lock);
+                //
+                if (li_error == 0 || li_error == EOWNERDEAD) {
+                    fv_kvLocked(lptrO_shard, lptrO_slots, li_error);
+                    fv_kvUnlock(lptrO_shard);
+                } else {
+                    sched_yield();
+                }
+                i = 0;
+            } else {
+                fv_kvRelax();
+            }
+            continue;
+        }
+        // optimistic: whatever is read here counts only if no writer came in the meantime
+        struct ipc_kvSlot *lptrO_slot = fptrO_kvFind(lptrO_slots, lul_hash, pptrv_key, psz_key);
+        long               ll_length = -1;
+        //
+        if (lptrO_slot != NULL && lptrO_slot->mul_hash == lul_hash) {
+            size_t lsz_value = lptrO_slot->mus_value;
+            //
+            // lengths torn by a writer must not send the copy out of the slot
+            if (psz_key + lsz_value <= sizeof(lptrO_slot->mc_a1_data)) {
+                memcpy(pptrv_value, lptrO_slot->mc_a1_data + psz_key, lsz_value < psz_room ? lsz_value : psz_room);
+                ll_length = (long) lsz_value;
+            }
+            // written only when not set yet: hot keys do not bounce their cache line between cores
+            if (!atomic_load_explicit(&lptrO_slot->muc_referenced, memory_order_relaxed)) {
+                atomic_store_explicit(&lptrO_slot->muc_referenced, 1, memory_order_relaxed);
+            }
+        }
+        atomic_thread_fence(memory_order_acquire);
+        //
+        if (atomic_load_explicit(&lptrO_shard->mui_sequence, memory_order_relaxed) == lui_sequence) {
+            return ll_length;
+        }
+    }
+}
+
+int fi_kvSet(const void *pptrv_key, size_t psz_key, const void *pptrv_value, size_t psz_value) {
+    //
+    if (gptrO_shards == NULL || psz_key == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (psz_key > IPC_KV_KEY_MAX || psz_key + psz_value > sizeof(((struct ipc_kvSlot *) 0)->mc_a1_data)) {
+        errno = E2BIG;
+        return -1;
+    }
+    uint64_t            lul_hash = ful_kvHash(pptrv_key, psz_key);
+    struct ipc_kvSlot  *lptrO_slots;
+    struct ipc_kvShard *lptrO_shard = fptrO_kvShard(lul_hash, &lptrO_slots);
+    //
+    fv_kvLock(lptrO_shard, lptrO_slots);
+    //
+    struct ipc_kvSlot *lptrO_slot = fptrO_kvFind(lptrO_slots, lul_hash, pptrv_key, psz_key);
+    //
+    if (lptrO_slot->mul_hash == 0) {
+        // a new key: room is made first, which may shift entries around, so look again
+        if (lptrO_shard->mui_used >= gui_fillMax) {
+            fv_kvEvict(lptrO_shard, lptrO_slots);
+            lptrO_slot = fptrO_kvFind(lptrO_slots, lul_hash, pptrv_key, psz_key);
+        }
+        ++lptrO_shard->mui_used;
+        lptrO_slot->mul_hash = lul_hash;
+        lptrO_slot->mus_key = (uint16_t) psz_key;
+        memcpy(lptrO_slot->mc_a1_data, pptrv_key, psz_key);
+    }
+    lptrO_slot->mus_value = (uint16_t) psz_value;
+    memcpy(lptrO_slot->mc_a1_data + psz_key, pptrv_value, psz_value);
+    atomic_store_explicit(&lptrO_slot->muc_referenced, 0, memory_order_relaxed);
+    //
+    fv_kvUnlock(lptrO_shard);
+    //
+    return 0;
+}
+
+int fi_kvDelete(const void *pptrv_key, size_t psz_key) {
+    //
+    if (gptrO_shards == NULL || psz_key == 0 || psz_key > IPC_KV_KEY_MAX) {
+        return 0;
+    }
+    uint64_t            lul_hash = ful_kvHash(pptrv_key, psz_key);
+    struct ipc_kvSlot  *lptrO_slots;
+    struct ipc_kvShard *lptrO_shard = fptrO_kvShard(lul_hash, &lptrO_slots);
+    int                 li_deleted = 0;
+    //
+    fv_kvLock(lptrO_shard, lptrO_slots);
+    //
+    struct ipc_kvSlot *lptrO_slot = fptrO_kvFind(lptrO_slots, lul_hash, pptrv_key, psz_key);
+    //
+    if (lptrO_slot->mul_hash != 0) {
+        fv_kvRemove(lptrO_slots, (unsigned) (lptrO_slot - lptrO_slots));
+        --lptrO_shard->mui_used;
+        li_deleted = 1;
+    }
+    fv_kvUnlock(lptrO_shard);
+    //
+    return li_deleted;
+}
+
+/********************* COMMANDS *********************/
+
+#define KV_STORED    "STORED"
+#define KV_DELETED   "DELETED"
+#define KV_NOT_FOUND "NOT_FOUND"
+#define KV_VALUE     "VALUE "
+#define KV_USAGE     "ERROR usage: !GET key | !SET key value | !DEL key"
+#define KV_TOO_LARGE "ERROR key or value too large"
+
+static size_t fsz_kvReply(char *pptrc_reply, size_t psz_room, const char *cptrc_text) {
+    size_t lsz_length = strlen(cptrc_text);
+    //
+    if (lsz_length > psz_room) {
+        lsz_length = psz_room;
+    }
+    memcpy(pptrc_reply, cptrc_text, lsz_length);
+    //
+    return lsz_length;
+}
+
+size_t fsz_kvExecute(const char *cptrc_message, size_t psz_message, char *pptrc_reply, size_t psz_room) {
+    //
+    if (gptrO_shards == NULL) {
+        return 0;
+    }
+    while (psz_message > 0 && (cptrc_message[psz_message - 1] == '\n' || cptrc_message[psz_message - 1] == '\r')) {
+        --psz_message;
+    }
+    // only a message starting with the prefix is a command, and it always is one
+    if (psz_message == 0 || cptrc_message[0] != IPC_KV_PREFIX) {
+        return 0;
+    }
+    ++cptrc_message;
+    --psz_message;
+    //
+    // a command word, alone or followed by a space
+    if (psz_message < 3 || (psz_message > 3 && cptrc_message[3] != ' ') ||
+        (memcmp(cptrc_message, "GET", 3) != 0 &&
+         memcmp(cptrc_message, "SET", 3) != 0 &&
+         memcmp(cptrc_message, "DEL", 3) != 0)) {
+        return fsz_kvReply(pptrc_reply, psz_room, KV_USAGE);
+    }
+    const char *lptrc_key = cptrc_message + 4;
+    size_t      lsz_rest = psz_message > 4 ? psz_message - 4 : 0;
+    const char *lptrc_space = memchr(lptrc_key, ' ', lsz_rest);
+    size_t      lsz_key = lptrc_space ? (size_t) (lptrc_space - lptrc_key) : lsz_rest;
+    //
+    if (lsz_key == 0) {
+        return fsz_kvReply(pptrc_reply, psz_room, KV_USAGE);
+    }
+    if (cptrc_message[0] == 'S') {
+        // the value is all the rest, spaces included; it may be empty
+        if (lptrc_space == NULL) {
+            return fsz_kvReply(pptrc_reply, psz_room, KV_USAGE);
+        }
+        if (fi_kvSet(lptrc_key, lsz_key, lptrc_space + 1, lsz_rest - lsz_key - 1) < 0) {
+            return fsz_kvReply(pptrc_reply, psz_room, KV_TOO_LARGE);
+        }
+        return fsz_kvReply(pptrc_reply, psz_room, KV_STORED);
+    }
+    // GET and DEL take the key alone
+    if (lptrc_space != NULL) {
+        return fsz_kvReply(pptrc_reply, psz_room, KV_USAGE);
+    }
+    if (cptrc_message[0] == 'D') {
+        return fsz_kvReply(pptrc_reply, psz_room, fi_kvDelete(lptrc_key, lsz_key) ? KV_DELETED : KV_NOT_FOUND);
+    }
+    size_t lsz_prefix = fsz_kvReply(pptrc_reply, psz_room, KV_VALUE);
+    long   ll_value = fl_kvGet(lptrc_key, lsz_key, pptrc_reply + lsz_prefix, psz_room - lsz_prefix);
+    //
+    if (ll_value < 0) {
+        return fsz_kvReply(pptrc_reply, psz_room, KV_NOT_FOUND);
+    }
+    return lsz_prefix + ((size_t) ll_value < psz_room - lsz_prefix ? (size_t) ll_value : psz_room - lsz_prefix);
+}
@@ -0,0 +1,68 @@
+/*
+ * In-memory key-value store: the server as a local cache
+ * Text commands, one per message (plain text, or the payload of a request frame),
+ * marked by a leading IPC_KV_PREFIX so that no ordinary message is ever taken for one:
+ *  !GET key        -> VALUE <value> | NOT_FOUND
+ *  !SET key value  -> STORED        (the value is the rest of the line, spaces included)
+ *  !DEL key        -> DELETED       | NOT_FOUND
+ * Any other message starting with the prefix is answered with a usage error
+ * The table is split into shards, each an open-addressing array of fixed-size slots
+ * (linear probing, deletion by backward shift: no tombstones to wade through)
+ * A slot keeps its key and value inline: a probe compares the key's hash, in the first
+ * cache line of the slot, and reads the key itself only when that matches
+ * Writers take their shard's lock, a robust process-shared mutex: a worker killed
+ * while holding it does not hang the shard, the next writer empties the shard instead
+ * (a cache may lose entries, never serve torn ones); readers take none: they read under the shard's
+ * sequence counter (seqlock) and retry if a writer got in between, so lookups never
+ * wait for each other, whatever the number of cores serving them
+ * Every shard is filled up to 3/4 of its slots, then evicts with CLOCK:
+ * a slot read since the hand last passed it is spared once
+ * The table lives in a shared anonymous mapping made before any worker starts:
+ * forked children, pre-forked workers and pooled threads all see the same data
+ */
+#ifndef IPC_KV_H
+#define IPC_KV_H
+
+#include <stddef.h>
+
+// a slot: its header, then the key and the value
+#define IPC_KV_SLOT_SIZE 256
+#define IPC_KV_KEY_MAX   64
+// longest value, next to the shortest key
+#define IPC_KV_VALUE_MAX (IPC_KV_SLOT_SIZE - 16 - 1)
+// first character of every command
+#define IPC_KV_PREFIX    '!'
+
+/*
+ * Set up an empty store taking about psz_budget bytes; 0 leaves the store off
+ * Returns 0, or -1 (with errno set; EINVAL for a budget too small for one shard)
+ */
+int fi_kvInit(size_t psz_budget);
+
+// whether fi_kvInit() set up a store
+int fi_kvEnabled(void);
+
+/*
+ * Copy the value of the key into pptrv_value, cut to psz_room bytes
+ * Returns the value's whole length, or -1 if the key is not there
+ */
+long fl_kvGet(const void *pptrv_key, size_t psz_key, void *pptrv_value, size_t psz_room);
+
+/*
+ * Store the value under the key, replacing any earlier one, evicting if the shard is full
+ * Returns 0, or -1 (errno EINVAL for an empty key, E2BIG for one too long or a value too large)
+ */
+int fi_kvSet(const void *pptrv_key, size_t psz_key, const void *pptrv_value, size_t psz_value);
+
+// Returns 1 if the key was there and is deleted now, 0 if it was not there
+int fi_kvDelete(const void *pptrv_key, size_t psz_key);
+
+/*
+ * Run the command in the message, and write the reply into pptrc_reply (at most psz_room bytes,
+ * not NUL-terminated); a trailing newline of the message is ignored
+ * Returns the reply's length, or 0 if the message does not start with IPC_KV_PREFIX (or the store is off):
+ * it gets the usual acknowledgement then
+ */
+size_t fsz_kvExecute(const char *cptrc_message, size_t psz_message, char *pptrc_reply, size_t psz_room);
+
+#endif  // IPC_KV_H
@@ -0,0 +1,382 @@
+/*
+ * Asynchronous logging
+ * The ring is the bounded MPMC queue of the shared-memory transport (ipc_shm.c),
+ * used with any number of producers and one consumer, the writer thread
+ * The writer sleeps on a futex like the shm server does: producers only enter
+ * the kernel to wake it when it announced that it is about to sleep
+ * The ring is a shared anonymous mapping: a forked child (a fork or prefork worker)
+ * starts no thread of its own, it queues its lines on the same ring, and the parent's
+ * writer writes them out (the futex is not private, so a child's wakeup reaches it)
+ * A line claimed by a process that died before filling it in would hold up every
+ * line behind it: after LOG_STALL_NANOSECONDS the writer skips it as dropped
+ * References:
+ *  D. Vyukov: Bounded MPMC queue (1024cores.net)
+ *  man 3 pthread_atfork
+ */
+#define _GNU_SOURCE  // %m
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include "ipc_log.h"
+
+// ring size, a power of 2
+#define LOG_SLOTS 2048
+// most lines one writev() carries
+#define LOG_BATCH 64
+// an idle writer still wakes up this often, e.g. to report dropped lines
+#define LOG_IDLE_NANOSECONDS 100000000L
+// a line claimed but not filled in for that long: its process is taken for dead
+#define LOG_STALL_NANOSECONDS 1000000000ull
+#define CACHE_LINE_SIZE 64
+
+// slot: its sequence number says whose turn it is (a producer or the writer)
+struct ipc_logSlot {
+    atomic_ulong mul_sequence;
+    int          mi_level;
+    unsigned     mui_length;
+    char         mc_a1_line[IPC_LOG_LINE_MAX];
+};
+
+struct ipc_logRing {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong  mul_tail;  // claimed by producers
+    _Alignas(CACHE_LINE_SIZE) unsigned long mul_head;  // writer only
+    _Alignas(CACHE_LINE_SIZE) atomic_uint   mui_counter;
+    atomic_uint                             mui_sleeping;
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong  mul_dropped;
+    struct ipc_logSlot                      mO_a1_slots[LOG_SLOTS];
+};
+
+int gi_logLevel = IPC_LOG_INFO;
+//
+// shared with the forked children, which queue their lines on it too
+static struct ipc_logRing *gptrO_ring;
+static pthread_t           gO_writer;
+static int                 gi_initialized = 0;
+// the writer of this process runs (never in a forked child: its parent's writes its lines)
+static atomic_int          gi_writerRunning;
+static atomic_int          gi_writerStop;
+
+static int fi_logDestination(int pi_level) {
+    return pi_level <= IPC_LOG_WARN ? STDERR_FILENO : STDOUT_FILENO;
+}
+
+// write all the lines described by pptrO_a1_parts; a failing destination loses them
+static void fv_logWritev(int pi_fd, struct iovec *pptrO_a1_parts, int pi_parts) {
+    //
+    while (pi_parts > 0) {
+        ssize_t li_n = writev(pi_fd, pptrO_a1_parts, pi_parts);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        while (pi_parts > 0 && (size_t) li_n >= pptrO_a1_parts->iov_len) {
+            li_n -= pptrO_a1_parts->iov_len;
+            ++pptrO_a1_parts;
+            --pi_parts;
+        }
+        if (pi_parts > 0) {
+            pptrO_a1_parts->iov_base = (char *) pptrO_a1_parts->iov_base + li_n;
+            pptrO_a1_parts->iov_len -= li_n;
+        }
+    }
+}
+
+/*
+ * Write out up to LOG_BATCH published lines, in order, then give their slots back
+ * Returns how many were written
+ */
+static unsigned fui_logDrain(void) {
+    //
+    struct iovec lO_a1_parts[LOG_BATCH];
+    unsigned     lui_lines = 0;
+    int          li_parts = 0,
+                 li_fd = -1;
+    //
+    while (lui_lines < LOG_BATCH) {
+        struct ipc_logSlot *lptrO_slot = &gptrO_ring->mO_a1_slots[(gptrO_ring->mul_head + lui_lines) & (LOG_SLOTS - 1)];
+        //
+        if (atomic_load_explicit(&lptrO_slot->mul_sequence, memory_order_acquire) !=
+            gptrO_ring->mul_head + lui_lines + 1) {
+            break;
+        }
+        // stdout and stderr lines go out in one writev() each, as long as they alternate rarely
+        if (fi_logDestination(lptrO_slot->mi_level) != li_fd) {
+            fv_logWritev(li_fd, lO_a1_parts, li_parts);
+            li_fd = fi_logDestination(lptrO_slot->mi_level);
+            li_parts = 0;
+        }
+        lO_a1_parts[li_parts].iov_base = lptrO_slot->mc_a1_line;
+        lO_a1_parts[li_parts].iov_len = lptrO_slot->mui_length;
+        ++li_parts;
+        ++lui_lines;
+    }
+    fv_logWritev(li_fd, lO_a1_parts, li_parts);
+    //
+    for (unsigned i = 0; i < lui_lines; ++i) {
+        atomic_store_explicit(&gptrO_ring->mO_a1_slots[gptrO_ring->mul_head & (LOG_SLOTS - 1)].mul_sequence,
+                              gptrO_ring->mul_head + LOG_SLOTS,
+                              memory_order_release);
+        ++gptrO_ring->mul_head;
+    }
+    //
+    return lui_lines;
+}
+
+static void fv_logReportDropped(void) {
+    //
+    unsigned long lul_dropped = atomic_exchange(&gptrO_ring->mul_dropped, 0);
+    //
+    if (lul_dropped > 0) {
+        char lc_a1_line[64];
+        int  li_length = snprintf(lc_a1_line, sizeof(lc_a1_line),
+                                  "%lu log line(s) dropped: ring full, or left unfinished\n", lul_dropped);
+        //
+        if (write(STDERR_FILENO, lc_a1_line, li_length) < 0) {
+            // nowhere left to report it
+        }
+    }
+}
+
+static uint64_t ful_logNow(void) {
+    struct timespec lO_now;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_now);
+    //
+    return (uint64_t) lO_now.tv_sec * 1000000000ull + lO_now.tv_nsec;
+}
+
+/*
+ * The next line to write was claimed but is not filled in: note since when, and once
+ * that is LOG_STALL_NANOSECONDS ago, skip it, as its process died in the middle
+ * The slot is taken back only if it is still unfilled: a late producer then loses its line
+ */
+static void fv_logSkipStalled(uint64_t *pptrul_since) {
+    //
+    struct ipc_logSlot *lptrO_slot = &gptrO_ring->mO_a1_slots[gptrO_ring->mul_head & (LOG_SLOTS - 1)];
+    unsigned long       lul_claimed = gptrO_ring->mul_head;
+    //
+    if (atomic_load_explicit(&gptrO_ring->mul_tail, memory_order_relaxed) == gptrO_ring->mul_head) {
+        *pptrul_since = 0;
+        return;
+    }
+    uint64_t lul_now = ful_logNow();
+    //
+    if (*pptrul_since == 0) {
+        *pptrul_since = lul_now;
+        return;
+    }
+    if (lul_now - *pptrul_since < LOG_STALL_NANOSECONDS) {
+        return;
+    }
+    if (atomic_compare_exchange_strong(&lptrO_slot->mul_sequence, &lul_claimed, lul_claimed + LOG_SLOTS)) {
+        ++gptrO_ring->mul_head;
+        atomic_fetch_add(&gptrO_ring->mul_dropped, 1);
+    }
+    *pptrul_since = 0;
+}
+
+static void *fptrv_logWriter(void *pptrv_unused) {
+    //
+    // since when the next line is awaited, 0 if it is not
+    uint64_t lul_stalled = 0;
+    //
+    (void) pptrv_unused;
+    //
+    while (1) {
+        int      li_stop = atomic_load(&gi_writerStop);
+        unsigned lui_seen = atomic_load(&gptrO_ring->mui_counter);
+        //
+        if (fui_logDrain() > 0) {
+            lul_stalled = 0;
+            continue;
+        }
+        fv_logReportDropped();
+        fv_logSkipStalled(&lul_stalled);
+        // everything queued before the stop request is out
+        if (li_stop) {
+            return NULL;
+        }
+        //
+        struct timespec lO_timeout = { 0, LOG_IDLE_NANOSECONDS };
+        //
+        atomic_store(&gptrO_ring->mui_sleeping, 1);
+        // a line published after lui_seen was read moved the counter: the wait returns at once
+        syscall(SYS_futex, &gptrO_ring->mui_counter, FUTEX_WAIT, lui_seen, &lO_timeout, NULL, 0);
+        atomic_store(&gptrO_ring->mui_sleeping, 0);
+    }
+}
+
+static void fv_logNotify(void) {
+    atomic_fetch_add(&gptrO_ring->mui_counter, 1);
+    //
+    if (atomic_load(&gptrO_ring->mui_sleeping)) {
+        syscall(SYS_futex, &gptrO_ring->mui_counter, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+static int fi_logStartWriter(void) {
+    //
+    int li_error = pthread_create(&gO_writer, NULL, fptrv_logWriter, NULL);
+    //
+    if (li_error != 0) {
+        atomic_store(&gi_writerRunning, 0);
+        errno = li_error;
+        return -1;
+    }
+    return 0;
+}
+
+// at exit, let the writer empty the ring before the process goes
+static void fv_logShutdown(void) {
+    //
+    if (!atomic_load(&gi_writerRunning)) {
+        return;
+    }
+    atomic_store(&gi_writerStop, 1);
+    fv_logNotify();
+    pthread_join(gO_writer, NULL);
+    atomic_store(&gi_writerRunning, 0);
+}
+
+/*
+ * In a forked child, only the thread that called fork() exists, and there is no writer:
+ * the child keeps queueing on the shared ring, for its parent's writer,
+ * and has none to stop when it exits
+ */
+static void fv_logAtForkChild(void) {
+    atomic_store(&gi_writerRunning, 0);
+}
+
+/*
+ * Format one line into pptrc_line (IPC_LOG_LINE_MAX bytes), the newline included
+ * Returns its length
+ */
+static unsigned fui_logFormat(char *pptrc_line, const char *cptrc_format, va_list pO_arguments) {
+    //
+    int li_length = vsnprintf(pptrc_line, IPC_LOG_LINE_MAX - 1, cptrc_format, pO_arguments);
+    //
+    if (li_length < 0) {
+        li_length = 0;
+    } else if (li_length > IPC_LOG_LINE_MAX - 2) {
+        li_length = IPC_LOG_LINE_MAX - 2;
+    }
+    pptrc_line[li_length] = '\n';
+    //
+    return li_length + 1;
+}
+
+int fi_logInit(void) {
+    //
+    if (gi_initialized) {
+        return 0;
+    }
+    // zero-filled; shared, so that the children forked later write through this writer
+    gptrO_ring = mmap(NULL, sizeof(*gptrO_ring), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    //
+    if (gptrO_ring == MAP_FAILED) {
+        gptrO_ring = NULL;
+        return -1;
+    }
+    for (unsigned i = 0; i < LOG_SLOTS; ++i) {
+        atomic_init(&gptrO_ring->mO_a1_slots[i].mul_sequence, i);
+    }
+    // from now on, what the program still prints directly (e.g. start-up steps) is written
+    // at once: it keeps its place among the queued lines, and a forked child has nothing
+    // buffered by stdio that it would print a second time
+    fflush(stdout);
+    setvbuf(stdout, NULL, _IONBF, 0);
+    //
+    atomic_store(&gi_writerRunning, 1);
+    //
+    if (fi_logStartWriter() < 0) {
+        return -1;
+    }
+    pthread_atfork(NULL, NULL, fv_logAtForkChild);
+    atexit(fv_logShutdown);
+    gi_initialized = 1;
+    //
+    return 0;
+}
+
+void fv_logSetLevel(int pi_level) {
+    gi_logLevel = pi_level;
+}
+
+int fi_logLevelParse(const char *cptrc_name) {
+    //
+    static const char *const lptrc_a1_names[] = { "error", "warn", "info", "debug" };
+    //
+    for (int i = IPC_LOG_ERROR; i <= IPC_LOG_DEBUG; ++i) {
+        if (strcmp(cptrc_name, lptrc_a1_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void fv_logWrite(int pi_level, const char *cptrc_format, ...) {
+    //
+    va_list lO_arguments;
+    // callers log an error and then look at errno again: leave it as it was
+    int     li_errno = errno;
+    //
+    if (!gi_initialized) {
+        va_start(lO_arguments, cptrc_format);
+        vfprintf(pi_level <= IPC_LOG_WARN ? stderr : stdout, cptrc_format, lO_arguments);
+        va_end(lO_arguments);
+        fputc('\n', pi_level <= IPC_LOG_WARN ? stderr : stdout);
+        return;
+    }
+    //
+    // claim a slot; a full ring loses the line rather than blocking the caller
+    unsigned long       lul_position = atomic_load_explicit(&gptrO_ring->mul_tail, memory_order_relaxed);
+    struct ipc_logSlot *lptrO_slot;
+    //
+    while (1) {
+        lptrO_slot = &gptrO_ring->mO_a1_slots[lul_position & (LOG_SLOTS - 1)];
+        //
+        long ll_difference = (long) (atomic_load_explicit(&lptrO_slot->mul_sequence, memory_order_acquire) -
+                                     lul_position);
+        //
+        if (ll_difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&gptrO_ring->mul_tail, &lul_position, lul_position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (ll_difference < 0) {
+            atomic_fetch_add_explicit(&gptrO_ring->mul_dropped, 1, memory_order_relaxed);
+            return;
+        } else {
+            lul_position = atomic_load_explicit(&gptrO_ring->mul_tail, memory_order_relaxed);
+        }
+    }
+    //
+    // formatted in place, with the caller's errno for %m
+    errno = li_errno;
+    va_start(lO_arguments, cptrc_format);
+    lptrO_slot->mui_length = fui_logFormat(lptrO_slot->mc_a1_line, cptrc_format, lO_arguments);
+    va_end(lO_arguments);
+    lptrO_slot->mi_level = pi_level;
+    // published unless the writer gave the slot up for stalled meanwhile (see fv_logSkipStalled())
+    atomic_compare_exchange_strong_explicit(&lptrO_slot->mul_sequence, &lul_position, lul_position + 1,
+                                            memory_order_release, memory_order_relaxed);
+    //
+    fv_logNotify();
+    errno = li_errno;
+}
@@ -0,0 +1,68 @@
+/*
+ * Asynchronous logging
+ * A log call formats its line into a slot of a lock-free ring and returns;
+ * a background thread writes the lines out, many per system call,
+ * so a slow terminal, pipe or disk never stalls a connection
+ * When the ring is full, lines are dropped (and counted), never waited for
+ * The ring is shared with forked children: their lines go through the parent's writer
+ * Levels below IPC_LOG_COMPILED_LEVEL are compiled out entirely:
+ * their arguments are not even evaluated
+ */
+#ifndef IPC_LOG_H
+#define IPC_LOG_H
+
+#define IPC_LOG_ERROR 0
+#define IPC_LOG_WARN  1
+#define IPC_LOG_INFO  2
+#define IPC_LOG_DEBUG 3
+
+// longest line kept, newline included
+#define IPC_LOG_LINE_MAX 512
+
+// most verbose level built in: -DIPC_LOG_COMPILED_LEVEL=IPC_LOG_DEBUG keeps the debug lines
+#ifndef IPC_LOG_COMPILED_LEVEL
+#define IPC_LOG_COMPILED_LEVEL IPC_LOG_INFO
+#endif
+
+// most verbose level written at run time, see fv_logSetLevel()
+extern int gi_logLevel;
+
+#define IPC_LOG(pi_level, ...)                                                         \
+    do {                                                                               \
+        if ((pi_level) <= IPC_LOG_COMPILED_LEVEL && (pi_level) <= gi_logLevel) {       \
+            fv_logWrite((pi_level), __VA_ARGS__);                                      \
+        }                                                                              \
+    } while (0)
+
+#define IPC_LOGE(...) IPC_LOG(IPC_LOG_ERROR, __VA_ARGS__)
+#define IPC_LOGW(...) IPC_LOG(IPC_LOG_WARN, __VA_ARGS__)
+#define IPC_LOGI(...) IPC_LOG(IPC_LOG_INFO, __VA_ARGS__)
+#define IPC_LOGD(...) IPC_LOG(IPC_LOG_DEBUG, __VA_ARGS__)
+
+/*
+ * Start the writer thread; errors and warnings go to stderr, the rest to stdout
+ * stdout is made unbuffered, so that lines still printed directly keep their order
+ * The ring is flushed when the process exits; a forked child starts no writer,
+ * its lines are queued on the same ring and written by its parent's
+ * Returns 0, or -1 (with errno set) if the writer cannot be started
+ */
+int fi_logInit(void);
+
+void fv_logSetLevel(int pi_level);
+
+/*
+ * Level named "error", "warn", "info" or "debug"
+ * Returns -1 if the name is none of those
+ */
+int fi_logLevelParse(const char *cptrc_name);
+
+/*
+ * Queue one line (a newline is added), cut to IPC_LOG_LINE_MAX bytes;
+ * the format may use %m, like perror() does
+ * Before fi_logInit(), the line is written at once instead
+ * Use the IPC_LOG*() macros instead, so that disabled levels cost nothing
+ */
+void fv_logWrite(int pi_level, const char *cptrc_format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#endif  // IPC_LOG_H
@@ -0,0 +1,104 @@
+/*
+ * Compact binary messages
+ * A message is a fixed 24-byte header, a table of blob descriptors, and the blobs:
+ *
+ *  0      2       4         8            16             24                    24 + 8 * blobs
+ *  +------+-------+---------+------------+--------------+---------------------+----------...
+ *  | kind | blobs | status  | sequence   | timestamp ns | blobs x             | blob bytes
+ *  |      |       |         |            |              | {offset, size}      |
+ *  +------+-------+---------+------------+--------------+---------------------+----------...
+ *
+ * All fields are LITTLE-endian, the native order of the hosts this runs on, and naturally
+ * aligned within the message; blob offsets count from the start of the message
+ * Nothing is parsed or copied out: once fi_messageValidate() accepted a buffer,
+ * the accessors below read each field in place, and a blob is a pointer into the buffer
+ * Messages travel as the payload of IPC_FRAME_MESSAGE frames (see ipc_frame.h)
+ */
+#ifndef IPC_MESSAGE_H
+#define IPC_MESSAGE_H
+
+#include <endian.h>  // le16toh() and friends (default feature set)
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#define IPC_MESSAGE_HEADER_SIZE 24
+#define IPC_MESSAGE_BLOB_SIZE   8
+// most blobs in a message
+#define IPC_MESSAGE_BLOBS_MAX   16
+// largest message, header and blobs included: it must fit one pooled buffer
+#define IPC_MESSAGE_SIZE_MAX    (64 * 1024)
+
+// what a message is
+enum ipc_messageKind {
+    IPC_MESSAGE_NOTE    = 1,  // from a client: blob 0 is its text
+    IPC_MESSAGE_RECEIPT = 2   // server's answer: the note's sequence and timestamp, and a status
+};
+
+/*
+ * Check that a received message is well formed: its header and blob table lie within
+ * psz_length bytes, and every blob lies behind the table and within the message
+ * Returns 0, or -1 (errno EPROTO)
+ */
+int fi_messageValidate(const void *pptrv_message, size_t psz_length);
+
+/*
+ * Encode a message with pi_blobs blobs (at most IPC_MESSAGE_BLOBS_MAX) into pptrv_out
+ * Returns the number of bytes written, or 0 if they do not fit into psz_room
+ */
+size_t fsz_messageEncode(void               *pptrv_out,
+                         size_t              psz_room,
+                         uint16_t            pus_kind,
+                         uint32_t            pui_status,
+                         uint64_t            pul_sequence,
+                         uint64_t            pul_timestamp,
+                         const struct iovec *pptrO_a1_blobs,
+                         int                 pi_blobs);
+
+// in-place accessors, valid on a validated message only
+
+static inline uint16_t fus_messageKind(const void *pptrv_message) {
+    uint16_t lus_value;
+    memcpy(&lus_value, (const char *) pptrv_message, sizeof(lus_value));
+    return le16toh(lus_value);
+}
+
+static inline uint16_t fus_messageBlobs(const void *pptrv_message) {
+    uint16_t lus_value;
+    memcpy(&lus_value, (const char *) pptrv_message + 2, sizeof(lus_value));
+    return le16toh(lus_value);
+}
+
+static inline uint32_t fui_messageStatus(const void *pptrv_message) {
+    uint32_t lui_value;
+    memcpy(&lui_value, (const char *) pptrv_message + 4, sizeof(lui_value));
+    return le32toh(lui_value);
+}
+
+static inline uint64_t ful_messageSequence(const void *pptrv_message) {
+    uint64_t lul_value;
+    memcpy(&lul_value, (const char *) pptrv_message + 8, sizeof(lul_value));
+    return le64toh(lul_value);
+}
+
+static inline uint64_t ful_messageTimestamp(const void *pptrv_message) {
+    uint64_t lul_value;
+    memcpy(&lul_value, (const char *) pptrv_message + 16, sizeof(lul_value));
+    return le64toh(lul_value);
+}
+
+// blob pui_index (below fus_messageBlobs()), its size in *pptrsz_size
+static inline const char *fptrc_messageBlob(const void *pptrv_message, unsigned pui_index, size_t *pptrsz_size) {
+    const char *lptrc_entry = (const char *) pptrv_message + IPC_MESSAGE_HEADER_SIZE + pui_index * IPC_MESSAGE_BLOB_SIZE;
+    uint32_t    lui_offset,
+                lui_size;
+    //
+    memcpy(&lui_offset, lptrc_entry, sizeof(lui_offset));
+    memcpy(&lui_size, lptrc_entry + 4, sizeof(lui_size));
+    *pptrsz_size = le32toh(lui_size);
+    //
+    return (const char *) pptrv_message + le32toh(lui_offset);
+}
+
+#endif  // IPC_MESSAGE_H
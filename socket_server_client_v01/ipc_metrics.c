@@ -0,0 +1,348 @@
+/*
+ * Server metrics
+ * The start of each phase is stamped in a table indexed by descriptor, private to
+ * the process: a connection is only ever served by one thread at a time, and
+ * a forked child inherits the stamps of the connection it was forked for
+ * References:
+ *  man 7 shm_overview
+ */
+#define _GNU_SOURCE  // strerrorname_np()
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ipc_metrics.h"
+
+// descriptors whose phases are timed; connections on higher ones are only counted
+#define METRICS_DESCRIPTORS 65536
+
+// when the phases of a connection started (0: not started)
+struct ipc_metricsStamps {
+    uint64_t mul_accepted;
+    uint64_t mul_read;
+};
+
+static struct ipc_metricsRegion  *gptrO_region = NULL;
+static struct ipc_metricsStamps   gO_a1_stamps[METRICS_DESCRIPTORS];
+// slot of the calling thread, taken on its first update
+static __thread struct ipc_metricsWorker *gptrO_worker = NULL;
+
+// "/c-ipc-metrics-<name>", with the slashes of a socket path replaced
+static void fv_metricsRegionName(const char *cptrc_name, char *pptrc_out, size_t psz_room) {
+    //
+    size_t lsz_length = (size_t) snprintf(pptrc_out, psz_room, "/c-ipc-metrics-%s", cptrc_name);
+    //
+    for (size_t i = 1; i < lsz_length && i < psz_room; ++i) {
+        if (pptrc_out[i] == '/') {
+            pptrc_out[i] = '_';
+        }
+    }
+}
+
+// in a forked child, the slot of the parent's thread belongs to the parent
+static void fv_metricsAtForkChild(void) {
+    gptrO_worker = NULL;
+}
+
+static struct ipc_metricsWorker *fptrO_metricsWorker(void) {
+    //
+    if (gptrO_worker == NULL) {
+        unsigned lui_slot = atomic_fetch_add(&gptrO_region->mui_nextWorker, 1);
+        //
+        gptrO_worker = &gptrO_region->mO_a1_workers[lui_slot % IPC_METRICS_WORKERS];
+    }
+    return gptrO_worker;
+}
+
+static unsigned fui_metricsBucket(uint64_t pul_nanoseconds) {
+    return pul_nanoseconds == 0 ? 0 : 64 - __builtin_clzll(pul_nanoseconds);
+}
+
+static void fv_metricsLatency(struct ipc_metricsWorker *pptrO_worker,
+                              enum ipc_metricsPhase     pe_phase,
+                              uint64_t                  pul_nanoseconds,
+                              unsigned                  pui_count) {
+    //
+    unsigned lui_bucket = fui_metricsBucket(pul_nanoseconds);
+    //
+    if (lui_bucket >= IPC_METRICS_BUCKETS) {
+        lui_bucket = IPC_METRICS_BUCKETS - 1;
+    }
+    atomic_fetch_add_explicit(&pptrO_worker->mul_a2_latency[pe_phase][lui_bucket], pui_count, memory_order_relaxed);
+    atomic_fetch_add_explicit(&pptrO_worker->mul_a1_latencySum[pe_phase], pul_nanoseconds * pui_count,
+                              memory_order_relaxed);
+}
+
+int fi_metricsInit(const char *cptrc_name) {
+    //
+    char lc_a1_name[NAME_MAX];
+    fv_metricsRegionName(cptrc_name, lc_a1_name, sizeof(lc_a1_name));
+    //
+    // a region left behind by a server that did not exit cleanly is replaced
+    shm_unlink(lc_a1_name);
+    //
+    int li_shm_fd = shm_open(lc_a1_name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    //
+    if (li_shm_fd < 0) {
+        return -1;
+    }
+    // a fresh region reads as all zeroes: every counter starts at 0
+    if (ftruncate(li_shm_fd, sizeof(struct ipc_metricsRegion)) < 0) {
+        close(li_shm_fd);
+        shm_unlink(lc_a1_name);
+        return -1;
+    }
+    //
+    struct ipc_metricsRegion *lptrO_region = mmap(NULL, sizeof(struct ipc_metricsRegion),
+                                                  PROT_READ | PROT_WRITE, MAP_SHARED, li_shm_fd, 0);
+    close(li_shm_fd);
+    //
+    if (lptrO_region == MAP_FAILED) {
+        shm_unlink(lc_a1_name);
+        return -1;
+    }
+    //
+    struct timespec lO_now;
+    clock_gettime(CLOCK_REALTIME, &lO_now);
+    //
+    lptrO_region->mui_version = IPC_METRICS_VERSION;
+    lptrO_region->mi_serverPID = getpid();
+    lptrO_region->mul_startedNanoseconds = (uint64_t) lO_now.tv_sec * 1000000000ull + lO_now.tv_nsec;
+    // readers only trust the region once the magic is there, i.e., after everything above
+    atomic_store(&lptrO_region->mui_magic, IPC_METRICS_MAGIC);
+    //
+    pthread_atfork(NULL, NULL, fv_metricsAtForkChild);
+    gptrO_region = lptrO_region;
+    //
+    return 0;
+}
+
+uint64_t ful_metricsNow(void) {
+    struct timespec lO_now;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_now);
+    //
+    return (uint64_t) lO_now.tv_sec * 1000000000ull + lO_now.tv_nsec;
+}
+
+void fv_metricsAccept(int pi_socketRW_fd) {
+    //
+    if (gptrO_region == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&fptrO_metricsWorker()->mul_accepts, 1, memory_order_relaxed);
+    //
+    if (pi_socketRW_fd >= 0 && pi_socketRW_fd < METRICS_DESCRIPTORS) {
+        gO_a1_stamps[pi_socketRW_fd].mul_accepted = ful_metricsNow();
+        gO_a1_stamps[pi_socketRW_fd].mul_read = 0;
+    }
+}
+
+void fv_metricsClose(int pi_socketRW_fd) {
+    //
+    if (gptrO_region == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&fptrO_metricsWorker()->mul_closes, 1, memory_order_relaxed);
+    //
+    if (pi_socketRW_fd >= 0 && pi_socketRW_fd < METRICS_DESCRIPTORS) {
+        gO_a1_stamps[pi_socketRW_fd].mul_accepted = 0;
+        gO_a1_stamps[pi_socketRW_fd].mul_read = 0;
+    }
+}
+
+void fv_metricsReject(void) {
+    //
+    if (gptrO_region == NULL) {
+        return;
+    }
+    atomic_fetch_add_explicit(&fptrO_metricsWorker()->mul_rejects, 1, memory_order_relaxed);
+}
+
+void fv_metricsRead(int pi_socketRW_fd, size_t psz_bytes) {
+    //
+    if (gptrO_region == NULL) {
+        return;
+    }
+    struct ipc_metricsWorker *lptrO_worker = fptrO_metricsWorker();
+    //
+    atomic_fetch_add_explicit(&lptrO_worker->mul_bytesIn, psz_bytes, memory_order_relaxed);
+    //
+    if (pi_socketRW_fd < 0 || pi_socketRW_fd >= METRICS_DESCRIPTORS) {
+        return;
+    }
+    struct ipc_metricsStamps *lptrO_stamps = &gO_a1_stamps[pi_socketRW_fd];
+    uint64_t                  lul_now = ful_metricsNow();
+    //
+    if (lptrO_stamps->mul_accepted != 0) {
+        fv_metricsLatency(lptrO_worker, IPC_PHASE_ACCEPT_READ, lul_now - lptrO_stamps->mul_accepted, 1);
+        lptrO_stamps->mul_accepted = 0;
+    }
+    // the replies sent next answer what was read from here on
+    if (lptrO_stamps->mul_read == 0) {
+        lptrO_stamps->mul_read = lul_now;
+    }
+}
+
+void fv_metricsSend(int pi_socketRW_fd, size_t psz_bytes, unsigned pui_replies) {
+    //
+    if (gptrO_region == NULL) {
+        return;
+    }
+    struct ipc_metricsWorker *lptrO_worker = fptrO_metricsWorker();
+    //
+    atomic_fetch_add_explicit(&lptrO_worker->mul_bytesOut, psz_bytes, memory_order_relaxed);
+    atomic_fetch_add_explicit(&lptrO_worker->mul_requests, pui_replies, memory_order_relaxed);
+    //
+    if (pi_socketRW_fd < 0 || pi_socketRW_fd >= METRICS_DESCRIPTORS ||
+        gO_a1_stamps[pi_socketRW_fd].mul_read == 0) {
+        return;
+    }
+    fv_metricsLatency(lptrO_worker, IPC_PHASE_READ_SEND,
+                      ful_metricsNow() - gO_a1_stamps[pi_socketRW_fd].mul_read, pui_replies);
+    gO_a1_stamps[pi_socketRW_fd].mul_read = 0;
+}
+
+void fv_metricsError(int pi_errno) {
+    //
+    if (gptrO_region == NULL) {
+        return;
+    }
+    if (pi_errno < 0 || pi_errno >= IPC_METRICS_ERRNOS) {
+        pi_errno = IPC_METRICS_ERRNOS - 1;
+    }
+    atomic_fetch_add_explicit(&fptrO_metricsWorker()->mul_a1_errors[pi_errno], 1, memory_order_relaxed);
+}
+
+const struct ipc_metricsRegion *fptrO_metricsAttach(const char *cptrc_name) {
+    //
+    char lc_a1_name[NAME_MAX];
+    fv_metricsRegionName(cptrc_name, lc_a1_name, sizeof(lc_a1_name));
+    //
+    int li_shm_fd = shm_open(lc_a1_name, O_RDONLY, 0);
+    //
+    if (li_shm_fd < 0) {
+        return NULL;
+    }
+    //
+    struct ipc_metricsRegion *lptrO_region = mmap(NULL, sizeof(struct ipc_metricsRegion),
+                                                  PROT_READ, MAP_SHARED, li_shm_fd, 0);
+    close(li_shm_fd);
+    //
+    if (lptrO_region == MAP_FAILED) {
+        return NULL;
+    }
+    if (atomic_load(&lptrO_region->mui_magic) != IPC_METRICS_MAGIC ||
+        lptrO_region->mui_version != IPC_METRICS_VERSION ||
+        (kill(lptrO_region->mi_serverPID, 0) < 0 && errno == ESRCH)) {
+        munmap(lptrO_region, sizeof(struct ipc_metricsRegion));
+        errno = ECONNREFUSED;
+        return NULL;
+    }
+    return lptrO_region;
+}
+
+// upper bound of bucket pui_bucket, in nanoseconds
+static uint64_t ful_metricsBucketLimit(unsigned pui_bucket) {
+    return pui_bucket == 0 ? 0 : (pui_bucket >= 64 ? UINT64_MAX : (1ull << pui_bucket) - 1);
+}
+
+void fv_metricsPrint(const struct ipc_metricsRegion *pptrO_region, FILE *pptrO_stream) {
+    //
+    static const char *const lptrc_a1_phases[IPC_PHASE_COUNT] = { "accept_read", "read_send" };
+    //
+    uint64_t lul_accepts = 0, lul_closes = 0, lul_rejects = 0, lul_requests = 0, lul_bytesIn = 0, lul_bytesOut = 0;
+    uint64_t lul_a1_errors[IPC_METRICS_ERRNOS] = {0};
+    uint64_t lul_a2_latency[IPC_PHASE_COUNT][IPC_METRICS_BUCKETS] = {{0}};
+    uint64_t lul_a1_latencySum[IPC_PHASE_COUNT] = {0};
+    //
+    // each counter is read on its own: totals are consistent per counter, not across them
+    for (int w = 0; w < IPC_METRICS_WORKERS; ++w) {
+        const struct ipc_metricsWorker *lptrO_worker = &pptrO_region->mO_a1_workers[w];
+        //
+        lul_accepts += atomic_load_explicit(&lptrO_worker->mul_accepts, memory_order_relaxed);
+        lul_closes += atomic_load_explicit(&lptrO_worker->mul_closes, memory_order_relaxed);
+        lul_rejects += atomic_load_explicit(&lptrO_worker->mul_rejects, memory_order_relaxed);
+        lul_requests += atomic_load_explicit(&lptrO_worker->mul_requests, memory_order_relaxed);
+        lul_bytesIn += atomic_load_explicit(&lptrO_worker->mul_bytesIn, memory_order_relaxed);
+        lul_bytesOut += atomic_load_explicit(&lptrO_worker->mul_bytesOut, memory_order_relaxed);
+        //
+        for (int e = 0; e < IPC_METRICS_ERRNOS; ++e) {
+            lul_a1_errors[e] += atomic_load_explicit(&lptrO_worker->mul_a1_errors[e], memory_order_relaxed);
+        }
+        for (int p = 0; p < IPC_PHASE_COUNT; ++p) {
+            lul_a1_latencySum[p] += atomic_load_explicit(&lptrO_worker->mul_a1_latencySum[p], memory_order_relaxed);
+            //
+            for (int b = 0; b < IPC_METRICS_BUCKETS; ++b) {
+                lul_a2_latency[p][b] += atomic_load_explicit(&lptrO_worker->mul_a2_latency[p][b],
+                                                             memory_order_relaxed);
+            }
+        }
+    }
+    //
+    struct timespec lO_now;
+    clock_gettime(CLOCK_REALTIME, &lO_now);
+    //
+    double ld_uptime = ((uint64_t) lO_now.tv_sec * 1000000000ull + lO_now.tv_nsec -
+                        pptrO_region->mul_startedNanoseconds) / 1e9;
+    //
+    fprintf(pptrO_stream,
+            "{\"pid\":%d,\"uptime_s\":%.3f,\"accepts\":%llu,\"accepts_per_s\":%.1f,"
+            "\"active_connections\":%lld,\"rejects\":%llu,\"requests\":%llu,\"bytes_in\":%llu,\"bytes_out\":%llu,\"errors\":{",
+            pptrO_region->mi_serverPID, ld_uptime,
+            (unsigned long long) lul_accepts, ld_uptime > 0 ? lul_accepts / ld_uptime : 0.0,
+            (long long) (lul_accepts - lul_closes), (unsigned long long) lul_rejects,
+            (unsigned long long) lul_requests, (unsigned long long) lul_bytesIn, (unsigned long long) lul_bytesOut);
+    //
+    const char *lptrc_separator = "";
+    //
+    for (int e = 0; e < IPC_METRICS_ERRNOS; ++e) {
+        if (lul_a1_errors[e] > 0) {
+            fprintf(pptrO_stream, "%s\"%s\":%llu", lptrc_separator,
+                    e == IPC_METRICS_ERRNOS - 1 ? "other" : strerrorname_np(e) ? strerrorname_np(e) : "unknown",
+                    (unsigned long long) lul_a1_errors[e]);
+            lptrc_separator = ",";
+        }
+    }
+    fprintf(pptrO_stream, "},\"latency_ns\":{");
+    //
+    for (int p = 0; p < IPC_PHASE_COUNT; ++p) {
+        uint64_t lul_count = 0;
+        //
+        for (int b = 0; b < IPC_METRICS_BUCKETS; ++b) {
+            lul_count += lul_a2_latency[p][b];
+        }
+        fprintf(pptrO_stream, "%s\"%s\":{\"count\":%llu,\"mean\":%llu", p > 0 ? "," : "", lptrc_a1_phases[p],
+                (unsigned long long) lul_count,
+                (unsigned long long) (lul_count > 0 ? lul_a1_latencySum[p] / lul_count : 0));
+        //
+        // percentiles are bucket upper bounds: within a factor of 2 of the truth
+        static const double ld_a1_percentiles[] = { 0.50, 0.90, 0.99, 0.999 };
+        static const char *const lptrc_a1_percentiles[] = { "p50", "p90", "p99", "p999" };
+        //
+        for (int q = 0; q < 4; ++q) {
+            uint64_t lul_rank = (uint64_t) (ld_a1_percentiles[q] * lul_count + 0.5),
+                     lul_seen = 0;
+            int      b = 0;
+            //
+            for (; b < IPC_METRICS_BUCKETS - 1; ++b) {
+                lul_seen += lul_a2_latency[p][b];
+                //
+                if (lul_seen >= lul_rank && lul_seen > 0) {
+                    break;
+                }
+            }
+            fprintf(pptrO_stream, ",\"%s\":%llu", lptrc_a1_percentiles[q],
+                    (unsigned long long) (lul_count > 0 ? ful_metricsBucketLimit(b) : 0));
+        }
+        fprintf(pptrO_stream, "}");
+    }
+    fprintf(pptrO_stream, "}}\n");
+}
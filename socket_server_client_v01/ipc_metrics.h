@@ -0,0 +1,94 @@
+/*
+ * Server metrics
+ * Counters and per-phase latency histograms live in a shared-memory region,
+ * /c-ipc-metrics-<port>, that any tool on the host can map read-only and scrape
+ * while the server runs: reading them never touches the serving path
+ * Every serving process or thread updates a cache-line-aligned worker slot of its own
+ * with relaxed atomic adds; readers add the slots up, no lock anywhere
+ * (a forked child takes a fresh slot; with more workers than slots, some share one)
+ */
+#ifndef IPC_METRICS_H
+#define IPC_METRICS_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define IPC_METRICS_MAGIC    0x4d504943u  // "CIPM"
+#define IPC_METRICS_VERSION  2
+// worker slots in the region
+#define IPC_METRICS_WORKERS  64
+// errno values counted one by one; larger ones share the last counter
+#define IPC_METRICS_ERRNOS   134
+// latency buckets: bucket i counts durations of [2^(i-1), 2^i) ns, bucket 0 those of 0 ns
+#define IPC_METRICS_BUCKETS  64
+
+// phases of serving a connection, timed in nanoseconds
+enum ipc_metricsPhase {
+    IPC_PHASE_ACCEPT_READ = 0,  // from accept() to the first message read
+    IPC_PHASE_READ_SEND,        // from a message read to its reply sent
+    IPC_PHASE_COUNT
+};
+
+struct ipc_metricsWorker {
+    _Alignas(64) atomic_ulong mul_accepts;
+    atomic_ulong              mul_closes;
+    atomic_ulong              mul_rejects;
+    atomic_ulong              mul_requests;
+    atomic_ulong              mul_bytesIn;
+    atomic_ulong              mul_bytesOut;
+    atomic_ulong              mul_a1_errors[IPC_METRICS_ERRNOS];
+    atomic_ulong              mul_a2_latency[IPC_PHASE_COUNT][IPC_METRICS_BUCKETS];
+    atomic_ulong              mul_a1_latencySum[IPC_PHASE_COUNT];
+};
+
+struct ipc_metricsRegion {
+    atomic_uint              mui_magic;
+    uint32_t                 mui_version;
+    int32_t                  mi_serverPID;
+    // CLOCK_REALTIME of the server's start, to turn totals into rates
+    uint64_t                 mul_startedNanoseconds;
+    // slots handed out so far (modulo IPC_METRICS_WORKERS)
+    atomic_uint              mui_nextWorker;
+    struct ipc_metricsWorker mO_a1_workers[IPC_METRICS_WORKERS];
+};
+
+/*
+ * Create the region of the server named cptrc_name (its port or socket path)
+ * Until this succeeds, every fv_metrics*() call does nothing
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_metricsInit(const char *cptrc_name);
+
+// nanoseconds of CLOCK_MONOTONIC
+uint64_t ful_metricsNow(void);
+
+// a connection was accepted on pi_socketRW_fd: counted, and its accept→read phase starts
+void fv_metricsAccept(int pi_socketRW_fd);
+
+// the connection on pi_socketRW_fd is closed
+void fv_metricsClose(int pi_socketRW_fd);
+
+// a connection was turned away by admission control, without being served
+void fv_metricsReject(void);
+
+// psz_bytes of requests read on pi_socketRW_fd (-1: no connection, phases not timed)
+void fv_metricsRead(int pi_socketRW_fd, size_t psz_bytes);
+
+// psz_bytes of pui_replies replies sent on pi_socketRW_fd: ends their read→send phase
+void fv_metricsSend(int pi_socketRW_fd, size_t psz_bytes, unsigned pui_replies);
+
+// an operation failed with pi_errno
+void fv_metricsError(int pi_errno);
+
+/*
+ * Map the region of the server named cptrc_name read-only
+ * Returns NULL (with errno set; ECONNREFUSED if it holds no metrics of a running server)
+ */
+const struct ipc_metricsRegion *fptrO_metricsAttach(const char *cptrc_name);
+
+// add up the worker slots and print them as one JSON object
+void fv_metricsPrint(const struct ipc_metricsRegion *pptrO_region, FILE *pptrO_stream);
+
+#endif  // IPC_METRICS_H
@@ -0,0 +1,148 @@
+/*
+ * Per-connection output queue
+ * References:
+ *  man 7 tcp (TCP_NODELAY, TCP_CORK)
+ *  man 2 sendmsg
+ */
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "ipc_output.h"
+
+// set once, before any connection is served
+static enum ipc_outputPolicy ge_policy = IPC_OUTPUT_LATENCY;
+
+int fi_outputSetPolicy(const char *cptrc_policy) {
+    //
+    if (strcmp(cptrc_policy, "latency") == 0) {
+        ge_policy = IPC_OUTPUT_LATENCY;
+    } else if (strcmp(cptrc_policy, "throughput") == 0) {
+        ge_policy = IPC_OUTPUT_THROUGHPUT;
+    } else {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+void fv_outputInit(struct ipc_output *pptrO_output, int pi_socket_fd) {
+    //
+    int li_enable = 1;
+    //
+    pptrO_output->mi_socket_fd = pi_socket_fd;
+    pptrO_output->mi_parts = 0;
+    pptrO_output->msz_queued = 0;
+    pptrO_output->msz_staged = 0;
+    //
+    // the two exclude each other: TCP_CORK wins while set
+    pptrO_output->mi_corked = ge_policy == IPC_OUTPUT_THROUGHPUT &&
+                              setsockopt(pi_socket_fd, IPPROTO_TCP, TCP_CORK, &li_enable, sizeof(li_enable)) == 0;
+    //
+    if (!pptrO_output->mi_corked) {
+        setsockopt(pi_socket_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+    }
+}
+
+int fi_outputFits(const struct ipc_output *pptrO_output, size_t psz_copied, int pi_referenced) {
+    return pptrO_output->msz_staged + psz_copied <= IPC_OUTPUT_STAGING_SIZE &&
+           pptrO_output->mi_parts + pi_referenced + (psz_copied > 0) <= IPC_OUTPUT_PARTS_MAX;
+}
+
+int fi_outputAppend(struct ipc_output *pptrO_output, const void *pptrv_data, size_t psz_length, int pi_stable) {
+    //
+    if (psz_length == 0) {
+        return 0;
+    }
+    struct iovec *lptrO_last = pptrO_output->mi_parts > 0
+                                   ? &pptrO_output->mO_a1_parts[pptrO_output->mi_parts - 1] : NULL;
+    //
+    if (pi_stable && psz_length > IPC_OUTPUT_COPY_MAX) {
+        if (!fi_outputFits(pptrO_output, 0, 1)) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        pptrO_output->mO_a1_parts[pptrO_output->mi_parts].iov_base = (void *) pptrv_data;
+        pptrO_output->mO_a1_parts[pptrO_output->mi_parts].iov_len = psz_length;
+        ++pptrO_output->mi_parts;
+    } else {
+        char *lptrc_staged = pptrO_output->mc_a1_staging + pptrO_output->msz_staged;
+        // right behind the previous copy: the same fragment grows
+        int   li_adjacent = lptrO_last != NULL && (char *) lptrO_last->iov_base + lptrO_last->iov_len == lptrc_staged;
+        //
+        if (!fi_outputFits(pptrO_output, psz_length, li_adjacent ? -1 : 0)) {
+            errno = ENOBUFS;
+            return -1;
+        }
+        memcpy(lptrc_staged, pptrv_data, psz_length);
+        pptrO_output->msz_staged += psz_length;
+        //
+        if (li_adjacent) {
+            lptrO_last->iov_len += psz_length;
+        } else {
+            pptrO_output->mO_a1_parts[pptrO_output->mi_parts].iov_base = lptrc_staged;
+            pptrO_output->mO_a1_parts[pptrO_output->mi_parts].iov_len = psz_length;
+            ++pptrO_output->mi_parts;
+        }
+    }
+    pptrO_output->msz_queued += psz_length;
+    //
+    return 0;
+}
+
+size_t fsz_outputQueued(const struct ipc_output *pptrO_output) {
+    return pptrO_output->msz_queued;
+}
+
+int fi_outputFlush(struct ipc_output *pptrO_output) {
+    //
+    struct msghdr lO_message;
+    //
+    memset(&lO_message, 0, sizeof(lO_message));
+    lO_message.msg_iov = pptrO_output->mO_a1_parts;
+    lO_message.msg_iovlen = pptrO_output->mi_parts;
+    //
+    while (lO_message.msg_iovlen > 0) {
+        ssize_t li_n = sendmsg(pptrO_output->mi_socket_fd, &lO_message, MSG_NOSIGNAL);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        // after a short write, resume where it stopped: skip the parts sent, trim the one cut
+        while (lO_message.msg_iovlen > 0 && (size_t) li_n >= lO_message.msg_iov->iov_len) {
+            li_n -= lO_message.msg_iov->iov_len;
+            ++lO_message.msg_iov;
+            --lO_message.msg_iovlen;
+        }
+        if (lO_message.msg_iovlen > 0) {
+            lO_message.msg_iov->iov_base = (char *) lO_message.msg_iov->iov_base + li_n;
+            lO_message.msg_iov->iov_len -= li_n;
+        }
+    }
+    pptrO_output->mi_parts = 0;
+    pptrO_output->msz_queued = 0;
+    pptrO_output->msz_staged = 0;
+    //
+    return 0;
+}
+
+int fi_outputPush(struct ipc_output *pptrO_output) {
+    //
+    if (fi_outputFlush(pptrO_output) < 0) {
+        return -1;
+    }
+    // pulling the cork sends what it held back, putting it back holds the next replies again
+    if (pptrO_output->mi_corked) {
+        int li_value = 0;
+        //
+        setsockopt(pptrO_output->mi_socket_fd, IPPROTO_TCP, TCP_CORK, &li_value, sizeof(li_value));
+        li_value = 1;
+        setsockopt(pptrO_output->mi_socket_fd, IPPROTO_TCP, TCP_CORK, &li_value, sizeof(li_value));
+    }
+    return 0;
+}
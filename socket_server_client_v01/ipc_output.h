@@ -0,0 +1,74 @@
+/*
+ * Per-connection output queue
+ * Replies are queued as fragments (a frame header, a payload) and leave together,
+ * gathered by one sendmsg() from where they lie: a fragment that stays valid until
+ * the flush (a constant, a buffer the caller holds on to) is referenced, not copied;
+ * small transient ones are copied into the queue's staging area, next to each other
+ * Two policies for when flushed bytes leave the host:
+ *  latency (default): TCP_NODELAY, every flush goes out at once
+ *  throughput: TCP_CORK, flushed bytes wait until they fill a segment or the caller
+ *   reaches a flush point (fi_outputPush(): e.g., no request left to read), so that
+ *   pipelined replies answered across several reads still share segments
+ */
+#ifndef IPC_OUTPUT_H
+#define IPC_OUTPUT_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// most fragments, and most staged bytes, queued before a flush is due
+#define IPC_OUTPUT_PARTS_MAX    64
+#define IPC_OUTPUT_STAGING_SIZE (16 * 1024)
+// shorter fragments are cheaper to copy than to gather
+#define IPC_OUTPUT_COPY_MAX     256
+
+enum ipc_outputPolicy {
+    IPC_OUTPUT_LATENCY,
+    IPC_OUTPUT_THROUGHPUT
+};
+
+struct ipc_output {
+    int          mi_socket_fd;
+    int          mi_corked;
+    struct iovec mO_a1_parts[IPC_OUTPUT_PARTS_MAX];
+    int          mi_parts;
+    size_t       msz_queued;
+    char         mc_a1_staging[IPC_OUTPUT_STAGING_SIZE];
+    size_t       msz_staged;
+};
+
+/*
+ * Policy of the queues set up from now on; call before serving (workers inherit it)
+ * Returns 0, or -1 (errno EINVAL) for a name other than "latency" or "throughput"
+ */
+int fi_outputSetPolicy(const char *cptrc_policy);
+
+// an empty queue for a connected socket, tuned for the policy (best effort: not on Unix domain sockets)
+void fv_outputInit(struct ipc_output *pptrO_output, int pi_socket_fd);
+
+// whether psz_copied staged bytes and pi_referenced other fragments still fit before a flush
+int fi_outputFits(const struct ipc_output *pptrO_output, size_t psz_copied, int pi_referenced);
+
+/*
+ * Queue the bytes behind the ones queued before: a copy if pi_stable is 0 or they are short,
+ * else a reference (they must stay untouched until the next flush)
+ * Returns 0, or -1 (errno ENOBUFS) if they do not fit (see fi_outputFits())
+ */
+int fi_outputAppend(struct ipc_output *pptrO_output, const void *pptrv_data, size_t psz_length, int pi_stable);
+
+// bytes queued, not flushed yet
+size_t fsz_outputQueued(const struct ipc_output *pptrO_output);
+
+/*
+ * Hand everything queued to the kernel, in one system call when the socket takes it all
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_outputFlush(struct ipc_output *pptrO_output);
+
+/*
+ * A flush point: flush, and under the throughput policy let a partly filled segment leave now
+ * Returns 0, or -1 (with errno set)
+ */
+int fi_outputPush(struct ipc_output *pptrO_output);
+
+#endif  // IPC_OUTPUT_H
@@ -0,0 +1,285 @@
+/*
+ * Pooled I/O buffers
+ * Two levels, like most slab allocators:
+ *  - per class, one free list shared by all threads, behind one lock,
+ *    grown a slab at a time
+ *  - per thread and class, a cache of at most POOL_CACHE_MAX buffers that
+ *    is refilled from, and spilled to, the shared list POOL_CACHE_BATCH at a time
+ * Buffer headers live apart from the data, so every buffer's data is aligned
+ * to its own size (and large ones to the page)
+ */
+#define _GNU_SOURCE  // MAP_HUGETLB
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "ipc_pool.h"
+
+// slabs are the size of a (2 MiB) huge page
+#define POOL_SLAB_SIZE   (2 * 1024 * 1024)
+// most buffers a thread keeps to itself per class, and how many move between it and the shared list at once
+#define POOL_CACHE_MAX   64
+#define POOL_CACHE_BATCH 32
+
+// buffers of one class nobody is using
+struct ipc_poolClass {
+    struct ipc_buffer *mptrO_free;
+    unsigned           mui_free;
+};
+
+// buffers of every class a thread keeps for itself
+struct ipc_poolCache {
+    struct ipc_buffer *mptrO_a1_free[IPC_POOL_CLASSES];
+    unsigned           mui_a1_free[IPC_POOL_CLASSES];
+    int                mi_registered;
+};
+
+static pthread_mutex_t      gO_poolLock = PTHREAD_MUTEX_INITIALIZER;
+static struct ipc_poolClass gO_a1_classes[IPC_POOL_CLASSES];
+static int                  gi_hugePages = 0;
+//
+static __thread struct ipc_poolCache gO_cache;
+// a thread that ends hands its cache back through this key's destructor
+static pthread_key_t                 gO_cacheKey;
+static pthread_once_t                gO_cacheKeyOnce = PTHREAD_ONCE_INIT;
+
+void fv_poolInit(int pi_hugePages) {
+    pthread_mutex_lock(&gO_poolLock);
+    gi_hugePages = pi_hugePages;
+    pthread_mutex_unlock(&gO_poolLock);
+}
+
+static unsigned fui_poolClass(size_t psz_size) {
+    //
+    unsigned lui_class = 0;
+    //
+    while ((size_t) IPC_POOL_SMALLEST << (2 * lui_class) < psz_size) {
+        ++lui_class;
+    }
+    return lui_class;
+}
+
+// add one slab of buffers to the shared list of pui_class; called with the lock held
+static int fi_poolGrow(unsigned pui_class) {
+    //
+    size_t   lsz_capacity = (size_t) IPC_POOL_SMALLEST << (2 * pui_class);
+    unsigned lui_count = POOL_SLAB_SIZE / lsz_capacity;
+    char    *lptrc_data = MAP_FAILED;
+    //
+    if (gi_hugePages) {
+        lptrc_data = mmap(NULL, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    }
+    // no huge pages reserved (vm.nr_hugepages): let the kernel use transparent ones if it can
+    if (lptrc_data == MAP_FAILED) {
+        lptrc_data = mmap(NULL, POOL_SLAB_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        //
+        if (lptrc_data == MAP_FAILED) {
+            return -1;
+        }
+        if (gi_hugePages) {
+            madvise(lptrc_data, POOL_SLAB_SIZE, MADV_HUGEPAGE);
+        }
+    }
+    //
+    struct ipc_buffer *lptrO_a1_headers = calloc(lui_count, sizeof(struct ipc_buffer));
+    //
+    if (lptrO_a1_headers == NULL) {
+        munmap(lptrc_data, POOL_SLAB_SIZE);
+        return -1;
+    }
+    //
+    struct ipc_poolClass *lptrO_class = &gO_a1_classes[pui_class];
+    //
+    for (unsigned i = 0; i < lui_count; ++i) {
+        lptrO_a1_headers[i].mptrc_data = lptrc_data + i * lsz_capacity;
+        lptrO_a1_headers[i].mui_capacity = (uint32_t) lsz_capacity;
+        lptrO_a1_headers[i].muc_class = (uint8_t) pui_class;
+        lptrO_a1_headers[i].mptrO_next = lptrO_class->mptrO_free;
+        lptrO_class->mptrO_free = &lptrO_a1_headers[i];
+    }
+    lptrO_class->mui_free += lui_count;
+    //
+    return 0;
+}
+
+// move up to pui_count buffers of pui_class from the thread's cache to the shared list
+static void fv_poolSpill(struct ipc_poolCache *pptrO_cache, unsigned pui_class, unsigned pui_count) {
+    //
+    pthread_mutex_lock(&gO_poolLock);
+    //
+    struct ipc_poolClass *lptrO_class = &gO_a1_classes[pui_class];
+    //
+    while (pui_count-- > 0 && pptrO_cache->mptrO_a1_free[pui_class] != NULL) {
+        struct ipc_buffer *lptrO_buffer = pptrO_cache->mptrO_a1_free[pui_class];
+        //
+        pptrO_cache->mptrO_a1_free[pui_class] = lptrO_buffer->mptrO_next;
+        --pptrO_cache->mui_a1_free[pui_class];
+        lptrO_buffer->mptrO_next = lptrO_class->mptrO_free;
+        lptrO_class->mptrO_free = lptrO_buffer;
+        ++lptrO_class->mui_free;
+    }
+    //
+    pthread_mutex_unlock(&gO_poolLock);
+}
+
+static void fv_poolCacheDestroy(void *pptrv_cache) {
+    //
+    for (unsigned i = 0; i < IPC_POOL_CLASSES; ++i) {
+        fv_poolSpill(pptrv_cache, i, ((struct ipc_poolCache *) pptrv_cache)->mui_a1_free[i]);
+    }
+}
+
+static void fv_poolCacheKeyCreate(void) {
+    pthread_key_create(&gO_cacheKey, fv_poolCacheDestroy);
+}
+
+// take POOL_CACHE_BATCH buffers of pui_class from the shared list, growing it if needed
+static int fi_poolRefill(struct ipc_poolCache *pptrO_cache, unsigned pui_class) {
+    //
+    if (!pptrO_cache->mi_registered) {
+        pthread_once(&gO_cacheKeyOnce, fv_poolCacheKeyCreate);
+        pthread_setspecific(gO_cacheKey, pptrO_cache);
+        pptrO_cache->mi_registered = 1;
+    }
+    //
+    pthread_mutex_lock(&gO_poolLock);
+    //
+    struct ipc_poolClass *lptrO_class = &gO_a1_classes[pui_class];
+    //
+    if (lptrO_class->mui_free == 0 && fi_poolGrow(pui_class) < 0) {
+        pthread_mutex_unlock(&gO_poolLock);
+        errno = ENOMEM;
+        return -1;
+    }
+    for (unsigned i = 0; i < POOL_CACHE_BATCH && lptrO_class->mptrO_free != NULL; ++i) {
+        struct ipc_buffer *lptrO_buffer = lptrO_class->mptrO_free;
+        //
+        lptrO_class->mptrO_free = lptrO_buffer->mptrO_next;
+        --lptrO_class->mui_free;
+        lptrO_buffer->mptrO_next = pptrO_cache->mptrO_a1_free[pui_class];
+        pptrO_cache->mptrO_a1_free[pui_class] = lptrO_buffer;
+        ++pptrO_cache->mui_a1_free[pui_class];
+    }
+    //
+    pthread_mutex_unlock(&gO_poolLock);
+    //
+    return 0;
+}
+
+struct ipc_buffer *fptrO_bufferGet(size_t psz_size) {
+    //
+    if (psz_size > IPC_POOL_LARGEST) {
+        errno = EINVAL;
+        return NULL;
+    }
+    //
+    unsigned              lui_class = fui_poolClass(psz_size);
+    struct ipc_poolCache *lptrO_cache = &gO_cache;
+    //
+    if (lptrO_cache->mptrO_a1_free[lui_class] == NULL && fi_poolRefill(lptrO_cache, lui_class) < 0) {
+        return NULL;
+    }
+    //
+    struct ipc_buffer *lptrO_buffer = lptrO_cache->mptrO_a1_free[lui_class];
+    //
+    lptrO_cache->mptrO_a1_free[lui_class] = lptrO_buffer->mptrO_next;
+    --lptrO_cache->mui_a1_free[lui_class];
+    //
+    lptrO_buffer->mptrO_next = NULL;
+    lptrO_buffer->mui_length = 0;
+    atomic_store_explicit(&lptrO_buffer->mui_references, 1, memory_order_relaxed);
+    //
+    return lptrO_buffer;
+}
+
+void fv_bufferRetain(struct ipc_buffer *pptrO_buffer) {
+    atomic_fetch_add_explicit(&pptrO_buffer->mui_references, 1, memory_order_relaxed);
+}
+
+void fv_bufferRelease(struct ipc_buffer *pptrO_buffer) {
+    //
+    struct ipc_poolCache *lptrO_cache = &gO_cache;
+    //
+    while (pptrO_buffer != NULL) {
+        // whoever drops the last reference must see every write the other owners made
+        if (atomic_fetch_sub_explicit(&pptrO_buffer->mui_references, 1, memory_order_acq_rel) != 1) {
+            return;
+        }
+        //
+        struct ipc_buffer *lptrO_next = pptrO_buffer->mptrO_next;
+        unsigned           lui_class = pptrO_buffer->muc_class;
+        //
+        // back to the cache of the thread that let it go, whichever one borrowed it
+        pptrO_buffer->mptrO_next = lptrO_cache->mptrO_a1_free[lui_class];
+        lptrO_cache->mptrO_a1_free[lui_class] = pptrO_buffer;
+        //
+        if (++lptrO_cache->mui_a1_free[lui_class] > POOL_CACHE_MAX) {
+            fv_poolSpill(lptrO_cache, lui_class, POOL_CACHE_BATCH);
+        }
+        pptrO_buffer = lptrO_next;
+    }
+}
+
+int fi_bufferAppend(struct ipc_buffer **pptrO_chain, const void *pptrv_data, size_t psz_length) {
+    //
+    const char         *lptrc_data = pptrv_data;
+    struct ipc_buffer **lptrO_link = pptrO_chain,
+                       *lptrO_tail = NULL;
+    //
+    while (*lptrO_link != NULL) {
+        lptrO_tail = *lptrO_link;
+        lptrO_link = &lptrO_tail->mptrO_next;
+    }
+    //
+    while (psz_length > 0) {
+        if (lptrO_tail == NULL || lptrO_tail->mui_length == lptrO_tail->mui_capacity) {
+            // the first buffer fits the data; a chain that keeps growing gets the largest ones
+            size_t lsz_size = (lptrO_tail != NULL || psz_length > IPC_POOL_LARGEST) ? IPC_POOL_LARGEST : psz_length;
+            //
+            if ((lptrO_tail = fptrO_bufferGet(lsz_size)) == NULL) {
+                return -1;
+            }
+            *lptrO_link = lptrO_tail;
+            lptrO_link = &lptrO_tail->mptrO_next;
+        }
+        //
+        size_t lsz_take = lptrO_tail->mui_capacity - lptrO_tail->mui_length;
+        //
+        if (lsz_take > psz_length) {
+            lsz_take = psz_length;
+        }
+        memcpy(lptrO_tail->mptrc_data + lptrO_tail->mui_length, lptrc_data, lsz_take);
+        lptrO_tail->mui_length += lsz_take;
+        lptrc_data += lsz_take;
+        psz_length -= lsz_take;
+    }
+    //
+    return 0;
+}
+
+size_t fsz_bufferChainLength(const struct ipc_buffer *pptrO_chain) {
+    //
+    size_t lsz_length = 0;
+    //
+    for (; pptrO_chain != NULL; pptrO_chain = pptrO_chain->mptrO_next) {
+        lsz_length += pptrO_chain->mui_length;
+    }
+    return lsz_length;
+}
+
+int fi_bufferChainIovec(const struct ipc_buffer *pptrO_chain, struct iovec *pptrO_a1_parts, int pi_max) {
+    //
+    int li_parts = 0;
+    //
+    for (; pptrO_chain != NULL && li_parts < pi_max; pptrO_chain = pptrO_chain->mptrO_next) {
+        if (pptrO_chain->mui_length > 0) {
+            pptrO_a1_parts[li_parts].iov_base = pptrO_chain->mptrc_data;
+            pptrO_a1_parts[li_parts].iov_len = pptrO_chain->mui_length;
+            ++li_parts;
+        }
+    }
+    return li_parts;
+}
@@ -0,0 +1,69 @@
+/*
+ * Pooled I/O buffers
+ * Buffers come in a few size classes, carved out of 2 MiB slabs (optionally huge pages)
+ * that are never given back; a freed buffer goes to a small cache of the thread
+ * that freed it, so borrowing and returning one is a list push/pop: no malloc(),
+ * no lock and no memset() on the hot path
+ * Buffers are reference counted, so one buffer can be handed to several owners,
+ * and can be chained (mptrO_next) to hold messages larger than the largest class
+ */
+#ifndef IPC_POOL_H
+#define IPC_POOL_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+// capacities of the size classes: 256 B, 1 KiB, 4 KiB, 16 KiB, 64 KiB
+#define IPC_POOL_CLASSES    5
+#define IPC_POOL_SMALLEST   256
+#define IPC_POOL_LARGEST    (IPC_POOL_SMALLEST << (2 * (IPC_POOL_CLASSES - 1)))
+
+struct ipc_buffer {
+    // next buffer of a chain (or, while pooled, of a free list)
+    struct ipc_buffer *mptrO_next;
+    char              *mptrc_data;
+    uint32_t           mui_capacity;
+    // bytes of mptrc_data in use
+    uint32_t           mui_length;
+    atomic_uint        mui_references;
+    uint8_t            muc_class;
+};
+
+/*
+ * Back slabs created from now on with huge pages (pi_hugePages),
+ * falling back to transparent huge pages, then to normal pages
+ * Optional: without it, the pool starts on first use with normal pages
+ */
+void fv_poolInit(int pi_hugePages);
+
+/*
+ * Borrow a buffer of at least psz_size bytes (at most IPC_POOL_LARGEST),
+ * empty and with one reference; its contents are NOT cleared
+ * Returns NULL (errno ENOMEM, or EINVAL if psz_size is too large)
+ */
+struct ipc_buffer *fptrO_bufferGet(size_t psz_size);
+
+void fv_bufferRetain(struct ipc_buffer *pptrO_buffer);
+
+// drop a reference; the last one returns the buffer, and the rest of its chain, to the pool
+void fv_bufferRelease(struct ipc_buffer *pptrO_buffer);
+
+/*
+ * Append psz_length bytes to the chain starting at *pptrO_chain (NULL: an empty chain),
+ * adding buffers of the largest class as needed
+ * Returns 0, or -1 (errno ENOMEM) with the chain holding what did fit
+ */
+int fi_bufferAppend(struct ipc_buffer **pptrO_chain, const void *pptrv_data, size_t psz_length);
+
+// total bytes held by a chain
+size_t fsz_bufferChainLength(const struct ipc_buffer *pptrO_chain);
+
+/*
+ * Describe a chain as at most pi_max iovecs, for writev()/sendmsg()
+ * Returns how many were filled
+ */
+int fi_bufferChainIovec(const struct ipc_buffer *pptrO_chain, struct iovec *pptrO_a1_parts, int pi_max);
+
+#endif  // IPC_POOL_H
@@ -0,0 +1,323 @@
+/*
+ * Pre-forked serving mode
+ * Supervisor: owns one SO_REUSEPORT listening socket per worker,
+ *             forks the workers once, reaps them and restarts the ones that die
+ * Worker:     pinned to one core, waits for connections on its own socket, takes all
+ *             that are pending (accept4()) and serves them one after the other
+ * The kernel hashes every incoming connection onto exactly one socket of the
+ * SO_REUSEPORT group, so only one worker wakes up per connection
+ * References:
+ *  man 7 socket (SO_REUSEPORT, SO_INCOMING_CPU)
+ *  man 2 sched_setaffinity
+ */
+#define _GNU_SOURCE  // CPU_SET() and friends
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "ipc_prefork.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+#include "ipc_accept.h"
+
+#ifndef SO_INCOMING_CPU
+#define SO_INCOMING_CPU 49
+#endif
+
+// a worker dying sooner than this after its start is restarted with a delay,
+// so a worker that cannot start does not turn the supervisor into a fork loop
+#define WORKER_MIN_UPTIME_SECONDS 1
+
+// bookkeeping of the supervisor for one worker slot
+struct ipc_worker {
+    pid_t  mi_processID;
+    int    mi_socketConn_fd;
+    int    mi_cpu;
+    time_t ml_started;
+};
+
+// set from the signal handler, checked by the supervision loop
+static volatile sig_atomic_t gi_stopRequested = 0;
+
+static void fv_onStopSignal(int pi_signal) {
+    (void) pi_signal;
+    gi_stopRequested = 1;
+}
+
+/*
+ * Create another listening socket in the SO_REUSEPORT group of pi_socketConn_fd:
+ * same local address and port, same backlog, same TCP_DEFER_ACCEPT and TCP_FASTOPEN
+ */
+static int fi_cloneListener(int pi_socketConn_fd, int pi_backlog) {
+    struct sockaddr_storage lO_address;
+    socklen_t               lui_sizeAddress = sizeof(lO_address);
+    //
+    if (getsockname(pi_socketConn_fd,
+                    (struct sockaddr *) &lO_address,
+                    &lui_sizeAddress) < 0) {
+        return -1;
+    }
+    //
+    int li_socket_fd = socket(lO_address.ss_family, SOCK_STREAM, 0);
+    //
+    if (li_socket_fd < 0) {
+        return -1;
+    }
+    //
+    // options of the original listener, not readable on a Unix domain one: left off then
+    int       li_deferSeconds = 0,
+              li_fastOpenQueue = 0;
+    socklen_t lui_sizeOption = sizeof(int);
+    //
+    if (lO_address.ss_family == AF_INET) {
+        getsockopt(pi_socketConn_fd, IPPROTO_TCP, TCP_DEFER_ACCEPT, &li_deferSeconds, &lui_sizeOption);
+        lui_sizeOption = sizeof(int);
+        getsockopt(pi_socketConn_fd, IPPROTO_TCP, TCP_FASTOPEN, &li_fastOpenQueue, &lui_sizeOption);
+    }
+    //
+    int li_socket_optionValue = 1;
+    //
+    if (setsockopt(li_socket_fd, SOL_SOCKET, SO_REUSEADDR,
+                   &li_socket_optionValue, sizeof(li_socket_optionValue)) < 0 ||
+        setsockopt(li_socket_fd, SOL_SOCKET, SO_REUSEPORT,
+                   &li_socket_optionValue, sizeof(li_socket_optionValue)) < 0 ||
+        bind(li_socket_fd, (struct sockaddr *) &lO_address, lui_sizeAddress) < 0 ||
+        listen(li_socket_fd, pi_backlog) < 0 ||
+        fi_listenerTune(li_socket_fd, li_deferSeconds, li_fastOpenQueue) < 0) {
+        int li_errno = errno;
+        close(li_socket_fd);
+        errno = li_errno;
+        return -1;
+    }
+    //
+    return li_socket_fd;
+}
+
+/*
+ * Body of a worker process, never returns
+ */
+static void fv_workerRun(struct ipc_worker *pptrO_workers,
+                         int                pi_workers,
+                         int                pi_index,
+                         void             (*pf_serve)(int)) {
+    //
+    // keep only this worker's listening socket
+    for (int i = 0; i < pi_workers; ++i) {
+        if (i != pi_index) {
+            close(pptrO_workers[i].mi_socketConn_fd);
+        }
+    }
+    int li_socketConn_fd = pptrO_workers[pi_index].mi_socketConn_fd;
+    //
+    // the supervisor's stop handler is not meant for workers
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+    // a client vanishing in the middle of a reply must not cost the worker its life
+    signal(SIGPIPE, SIG_IGN);
+    //
+    // pin to a single core, so the worker keeps its caches warm
+    cpu_set_t lO_cpuSet;
+    CPU_ZERO(&lO_cpuSet);
+    CPU_SET(pptrO_workers[pi_index].mi_cpu, &lO_cpuSet);
+    //
+    if (sched_setaffinity(0, sizeof(lO_cpuSet), &lO_cpuSet) < 0) {
+        IPC_LOGE("sched_setaffinity: %m");
+    }
+    //
+    IPC_LOGI("Worker %d (pid %d) accepting on socket %d, CPU %d",
+             pi_index, getpid(), li_socketConn_fd, pptrO_workers[pi_index].mi_cpu);
+    //
+    // every wakeup drains this worker's queue: the kernel already hashed those connections to it
+    int li_a1_accepted[IPC_ACCEPT_BATCH];
+    //
+    if (fi_listenerNonBlocking(li_socketConn_fd) < 0) {
+        IPC_LOGE("fcntl: %m");
+        exit(EXIT_FAILURE);
+    }
+    while (1) {
+        int li_accepted = fi_acceptBatch(li_socketConn_fd, li_a1_accepted, IPC_ACCEPT_BATCH, SOCK_CLOEXEC);
+        //
+        if (li_accepted < 0) {
+            IPC_LOGE("accept: %m");
+            // let the supervisor start a fresh worker
+            exit(EXIT_FAILURE);
+        }
+        for (int i = 0; i < li_accepted; ++i) {
+            int li_socketRW_fd = li_a1_accepted[i];
+            //
+            if (!fi_admissionEnter()) {
+                fv_admissionReject(li_socketRW_fd);
+                continue;
+            }
+            fv_metricsAccept(li_socketRW_fd);
+            //
+            pf_serve(li_socketRW_fd);
+            //
+            fv_metricsClose(li_socketRW_fd);
+            close(li_socketRW_fd);
+            fv_admissionLeave();
+        }
+    }
+}
+
+static int fi_workerStart(struct ipc_worker *pptrO_workers,
+                          int                pi_workers,
+                          int                pi_index,
+                          void             (*pf_serve)(int)) {
+    //
+    pid_t li_processID = fork();
+    //
+    if (li_processID < 0) {
+        return -1;
+    }
+    if (li_processID == 0) {
+        fv_workerRun(pptrO_workers, pi_workers, pi_index, pf_serve);
+    }
+    //
+    pptrO_workers[pi_index].mi_processID = li_processID;
+    pptrO_workers[pi_index].ml_started = time(NULL);
+    //
+    return 0;
+}
+
+int fi_preforkServe(int pi_socketConn_fd,
+                    int pi_backlog,
+                    int pi_workers,
+                    int pi_incomingCpu,
+                    void (*pf_serve)(int)) {
+    //
+    if (pi_workers < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    //
+    // CPUs this process may run on (respects taskset and cgroup limits)
+    cpu_set_t lO_cpuSet;
+    int       li_a1_cpus[CPU_SETSIZE];
+    int       li_cpus = 0;
+    //
+    if (sched_getaffinity(0, sizeof(lO_cpuSet), &lO_cpuSet) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < CPU_SETSIZE; ++i) {
+        if (CPU_ISSET(i, &lO_cpuSet)) {
+            li_a1_cpus[li_cpus++] = i;
+        }
+    }
+    //
+    struct ipc_worker *lptrO_workers = calloc(pi_workers, sizeof(*lptrO_workers));
+    //
+    if (lptrO_workers == NULL) {
+        return -1;
+    }
+    //
+    // one listening socket per worker, the first one is the caller's
+    // the supervisor keeps all of them open, so the accept queue of a
+    // crashed worker survives until its replacement picks it up
+    for (int i = 0; i < pi_workers; ++i) {
+        lptrO_workers[i].mi_cpu = li_a1_cpus[i % li_cpus];
+        lptrO_workers[i].mi_socketConn_fd =
+            (i == 0) ? pi_socketConn_fd : fi_cloneListener(pi_socketConn_fd, pi_backlog);
+        //
+        if (lptrO_workers[i].mi_socketConn_fd < 0) {
+            int li_errno = errno;
+            while (--i > 0) {
+                close(lptrO_workers[i].mi_socketConn_fd);
+            }
+            free(lptrO_workers);
+            errno = li_errno;
+            return -1;
+        }
+        //
+        if (pi_incomingCpu &&
+            setsockopt(lptrO_workers[i].mi_socketConn_fd, SOL_SOCKET, SO_INCOMING_CPU,
+                       &lptrO_workers[i].mi_cpu, sizeof(lptrO_workers[i].mi_cpu)) < 0) {
+            IPC_LOGE("setsockopt SO_INCOMING_CPU: %m");
+        }
+    }
+    //
+    // stop on SIGINT/SIGTERM; no SA_RESTART, so waitpid() returns with EINTR
+    struct sigaction lO_action;
+    memset(&lO_action, 0, sizeof(lO_action));
+    lO_action.sa_handler = fv_onStopSignal;
+    sigemptyset(&lO_action.sa_mask);
+    sigaction(SIGINT, &lO_action, NULL);
+    sigaction(SIGTERM, &lO_action, NULL);
+    //
+    for (int i = 0; i < pi_workers; ++i) {
+        if (fi_workerStart(lptrO_workers, pi_workers, i, pf_serve) < 0) {
+            IPC_LOGE("fork: %m");
+        }
+    }
+    //
+    // supervision loop: reap every worker that exits and start its replacement
+    while (!gi_stopRequested) {
+        int   li_status;
+        pid_t li_processID = waitpid(-1, &li_status, 0);
+        //
+        if (li_processID < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != ECHILD) {
+                IPC_LOGE("waitpid: %m");
+            }
+            // no worker is alive (every fork failed), try again shortly
+            sleep(WORKER_MIN_UPTIME_SECONDS);
+        }
+        //
+        for (int i = 0; i < pi_workers; ++i) {
+            if (li_processID > 0 && lptrO_workers[i].mi_processID != li_processID) {
+                continue;
+            }
+            if (li_processID < 0 && lptrO_workers[i].mi_processID > 0) {
+                continue;
+            }
+            //
+            if (li_processID > 0) {
+                if (WIFSIGNALED(li_status)) {
+                    IPC_LOGW("Worker %d (pid %d) killed by signal %d, restarting",
+                             i, li_processID, WTERMSIG(li_status));
+                } else {
+                    IPC_LOGW("Worker %d (pid %d) exited with status %d, restarting",
+                             i, li_processID, WEXITSTATUS(li_status));
+                }
+                lptrO_workers[i].mi_processID = 0;
+                //
+                if (time(NULL) - lptrO_workers[i].ml_started < WORKER_MIN_UPTIME_SECONDS) {
+                    sleep(WORKER_MIN_UPTIME_SECONDS);
+                }
+            }
+            //
+            if (!gi_stopRequested &&
+                fi_workerStart(lptrO_workers, pi_workers, i, pf_serve) < 0) {
+                IPC_LOGE("fork: %m");
+            }
+        }
+    }
+    //
+    // shut the pool down
+    for (int i = 0; i < pi_workers; ++i) {
+        if (lptrO_workers[i].mi_processID > 0) {
+            kill(lptrO_workers[i].mi_processID, SIGTERM);
+        }
+    }
+    while (waitpid(-1, NULL, 0) > 0 || errno == EINTR)
+        ;
+    //
+    for (int i = 1; i < pi_workers; ++i) {
+        close(lptrO_workers[i].mi_socketConn_fd);
+    }
+    free(lptrO_workers);
+    //
+    return 0;
+}
@@ -0,0 +1,27 @@
+/*
+ * Pre-forked serving mode
+ * A supervisor process starts a fixed pool of long-lived workers,
+ * each accepting on its own SO_REUSEPORT listening socket,
+ * so no process is ever forked on the accept path
+ */
+#ifndef IPC_PREFORK_H
+#define IPC_PREFORK_H
+
+/*
+ * Turn the calling process into the supervisor of pi_workers workers
+ * pi_socketConn_fd: listening socket, created with SO_REUSEPORT;
+ *  it is cloned (same address, backlog pi_backlog) once per additional worker
+ * pi_incomingCpu: when non-zero, also steer each socket with SO_INCOMING_CPU
+ *  to the core its worker is pinned to
+ * pf_serve: handles one accepted connection, like fv_serve()
+ * Worker i is pinned to the i-th CPU it is allowed to run on (round-robin),
+ * and is restarted by the supervisor whenever it exits or crashes
+ * Returns -1 (with errno set) if the pool cannot be set up, or 0 after SIGINT/SIGTERM
+ */
+int fi_preforkServe(int pi_socketConn_fd,
+                    int pi_backlog,
+                    int pi_workers,
+                    int pi_incomingCpu,
+                    void (*pf_serve)(int));
+
+#endif  // IPC_PREFORK_H
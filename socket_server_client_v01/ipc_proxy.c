@@ -0,0 +1,863 @@
+/*
+ * Load-balancing forwarding proxy
+ * A session moves through FIRST (waiting for the client's first bytes, to pick a backend),
+ * CONNECTING (to the backend) and RELAY; each direction of a relay is a small pump:
+ *  pipe -> destination first, then (framed) the header read, then source -> pipe
+ * so the pipe is always empty when it is filled: splice() answering EAGAIN then means
+ * the source has nothing, never that the pipe is full
+ * Every session has one deadline on a timing wheel: to be relaying (FIRST, CONNECTING),
+ * then, optionally, for its next event while relaying; past it, the session is closed
+ * References:
+ *  man 2 splice
+ *  D. Karger et al.: Consistent Hashing and Random Trees (STOC 1997)
+ *  https://www.haproxy.com/blog/haproxy-and-splice (kernel splicing in a proxy)
+ */
+#define _GNU_SOURCE  // splice(), pipe2(), accept4()
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+
+#include "ipc_frame.h"
+#include "ipc_log.h"
+#include "ipc_proxy.h"
+#include "ipc_timer.h"
+
+// number of ready events collected by a single epoll_wait()
+#define PROXY_MAX_EVENTS     256
+// most bytes moved by one splice(): a default pipe's capacity
+#define PROXY_PIPE_SIZE      (64 * 1024)
+// hashed request key, at most
+#define PROXY_KEY_MAX        64
+// virtual nodes of each backend on the hash ring
+#define PROXY_RING_POINTS    64
+// consecutive failed health checks before a backend is marked down
+#define PROXY_CHECK_FAILURES 2
+// empty pipes kept for the next sessions
+#define PROXY_SPARE_PIPES    64
+
+// what an epoll event stands for: every registered object starts with one of these
+enum ipc_proxyTag {
+    PROXY_TAG_LISTENER,
+    PROXY_TAG_TIMER,
+    PROXY_TAG_SESSION,
+    PROXY_TAG_CHECK
+};
+
+enum ipc_proxyState {
+    PROXY_FIRST,       // waiting for the client's first bytes
+    PROXY_CONNECTING,  // connecting to the chosen backend
+    PROXY_RELAY,       // relaying both ways
+    PROXY_CLOSED       // done, freed once the current batch of events is handled
+};
+
+struct ipc_proxyBackend {
+    enum ipc_proxyTag  me_tag;  // PROXY_TAG_CHECK: events of its health check
+    struct sockaddr_in mO_address;
+    char               mc_a1_name[INET_ADDRSTRLEN + 8];
+    int                mi_healthy;
+    int                mi_failures;
+    // connection of the health check in progress, -1 if none
+    int                mi_check_fd;
+    // sessions relayed to it now
+    int                mi_active;
+    // connected, idle, and registered nowhere: left by framed sessions with nothing in flight
+    int                mi_a1_idle[IPC_PROXY_IDLE_MAX];
+    int                mi_idle;
+};
+
+// one direction of a session: source -> pipe -> destination
+struct ipc_proxyDirection {
+    int      mi_a1_pipe[2];
+    size_t   msz_piped;
+    // framed: the header being read, how much of it went on, and the payload still to splice
+    int      mi_framed;
+    unsigned char muc_a1_header[IPC_FRAME_HEADER_SIZE];
+    size_t   msz_header;
+    size_t   msz_headerSent;
+    uint64_t mul_payload;
+    // framed: frames passed on completely
+    unsigned long mul_frames;
+    // the source reached its end; everything was passed on and the destination was shut down
+    int      mi_eof;
+    int      mi_done;
+};
+
+struct ipc_proxySession {
+    enum ipc_proxyTag         me_tag;  // PROXY_TAG_SESSION
+    enum ipc_proxyState       me_state;
+    int                       mi_client_fd;
+    int                       mi_backend_fd;
+    struct ipc_proxyBackend  *mptrO_backend;
+    int                       mi_framed;
+    // backends tried so far (bit i: the i-th), and the key they are chosen by
+    uint32_t                  mui_tried;
+    uint64_t                  mul_key;
+    // client -> backend, backend -> client
+    struct ipc_proxyDirection mO_up;
+    struct ipc_proxyDirection mO_down;
+    // on the list of sessions to free
+    struct ipc_proxySession  *mptrO_next;
+    // handshake, then idle deadline
+    struct ipc_timer          mO_deadline;
+};
+
+// a point of the hash ring, owned by a backend
+struct ipc_proxyPoint {
+    uint64_t mul_hash;
+    int      mi_backend;
+};
+
+// the proxy's state: one event loop
+static const struct ipc_proxyConfig *gptrO_config;
+static struct ipc_proxyBackend       gO_a1_backends[IPC_PROXY_BACKENDS_MAX];
+static struct ipc_proxyPoint         gO_a1_ring[IPC_PROXY_BACKENDS_MAX * PROXY_RING_POINTS];
+static int                           gi_ringPoints;
+static unsigned                      gui_next;
+static int                           gi_epoll_fd;
+static struct ipc_proxySession      *gptrO_closed;
+static int                           gi_a1_spare[PROXY_SPARE_PIPES][2];
+static int                           gi_spares;
+static struct ipc_timerWheel         gO_wheel;
+// stand-ins for the listener and timer in epoll events
+static enum ipc_proxyTag             ge_listenerTag = PROXY_TAG_LISTENER,
+                                     ge_timerTag = PROXY_TAG_TIMER;
+
+// FNV-1a, then the splitmix64 finalizer: short keys still spread over the whole ring
+static uint64_t ful_proxyHash(const void *pptrv_data, size_t psz_length) {
+    const unsigned char *lptruc_data = pptrv_data;
+    uint64_t             lul_hash = 0xcbf29ce484222325ull;
+    //
+    for (size_t i = 0; i < psz_length; ++i) {
+        lul_hash = (lul_hash ^ lptruc_data[i]) * 0x100000001b3ull;
+    }
+    lul_hash = (lul_hash ^ (lul_hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+    lul_hash = (lul_hash ^ (lul_hash >> 27)) * 0x94d049bb133111ebull;
+    //
+    return lul_hash ^ (lul_hash >> 31);
+}
+
+static int fi_pointCompare(const void *pptrv_a, const void *pptrv_b) {
+    const struct ipc_proxyPoint *lptrO_a = pptrv_a,
+                                *lptrO_b = pptrv_b;
+    //
+    return (lptrO_a->mul_hash > lptrO_b->mul_hash) - (lptrO_a->mul_hash < lptrO_b->mul_hash);
+}
+
+static void fv_ringBuild(void) {
+    //
+    gi_ringPoints = 0;
+    //
+    for (int i = 0; i < gptrO_config->mi_backends; ++i) {
+        for (int j = 0; j < PROXY_RING_POINTS; ++j) {
+            char lc_a1_name[sizeof(gO_a1_backends[i].mc_a1_name) + 8];
+            int  li_length = snprintf(lc_a1_name, sizeof(lc_a1_name), "%s#%d", gO_a1_backends[i].mc_a1_name, j);
+            //
+            gO_a1_ring[gi_ringPoints].mul_hash = ful_proxyHash(lc_a1_name, li_length);
+            gO_a1_ring[gi_ringPoints].mi_backend = i;
+            ++gi_ringPoints;
+        }
+    }
+    qsort(gO_a1_ring, gi_ringPoints, sizeof(gO_a1_ring[0]), fi_pointCompare);
+}
+
+// the backend for the next session, by policy, among the healthy ones not in pui_tried; NULL if none is
+static struct ipc_proxyBackend *fptrO_backendChoose(uint64_t pul_key, uint32_t pui_tried) {
+    //
+    int li_backends = gptrO_config->mi_backends;
+    //
+    if (gptrO_config->me_policy == IPC_PROXY_HASH) {
+        // first point at or after the key, clockwise; its owner, or the next healthy one
+        int li_low = 0,
+            li_high = gi_ringPoints;
+        //
+        while (li_low < li_high) {
+            int li_middle = (li_low + li_high) / 2;
+            //
+            if (gO_a1_ring[li_middle].mul_hash < pul_key) {
+                li_low = li_middle + 1;
+            } else {
+                li_high = li_middle;
+            }
+        }
+        for (int i = 0; i < gi_ringPoints; ++i) {
+            int                      li_index = gO_a1_ring[(li_low + i) % gi_ringPoints].mi_backend;
+            struct ipc_proxyBackend *lptrO_backend = &gO_a1_backends[li_index];
+            //
+            if (lptrO_backend->mi_healthy && !(pui_tried & (1u << li_index))) {
+                return lptrO_backend;
+            }
+        }
+        return NULL;
+    }
+    //
+    // round-robin, or the fewest sessions, ties broken round-robin
+    struct ipc_proxyBackend *lptrO_chosen = NULL;
+    unsigned                 lui_start = gui_next++;
+    //
+    for (int i = 0; i < li_backends; ++i) {
+        int                      li_index = (lui_start + i) % li_backends;
+        struct ipc_proxyBackend *lptrO_backend = &gO_a1_backends[li_index];
+        //
+        if (!lptrO_backend->mi_healthy || (pui_tried & (1u << li_index))) {
+            continue;
+        }
+        if (gptrO_config->me_policy == IPC_PROXY_ROUND_ROBIN) {
+            return lptrO_backend;
+        }
+        if (lptrO_chosen == NULL || lptrO_backend->mi_active < lptrO_chosen->mi_active) {
+            lptrO_chosen = lptrO_backend;
+        }
+    }
+    return lptrO_chosen;
+}
+
+static void fv_backendHealth(struct ipc_proxyBackend *pptrO_backend, int pi_healthy) {
+    //
+    if (pi_healthy) {
+        if (!pptrO_backend->mi_healthy) {
+            IPC_LOGW("backend %s up", pptrO_backend->mc_a1_name);
+        }
+        pptrO_backend->mi_healthy = 1;
+        pptrO_backend->mi_failures = 0;
+        return;
+    }
+    if (++pptrO_backend->mi_failures >= PROXY_CHECK_FAILURES && pptrO_backend->mi_healthy) {
+        IPC_LOGW("backend %s down", pptrO_backend->mc_a1_name);
+        pptrO_backend->mi_healthy = 0;
+        // its idle connections are most likely dead too
+        while (pptrO_backend->mi_idle > 0) {
+            close(pptrO_backend->mi_a1_idle[--pptrO_backend->mi_idle]);
+        }
+    }
+}
+
+/*
+ * Whether a non-blocking connect() completed
+ * Returns 1 if connected, 0 if still in progress, or -1 (with errno set) if it failed
+ */
+static int fi_connectResult(int pi_socket_fd) {
+    int                li_error = 0;
+    socklen_t          lui_size = sizeof(li_error);
+    struct sockaddr_in lO_peer;
+    socklen_t          lui_peerSize = sizeof(lO_peer);
+    //
+    if (getsockopt(pi_socket_fd, SOL_SOCKET, SO_ERROR, &li_error, &lui_size) < 0) {
+        return -1;
+    }
+    if (li_error != 0) {
+        errno = li_error;
+        return -1;
+    }
+    return getpeername(pi_socket_fd, (struct sockaddr *) &lO_peer, &lui_peerSize) == 0;
+}
+
+static int fi_connectStart(const struct sockaddr_in *pptrO_address) {
+    //
+    int li_socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0),
+        li_enable = 1;
+    //
+    if (li_socket_fd < 0) {
+        return -1;
+    }
+    setsockopt(li_socket_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+    //
+    if (connect(li_socket_fd, (const struct sockaddr *) pptrO_address, sizeof(*pptrO_address)) < 0 &&
+        errno != EINPROGRESS) {
+        close(li_socket_fd);
+        return -1;
+    }
+    return li_socket_fd;
+}
+
+/********************* HEALTH *********************/
+
+static void fv_checkStart(struct ipc_proxyBackend *pptrO_backend) {
+    //
+    // the previous check is still not answered: that is a failure
+    if (pptrO_backend->mi_check_fd >= 0) {
+        close(pptrO_backend->mi_check_fd);
+        pptrO_backend->mi_check_fd = -1;
+        fv_backendHealth(pptrO_backend, 0);
+    }
+    int li_check_fd = fi_connectStart(&pptrO_backend->mO_address);
+    //
+    if (li_check_fd < 0) {
+        fv_backendHealth(pptrO_backend, 0);
+        return;
+    }
+    struct epoll_event lO_event;
+    lO_event.events = EPOLLOUT | EPOLLET;
+    lO_event.data.ptr = pptrO_backend;
+    //
+    if (epoll_ctl(gi_epoll_fd, EPOLL_CTL_ADD, li_check_fd, &lO_event) < 0) {
+        close(li_check_fd);
+        return;
+    }
+    pptrO_backend->mi_check_fd = li_check_fd;
+}
+
+static void fv_checkEvent(struct ipc_proxyBackend *pptrO_backend) {
+    //
+    if (pptrO_backend->mi_check_fd < 0) {
+        return;
+    }
+    int li_result = fi_connectResult(pptrO_backend->mi_check_fd);
+    //
+    if (li_result == 0) {
+        return;
+    }
+    // closing also takes it out of the interest list
+    close(pptrO_backend->mi_check_fd);
+    pptrO_backend->mi_check_fd = -1;
+    fv_backendHealth(pptrO_backend, li_result > 0);
+}
+
+/********************* PIPES *********************/
+
+static int fi_pipeGet(int pi_a1_pipe[2]) {
+    //
+    if (gi_spares > 0) {
+        --gi_spares;
+        pi_a1_pipe[0] = gi_a1_spare[gi_spares][0];
+        pi_a1_pipe[1] = gi_a1_spare[gi_spares][1];
+        return 0;
+    }
+    return pipe2(pi_a1_pipe, O_NONBLOCK | O_CLOEXEC);
+}
+
+static void fv_pipeRelease(struct ipc_proxyDirection *pptrO_direction) {
+    //
+    if (pptrO_direction->mi_a1_pipe[0] < 0) {
+        return;
+    }
+    // only an empty pipe can serve another session
+    if (pptrO_direction->msz_piped == 0 && gi_spares < PROXY_SPARE_PIPES) {
+        gi_a1_spare[gi_spares][0] = pptrO_direction->mi_a1_pipe[0];
+        gi_a1_spare[gi_spares][1] = pptrO_direction->mi_a1_pipe[1];
+        ++gi_spares;
+    } else {
+        close(pptrO_direction->mi_a1_pipe[0]);
+        close(pptrO_direction->mi_a1_pipe[1]);
+    }
+    pptrO_direction->mi_a1_pipe[0] = pptrO_direction->mi_a1_pipe[1] = -1;
+}
+
+/********************* RELAY *********************/
+
+// nothing of this direction is half-way: no byte in the pipe, no frame begun
+static int fi_directionIdle(const struct ipc_proxyDirection *pptrO_direction) {
+    return pptrO_direction->msz_piped == 0 &&
+           pptrO_direction->msz_header == 0 &&
+           pptrO_direction->mul_payload == 0;
+}
+
+/*
+ * Move bytes from pi_from_fd to pi_to_fd until one of them would block, or the source ends
+ * Returns 0, or -1 (with errno set) if the session is broken
+ */
+static int fi_directionPump(struct ipc_proxyDirection *pptrO_direction, int pi_from_fd, int pi_to_fd) {
+    //
+    struct ipc_proxyDirection *lptrO_d = pptrO_direction;
+    ssize_t                    li_n;
+    //
+    while (!lptrO_d->mi_done) {
+        // what is in the pipe precedes anything still to come
+        if (lptrO_d->msz_piped > 0) {
+            li_n = splice(lptrO_d->mi_a1_pipe[0], NULL, pi_to_fd, NULL, lptrO_d->msz_piped,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (li_n < 0) {
+                return errno == EAGAIN ? 0 : -1;
+            }
+            lptrO_d->msz_piped -= li_n;
+            continue;
+        }
+        // framed: a whole header read, not passed on completely yet
+        if (lptrO_d->msz_header == IPC_FRAME_HEADER_SIZE && lptrO_d->msz_headerSent < IPC_FRAME_HEADER_SIZE) {
+            li_n = send(pi_to_fd, lptrO_d->muc_a1_header + lptrO_d->msz_headerSent,
+                        IPC_FRAME_HEADER_SIZE - lptrO_d->msz_headerSent, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (li_n < 0) {
+                return errno == EAGAIN ? 0 : -1;
+            }
+            lptrO_d->msz_headerSent += li_n;
+            //
+            if (lptrO_d->msz_headerSent == IPC_FRAME_HEADER_SIZE && lptrO_d->mul_payload == 0) {
+                ++lptrO_d->mul_frames;
+                lptrO_d->msz_header = lptrO_d->msz_headerSent = 0;
+            }
+            continue;
+        }
+        if (lptrO_d->mi_eof) {
+            // all passed on: ending it is the session's call
+            return 0;
+        }
+        // the stream itself (text), or a payload (framed): source -> pipe, never copied
+        if (!lptrO_d->mi_framed || lptrO_d->mul_payload > 0) {
+            size_t lsz_want = PROXY_PIPE_SIZE;
+            //
+            if (lptrO_d->mi_framed && lptrO_d->mul_payload < lsz_want) {
+                lsz_want = lptrO_d->mul_payload;
+            }
+            li_n = splice(pi_from_fd, NULL, lptrO_d->mi_a1_pipe[1], NULL, lsz_want,
+                          SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (li_n < 0) {
+                return errno == EAGAIN ? 0 : -1;
+            }
+            if (li_n == 0) {
+                if (lptrO_d->mi_framed) {
+                    // the stream ended inside a payload
+                    errno = EPROTO;
+                    return -1;
+                }
+                lptrO_d->mi_eof = 1;
+                continue;
+            }
+            lptrO_d->msz_piped += li_n;
+            //
+            if (lptrO_d->mi_framed && (lptrO_d->mul_payload -= li_n) == 0) {
+                ++lptrO_d->mul_frames;
+                lptrO_d->msz_header = lptrO_d->msz_headerSent = 0;
+            }
+            continue;
+        }
+        // framed: the next header, the only bytes that are read here
+        li_n = recv(pi_from_fd, lptrO_d->muc_a1_header + lptrO_d->msz_header,
+                    IPC_FRAME_HEADER_SIZE - lptrO_d->msz_header, MSG_DONTWAIT);
+        if (li_n < 0) {
+            return errno == EAGAIN ? 0 : -1;
+        }
+        if (li_n == 0) {
+            if (lptrO_d->msz_header > 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            lptrO_d->mi_eof = 1;
+            continue;
+        }
+        lptrO_d->msz_header += li_n;
+        //
+        if (lptrO_d->msz_header == IPC_FRAME_HEADER_SIZE) {
+            struct ipc_frameHeader lO_header;
+            //
+            if (fi_frameHeaderDecode(lptrO_d->muc_a1_header, &lO_header) < 0) {
+                errno = EPROTO;
+                return -1;
+            }
+            lptrO_d->mul_payload = lO_header.mul_length;
+            lptrO_d->msz_headerSent = 0;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Close the session; pi_keepBackend: its backend connection goes back to the idle pool
+ * Freed only after the current batch of events, which may still name it
+ */
+static void fv_sessionClose(struct ipc_proxySession *pptrO_session, int pi_keepBackend) {
+    //
+    struct ipc_proxyBackend *lptrO_backend = pptrO_session->mptrO_backend;
+    //
+    close(pptrO_session->mi_client_fd);
+    //
+    if (pptrO_session->mi_backend_fd >= 0) {
+        if (pi_keepBackend && lptrO_backend->mi_idle < gptrO_config->mi_idleMax &&
+            epoll_ctl(gi_epoll_fd, EPOLL_CTL_DEL, pptrO_session->mi_backend_fd, NULL) == 0) {
+            lptrO_backend->mi_a1_idle[lptrO_backend->mi_idle++] = pptrO_session->mi_backend_fd;
+        } else {
+            close(pptrO_session->mi_backend_fd);
+        }
+    }
+    if (lptrO_backend != NULL) {
+        --lptrO_backend->mi_active;
+    }
+    fv_timerCancel(&gO_wheel, &pptrO_session->mO_deadline);
+    fv_pipeRelease(&pptrO_session->mO_up);
+    fv_pipeRelease(&pptrO_session->mO_down);
+    //
+    pptrO_session->me_state = PROXY_CLOSED;
+    pptrO_session->mptrO_next = gptrO_closed;
+    gptrO_closed = pptrO_session;
+}
+
+static int fi_sessionRelayStart(struct ipc_proxySession *pptrO_session) {
+    //
+    if (fi_pipeGet(pptrO_session->mO_up.mi_a1_pipe) < 0) {
+        return -1;
+    }
+    if (fi_pipeGet(pptrO_session->mO_down.mi_a1_pipe) < 0) {
+        return -1;
+    }
+    pptrO_session->mO_up.mi_framed = pptrO_session->mO_down.mi_framed = pptrO_session->mi_framed;
+    pptrO_session->me_state = PROXY_RELAY;
+    //
+    // the handshake deadline is met; from now on only an idle one, if any
+    if (gptrO_config->mi_idleMilliseconds == 0) {
+        fv_timerCancel(&gO_wheel, &pptrO_session->mO_deadline);
+    }
+    //
+    IPC_LOGD("session relayed to %s", pptrO_session->mptrO_backend->mc_a1_name);
+    //
+    return 0;
+}
+
+/*
+ * Pick a backend for the session, and connect to it, or take one of its idle connections
+ * Returns 0, or -1 if no backend is left to try
+ */
+static int fi_sessionConnect(struct ipc_proxySession *pptrO_session) {
+    //
+    // a backend that failed this session is not picked for it again, whether or not it is marked down yet
+    struct ipc_proxyBackend *lptrO_backend;
+    //
+    while ((lptrO_backend = fptrO_backendChoose(pptrO_session->mul_key, pptrO_session->mui_tried)) != NULL) {
+        pptrO_session->mui_tried |= 1u << (lptrO_backend - gO_a1_backends);
+        pptrO_session->mptrO_backend = lptrO_backend;
+        ++lptrO_backend->mi_active;
+        //
+        // framed sessions may reuse a connection, if the backend did not close it meanwhile
+        while (pptrO_session->mi_framed && lptrO_backend->mi_idle > 0) {
+            int  li_idle_fd = lptrO_backend->mi_a1_idle[--lptrO_backend->mi_idle];
+            char lc_probe;
+            //
+            if (recv(li_idle_fd, &lc_probe, 1, MSG_PEEK | MSG_DONTWAIT) < 0 && errno == EAGAIN) {
+                pptrO_session->mi_backend_fd = li_idle_fd;
+                break;
+            }
+            close(li_idle_fd);
+        }
+        if (pptrO_session->mi_backend_fd < 0) {
+            pptrO_session->mi_backend_fd = fi_connectStart(&lptrO_backend->mO_address);
+        }
+        //
+        struct epoll_event lO_event;
+        lO_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        lO_event.data.ptr = pptrO_session;
+        //
+        if (pptrO_session->mi_backend_fd >= 0 &&
+            epoll_ctl(gi_epoll_fd, EPOLL_CTL_ADD, pptrO_session->mi_backend_fd, &lO_event) == 0) {
+            pptrO_session->me_state = PROXY_CONNECTING;
+            return 0;
+        }
+        // could not even start: count it against the backend, and try the next one (the next ring node, hashing)
+        IPC_LOGE("backend %s: %m", lptrO_backend->mc_a1_name);
+        if (pptrO_session->mi_backend_fd >= 0) {
+            close(pptrO_session->mi_backend_fd);
+            pptrO_session->mi_backend_fd = -1;
+        }
+        --lptrO_backend->mi_active;
+        pptrO_session->mptrO_backend = NULL;
+        fv_backendHealth(lptrO_backend, 0);
+    }
+    IPC_LOGE("no backend available, connection dropped");
+    //
+    return -1;
+}
+
+/*
+ * Read the client's first bytes without taking them: the protocol, and the key for hashing
+ * Returns 1 once known, 0 to wait for more, or -1 if the client left
+ */
+static int fi_sessionPeek(struct ipc_proxySession *pptrO_session) {
+    //
+    unsigned char luc_a1_peek[IPC_FRAME_HEADER_SIZE + PROXY_KEY_MAX];
+    ssize_t       li_n = recv(pptrO_session->mi_client_fd, luc_a1_peek, sizeof(luc_a1_peek), MSG_PEEK | MSG_DONTWAIT);
+    //
+    if (li_n < 0) {
+        return errno == EAGAIN ? 0 : -1;
+    }
+    if (li_n == 0) {
+        return -1;
+    }
+    pptrO_session->mi_framed = luc_a1_peek[0] == IPC_FRAME_MAGIC;
+    //
+    if (gptrO_config->me_policy != IPC_PROXY_HASH) {
+        return 1;
+    }
+    if (!pptrO_session->mi_framed) {
+        // a text message arrives in one piece: its first line is the key
+        const unsigned char *lptruc_end = memchr(luc_a1_peek, '\n', li_n);
+        //
+        pptrO_session->mul_key = ful_proxyHash(luc_a1_peek, lptruc_end ? lptruc_end - luc_a1_peek : li_n);
+        return 1;
+    }
+    // framed: the first bytes of the first request's payload, once they are all there
+    struct ipc_frameHeader lO_header;
+    //
+    if (li_n < IPC_FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    if (fi_frameHeaderDecode(luc_a1_peek, &lO_header) < 0) {
+        return -1;
+    }
+    size_t lsz_key = lO_header.mul_length < PROXY_KEY_MAX ? lO_header.mul_length : PROXY_KEY_MAX;
+    //
+    if ((size_t) li_n < IPC_FRAME_HEADER_SIZE + lsz_key) {
+        return 0;
+    }
+    pptrO_session->mul_key = ful_proxyHash(luc_a1_peek + IPC_FRAME_HEADER_SIZE, lsz_key);
+    //
+    return 1;
+}
+
+// move the session as far as it can go without blocking
+static void fv_sessionAdvance(struct ipc_proxySession *pptrO_session) {
+    //
+    if (pptrO_session->me_state == PROXY_FIRST) {
+        int li_result = fi_sessionPeek(pptrO_session);
+        //
+        if (li_result == 0) {
+            return;
+        }
+        if (li_result < 0 || fi_sessionConnect(pptrO_session) < 0) {
+            fv_sessionClose(pptrO_session, 0);
+            return;
+        }
+    }
+    //
+    while (pptrO_session->me_state == PROXY_CONNECTING) {
+        int li_result = fi_connectResult(pptrO_session->mi_backend_fd);
+        //
+        if (li_result == 0) {
+            return;
+        }
+        if (li_result > 0) {
+            if (fi_sessionRelayStart(pptrO_session) < 0) {
+                IPC_LOGE("pipe: %m");
+                fv_sessionClose(pptrO_session, 0);
+                return;
+            }
+            break;
+        }
+        // refused, or unreachable: down at once, without waiting for its health check
+        struct ipc_proxyBackend *lptrO_backend = pptrO_session->mptrO_backend;
+        //
+        IPC_LOGW("backend %s: %m", lptrO_backend->mc_a1_name);
+        close(pptrO_session->mi_backend_fd);
+        pptrO_session->mi_backend_fd = -1;
+        --lptrO_backend->mi_active;
+        pptrO_session->mptrO_backend = NULL;
+        lptrO_backend->mi_failures = PROXY_CHECK_FAILURES - 1;
+        fv_backendHealth(lptrO_backend, 0);
+        //
+        if (fi_sessionConnect(pptrO_session) < 0) {
+            fv_sessionClose(pptrO_session, 0);
+            return;
+        }
+    }
+    //
+    struct ipc_proxyDirection *lptrO_up = &pptrO_session->mO_up,
+                              *lptrO_down = &pptrO_session->mO_down;
+    //
+    // an event is activity: the idle deadline starts over
+    if (gptrO_config->mi_idleMilliseconds > 0) {
+        fv_timerArm(&gO_wheel, &pptrO_session->mO_deadline, gptrO_config->mi_idleMilliseconds);
+    }
+    if (fi_directionPump(lptrO_up, pptrO_session->mi_client_fd, pptrO_session->mi_backend_fd) < 0 ||
+        fi_directionPump(lptrO_down, pptrO_session->mi_backend_fd, pptrO_session->mi_client_fd) < 0) {
+        IPC_LOGD("session ended: %m");
+        fv_sessionClose(pptrO_session, 0);
+        return;
+    }
+    // the client is done
+    if (lptrO_up->mi_eof && !lptrO_up->mi_done && lptrO_up->msz_piped == 0) {
+        // every request answered: the backend connection is as good as new
+        if (pptrO_session->mi_framed && !lptrO_down->mi_eof &&
+            fi_directionIdle(lptrO_down) && lptrO_up->mul_frames == lptrO_down->mul_frames) {
+            fv_sessionClose(pptrO_session, 1);
+            return;
+        }
+        // otherwise the backend answers what it has, then closes as well
+        shutdown(pptrO_session->mi_backend_fd, SHUT_WR);
+        lptrO_up->mi_done = 1;
+    }
+    // the backend is done
+    if (lptrO_down->mi_eof && !lptrO_down->mi_done && lptrO_down->msz_piped == 0) {
+        shutdown(pptrO_session->mi_client_fd, SHUT_WR);
+        lptrO_down->mi_done = 1;
+    }
+    if (lptrO_up->mi_done && lptrO_down->mi_done) {
+        fv_sessionClose(pptrO_session, 0);
+    }
+}
+
+// a session past its deadline: a client that never sent a whole first request (or stalls), a backend never connected
+static void fv_sessionExpire(struct ipc_timer *pptrO_timer, void *pptrv_context) {
+    //
+    struct ipc_proxySession *lptrO_session = IPC_TIMER_OWNER(pptrO_timer, struct ipc_proxySession, mO_deadline);
+    //
+    (void) pptrv_context;
+    //
+    IPC_LOGD("session timed out (%s)", lptrO_session->me_state == PROXY_RELAY ? "idle" : "handshake");
+    fv_sessionClose(lptrO_session, 0);
+}
+
+static void fv_acceptAll(int pi_socketConn_fd) {
+    //
+    while (1) {
+        int li_client_fd = accept4(pi_socketConn_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        //
+        if (li_client_fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                // e.g., EMFILE: keep relaying the sessions already open
+                IPC_LOGE("accept4: %m");
+            }
+            return;
+        }
+        struct ipc_proxySession *lptrO_session = calloc(1, sizeof(*lptrO_session));
+        //
+        if (lptrO_session == NULL) {
+            IPC_LOGE("calloc: %m");
+            close(li_client_fd);
+            continue;
+        }
+        int li_enable = 1;
+        setsockopt(li_client_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+        //
+        lptrO_session->me_tag = PROXY_TAG_SESSION;
+        lptrO_session->me_state = PROXY_FIRST;
+        lptrO_session->mi_client_fd = li_client_fd;
+        lptrO_session->mi_backend_fd = -1;
+        lptrO_session->mO_up.mi_a1_pipe[0] = lptrO_session->mO_up.mi_a1_pipe[1] = -1;
+        lptrO_session->mO_down.mi_a1_pipe[0] = lptrO_session->mO_down.mi_a1_pipe[1] = -1;
+        fv_timerArm(&gO_wheel, &lptrO_session->mO_deadline, gptrO_config->mi_firstMilliseconds);
+        //
+        struct epoll_event lO_event;
+        lO_event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        lO_event.data.ptr = lptrO_session;
+        //
+        if (epoll_ctl(gi_epoll_fd, EPOLL_CTL_ADD, li_client_fd, &lO_event) < 0) {
+            IPC_LOGE("epoll_ctl: %m");
+            fv_timerCancel(&gO_wheel, &lptrO_session->mO_deadline);
+            close(li_client_fd);
+            free(lptrO_session);
+        }
+    }
+}
+
+int fi_proxyServe(int pi_socketConn_fd, const struct ipc_proxyConfig *pptrO_config) {
+    //
+    if (pptrO_config->mi_backends < 1 || pptrO_config->mi_backends > IPC_PROXY_BACKENDS_MAX ||
+        pptrO_config->mi_idleMax < 0 || pptrO_config->mi_idleMax > IPC_PROXY_IDLE_MAX ||
+        pptrO_config->mi_checkMilliseconds < 1 ||
+        pptrO_config->mi_firstMilliseconds < 1 || pptrO_config->mi_idleMilliseconds < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    gptrO_config = pptrO_config;
+    //
+    // every backend starts healthy: the first checks, or sessions, will tell
+    for (int i = 0; i < pptrO_config->mi_backends; ++i) {
+        struct ipc_proxyBackend *lptrO_backend = &gO_a1_backends[i];
+        char                     lc_a1_host[INET_ADDRSTRLEN];
+        //
+        lptrO_backend->me_tag = PROXY_TAG_CHECK;
+        lptrO_backend->mO_address = pptrO_config->mO_a1_backends[i];
+        lptrO_backend->mi_healthy = 1;
+        lptrO_backend->mi_check_fd = -1;
+        inet_ntop(AF_INET, &lptrO_backend->mO_address.sin_addr, lc_a1_host, sizeof(lc_a1_host));
+        snprintf(lptrO_backend->mc_a1_name, sizeof(lptrO_backend->mc_a1_name), "%s:%u",
+                 lc_a1_host, ntohs(lptrO_backend->mO_address.sin_port));
+    }
+    fv_ringBuild();
+    //
+    if (fcntl(pi_socketConn_fd, F_SETFL, fcntl(pi_socketConn_fd, F_GETFL, 0) | O_NONBLOCK) < 0) {
+        return -1;
+    }
+    gi_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    //
+    int li_timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    //
+    if (gi_epoll_fd < 0 || li_timer_fd < 0) {
+        return -1;
+    }
+    struct itimerspec lO_interval;
+    lO_interval.it_interval.tv_sec = pptrO_config->mi_checkMilliseconds / 1000;
+    lO_interval.it_interval.tv_nsec = (pptrO_config->mi_checkMilliseconds % 1000) * 1000000L;
+    lO_interval.it_value = lO_interval.it_interval;
+    //
+    struct epoll_event lO_event;
+    //
+    lO_event.events = EPOLLIN | EPOLLET;
+    lO_event.data.ptr = &ge_listenerTag;
+    //
+    if (epoll_ctl(gi_epoll_fd, EPOLL_CTL_ADD, pi_socketConn_fd, &lO_event) < 0) {
+        return -1;
+    }
+    lO_event.events = EPOLLIN;
+    lO_event.data.ptr = &ge_timerTag;
+    //
+    if (timerfd_settime(li_timer_fd, 0, &lO_interval, NULL) < 0 ||
+        epoll_ctl(gi_epoll_fd, EPOLL_CTL_ADD, li_timer_fd, &lO_event) < 0) {
+        return -1;
+    }
+    //
+    struct epoll_event lO_a1_events[PROXY_MAX_EVENTS];
+    //
+    fv_timerWheelInit(&gO_wheel, ful_timerNow());
+    //
+    while (1) {
+        int li_ready = epoll_wait(gi_epoll_fd, lO_a1_events, PROXY_MAX_EVENTS,
+                                  fi_timerWheelTimeout(&gO_wheel, ful_timerNow()));
+        //
+        if (li_ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        for (int i = 0; i < li_ready; ++i) {
+            enum ipc_proxyTag *lptre_tag = lO_a1_events[i].data.ptr;
+            //
+            switch (*lptre_tag) {
+                case PROXY_TAG_LISTENER:
+                    fv_acceptAll(pi_socketConn_fd);
+                    break;
+                case PROXY_TAG_TIMER: {
+                    uint64_t lul_expirations;
+                    //
+                    if (read(li_timer_fd, &lul_expirations, sizeof(lul_expirations)) > 0) {
+                        for (int j = 0; j < pptrO_config->mi_backends; ++j) {
+                            fv_checkStart(&gO_a1_backends[j]);
+                        }
+                    }
+                    break;
+                }
+                case PROXY_TAG_CHECK:
+                    fv_checkEvent((struct ipc_proxyBackend *) lptre_tag);
+                    break;
+                case PROXY_TAG_SESSION: {
+                    struct ipc_proxySession *lptrO_session = (struct ipc_proxySession *) lptre_tag;
+                    //
+                    // both of its sockets may be in this batch: a closed session is skipped
+                    if (lptrO_session->me_state != PROXY_CLOSED) {
+                        fv_sessionAdvance(lptrO_session);
+                    }
+                    break;
+                }
+            }
+        }
+        // every deadline passed meanwhile; closed sessions are freed below with the others
+        ful_timerWheelAdvance(&gO_wheel, ful_timerNow(), fv_sessionExpire, NULL);
+        //
+        // no event of this batch refers to them any longer
+        while (gptrO_closed != NULL) {
+            struct ipc_proxySession *lptrO_next = gptrO_closed->mptrO_next;
+            //
+            free(gptrO_closed);
+            gptrO_closed = lptrO_next;
+        }
+    } // end of infinite event loop
+}
@@ -0,0 +1,54 @@
+/*
+ * Load-balancing forwarding proxy
+ * One thread, one edge-triggered epoll instance: every client connection is paired with
+ * a connection to one of the backends, and bytes are relayed both ways with splice()
+ * through a pipe per direction, so payloads never enter user space
+ * The backend is picked when the client's first message is there:
+ *  - round-robin over the healthy backends
+ *  - least connections: the healthy backend relaying the fewest sessions
+ *  - consistent hashing of the request key (the first line of a text message, or the
+ *    first bytes of a framed request's payload) on a ring of virtual nodes: a backend
+ *    going down only moves the keys it owned
+ * Framed sessions (ipc_frame.h) are followed frame by frame: only the 16-byte headers are
+ * read, to count requests and replies, and the payloads are spliced. When such a client
+ * leaves with every request answered, its backend connection is kept for the next one
+ * Backends are health-checked with a TCP connect every interval, and marked down at once
+ * when a session cannot connect to them; a session then tries the next backend
+ * A session must be relaying within a deadline (its first request whole, its backend connected),
+ * so a client trickling or withholding its first bytes cannot hold descriptors forever
+ */
+#ifndef IPC_PROXY_H
+#define IPC_PROXY_H
+
+#include <netinet/in.h>
+
+#define IPC_PROXY_BACKENDS_MAX 32
+// most idle backend connections kept per backend, for framed sessions
+#define IPC_PROXY_IDLE_MAX     64
+
+enum ipc_proxyPolicy {
+    IPC_PROXY_ROUND_ROBIN,
+    IPC_PROXY_LEAST_CONNECTIONS,
+    IPC_PROXY_HASH
+};
+
+struct ipc_proxyConfig {
+    struct sockaddr_in   mO_a1_backends[IPC_PROXY_BACKENDS_MAX];
+    int                  mi_backends;
+    enum ipc_proxyPolicy me_policy;
+    // between two health checks of a backend; a check not answered by the next one failed
+    int                  mi_checkMilliseconds;
+    // idle connections kept per backend (at most IPC_PROXY_IDLE_MAX), 0 to close them all
+    int                  mi_idleMax;
+    // for a session to start relaying, and for its next event while relaying (0: no limit)
+    int                  mi_firstMilliseconds;
+    int                  mi_idleMilliseconds;
+};
+
+/*
+ * Relay every connection arriving on the listening socket, pi_socketConn_fd, to the backends
+ * Runs forever; returns -1 (with errno set) only if the loop cannot be set up
+ */
+int fi_proxyServe(int pi_socketConn_fd, const struct ipc_proxyConfig *pptrO_config);
+
+#endif  // IPC_PROXY_H
@@ -0,0 +1,98 @@
+/*
+ * Service-time simulator
+ * References:
+ *  https://prng.di.unimi.it/ (xorshift generators)
+ *  man 2 clock_gettime
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "ipc_service.h"
+
+// set once, before any request is served; 0 and 0: no simulated work
+static uint64_t gul_serviceMinimum;
+static uint64_t gul_serviceSpread;
+
+static uint64_t ful_serviceNow(void) {
+    struct timespec lO_time;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_time);
+    //
+    return (uint64_t) lO_time.tv_sec * 1000000000ull + lO_time.tv_nsec;
+}
+
+// parse a whole non-negative count of microseconds into nanoseconds
+static int fi_microsecondsParse(const char *cptrc_text, char **pptrc_end, uint64_t *pptrul_nanoseconds) {
+    //
+    if (*cptrc_text < '0' || *cptrc_text > '9') {
+        return -1;
+    }
+    errno = 0;
+    unsigned long long lull_microseconds = strtoull(cptrc_text, pptrc_end, 10);
+    //
+    if (errno != 0 || lull_microseconds > UINT64_MAX / 1000) {
+        return -1;
+    }
+    *pptrul_nanoseconds = lull_microseconds * 1000;
+    //
+    return 0;
+}
+
+int fi_serviceInit(const char *cptrc_spec) {
+    //
+    uint64_t lul_minimum = 0,
+             lul_maximum = 0;
+    char    *lptrc_end;
+    //
+    if (cptrc_spec == NULL) {
+        // no simulated work
+    } else if (strncmp(cptrc_spec, "uniform:", 8) == 0) {
+        if (fi_microsecondsParse(cptrc_spec + 8, &lptrc_end, &lul_minimum) < 0 ||
+            *lptrc_end != '-' ||
+            fi_microsecondsParse(lptrc_end + 1, &lptrc_end, &lul_maximum) < 0 ||
+            *lptrc_end != '\0' ||
+            lul_maximum < lul_minimum) {
+            errno = EINVAL;
+            return -1;
+        }
+    } else {
+        if (fi_microsecondsParse(cptrc_spec, &lptrc_end, &lul_minimum) < 0 ||
+            *lptrc_end != '\0') {
+            errno = EINVAL;
+            return -1;
+        }
+        lul_maximum = lul_minimum;
+    }
+    gul_serviceMinimum = lul_minimum;
+    gul_serviceSpread = lul_maximum - lul_minimum;
+    //
+    return 0;
+}
+
+void fv_serviceSimulate(void) {
+    //
+    if (gul_serviceMinimum == 0 && gul_serviceSpread == 0) {
+        return;
+    }
+    uint64_t lul_start = ful_serviceNow(),
+             lul_duration = gul_serviceMinimum;
+    //
+    if (gul_serviceSpread > 0) {
+        // xorshift64*, one generator per thread: no lock, no shared cache line
+        static __thread uint64_t stul_state;
+        //
+        if (stul_state == 0) {
+            stul_state = (lul_start ^ (uintptr_t) &stul_state) | 1;
+        }
+        stul_state ^= stul_state >> 12;
+        stul_state ^= stul_state << 25;
+        stul_state ^= stul_state >> 27;
+        lul_duration += (stul_state * 0x2545F4914F6CDD1Dull) % (gul_serviceSpread + 1);
+    }
+    // busy, like real work: a sleep would hand the core back and add a wakeup to every request
+    while (ful_serviceNow() - lul_start < lul_duration)
+        ;
+}
@@ -0,0 +1,23 @@
+/*
+ * Service-time simulator
+ * Stands in for the work a real server does per request, so that latency can be measured
+ * under a known, repeatable load: each request holds its serving thread for a time drawn
+ * from the configured distribution, busy (as computation would), not asleep
+ * Off by default: requests then cost only their I/O
+ */
+#ifndef IPC_SERVICE_H
+#define IPC_SERVICE_H
+
+/*
+ * cptrc_spec: service time per request, in microseconds, one of
+ *  "<us>"            every request takes the same time, e.g. "20"
+ *  "uniform:<a>-<b>" drawn uniformly between a and b, e.g. "uniform:5-50"
+ *  NULL or "0"       no simulated work
+ * Returns 0, or -1 (errno EINVAL)
+ */
+int fi_serviceInit(const char *cptrc_spec);
+
+// spend one request's service time on the calling thread
+void fv_serviceSimulate(void);
+
+#endif  // IPC_SERVICE_H
@@ -0,0 +1,461 @@
+/*
+ * Shared-memory transport for clients on the same host
+ * Region layout:
+ *  header | request ring (MPSC, bounded, per-slot sequence numbers) | mailboxes (SPSC)
+ * Every index that one side writes and another reads sits on its own cache line
+ * Wakeups: the consumer of a ring announces that it is about to sleep and
+ * futex-waits on the ring's counter; producers bump the counter and only
+ * enter the kernel to wake it if it announced so
+ * References:
+ *  D. Vyukov: Bounded MPMC queue (1024cores.net)
+ *  U. Drepper: Futexes Are Tricky
+ *  man 7 shm_overview, man 2 futex
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "ipc_common.h"
+#include "ipc_shm.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+
+#define SHM_MAGIC 0x43495043u  // "CIPC"
+#define SHM_VERSION 1
+// ring sizes, powers of 2
+#define SHM_REQUEST_SLOTS 1024
+#define SHM_MAILBOX_SLOTS 64
+// clients attached at the same time
+#define SHM_CLIENTS 64
+// polls of an empty ring before going to sleep on its futex
+#define SHM_SPIN_ITERATIONS 4096
+// a sleeping client wakes up this often to check that the server is still alive
+#define SHM_LIVENESS_NANOSECONDS 100000000L
+// longest the server waits for room in a full mailbox before dropping the acknowledgement
+#define SHM_POST_NANOSECONDS 1000000L
+#define CACHE_LINE_SIZE 64
+
+// one message, either direction
+struct ipc_shmMessage {
+    uint32_t mui_requestID;
+    uint32_t mui_client;
+    uint32_t mui_length;
+    char     mc_a1_data[BUFFER_SIZE];
+};
+
+// request slot: its sequence number says whose turn it is (producer or consumer)
+struct ipc_shmRequestSlot {
+    atomic_ulong          mul_sequence;
+    struct ipc_shmMessage mO_message;
+};
+
+// what the consumer of a ring sleeps on
+struct ipc_shmSignal {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint mui_counter;
+    atomic_uint                           mui_sleeping;
+};
+
+// acknowledgements from the server to one client
+struct ipc_shmMailbox {
+    _Alignas(CACHE_LINE_SIZE) atomic_int   mi_ownerPID;  // 0: free
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong mul_head;     // written by the client
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong mul_tail;     // written by the server
+    struct ipc_shmSignal                   mO_signal;
+    struct ipc_shmMessage                  mO_a1_slots[SHM_MAILBOX_SLOTS];
+};
+
+struct ipc_shmRegion {
+    atomic_uint                            mui_magic;
+    uint32_t                               mui_version;
+    atomic_int                             mi_serverPID;
+    // requests from all clients to the server
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong mul_requestTail;  // claimed by clients
+    _Alignas(CACHE_LINE_SIZE) uint64_t     mul_requestHead;  // server only
+    struct ipc_shmSignal                   mO_requestSignal;
+    struct ipc_shmRequestSlot              mO_a1_requests[SHM_REQUEST_SLOTS];
+    struct ipc_shmMailbox                  mO_a1_mailboxes[SHM_CLIENTS];
+};
+
+struct ipc_shmClient {
+    struct ipc_shmRegion  *mptrO_region;
+    struct ipc_shmMailbox *mptrO_mailbox;
+    uint32_t               mui_index;
+    uint32_t               mui_nextRequestID;
+};
+
+static void fv_cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+static void fv_signalNotify(struct ipc_shmSignal *pptrO_signal) {
+    atomic_fetch_add(&pptrO_signal->mui_counter, 1);
+    //
+    // the system call is only paid when the consumer is (about to be) asleep
+    if (atomic_load(&pptrO_signal->mui_sleeping)) {
+        syscall(SYS_futex, &pptrO_signal->mui_counter, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+    }
+}
+
+/*
+ * Sleep until the counter moves past pui_seen, or the timeout (NULL: none) expires
+ * The caller must have read pui_seen before checking its ring one last time
+ */
+static void fv_signalWait(struct ipc_shmSignal  *pptrO_signal,
+                          unsigned               pui_seen,
+                          const struct timespec *pptrO_timeout) {
+    syscall(SYS_futex, &pptrO_signal->mui_counter, FUTEX_WAIT, pui_seen, pptrO_timeout, NULL, 0);
+}
+
+static int fi_processAlive(pid_t pi_processID) {
+    return pi_processID > 0 && (kill(pi_processID, 0) == 0 || errno != ESRCH);
+}
+
+static void fv_regionName(const char *cptrc_name, char *pptrc_out, size_t psz_room) {
+    snprintf(pptrc_out, psz_room, "/c-ipc-%s", cptrc_name);
+}
+
+/********************** SERVER **********************/
+
+// the next request of any client, or NULL if there is none yet
+static struct ipc_shmRequestSlot *fptrO_requestPeek(struct ipc_shmRegion *pptrO_region) {
+    struct ipc_shmRequestSlot *lptrO_slot =
+        &pptrO_region->mO_a1_requests[pptrO_region->mul_requestHead & (SHM_REQUEST_SLOTS - 1)];
+    //
+    if (atomic_load_explicit(&lptrO_slot->mul_sequence, memory_order_acquire) !=
+        pptrO_region->mul_requestHead + 1) {
+        return NULL;
+    }
+    return lptrO_slot;
+}
+
+// hand a consumed request slot back to the producers, one lap ahead
+static void fv_requestRelease(struct ipc_shmRegion *pptrO_region, struct ipc_shmRequestSlot *pptrO_slot) {
+    atomic_store_explicit(&pptrO_slot->mul_sequence,
+                          pptrO_region->mul_requestHead + SHM_REQUEST_SLOTS,
+                          memory_order_release);
+    ++pptrO_region->mul_requestHead;
+}
+
+static struct ipc_shmRequestSlot *fptrO_requestWait(struct ipc_shmRegion *pptrO_region) {
+    struct ipc_shmRequestSlot *lptrO_slot;
+    //
+    for (int i = 0; i < SHM_SPIN_ITERATIONS; ++i) {
+        if ((lptrO_slot = fptrO_requestPeek(pptrO_region)) != NULL) {
+            return lptrO_slot;
+        }
+        fv_cpuRelax();
+    }
+    //
+    while (1) {
+        unsigned lui_seen = atomic_load(&pptrO_region->mO_requestSignal.mui_counter);
+        atomic_store(&pptrO_region->mO_requestSignal.mui_sleeping, 1);
+        //
+        if ((lptrO_slot = fptrO_requestPeek(pptrO_region)) == NULL) {
+            fv_signalWait(&pptrO_region->mO_requestSignal, lui_seen, NULL);
+            lptrO_slot = fptrO_requestPeek(pptrO_region);
+        }
+        atomic_store(&pptrO_region->mO_requestSignal.mui_sleeping, 0);
+        //
+        if (lptrO_slot != NULL) {
+            return lptrO_slot;
+        }
+    }
+}
+
+/*
+ * Queue an acknowledgement in the mailbox of the client that sent pptrO_request
+ * Returns 1, or 0 if it was dropped: the client is gone, or its mailbox stayed full
+ */
+static int fi_mailboxPost(struct ipc_shmRegion        *pptrO_region,
+                          const struct ipc_shmMessage *pptrO_request) {
+    //
+    if (pptrO_request->mui_client >= SHM_CLIENTS) {
+        return 0;
+    }
+    struct ipc_shmMailbox *lptrO_mailbox = &pptrO_region->mO_a1_mailboxes[pptrO_request->mui_client];
+    //
+    uint64_t lul_tail = atomic_load_explicit(&lptrO_mailbox->mul_tail, memory_order_relaxed);
+    uint64_t lul_deadline = 0;
+    //
+    // a client that stops reading may hold the server up only briefly: every other client waits too
+    while (lul_tail - atomic_load_explicit(&lptrO_mailbox->mul_head, memory_order_acquire) >=
+           SHM_MAILBOX_SLOTS) {
+        if (!fi_processAlive(atomic_load(&lptrO_mailbox->mi_ownerPID))) {
+            return 0;
+        }
+        if (lul_deadline == 0) {
+            lul_deadline = ful_metricsNow() + SHM_POST_NANOSECONDS;
+        } else if (ful_metricsNow() >= lul_deadline) {
+            IPC_LOGW("[Client %u]: mailbox full, acknowledgement #%u dropped",
+                     pptrO_request->mui_client, pptrO_request->mui_requestID);
+            fv_metricsError(ENOBUFS);
+            return 0;
+        }
+        sched_yield();
+    }
+    //
+    struct ipc_shmMessage *lptrO_reply = &lptrO_mailbox->mO_a1_slots[lul_tail & (SHM_MAILBOX_SLOTS - 1)];
+    //
+    lptrO_reply->mui_requestID = pptrO_request->mui_requestID;
+    lptrO_reply->mui_client = pptrO_request->mui_client;
+    lptrO_reply->mui_length = sizeof(IPC_ACKNOWLEDGE) - 1;
+    memcpy(lptrO_reply->mc_a1_data, IPC_ACKNOWLEDGE, sizeof(IPC_ACKNOWLEDGE));
+    //
+    atomic_store_explicit(&lptrO_mailbox->mul_tail, lul_tail + 1, memory_order_release);
+    fv_signalNotify(&lptrO_mailbox->mO_signal);
+    //
+    return 1;
+}
+
+int fi_shmServe(const char *cptrc_name) {
+    //
+    char lc_a1_name[NAME_MAX];
+    fv_regionName(cptrc_name, lc_a1_name, sizeof(lc_a1_name));
+    //
+    // a region left behind by a server that did not exit cleanly is replaced
+    shm_unlink(lc_a1_name);
+    //
+    int li_shm_fd = shm_open(lc_a1_name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    //
+    if (li_shm_fd < 0) {
+        return -1;
+    }
+    // a fresh region reads as all zeroes: every ring starts empty, every mailbox free
+    if (ftruncate(li_shm_fd, sizeof(struct ipc_shmRegion)) < 0) {
+        close(li_shm_fd);
+        shm_unlink(lc_a1_name);
+        return -1;
+    }
+    //
+    struct ipc_shmRegion *lptrO_region = mmap(NULL, sizeof(struct ipc_shmRegion),
+                                              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                                              li_shm_fd, 0);
+    close(li_shm_fd);
+    //
+    if (lptrO_region == MAP_FAILED) {
+        shm_unlink(lc_a1_name);
+        return -1;
+    }
+    //
+    for (unsigned i = 0; i < SHM_REQUEST_SLOTS; ++i) {
+        atomic_init(&lptrO_region->mO_a1_requests[i].mul_sequence, i);
+    }
+    lptrO_region->mui_version = SHM_VERSION;
+    atomic_store(&lptrO_region->mi_serverPID, getpid());
+    // clients only attach once the magic is there, i.e., after everything above
+    atomic_store(&lptrO_region->mui_magic, SHM_MAGIC);
+    //
+    IPC_LOGI("Shared-memory endpoint %s ready (%zu bytes)", lc_a1_name, sizeof(struct ipc_shmRegion));
+    //
+    while (1) {
+        struct ipc_shmRequestSlot *lptrO_slot = fptrO_requestWait(lptrO_region);
+        //
+        // the message is read in place, straight from the shared ring
+        if (lptrO_slot->mO_message.mui_length > BUFFER_SIZE - 1) {
+            lptrO_slot->mO_message.mui_length = BUFFER_SIZE - 1;
+        }
+        lptrO_slot->mO_message.mc_a1_data[lptrO_slot->mO_message.mui_length] = '\0';
+        fv_metricsRead(-1, lptrO_slot->mO_message.mui_length);
+        IPC_LOGI("[Client %u]: %s", lptrO_slot->mO_message.mui_client, lptrO_slot->mO_message.mc_a1_data);
+        //
+        if (fi_mailboxPost(lptrO_region, &lptrO_slot->mO_message)) {
+            fv_metricsSend(-1, strlen(IPC_ACKNOWLEDGE), 1);
+        }
+        fv_requestRelease(lptrO_region, lptrO_slot);
+    }
+}
+
+/********************** CLIENT **********************/
+
+struct ipc_shmClient *fptrO_shmConnect(const char *cptrc_name) {
+    //
+    char lc_a1_name[NAME_MAX];
+    fv_regionName(cptrc_name, lc_a1_name, sizeof(lc_a1_name));
+    //
+    int li_shm_fd = shm_open(lc_a1_name, O_RDWR, 0);
+    //
+    if (li_shm_fd < 0) {
+        return NULL;
+    }
+    //
+    struct stat lO_status;
+    //
+    if (fstat(li_shm_fd, &lO_status) < 0 || (size_t) lO_status.st_size != sizeof(struct ipc_shmRegion)) {
+        close(li_shm_fd);
+        errno = EPROTO;
+        return NULL;
+    }
+    //
+    struct ipc_shmRegion *lptrO_region = mmap(NULL, sizeof(struct ipc_shmRegion),
+                                              PROT_READ | PROT_WRITE, MAP_SHARED, li_shm_fd, 0);
+    close(li_shm_fd);
+    //
+    if (lptrO_region == MAP_FAILED) {
+        return NULL;
+    }
+    if (atomic_load(&lptrO_region->mui_magic) != SHM_MAGIC ||
+        lptrO_region->mui_version != SHM_VERSION ||
+        !fi_processAlive(atomic_load(&lptrO_region->mi_serverPID))) {
+        munmap(lptrO_region, sizeof(struct ipc_shmRegion));
+        errno = ECONNREFUSED;
+        return NULL;
+    }
+    //
+    struct ipc_shmClient *lptrO_client = calloc(1, sizeof(*lptrO_client));
+    //
+    if (lptrO_client == NULL) {
+        munmap(lptrO_region, sizeof(struct ipc_shmRegion));
+        return NULL;
+    }
+    lptrO_client->mptrO_region = lptrO_region;
+    //
+    // claim a free mailbox, or one whose owner died without giving it back
+    for (uint32_t i = 0; i < SHM_CLIENTS; ++i) {
+        struct ipc_shmMailbox *lptrO_mailbox = &lptrO_region->mO_a1_mailboxes[i];
+        int                    li_owner = atomic_load(&lptrO_mailbox->mi_ownerPID);
+        //
+        if (li_owner != 0 && fi_processAlive(li_owner)) {
+            continue;
+        }
+        if (atomic_compare_exchange_strong(&lptrO_mailbox->mi_ownerPID, &li_owner, getpid())) {
+            // drop whatever was left for the previous owner
+            atomic_store(&lptrO_mailbox->mul_head, atomic_load(&lptrO_mailbox->mul_tail));
+            //
+            lptrO_client->mptrO_mailbox = lptrO_mailbox;
+            lptrO_client->mui_index = i;
+            //
+            return lptrO_client;
+        }
+    }
+    //
+    fv_shmDisconnect(lptrO_client);
+    errno = EUSERS;
+    return NULL;
+}
+
+int64_t fl_shmRequest(struct ipc_shmClient *pptrO_client,
+                      const void           *pptrv_message,
+                      size_t                psz_length) {
+    //
+    struct ipc_shmRegion      *lptrO_region = pptrO_client->mptrO_region;
+    struct ipc_shmRequestSlot *lptrO_slot;
+    //
+    if (psz_length > BUFFER_SIZE - 1) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    //
+    // claim a slot: its sequence number equals the position once the server has freed it
+    uint64_t lul_position = atomic_load_explicit(&lptrO_region->mul_requestTail, memory_order_relaxed);
+    //
+    while (1) {
+        lptrO_slot = &lptrO_region->mO_a1_requests[lul_position & (SHM_REQUEST_SLOTS - 1)];
+        //
+        int64_t ll_difference =
+            (int64_t) (atomic_load_explicit(&lptrO_slot->mul_sequence, memory_order_acquire) - lul_position);
+        //
+        if (ll_difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(&lptrO_region->mul_requestTail,
+                                                      &lul_position, lul_position + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (ll_difference < 0) {
+            // ring full: the server is a lap behind
+            if (!fi_processAlive(atomic_load(&lptrO_region->mi_serverPID))) {
+                errno = EPIPE;
+                return -1;
+            }
+            sched_yield();
+            lul_position = atomic_load_explicit(&lptrO_region->mul_requestTail, memory_order_relaxed);
+        } else {
+            // another client took this slot first
+            lul_position = atomic_load_explicit(&lptrO_region->mul_requestTail, memory_order_relaxed);
+        }
+    }
+    //
+    uint32_t lui_requestID = ++pptrO_client->mui_nextRequestID;
+    //
+    lptrO_slot->mO_message.mui_requestID = lui_requestID;
+    lptrO_slot->mO_message.mui_client = pptrO_client->mui_index;
+    lptrO_slot->mO_message.mui_length = (uint32_t) psz_length;
+    memcpy(lptrO_slot->mO_message.mc_a1_data, pptrv_message, psz_length);
+    //
+    // publish the slot to the server
+    atomic_store_explicit(&lptrO_slot->mul_sequence, lul_position + 1, memory_order_release);
+    fv_signalNotify(&lptrO_region->mO_requestSignal);
+    //
+    return lui_requestID;
+}
+
+ssize_t fl_shmReceive(struct ipc_shmClient *pptrO_client,
+                      char                 *pptrc_out,
+                      size_t                psz_room,
+                      uint32_t             *pptrui_requestID) {
+    //
+    struct ipc_shmMailbox *lptrO_mailbox = pptrO_client->mptrO_mailbox;
+    uint64_t               lul_head = atomic_load_explicit(&lptrO_mailbox->mul_head, memory_order_relaxed);
+    struct timespec        lO_timeout = { 0, SHM_LIVENESS_NANOSECONDS };
+    int                    li_spins = 0;
+    //
+    while (atomic_load_explicit(&lptrO_mailbox->mul_tail, memory_order_acquire) == lul_head) {
+        if (li_spins++ < SHM_SPIN_ITERATIONS) {
+            fv_cpuRelax();
+            continue;
+        }
+        //
+        unsigned lui_seen = atomic_load(&lptrO_mailbox->mO_signal.mui_counter);
+        atomic_store(&lptrO_mailbox->mO_signal.mui_sleeping, 1);
+        //
+        if (atomic_load_explicit(&lptrO_mailbox->mul_tail, memory_order_acquire) == lul_head) {
+            fv_signalWait(&lptrO_mailbox->mO_signal, lui_seen, &lO_timeout);
+        }
+        atomic_store(&lptrO_mailbox->mO_signal.mui_sleeping, 0);
+        //
+        if (!fi_processAlive(atomic_load(&pptrO_client->mptrO_region->mi_serverPID))) {
+            errno = EPIPE;
+            return -1;
+        }
+    }
+    //
+    struct ipc_shmMessage *lptrO_reply = &lptrO_mailbox->mO_a1_slots[lul_head & (SHM_MAILBOX_SLOTS - 1)];
+    size_t                 lsz_length = lptrO_reply->mui_length;
+    //
+    if (psz_room == 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    if (lsz_length > psz_room - 1) {
+        lsz_length = psz_room - 1;
+    }
+    memcpy(pptrc_out, lptrO_reply->mc_a1_data, lsz_length);
+    pptrc_out[lsz_length] = '\0';
+    *pptrui_requestID = lptrO_reply->mui_requestID;
+    //
+    atomic_store_explicit(&lptrO_mailbox->mul_head, lul_head + 1, memory_order_release);
+    //
+    return (ssize_t) lsz_length;
+}
+
+void fv_shmDisconnect(struct ipc_shmClient *pptrO_client) {
+    //
+    if (pptrO_client->mptrO_mailbox != NULL) {
+        atomic_store(&pptrO_client->mptrO_mailbox->mi_ownerPID, 0);
+    }
+    munmap(pptrO_client->mptrO_region, sizeof(struct ipc_shmRegion));
+    free(pptrO_client);
+}
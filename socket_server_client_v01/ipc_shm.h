@@ -0,0 +1,54 @@
+/*
+ * Shared-memory transport for clients on the same host
+ * Server and clients map one POSIX shared-memory region, /c-ipc-<name>,
+ * and exchange the same text messages and acknowledgements as over TCP,
+ * without any system call while the other side is busy:
+ *  - one multi-producer ring carries requests from all clients to the server
+ *  - every client owns a single-producer mailbox ring for its acknowledgements
+ * A side with nothing to do spins briefly, then sleeps on a futex in the region
+ */
+#ifndef IPC_SHM_H
+#define IPC_SHM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// opaque handle of a client attached to the region
+struct ipc_shmClient;
+
+/*
+ * Create the region /c-ipc-<cptrc_name> (replacing a stale one) and serve
+ * its requests forever, printing and acknowledging each one like fv_serve()
+ * Returns -1 (with errno set) only if the region cannot be set up
+ */
+int fi_shmServe(const char *cptrc_name);
+
+/*
+ * Attach to the region of a running server and claim a mailbox
+ * Returns NULL (with errno set) if there is no such server, or all mailboxes are taken
+ */
+struct ipc_shmClient *fptrO_shmConnect(const char *cptrc_name);
+
+/*
+ * Queue one message (at most BUFFER_SIZE - 1 bytes) for the server
+ * Returns the request ID it was given, or -1 (with errno set)
+ */
+int64_t fl_shmRequest(struct ipc_shmClient *pptrO_client,
+                      const void           *pptrv_message,
+                      size_t                psz_length);
+
+/*
+ * Wait for the next acknowledgement, copy it NUL-terminated into pptrc_out
+ * and store its request ID
+ * Returns its length, or -1 (errno EPIPE) if the server went away
+ */
+ssize_t fl_shmReceive(struct ipc_shmClient *pptrO_client,
+                      char                 *pptrc_out,
+                      size_t                psz_room,
+                      uint32_t             *pptrui_requestID);
+
+// give the mailbox back and unmap the region
+void fv_shmDisconnect(struct ipc_shmClient *pptrO_client);
+
+#endif  // IPC_SHM_H
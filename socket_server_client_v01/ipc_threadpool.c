@@ -0,0 +1,239 @@
+/*
+ * Thread-pool serving mode
+ * Every worker owns a fixed-size Chase-Lev deque of accepted sockets:
+ *  - the accepting thread is the only one pushing, at the bottom
+ *  - workers take from the top, first from their own deque, then from the others
+ * Since nobody pops at the bottom, taking is always a single compare-and-swap
+ * A counting semaphore lets idle workers sleep instead of spinning
+ * References:
+ *  D. Chase, Y. Lev: Dynamic Circular Work-Stealing Deque (SPAA 2005)
+ *  N. M. Le et al.: Correct and Efficient Work-Stealing for Weak Memory Models (PPoPP 2013)
+ */
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "ipc_threadpool.h"
+#include "ipc_metrics.h"
+#include "ipc_accept.h"
+#include "ipc_busypoll.h"
+
+// sockets a single deque can hold, a power of 2
+#define DEQUE_CAPACITY 1024
+// pooled threads only run fv_serve(): a small stack is plenty
+#define WORKER_STACK_SIZE (256 * 1024)
+#define CACHE_LINE_SIZE 64
+// how often a pool handing over to a successor checks whether its connections are done
+#define POOL_DRAIN_POLL_US 10000
+
+// take results besides a socket
+#define DEQUE_EMPTY -1
+#define DEQUE_LOST_RACE -2
+
+// top and bottom on their own cache lines: thieves write one, the pusher the other
+struct ipc_deque {
+    _Alignas(CACHE_LINE_SIZE) atomic_long ml_top;
+    _Alignas(CACHE_LINE_SIZE) atomic_long ml_bottom;
+    _Alignas(CACHE_LINE_SIZE) atomic_int  mi_a1_sockets[DEQUE_CAPACITY];
+};
+
+struct ipc_threadPool {
+    struct ipc_deque *mptrO_deques;
+    int               mi_workers;
+    // number of pushed sockets no worker has claimed yet
+    sem_t             mO_pending;
+    // sockets pushed and not closed yet: what a hot restart waits for
+    atomic_int        mi_outstanding;
+    void            (*mpf_serve)(int);
+};
+
+// arguments of one worker thread
+struct ipc_poolWorker {
+    struct ipc_threadPool *mptrO_pool;
+    int                    mi_index;
+};
+
+/*
+ * Push at the bottom, by the accepting thread only
+ * Returns -1 if the deque is full
+ */
+static int fi_dequePush(struct ipc_deque *pptrO_deque, int pi_socket_fd) {
+    long ll_bottom = atomic_load_explicit(&pptrO_deque->ml_bottom, memory_order_relaxed);
+    long ll_top = atomic_load_explicit(&pptrO_deque->ml_top, memory_order_acquire);
+    //
+    if (ll_bottom - ll_top >= DEQUE_CAPACITY) {
+        return -1;
+    }
+    atomic_store_explicit(&pptrO_deque->mi_a1_sockets[ll_bottom & (DEQUE_CAPACITY - 1)],
+                          pi_socket_fd,
+                          memory_order_relaxed);
+    // the socket must be visible before the new bottom is
+    atomic_store_explicit(&pptrO_deque->ml_bottom, ll_bottom + 1, memory_order_release);
+    //
+    return 0;
+}
+
+/*
+ * Take from the top, by any worker
+ * Returns the socket, DEQUE_EMPTY, or DEQUE_LOST_RACE if another worker took it first
+ */
+static int fi_dequeTake(struct ipc_deque *pptrO_deque) {
+    long ll_top = atomic_load_explicit(&pptrO_deque->ml_top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long ll_bottom = atomic_load_explicit(&pptrO_deque->ml_bottom, memory_order_acquire);
+    //
+    if (ll_top >= ll_bottom) {
+        return DEQUE_EMPTY;
+    }
+    int li_socket_fd = atomic_load_explicit(&pptrO_deque->mi_a1_sockets[ll_top & (DEQUE_CAPACITY - 1)],
+                                            memory_order_relaxed);
+    //
+    if (!atomic_compare_exchange_strong_explicit(&pptrO_deque->ml_top, &ll_top, ll_top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return DEQUE_LOST_RACE;
+    }
+    //
+    return li_socket_fd;
+}
+
+static void *fptrv_workerRun(void *pptrv_worker) {
+    struct ipc_poolWorker *lptrO_worker = pptrv_worker;
+    struct ipc_threadPool *lptrO_pool = lptrO_worker->mptrO_pool;
+    //
+    // with -C, a spinning worker gets a core to itself, rather than one the scheduler moves around
+    fv_busyPollPin(lptrO_worker->mi_index);
+    //
+    while (1) {
+        // sleep until at least one socket is waiting for this worker to claim it
+        while (sem_wait(&lptrO_pool->mO_pending) < 0 && errno == EINTR)
+            ;
+        //
+        // the semaphore guarantees a socket somewhere: own deque first, then steal
+        int li_socketRW_fd = DEQUE_EMPTY;
+        //
+        while (li_socketRW_fd < 0) {
+            for (int i = 0; i < lptrO_pool->mi_workers && li_socketRW_fd < 0; ++i) {
+                int li_victim = (lptrO_worker->mi_index + i) % lptrO_pool->mi_workers;
+                //
+                li_socketRW_fd = fi_dequeTake(&lptrO_pool->mptrO_deques[li_victim]);
+            }
+        }
+        //
+        lptrO_pool->mpf_serve(li_socketRW_fd);
+        //
+        fv_metricsClose(li_socketRW_fd);
+        close(li_socketRW_fd);
+        fv_admissionLeave();
+        atomic_fetch_sub_explicit(&lptrO_pool->mi_outstanding, 1, memory_order_release);
+    }
+    //
+    return NULL;
+}
+
+int fi_threadPoolServe(int pi_socketConn_fd,
+                       int pi_workers,
+                       void (*pf_serve)(int)) {
+    //
+    if (pi_workers < 1) {
+        errno = EINVAL;
+        return -1;
+    }
+    //
+    // a vanished client must not take the whole pool down with SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+    //
+    struct ipc_threadPool lO_pool;
+    lO_pool.mi_workers = pi_workers;
+    lO_pool.mpf_serve = pf_serve;
+    lO_pool.mptrO_deques = aligned_alloc(CACHE_LINE_SIZE, pi_workers * sizeof(struct ipc_deque));
+    //
+    struct ipc_poolWorker *lptrO_workers = calloc(pi_workers, sizeof(*lptrO_workers));
+    //
+    if (lO_pool.mptrO_deques == NULL || lptrO_workers == NULL ||
+        sem_init(&lO_pool.mO_pending, 0, 0) < 0) {
+        free(lO_pool.mptrO_deques);
+        free(lptrO_workers);
+        errno = ENOMEM;
+        return -1;
+    }
+    atomic_init(&lO_pool.mi_outstanding, 0);
+    //
+    for (int i = 0; i < pi_workers; ++i) {
+        atomic_init(&lO_pool.mptrO_deques[i].ml_top, 0);
+        atomic_init(&lO_pool.mptrO_deques[i].ml_bottom, 0);
+    }
+    //
+    pthread_attr_t lO_attributes;
+    pthread_attr_init(&lO_attributes);
+    pthread_attr_setstacksize(&lO_attributes, WORKER_STACK_SIZE);
+    pthread_attr_setdetachstate(&lO_attributes, PTHREAD_CREATE_DETACHED);
+    //
+    for (int i = 0; i < pi_workers; ++i) {
+        pthread_t lO_thread;
+        //
+        lptrO_workers[i].mptrO_pool = &lO_pool;
+        lptrO_workers[i].mi_index = i;
+        //
+        int li_error = pthread_create(&lO_thread, &lO_attributes, fptrv_workerRun, &lptrO_workers[i]);
+        if (li_error != 0) {
+            // threads already started keep using the pool: it is never freed
+            errno = li_error;
+            return -1;
+        }
+    }
+    pthread_attr_destroy(&lO_attributes);
+    //
+    // accept loop: the calling thread only dispatches, it never serves
+    // every wakeup drains the queue of pending connections, so the listening socket must not block
+    int li_next = 0,
+        li_a1_accepted[IPC_ACCEPT_BATCH];
+    //
+    if (fi_listenerNonBlocking(pi_socketConn_fd) < 0) {
+        return -1;
+    }
+    while (1) {
+        int li_accepted = fi_acceptBatch(pi_socketConn_fd, li_a1_accepted, IPC_ACCEPT_BATCH, SOCK_CLOEXEC);
+        //
+        if (li_accepted < 0 && errno == ESHUTDOWN) {
+            break;
+        }
+        if (li_accepted < 0) {
+            return -1;
+        }
+        for (int i = 0; i < li_accepted; ++i) {
+            int li_socketRW_fd = li_a1_accepted[i];
+            //
+            // at the limit: turned away here, before any worker sees it
+            if (!fi_admissionEnter()) {
+                fv_admissionReject(li_socketRW_fd);
+                continue;
+            }
+            fv_metricsAccept(li_socketRW_fd);
+            atomic_fetch_add_explicit(&lO_pool.mi_outstanding, 1, memory_order_relaxed);
+            //
+            // round-robin; when a deque is full try the next one, and wait if all are
+            while (fi_dequePush(&lO_pool.mptrO_deques[li_next], li_socketRW_fd) < 0) {
+                li_next = (li_next + 1) % pi_workers;
+                if (li_next == 0) {
+                    sched_yield();
+                }
+            }
+            li_next = (li_next + 1) % pi_workers;
+            //
+            sem_post(&lO_pool.mO_pending);
+        }
+    }
+    // hot restart: the successor accepts now, the workers finish what was accepted here
+    while (atomic_load_explicit(&lO_pool.mi_outstanding, memory_order_acquire) > 0) {
+        usleep(POOL_DRAIN_POLL_US);
+    }
+    //
+    return 0;
+}
@@ -0,0 +1,23 @@
+/*
+ * Thread-pool serving mode
+ * Accepted connections are dispatched to a fixed pool of threads
+ * through per-worker lock-free deques, instead of forking a process each
+ */
+#ifndef IPC_THREADPOOL_H
+#define IPC_THREADPOOL_H
+
+/*
+ * Accept connections on the listening socket, pi_socketConn_fd, from the
+ * calling thread and serve them with pf_serve on pi_workers pooled threads
+ * Connections are pushed round-robin onto the workers' deques;
+ * a worker whose own deque is empty steals from the others
+ * pf_serve must return (not exit) on errors; the socket is closed after it returns
+ * Runs until the listening socket is handed to a successor (see ipc_handoff.h), then returns 0
+ * once every connection accepted is served; returns -1 (with errno set) if the pool cannot
+ * be set up, or accepting fails
+ */
+int fi_threadPoolServe(int pi_socketConn_fd,
+                       int pi_workers,
+                       void (*pf_serve)(int));
+
+#endif  // IPC_THREADPOOL_H
@@ -0,0 +1,229 @@
+/*
+ * Connection deadlines, and the timing wheel enforcing them in the event loop
+ * References:
+ *  George Varghese, Tony Lauck: Hashed and Hierarchical Timing Wheels (SOSP 1987)
+ *  man 7 socket (SO_RCVTIMEO, SO_SNDTIMEO)
+ */
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+
+#include "ipc_timer.h"
+
+#define TIMER_TICK_NS   ((uint64_t) IPC_TIMER_TICK_MS * 1000000)
+#define TIMER_SLOT_MASK (IPC_TIMER_SLOTS - 1)
+// farthest a timer can be armed ahead, in ticks: later ones are brought forward to it
+#define TIMER_SPAN      ((uint64_t) 1 << (IPC_TIMER_LEVELS * IPC_TIMER_SLOT_BITS))
+
+// set once, before any connection is served
+static int gi_idleMilliseconds;
+static int gi_writeMilliseconds;
+
+void fv_timeoutSet(int pi_idleMilliseconds, int pi_writeMilliseconds) {
+    gi_idleMilliseconds = pi_idleMilliseconds;
+    gi_writeMilliseconds = pi_writeMilliseconds;
+}
+
+int fi_timeoutIdle(void) {
+    return gi_idleMilliseconds;
+}
+
+int fi_timeoutWrite(void) {
+    return gi_writeMilliseconds;
+}
+
+void fv_timeoutSocket(int pi_socket_fd) {
+    //
+    struct timeval lO_timeout;
+    //
+    if (gi_idleMilliseconds > 0) {
+        lO_timeout.tv_sec = gi_idleMilliseconds / 1000;
+        lO_timeout.tv_usec = (gi_idleMilliseconds % 1000) * 1000;
+        setsockopt(pi_socket_fd, SOL_SOCKET, SO_RCVTIMEO, &lO_timeout, sizeof(lO_timeout));
+    }
+    if (gi_writeMilliseconds > 0) {
+        lO_timeout.tv_sec = gi_writeMilliseconds / 1000;
+        lO_timeout.tv_usec = (gi_writeMilliseconds % 1000) * 1000;
+        setsockopt(pi_socket_fd, SOL_SOCKET, SO_SNDTIMEO, &lO_timeout, sizeof(lO_timeout));
+    }
+}
+
+uint64_t ful_timerNow(void) {
+    struct timespec lO_time;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_time);
+    //
+    return (uint64_t) lO_time.tv_sec * 1000000000ull + lO_time.tv_nsec;
+}
+
+/********************* LISTS *********************/
+
+static void fv_listInit(struct ipc_timer *pptrO_head) {
+    pptrO_head->mptrO_next = pptrO_head->mptrO_prev = pptrO_head;
+}
+
+static void fv_listPush(struct ipc_timer *pptrO_head, struct ipc_timer *pptrO_timer) {
+    pptrO_timer->mptrO_next = pptrO_head;
+    pptrO_timer->mptrO_prev = pptrO_head->mptrO_prev;
+    pptrO_head->mptrO_prev->mptrO_next = pptrO_timer;
+    pptrO_head->mptrO_prev = pptrO_timer;
+}
+
+static void fv_listUnlink(struct ipc_timer *pptrO_timer) {
+    pptrO_timer->mptrO_prev->mptrO_next = pptrO_timer->mptrO_next;
+    pptrO_timer->mptrO_next->mptrO_prev = pptrO_timer->mptrO_prev;
+    pptrO_timer->mptrO_next = pptrO_timer->mptrO_prev = NULL;
+}
+
+// move a whole slot's list to pptrO_to, leaving the slot empty
+static void fv_listTake(struct ipc_timer *pptrO_from, struct ipc_timer *pptrO_to) {
+    //
+    fv_listInit(pptrO_to);
+    //
+    if (pptrO_from->mptrO_next == pptrO_from) {
+        return;
+    }
+    pptrO_to->mptrO_next = pptrO_from->mptrO_next;
+    pptrO_to->mptrO_prev = pptrO_from->mptrO_prev;
+    pptrO_to->mptrO_next->mptrO_prev = pptrO_to;
+    pptrO_to->mptrO_prev->mptrO_next = pptrO_to;
+    fv_listInit(pptrO_from);
+}
+
+/********************* WHEEL *********************/
+
+// the slot for the timer's tick, seen from pul_tick: the closer, the finer the level
+static void fv_timerPlace(struct ipc_timerWheel *pptrO_wheel, struct ipc_timer *pptrO_timer, uint64_t pul_tick) {
+    //
+    uint64_t lul_delta = pptrO_timer->mul_expires > pul_tick ? pptrO_timer->mul_expires - pul_tick : 0;
+    int      li_level = 0;
+    //
+    if (lul_delta >= TIMER_SPAN) {
+        pptrO_timer->mul_expires = pul_tick + TIMER_SPAN - 1;
+        lul_delta = TIMER_SPAN - 1;
+    }
+    // overdue: in the slot being processed
+    uint64_t lul_expires = lul_delta == 0 ? pul_tick : pptrO_timer->mul_expires;
+    //
+    while (lul_delta >= ((uint64_t) 1 << ((li_level + 1) * IPC_TIMER_SLOT_BITS))) {
+        ++li_level;
+    }
+    fv_listPush(&pptrO_wheel->mO_a2_slots[li_level][(lul_expires >> (li_level * IPC_TIMER_SLOT_BITS)) & TIMER_SLOT_MASK],
+                pptrO_timer);
+}
+
+void fv_timerWheelInit(struct ipc_timerWheel *pptrO_wheel, uint64_t pul_now) {
+    //
+    pptrO_wheel->mul_tick = 0;
+    pptrO_wheel->mul_start = pul_now;
+    pptrO_wheel->mul_armed = 0;
+    //
+    for (int i = 0; i < IPC_TIMER_LEVELS; ++i) {
+        for (int j = 0; j < IPC_TIMER_SLOTS; ++j) {
+            fv_listInit(&pptrO_wheel->mO_a2_slots[i][j]);
+        }
+    }
+}
+
+void fv_timerArm(struct ipc_timerWheel *pptrO_wheel, struct ipc_timer *pptrO_timer, int pi_milliseconds) {
+    //
+    fv_timerCancel(pptrO_wheel, pptrO_timer);
+    //
+    // an empty wheel is not stepped through: catch up with the clock first
+    if (pptrO_wheel->mul_armed == 0) {
+        pptrO_wheel->mul_tick = (ful_timerNow() - pptrO_wheel->mul_start) / TIMER_TICK_NS + 1;
+    }
+    // counted from the next tick to process, which the clock may already be into: never early
+    pptrO_timer->mul_expires = pptrO_wheel->mul_tick + (pi_milliseconds + IPC_TIMER_TICK_MS - 1) / IPC_TIMER_TICK_MS;
+    fv_timerPlace(pptrO_wheel, pptrO_timer, pptrO_wheel->mul_tick);
+    ++pptrO_wheel->mul_armed;
+}
+
+void fv_timerCancel(struct ipc_timerWheel *pptrO_wheel, struct ipc_timer *pptrO_timer) {
+    //
+    if (pptrO_timer->mptrO_next != NULL) {
+        fv_listUnlink(pptrO_timer);
+        --pptrO_wheel->mul_armed;
+    }
+}
+
+unsigned long ful_timerWheelAdvance(struct ipc_timerWheel *pptrO_wheel,
+                                    uint64_t               pul_now,
+                                    void                 (*pf_expire)(struct ipc_timer *, void *),
+                                    void                  *pptrv_context) {
+    //
+    uint64_t      lul_target = (pul_now - pptrO_wheel->mul_start) / TIMER_TICK_NS;
+    unsigned long lul_expired = 0;
+    //
+    for (; pptrO_wheel->mul_tick <= lul_target; ++pptrO_wheel->mul_tick) {
+        uint64_t         lul_tick = pptrO_wheel->mul_tick;
+        struct ipc_timer lO_due;
+        //
+        // nothing armed: nothing to step through either
+        if (pptrO_wheel->mul_armed == 0) {
+            pptrO_wheel->mul_tick = lul_target + 1;
+            break;
+        }
+        // a new lap of a level: spread the next slot of the level above over it
+        for (int li_level = 1;
+             li_level < IPC_TIMER_LEVELS && ((lul_tick >> ((li_level - 1) * IPC_TIMER_SLOT_BITS)) & TIMER_SLOT_MASK) == 0;
+             ++li_level) {
+            struct ipc_timer lO_cascade;
+            //
+            fv_listTake(&pptrO_wheel->mO_a2_slots[li_level][(lul_tick >> (li_level * IPC_TIMER_SLOT_BITS)) & TIMER_SLOT_MASK],
+                        &lO_cascade);
+            //
+            while (lO_cascade.mptrO_next != &lO_cascade) {
+                struct ipc_timer *lptrO_timer = lO_cascade.mptrO_next;
+                //
+                fv_listUnlink(lptrO_timer);
+                fv_timerPlace(pptrO_wheel, lptrO_timer, lul_tick);
+            }
+        }
+        // taken off the slot first: a callback may cancel or arm any timer, this one included
+        fv_listTake(&pptrO_wheel->mO_a2_slots[0][lul_tick & TIMER_SLOT_MASK], &lO_due);
+        //
+        while (lO_due.mptrO_next != &lO_due) {
+            struct ipc_timer *lptrO_timer = lO_due.mptrO_next;
+            //
+            fv_listUnlink(lptrO_timer);
+            //
+            // a full lap ahead (placed from a level above, early): back on the wheel
+            if (lptrO_timer->mul_expires > lul_tick) {
+                fv_timerPlace(pptrO_wheel, lptrO_timer, lul_tick);
+                continue;
+            }
+            --pptrO_wheel->mul_armed;
+            ++lul_expired;
+            pf_expire(lptrO_timer, pptrv_context);
+        }
+    }
+    //
+    return lul_expired;
+}
+
+int fi_timerWheelTimeout(const struct ipc_timerWheel *pptrO_wheel, uint64_t pul_now) {
+    //
+    if (pptrO_wheel->mul_armed == 0) {
+        return -1;
+    }
+    // the first tick with a timer on the first level, or else the end of its lap: a cascade is due
+    uint64_t lul_tick = pptrO_wheel->mul_tick;
+    //
+    do {
+        const struct ipc_timer *lptrO_slot = &pptrO_wheel->mO_a2_slots[0][lul_tick & TIMER_SLOT_MASK];
+        //
+        if (lptrO_slot->mptrO_next != lptrO_slot) {
+            break;
+        }
+        ++lul_tick;
+    } while ((lul_tick & TIMER_SLOT_MASK) != 0);
+    //
+    uint64_t lul_due = pptrO_wheel->mul_start + lul_tick * TIMER_TICK_NS;
+    //
+    if (lul_due <= pul_now) {
+        return 0;
+    }
+    // rounded up: waking before the tick would find nothing to do
+    return (int) ((lul_due - pul_now + 999999) / 1000000);
+}
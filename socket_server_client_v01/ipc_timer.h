@@ -0,0 +1,83 @@
+/*
+ * Connection deadlines, and the timing wheel enforcing them in the event loop
+ * A connection may wait so long for a message (idle deadline) and for the client to take
+ * its reply (write deadline); past either, it is closed and its resources reclaimed
+ * Blocking modes leave the waiting to the kernel (SO_RCVTIMEO, SO_SNDTIMEO): a read or
+ * write past its deadline fails, and the process or thread serving it moves on
+ * The event loop keeps its timers on a hierarchical timing wheel instead: 4 levels of
+ * 64 slots, a tick per slot of the first level, 64 ticks per slot of the next, and so on
+ * (10 ms ticks: 640 ms, 41 s, 44 min, 47 h). Arming and cancelling a timer link or unlink it
+ * from one slot's list, whatever the number of timers; a slot of a higher level is spread
+ * over the level below once the time it covers comes up, and everything in the first level's
+ * slot of a tick expires together, at the first look at the clock after that tick
+ */
+#ifndef IPC_TIMER_H
+#define IPC_TIMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define IPC_TIMER_LEVELS    4
+#define IPC_TIMER_SLOT_BITS 6
+#define IPC_TIMER_SLOTS     (1 << IPC_TIMER_SLOT_BITS)
+// resolution of the event loop's deadlines
+#define IPC_TIMER_TICK_MS   10
+
+// embedded in whatever it times; IPC_TIMER_OWNER() leads back from it
+struct ipc_timer {
+    // neighbours in a slot's circular list; NULL while not armed
+    struct ipc_timer *mptrO_next;
+    struct ipc_timer *mptrO_prev;
+    // tick at which it expires
+    uint64_t          mul_expires;
+};
+
+#define IPC_TIMER_OWNER(pptrO_timer, type, member) \
+    ((type *) ((char *) (pptrO_timer) - offsetof(type, member)))
+
+struct ipc_timerWheel {
+    // next tick to process, and the clock reading of tick 0
+    uint64_t         mul_tick;
+    uint64_t         mul_start;
+    unsigned long    mul_armed;
+    // list heads: a slot is empty while its head points at itself
+    struct ipc_timer mO_a2_slots[IPC_TIMER_LEVELS][IPC_TIMER_SLOTS];
+};
+
+/*
+ * Deadlines of every connection, in milliseconds (0: none): for its (next) message to arrive,
+ * and for the client to take a reply; call once, before serving
+ */
+void fv_timeoutSet(int pi_idleMilliseconds, int pi_writeMilliseconds);
+
+int fi_timeoutIdle(void);
+int fi_timeoutWrite(void);
+
+// give a blocking socket the deadlines: a read or write waiting longer fails with EAGAIN
+void fv_timeoutSocket(int pi_socket_fd);
+
+// monotonic clock, in nanoseconds
+uint64_t ful_timerNow(void);
+
+void fv_timerWheelInit(struct ipc_timerWheel *pptrO_wheel, uint64_t pul_now);
+
+// (re)arm the timer to expire pi_milliseconds from now, rounded up to whole ticks
+void fv_timerArm(struct ipc_timerWheel *pptrO_wheel, struct ipc_timer *pptrO_timer, int pi_milliseconds);
+
+// disarm the timer; harmless if it is not armed (a timer that expired is not)
+void fv_timerCancel(struct ipc_timerWheel *pptrO_wheel, struct ipc_timer *pptrO_timer);
+
+/*
+ * Expire every timer due by pul_now, calling pf_expire on each (disarmed already:
+ * it may be armed again, or its owner freed)
+ * Returns the number of timers expired
+ */
+unsigned long ful_timerWheelAdvance(struct ipc_timerWheel *pptrO_wheel,
+                                    uint64_t               pul_now,
+                                    void                 (*pf_expire)(struct ipc_timer *, void *),
+                                    void                  *pptrv_context);
+
+// milliseconds until the wheel next needs advancing, for epoll_wait(); -1 with no timer armed
+int fi_timerWheelTimeout(const struct ipc_timerWheel *pptrO_wheel, uint64_t pul_now);
+
+#endif  // IPC_TIMER_H
@@ -0,0 +1,214 @@
+/*
+ * Datagram (UDP) serving mode
+ * Each loop iteration is one recvmmsg(), which blocks for the first datagram
+ * and then takes whatever else is queued (MSG_WAITFORONE), and one sendmmsg()
+ * carrying all the acknowledgements due
+ * References:
+ *  man 2 recvmmsg, sendmmsg
+ *  man 7 udp (UDP_SEGMENT, UDP_GRO)
+ */
+#define _GNU_SOURCE  // recvmmsg(), sendmmsg()
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <netinet/in.h>
+#include <netinet/udp.h>  // UDP_SEGMENT, UDP_GRO
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include "ipc_common.h"
+#include "ipc_udp.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+
+// a GRO buffer holds up to one maximum-sized UDP payload
+#define UDP_GRO_BUFFER_SIZE (64 * 1024)
+// the kernel may drop datagrams that arrive while a batch is being answered: give them room
+#define UDP_RECEIVE_BUFFER  (4 * 1024 * 1024)
+
+// acknowledgements waiting for the next sendmmsg()
+struct ipc_udpReplies {
+    struct mmsghdr mO_a1_messages[IPC_UDP_BATCH];
+    struct iovec   mO_a1_parts[IPC_UDP_BATCH];
+    char           mc_a2_control[IPC_UDP_BATCH][IPC_UDP_CONTROL_SIZE];
+    unsigned       mui_count;
+};
+
+int fi_udpEnableGRO(int pi_socket_fd) {
+    int li_enable = 1;
+    //
+    return setsockopt(pi_socket_fd, SOL_UDP, UDP_GRO, &li_enable, sizeof(li_enable));
+}
+
+unsigned fui_udpSegments(struct msghdr *pptrO_message, size_t psz_length) {
+    //
+    for (struct cmsghdr *lptrO_header = CMSG_FIRSTHDR(pptrO_message);
+         lptrO_header != NULL;
+         lptrO_header = CMSG_NXTHDR(pptrO_message, lptrO_header)) {
+        if (lptrO_header->cmsg_level == SOL_UDP && lptrO_header->cmsg_type == UDP_GRO) {
+            int li_size;
+            memcpy(&li_size, CMSG_DATA(lptrO_header), sizeof(li_size));
+            //
+            // all datagrams are li_size bytes, but the last one may be shorter
+            if (li_size > 0) {
+                return (unsigned) ((psz_length + li_size - 1) / li_size);
+            }
+        }
+    }
+    //
+    return 1;
+}
+
+void fv_udpSetSegment(struct msghdr *pptrO_message, void *pptrv_control, uint16_t pus_size) {
+    //
+    memset(pptrv_control, 0, IPC_UDP_CONTROL_SIZE);
+    pptrO_message->msg_control = pptrv_control;
+    pptrO_message->msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+    //
+    struct cmsghdr *lptrO_header = CMSG_FIRSTHDR(pptrO_message);
+    lptrO_header->cmsg_level = SOL_UDP;
+    lptrO_header->cmsg_type = UDP_SEGMENT;
+    lptrO_header->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(lptrO_header), &pus_size, sizeof(pus_size));
+}
+
+static void fv_udpFlush(int pi_socket_fd, struct ipc_udpReplies *pptrO_replies) {
+    //
+    unsigned lui_done = 0;
+    //
+    while (lui_done < pptrO_replies->mui_count) {
+        int li_n = sendmmsg(pi_socket_fd,
+                            pptrO_replies->mO_a1_messages + lui_done,
+                            pptrO_replies->mui_count - lui_done,
+                            0);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // acknowledgements are fire-and-forget too: drop the one that failed, send the rest
+            IPC_LOGE("ERROR writing to socket: %m");
+            li_n = 1;
+        }
+        lui_done += li_n;
+    }
+    pptrO_replies->mui_count = 0;
+}
+
+int fi_udpServe(int pi_socket_fd, int pi_segmentation) {
+    //
+    size_t lsz_buffer = pi_segmentation ? UDP_GRO_BUFFER_SIZE : BUFFER_SIZE;
+    int    li_receiveBuffer = UDP_RECEIVE_BUFFER;
+    //
+    if (pi_segmentation && fi_udpEnableGRO(pi_socket_fd) < 0) {
+        return -1;
+    }
+    // best effort: the limit is net.core.rmem_max
+    setsockopt(pi_socket_fd, SOL_SOCKET, SO_RCVBUF, &li_receiveBuffer, sizeof(li_receiveBuffer));
+    //
+    char                  *lptrc_buffers = malloc(IPC_UDP_BATCH * lsz_buffer);
+    struct ipc_udpReplies *lptrO_replies = malloc(sizeof(struct ipc_udpReplies));
+    //
+    if (lptrc_buffers == NULL || lptrO_replies == NULL) {
+        free(lptrc_buffers);
+        free(lptrO_replies);
+        return -1;
+    }
+    lptrO_replies->mui_count = 0;
+    //
+    // the acknowledgement, back to back, as many times as one GSO send may carry it
+    size_t lsz_acknowledge = strlen(IPC_ACKNOWLEDGE);
+    char   lc_a1_acknowledge[IPC_UDP_SEGMENTS_MAX * (sizeof(IPC_ACKNOWLEDGE) - 1)];
+    //
+    for (int i = 0; i < IPC_UDP_SEGMENTS_MAX; ++i) {
+        memcpy(lc_a1_acknowledge + i * lsz_acknowledge, IPC_ACKNOWLEDGE, lsz_acknowledge);
+    }
+    //
+    struct mmsghdr          lO_a1_messages[IPC_UDP_BATCH];
+    struct iovec            lO_a1_parts[IPC_UDP_BATCH];
+    struct sockaddr_storage lO_a1_senders[IPC_UDP_BATCH];
+    char                    lc_a2_control[IPC_UDP_BATCH][IPC_UDP_CONTROL_SIZE];
+    //
+    memset(lO_a1_messages, 0, sizeof(lO_a1_messages));
+    //
+    for (int i = 0; i < IPC_UDP_BATCH; ++i) {
+        lO_a1_parts[i].iov_base = lptrc_buffers + i * lsz_buffer;
+        lO_a1_parts[i].iov_len = lsz_buffer;
+        lO_a1_messages[i].msg_hdr.msg_iov = &lO_a1_parts[i];
+        lO_a1_messages[i].msg_hdr.msg_iovlen = 1;
+        lO_a1_messages[i].msg_hdr.msg_name = &lO_a1_senders[i];
+        lO_a1_messages[i].msg_hdr.msg_control = lc_a2_control[i];
+    }
+    //
+    while (1) {
+        // recvmmsg() overwrites the sizes with what it filled in
+        for (int i = 0; i < IPC_UDP_BATCH; ++i) {
+            lO_a1_messages[i].msg_hdr.msg_namelen = sizeof(lO_a1_senders[i]);
+            lO_a1_messages[i].msg_hdr.msg_controllen = IPC_UDP_CONTROL_SIZE;
+        }
+        //
+        int li_received = recvmmsg(pi_socket_fd, lO_a1_messages, IPC_UDP_BATCH, MSG_WAITFORONE, NULL);
+        //
+        if (li_received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            free(lptrc_buffers);
+            free(lptrO_replies);
+            return -1;
+        }
+        //
+        unsigned lui_datagrams = 0;
+        size_t   lsz_received = 0;
+        //
+        for (int i = 0; i < li_received; ++i) {
+            unsigned lui_segments = fui_udpSegments(&lO_a1_messages[i].msg_hdr, lO_a1_messages[i].msg_len);
+            //
+            lui_datagrams += lui_segments;
+            lsz_received += lO_a1_messages[i].msg_len;
+            //
+            // one acknowledgement per datagram: with GSO, up to IPC_UDP_SEGMENTS_MAX of them per send
+            while (lui_segments > 0) {
+                unsigned lui_take = (pi_segmentation && lui_segments > IPC_UDP_SEGMENTS_MAX) ? IPC_UDP_SEGMENTS_MAX
+                                  : pi_segmentation ? lui_segments : 1;
+                //
+                if (lptrO_replies->mui_count == IPC_UDP_BATCH) {
+                    fv_udpFlush(pi_socket_fd, lptrO_replies);
+                }
+                //
+                struct msghdr *lptrO_reply = &lptrO_replies->mO_a1_messages[lptrO_replies->mui_count].msg_hdr;
+                struct iovec  *lptrO_part = &lptrO_replies->mO_a1_parts[lptrO_replies->mui_count];
+                //
+                memset(lptrO_reply, 0, sizeof(*lptrO_reply));
+                lptrO_part->iov_base = lc_a1_acknowledge;
+                lptrO_part->iov_len = lui_take * lsz_acknowledge;
+                lptrO_reply->msg_iov = lptrO_part;
+                lptrO_reply->msg_iovlen = 1;
+                lptrO_reply->msg_name = &lO_a1_senders[i];
+                lptrO_reply->msg_namelen = lO_a1_messages[i].msg_hdr.msg_namelen;
+                //
+                if (lui_take > 1) {
+                    fv_udpSetSegment(lptrO_reply, lptrO_replies->mc_a2_control[lptrO_replies->mui_count],
+                                     (uint16_t) lsz_acknowledge);
+                }
+                ++lptrO_replies->mui_count;
+                lui_segments -= lui_take;
+            }
+        }
+        // the replies point at this batch's sender addresses: they leave before the next receive
+        fv_udpFlush(pi_socket_fd, lptrO_replies);
+        // no connections: only the counters, no phases
+        fv_metricsRead(-1, lsz_received);
+        fv_metricsSend(-1, lui_datagrams * lsz_acknowledge, lui_datagrams);
+        //
+        // one line per batch: per datagram, printing would cost more than serving
+        size_t      lsz_first = lO_a1_messages[0].msg_len < 64 ? lO_a1_messages[0].msg_len : 64;
+        const char *lptrc_end = memchr(lptrc_buffers, '\n', lsz_first);
+        //
+        if (lptrc_end != NULL) {
+            lsz_first = lptrc_end - lptrc_buffers;
+        }
+        IPC_LOGI("[Client]: %.*s (%u datagram(s), acknowledged)", (int) lsz_first, lptrc_buffers, lui_datagrams);
+    }
+}
@@ -0,0 +1,46 @@
+/*
+ * Datagram (UDP) serving mode
+ * No connections: every datagram is a message of its own, acknowledged
+ * to its sender like fv_serve() does, with dozens of datagrams moved
+ * per system call by recvmmsg() and sendmmsg()
+ * Optionally, UDP GRO hands the server runs of same-sized datagrams from one
+ * sender as one large buffer, and UDP GSO sends their acknowledgements back
+ * as one buffer too, cut into datagrams by the kernel (or the NIC)
+ */
+#ifndef IPC_UDP_H
+#define IPC_UDP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+// datagrams (or GRO buffers) per recvmmsg()/sendmmsg()
+#define IPC_UDP_BATCH         64
+// most datagrams one GSO send may be cut into
+#define IPC_UDP_SEGMENTS_MAX  64
+// room for the UDP_GRO / UDP_SEGMENT control message
+#define IPC_UDP_CONTROL_SIZE  CMSG_SPACE(sizeof(int))
+
+/*
+ * Serve the datagrams arriving on the bound socket forever;
+ * with pi_segmentation, receive with GRO and acknowledge with GSO
+ * Returns -1 (with errno set) only if receiving fails
+ */
+int fi_udpServe(int pi_socket_fd, int pi_segmentation);
+
+/*
+ * Let the socket receive coalesced (GRO) buffers
+ * Returns 0, or -1 (with errno set) if the kernel cannot do it
+ */
+int fi_udpEnableGRO(int pi_socket_fd);
+
+// number of datagrams in a received buffer of psz_length bytes: more than 1 only for GRO buffers
+unsigned fui_udpSegments(struct msghdr *pptrO_message, size_t psz_length);
+
+/*
+ * Ask the kernel to cut the buffer sent with pptrO_message into datagrams of pus_size bytes (GSO)
+ * pptrv_control needs IPC_UDP_CONTROL_SIZE bytes
+ */
+void fv_udpSetSegment(struct msghdr *pptrO_message, void *pptrv_control, uint16_t pus_size);
+
+#endif  // IPC_UDP_H
@@ -0,0 +1,406 @@
+/*
+ * io_uring serving mode
+ * The submission queue (SQ) and completion queue (CQ) are rings shared with
+ * the kernel; this process only ever writes the SQ tail and the CQ head
+ * Every request carries its connection and its kind in user_data:
+ *  ACCEPT (multishot) -> RECV (provided buffer) -> SEND ==link==> CLOSE
+ * References:
+ *  man 7 io_uring
+ *  man 2 io_uring_setup, io_uring_enter, io_uring_register
+ */
+#include <errno.h>
+#include <stdio.h>
+
+#include "ipc_uring.h"
+
+#ifndef IPC_WITH_URING
+
+int fi_uringServe(int pi_socketConn_fd) {
+    (void) pi_socketConn_fd;
+    //
+    errno = ENOSYS;
+    return -1;
+}
+
+#else
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "ipc_common.h"
+#include "ipc_log.h"
+#include "ipc_metrics.h"
+#include "ipc_accept.h"
+#include "ipc_service.h"
+
+// number of submission queue entries (the completion queue gets twice as many)
+#define URING_ENTRIES 4096
+// number of receive buffers provided to the kernel, a power of 2
+#define URING_BUFFERS 1024
+// provided buffer group used by every receive
+#define URING_BUFFER_GROUP 0
+
+// kind of request, stored in the low byte of user_data
+enum ipc_uringRequest {
+    IPC_URING_ACCEPT,
+    IPC_URING_RECV,
+    IPC_URING_SEND,
+    IPC_URING_CLOSE
+};
+
+// both queues and the provided buffers, as mapped into this process
+struct ipc_uring {
+    int                       mi_ring_fd;
+    // submission queue
+    unsigned                 *mptrui_sqHead;
+    unsigned                 *mptrui_sqTail;
+    unsigned                  mui_sqMask;
+    unsigned                  mui_sqEntries;
+    struct io_uring_sqe      *mptrO_sqes;
+    // SQ entries filled in, but not yet visible to the kernel
+    unsigned                  mui_sqLocalTail;
+    // completion queue
+    unsigned                 *mptrui_cqHead;
+    unsigned                 *mptrui_cqTail;
+    unsigned                  mui_cqMask;
+    struct io_uring_cqe      *mptrO_cqes;
+    // provided buffers: descriptors shared with the kernel, and their memory
+    struct io_uring_buf_ring *mptrO_bufferRing;
+    char                     *mptrc_buffers;
+    unsigned short            mus_bufferTail;
+};
+
+static int fi_uringSetup(unsigned pui_entries, struct io_uring_params *pptrO_params) {
+    return (int) syscall(__NR_io_uring_setup, pui_entries, pptrO_params);
+}
+
+static int fi_uringEnter(int      pi_ring_fd,
+                         unsigned pui_toSubmit,
+                         unsigned pui_minComplete,
+                         unsigned pui_flags) {
+    return (int) syscall(__NR_io_uring_enter, pi_ring_fd, pui_toSubmit,
+                         pui_minComplete, pui_flags, NULL, 0);
+}
+
+static int fi_uringRegister(int pi_ring_fd, unsigned pui_opcode, void *pptrv_arg, unsigned pui_count) {
+    return (int) syscall(__NR_io_uring_register, pi_ring_fd, pui_opcode, pptrv_arg, pui_count);
+}
+
+static uint64_t fui_userData(int pi_socket_fd, enum ipc_uringRequest pe_request) {
+    return ((uint64_t) (uint32_t) pi_socket_fd << 8) | pe_request;
+}
+
+/*
+ * Hand the queued submissions to the kernel and, if pui_wait,
+ * sleep until at least one completion is available
+ */
+static int fi_uringSubmit(struct ipc_uring *pptrO_ring, unsigned pui_wait) {
+    // publish the new entries before telling the kernel about them
+    unsigned lui_toSubmit = pptrO_ring->mui_sqLocalTail - *pptrO_ring->mptrui_sqTail;
+    __atomic_store_n(pptrO_ring->mptrui_sqTail, pptrO_ring->mui_sqLocalTail, __ATOMIC_RELEASE);
+    //
+    while (1) {
+        int li_n = fi_uringEnter(pptrO_ring->mi_ring_fd,
+                                 lui_toSubmit,
+                                 pui_wait,
+                                 pui_wait ? IORING_ENTER_GETEVENTS : 0);
+        if (li_n >= 0 || errno != EINTR) {
+            return li_n;
+        }
+        // submitted entries are consumed even if the wait was interrupted
+        lui_toSubmit = 0;
+    }
+}
+
+/*
+ * Next free submission queue entry, cleared
+ * A full queue is flushed to the kernel first
+ */
+static struct io_uring_sqe *fptrO_sqeGet(struct ipc_uring *pptrO_ring) {
+    unsigned lui_head = __atomic_load_n(pptrO_ring->mptrui_sqHead, __ATOMIC_ACQUIRE);
+    //
+    if (pptrO_ring->mui_sqLocalTail - lui_head >= pptrO_ring->mui_sqEntries) {
+        if (fi_uringSubmit(pptrO_ring, 0) < 0) {
+            return NULL;
+        }
+        lui_head = __atomic_load_n(pptrO_ring->mptrui_sqHead, __ATOMIC_ACQUIRE);
+        if (pptrO_ring->mui_sqLocalTail - lui_head >= pptrO_ring->mui_sqEntries) {
+            return NULL;
+        }
+    }
+    //
+    struct io_uring_sqe *lptrO_sqe =
+        &pptrO_ring->mptrO_sqes[pptrO_ring->mui_sqLocalTail & pptrO_ring->mui_sqMask];
+    ++pptrO_ring->mui_sqLocalTail;
+    //
+    memset(lptrO_sqe, 0, sizeof(*lptrO_sqe));
+    //
+    return lptrO_sqe;
+}
+
+// give a receive buffer back to the kernel
+static void fv_bufferRecycle(struct ipc_uring *pptrO_ring, unsigned short pus_bufferID) {
+    struct io_uring_buf *lptrO_buffer =
+        &pptrO_ring->mptrO_bufferRing->bufs[pptrO_ring->mus_bufferTail & (URING_BUFFERS - 1)];
+    //
+    lptrO_buffer->addr = (uint64_t) (uintptr_t) (pptrO_ring->mptrc_buffers +
+                                                 (size_t) pus_bufferID * BUFFER_SIZE);
+    // one byte less than the buffer, to leave room for the string terminator
+    lptrO_buffer->len = BUFFER_SIZE - 1;
+    lptrO_buffer->bid = pus_bufferID;
+    //
+    ++pptrO_ring->mus_bufferTail;
+    __atomic_store_n(&pptrO_ring->mptrO_bufferRing->tail,
+                     pptrO_ring->mus_bufferTail,
+                     __ATOMIC_RELEASE);
+}
+
+static void fv_queueAccept(struct ipc_uring *pptrO_ring, int pi_socketConn_fd) {
+    struct io_uring_sqe *lptrO_sqe = fptrO_sqeGet(pptrO_ring);
+    //
+    if (lptrO_sqe == NULL) {
+        IPC_LOGE("io_uring accept: %m");
+        return;
+    }
+    lptrO_sqe->opcode = IORING_OP_ACCEPT;
+    lptrO_sqe->fd = pi_socketConn_fd;
+    // one request keeps producing a completion per accepted connection
+    lptrO_sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    lptrO_sqe->accept_flags = SOCK_CLOEXEC;
+    lptrO_sqe->user_data = fui_userData(pi_socketConn_fd, IPC_URING_ACCEPT);
+}
+
+static void fv_queueRecv(struct ipc_uring *pptrO_ring, int pi_socketRW_fd) {
+    struct io_uring_sqe *lptrO_sqe = fptrO_sqeGet(pptrO_ring);
+    //
+    if (lptrO_sqe == NULL) {
+        IPC_LOGE("io_uring recv: %m");
+        fv_metricsClose(pi_socketRW_fd);
+        fv_admissionLeave();
+        close(pi_socketRW_fd);
+        return;
+    }
+    lptrO_sqe->opcode = IORING_OP_RECV;
+    lptrO_sqe->fd = pi_socketRW_fd;
+    // no buffer is tied up while the connection is idle:
+    // the kernel picks one from the group only once data arrives
+    lptrO_sqe->flags = IOSQE_BUFFER_SELECT;
+    lptrO_sqe->buf_group = URING_BUFFER_GROUP;
+    lptrO_sqe->user_data = fui_userData(pi_socketRW_fd, IPC_URING_RECV);
+}
+
+// acknowledge, then close: the close runs only once the send has completed in full
+static void fv_queueAcknowledge(struct ipc_uring *pptrO_ring, int pi_socketRW_fd) {
+    static const char cc_a1_acknowledge[] = IPC_ACKNOWLEDGE;
+    //
+    struct io_uring_sqe *lptrO_send = fptrO_sqeGet(pptrO_ring);
+    struct io_uring_sqe *lptrO_close = lptrO_send ? fptrO_sqeGet(pptrO_ring) : NULL;
+    //
+    if (lptrO_close == NULL) {
+        // a half-built link must not reach the kernel: turn the send into a no-op
+        if (lptrO_send != NULL) {
+            lptrO_send->opcode = IORING_OP_NOP;
+        }
+        IPC_LOGE("io_uring send: %m");
+        fv_metricsClose(pi_socketRW_fd);
+        fv_admissionLeave();
+        close(pi_socketRW_fd);
+        return;
+    }
+    lptrO_send->opcode = IORING_OP_SEND;
+    lptrO_send->fd = pi_socketRW_fd;
+    lptrO_send->addr = (uint64_t) (uintptr_t) cc_a1_acknowledge;
+    lptrO_send->len = sizeof(cc_a1_acknowledge) - 1;
+    lptrO_send->msg_flags = MSG_NOSIGNAL;
+    lptrO_send->flags = IOSQE_IO_LINK;
+    lptrO_send->user_data = fui_userData(pi_socketRW_fd, IPC_URING_SEND);
+    //
+    lptrO_close->opcode = IORING_OP_CLOSE;
+    lptrO_close->fd = pi_socketRW_fd;
+    lptrO_close->user_data = fui_userData(pi_socketRW_fd, IPC_URING_CLOSE);
+}
+
+static void fv_complete(struct ipc_uring *pptrO_ring,
+                        int               pi_socketConn_fd,
+                        struct io_uring_cqe *pptrO_cqe) {
+    int                   li_socket_fd = (int) (pptrO_cqe->user_data >> 8);
+    enum ipc_uringRequest le_request = (enum ipc_uringRequest) (pptrO_cqe->user_data & 0xFF);
+    int                   li_result = pptrO_cqe->res;
+    //
+    switch (le_request) {
+        case IPC_URING_ACCEPT:
+            if (li_result >= 0 && !fi_admissionEnter()) {
+                // at the limit: the reject reply is a single non-blocking send, no round trip through the ring
+                fv_admissionReject(li_result);
+            } else if (li_result >= 0) {
+                fv_metricsAccept(li_result);
+                fv_queueRecv(pptrO_ring, li_result);
+            } else {
+                // e.g., EMFILE: keep serving the connections already open
+                IPC_LOGE("accept: %s", strerror(-li_result));
+                fv_metricsError(-li_result);
+            }
+            // the multishot request ended, re-arm it
+            if (!(pptrO_cqe->flags & IORING_CQE_F_MORE)) {
+                fv_queueAccept(pptrO_ring, pi_socketConn_fd);
+            }
+            break;
+        //
+        case IPC_URING_RECV:
+            if (li_result > 0) {
+                unsigned short lus_bufferID = pptrO_cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                char *lptrc_message = pptrO_ring->mptrc_buffers + (size_t) lus_bufferID * BUFFER_SIZE;
+                //
+                lptrc_message[li_result] = '\0';
+                fv_metricsRead(li_socket_fd, li_result);
+                IPC_LOGI("[Client]: %s", lptrc_message);
+                fv_serviceSimulate();
+                //
+                fv_bufferRecycle(pptrO_ring, lus_bufferID);
+                fv_queueAcknowledge(pptrO_ring, li_socket_fd);
+            } else if (li_result == -ENOBUFS) {
+                // every buffer is in use, try again once some are recycled
+                fv_queueRecv(pptrO_ring, li_socket_fd);
+            } else {
+                if (li_result < 0) {
+                    IPC_LOGE("ERROR reading from socket: %s", strerror(-li_result));
+                    fv_metricsError(-li_result);
+                }
+                fv_metricsClose(li_socket_fd);
+                fv_admissionLeave();
+                close(li_socket_fd);
+            }
+            break;
+        //
+        case IPC_URING_SEND:
+            if (li_result < 0) {
+                IPC_LOGE("ERROR writing to socket: %s", strerror(-li_result));
+                fv_metricsError(-li_result);
+            } else if (li_result < (int) sizeof(IPC_ACKNOWLEDGE) - 1) {
+                IPC_LOGE("ERROR writing to socket: short send");
+            } else {
+                fv_metricsSend(li_socket_fd, li_result, 1);
+                IPC_LOGI("Acknowledgement message sent");
+            }
+            break;
+        //
+        case IPC_URING_CLOSE:
+            fv_metricsClose(li_socket_fd);
+            fv_admissionLeave();
+            // a failed send breaks the link and cancels the close
+            if (li_result == -ECANCELED) {
+                close(li_socket_fd);
+            }
+            break;
+    }
+}
+
+int fi_uringServe(int pi_socketConn_fd) {
+    //
+    struct ipc_uring       lO_ring;
+    struct io_uring_params lO_params;
+    //
+    memset(&lO_ring, 0, sizeof(lO_ring));
+    memset(&lO_params, 0, sizeof(lO_params));
+    //
+    // completions may burst beyond the submissions (one accept, many connections)
+    lO_params.flags = IORING_SETUP_CQSIZE;
+    lO_params.cq_entries = 2 * URING_ENTRIES;
+    //
+    lO_ring.mi_ring_fd = fi_uringSetup(URING_ENTRIES, &lO_params);
+    //
+    if (lO_ring.mi_ring_fd < 0) {
+        return -1;
+    }
+    if (!(lO_params.features & IORING_FEAT_SINGLE_MMAP) ||
+        !(lO_params.features & IORING_FEAT_NODROP)) {
+        close(lO_ring.mi_ring_fd);
+        errno = ENOSYS;
+        return -1;
+    }
+    //
+    // both rings share one mapping, the SQ entries live in another
+    size_t lsz_sqRing = lO_params.sq_off.array + lO_params.sq_entries * sizeof(unsigned);
+    size_t lsz_cqRing = lO_params.cq_off.cqes + lO_params.cq_entries * sizeof(struct io_uring_cqe);
+    size_t lsz_ring = lsz_sqRing > lsz_cqRing ? lsz_sqRing : lsz_cqRing;
+    //
+    char *lptrc_ring = mmap(NULL, lsz_ring, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, lO_ring.mi_ring_fd, IORING_OFF_SQ_RING);
+    lO_ring.mptrO_sqes = mmap(NULL, lO_params.sq_entries * sizeof(struct io_uring_sqe),
+                              PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                              lO_ring.mi_ring_fd, IORING_OFF_SQES);
+    //
+    if (lptrc_ring == MAP_FAILED || lO_ring.mptrO_sqes == MAP_FAILED) {
+        close(lO_ring.mi_ring_fd);
+        return -1;
+    }
+    //
+    lO_ring.mptrui_sqHead = (unsigned *) (lptrc_ring + lO_params.sq_off.head);
+    lO_ring.mptrui_sqTail = (unsigned *) (lptrc_ring + lO_params.sq_off.tail);
+    lO_ring.mui_sqMask = *(unsigned *) (lptrc_ring + lO_params.sq_off.ring_mask);
+    lO_ring.mui_sqEntries = lO_params.sq_entries;
+    lO_ring.mui_sqLocalTail = *lO_ring.mptrui_sqTail;
+    lO_ring.mptrui_cqHead = (unsigned *) (lptrc_ring + lO_params.cq_off.head);
+    lO_ring.mptrui_cqTail = (unsigned *) (lptrc_ring + lO_params.cq_off.tail);
+    lO_ring.mui_cqMask = *(unsigned *) (lptrc_ring + lO_params.cq_off.ring_mask);
+    lO_ring.mptrO_cqes = (struct io_uring_cqe *) (lptrc_ring + lO_params.cq_off.cqes);
+    //
+    // SQ slot i always holds SQ entry i
+    unsigned *lptrui_sqArray = (unsigned *) (lptrc_ring + lO_params.sq_off.array);
+    for (unsigned i = 0; i < lO_params.sq_entries; ++i) {
+        lptrui_sqArray[i] = i;
+    }
+    //
+    // provided buffers: the descriptor ring must be page aligned, hence mmap()
+    lO_ring.mptrO_bufferRing = mmap(NULL, URING_BUFFERS * sizeof(struct io_uring_buf),
+                                    PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    lO_ring.mptrc_buffers = malloc((size_t) URING_BUFFERS * BUFFER_SIZE);
+    //
+    if (lO_ring.mptrO_bufferRing == MAP_FAILED || lO_ring.mptrc_buffers == NULL) {
+        close(lO_ring.mi_ring_fd);
+        errno = ENOMEM;
+        return -1;
+    }
+    //
+    struct io_uring_buf_reg lO_bufferRegistration;
+    memset(&lO_bufferRegistration, 0, sizeof(lO_bufferRegistration));
+    lO_bufferRegistration.ring_addr = (uint64_t) (uintptr_t) lO_ring.mptrO_bufferRing;
+    lO_bufferRegistration.ring_entries = URING_BUFFERS;
+    lO_bufferRegistration.bgid = URING_BUFFER_GROUP;
+    //
+    if (fi_uringRegister(lO_ring.mi_ring_fd, IORING_REGISTER_PBUF_RING,
+                         &lO_bufferRegistration, 1) < 0) {
+        close(lO_ring.mi_ring_fd);
+        return -1;
+    }
+    for (unsigned i = 0; i < URING_BUFFERS; ++i) {
+        fv_bufferRecycle(&lO_ring, (unsigned short) i);
+    }
+    //
+    fv_queueAccept(&lO_ring, pi_socketConn_fd);
+    //
+    while (1) {
+        // one system call submits everything queued so far and waits for completions
+        if (fi_uringSubmit(&lO_ring, 1) < 0) {
+            return -1;
+        }
+        //
+        unsigned lui_head = *lO_ring.mptrui_cqHead;
+        unsigned lui_tail = __atomic_load_n(lO_ring.mptrui_cqTail, __ATOMIC_ACQUIRE);
+        //
+        for (; lui_head != lui_tail; ++lui_head) {
+            fv_complete(&lO_ring, pi_socketConn_fd,
+                        &lO_ring.mptrO_cqes[lui_head & lO_ring.mui_cqMask]);
+        }
+        // hand the consumed completion slots back to the kernel
+        __atomic_store_n(lO_ring.mptrui_cqHead, lui_head, __ATOMIC_RELEASE);
+    } // end of infinite completion loop
+}
+
+#endif  // IPC_WITH_URING
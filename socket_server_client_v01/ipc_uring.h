@@ -0,0 +1,24 @@
+/*
+ * io_uring serving mode
+ * Accepts, reads and acknowledges connections through a single io_uring
+ * instance: requests are queued in shared memory and submitted in batches,
+ * so a busy server makes about one system call per batch instead of
+ * accept() + read() + send() per connection
+ * Built only when compiled with -DIPC_WITH_URING (needs Linux >= 6.0);
+ * uses the raw system calls, no liburing required
+ */
+#ifndef IPC_URING_H
+#define IPC_URING_H
+
+/*
+ * Serve all connections arriving on the listening socket, pi_socketConn_fd,
+ * with the same read/print/acknowledge behavior as fv_serve()
+ *  - one multishot accept request produces every accepted connection
+ *  - reads land in a ring of buffers provided to the kernel up front
+ *  - each acknowledgement is sent by a send request linked to the close request
+ * Runs forever; returns -1 (with errno set) if the ring cannot be set up,
+ * or with errno ENOSYS when built without -DIPC_WITH_URING
+ */
+int fi_uringServe(int pi_socketConn_fd);
+
+#endif  // IPC_URING_H
@@ -0,0 +1,828 @@
+/*
+ * Same-host IPC microbenchmark
+ * Which mechanism should two processes on one host talk through? Two processes, each
+ * pinned to a CPU of its own, bounce messages over one mechanism at a time, for every
+ * message size asked for (by default 8 B to 1 MB, in steps of 8x):
+ *  - latency: one message in flight, echoed back; percentiles of the round-trip time
+ *  - throughput: the pinging side streams messages as fast as the mechanism takes them,
+ *    and only the last one is answered
+ * Mechanisms:
+ *  tcp        loopback TCP connection (TCP_NODELAY), as between client and server
+ *  unix       AF_UNIX stream socket pair
+ *  unixdgram  AF_UNIX datagram socket pair
+ *  pipe       a pipe each way
+ *  mqueue     a POSIX message queue each way
+ *  eventfd    a shared-memory ring each way; a side with nothing to do spins briefly,
+ *             then sleeps on an eventfd
+ *  futex      the same rings, sleeping on a futex in the shared memory instead
+ * Every message is copied in and out by both sides, whatever the mechanism
+ * A size the mechanism cannot carry (datagram and queue limits) is reported as skipped
+ * One JSON object per mechanism and size goes to standard output
+ * References:
+ *  man 7 unix, man 7 pipe, man 7 mq_overview, man 2 eventfd, man 2 futex
+ */
+#define _GNU_SOURCE  // F_SETPIPE_SZ, CPU_SET()
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <limits.h>
+#include <mqueue.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <linux/futex.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // TCP_NODELAY
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+#include "ipc_histogram.h"  // latency histogram
+
+#define CACHE_LINE_SIZE 64
+// sizes measured by default: 8 B to 1 MB, times 8 each step
+#define BENCH_SIZES        "8,64,512,4096,32768,262144,1048576"
+#define BENCH_SIZES_MAX    32
+// round trips before the clock starts, at most (and at most a tenth of the run)
+#define BENCH_WARMUP       1000
+// polls of an empty (or full) ring before going to sleep
+#define BENCH_SPIN_ITERATIONS 4096
+
+// what a message asks of the echoing side, in its first 8 bytes
+enum ipc_benchControl {
+    BENCH_PING,        // send it back
+    BENCH_STREAM,      // keep it
+    BENCH_STREAM_END,  // keep it, and answer: the stream is through
+    BENCH_EXIT
+};
+
+// how messages move
+enum ipc_benchKind {
+    BENCH_KIND_STREAM,    // a byte stream: read until the whole message is there
+    BENCH_KIND_DATAGRAM,  // one message per send
+    BENCH_KIND_MQUEUE,
+    BENCH_KIND_RING
+};
+
+// where a ring side sleeps: a futex on the counter, or an eventfd
+struct ipc_benchSignal {
+    _Alignas(CACHE_LINE_SIZE) atomic_uint mui_counter;
+    atomic_uint                           mui_sleeping;
+    int                                   mi_event_fd;  // -1: futex
+};
+
+// single-producer, single-consumer byte ring: messages are a length, then the data, 8-byte aligned
+struct ipc_benchRing {
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong mul_head;  // consumer
+    _Alignas(CACHE_LINE_SIZE) atomic_ulong mul_tail;  // producer
+    struct ipc_benchSignal                 mO_data;   // the consumer waits here for messages
+    struct ipc_benchSignal                 mO_room;   // the producer waits here for room
+    _Alignas(CACHE_LINE_SIZE) char         mc_a1_data[];
+};
+
+// both ends of a mechanism, made before the fork; each process then keeps its side
+struct ipc_benchChannel {
+    enum ipc_benchKind    me_kind;
+    size_t                msz_message;
+    // [side][0]: receives, [side][1]: sends (the same socket for socket pairs)
+    int                   mi_a1_fds[2][2];
+    // ring d carries side d's messages to side 1 - d
+    struct ipc_benchRing *mptrO_a1_rings[2];
+    size_t                msz_ring;
+};
+
+struct ipc_benchTransport {
+    const char        *mptrc_name;
+    enum ipc_benchKind me_kind;
+    // Returns 0, or -1 (with errno set; EMSGSIZE: this message size is out of reach)
+    int              (*mpf_open)(struct ipc_benchChannel *pptrO_channel);
+};
+
+static struct ipc_histogram gO_histogram;
+// polls before sleeping: none when both sides share a CPU, the other side cannot move meanwhile
+static int                  gi_spinIterations = BENCH_SPIN_ITERATIONS;
+
+static uint64_t ful_now(void) {
+    struct timespec lO_time;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_time);
+    //
+    return (uint64_t) lO_time.tv_sec * 1000000000ull + lO_time.tv_nsec;
+}
+
+void fv_logErrorEXIT(const char *cptrc_errorMessage, int pi_socket_fd) {
+    //
+    // print a system error message on stderr
+    perror(cptrc_errorMessage);
+    //
+    if (pi_socket_fd >= 0) {
+        close(pi_socket_fd);
+    }
+    // cause normal process (unsuccessful) termination
+    exit(EXIT_FAILURE);
+}
+
+static inline void fv_cpuRelax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/********************* OPEN *********************/
+
+// a socket pair: each side sends and receives on its own end
+static int fi_openPair(struct ipc_benchChannel *pptrO_channel, int pi_type) {
+    int li_a1_pair[2];
+    //
+    if (socketpair(AF_UNIX, pi_type, 0, li_a1_pair) < 0) {
+        return -1;
+    }
+    for (int i = 0; i < 2; ++i) {
+        pptrO_channel->mi_a1_fds[i][0] = pptrO_channel->mi_a1_fds[i][1] = li_a1_pair[i];
+    }
+    return 0;
+}
+
+static int fi_openUnix(struct ipc_benchChannel *pptrO_channel) {
+    return fi_openPair(pptrO_channel, SOCK_STREAM);
+}
+
+static int fi_openUnixDgram(struct ipc_benchChannel *pptrO_channel) {
+    //
+    if (fi_openPair(pptrO_channel, SOCK_DGRAM) < 0) {
+        return -1;
+    }
+    // a datagram must fit in the sender's buffer whole, capped by net.core.wmem_max
+    int       li_size = pptrO_channel->msz_message > INT_MAX / 2 ? INT_MAX : (int) pptrO_channel->msz_message * 2;
+    socklen_t lui_length = sizeof(li_size);
+    //
+    for (int i = 0; i < 2; ++i) {
+        setsockopt(pptrO_channel->mi_a1_fds[i][1], SOL_SOCKET, SO_SNDBUF, &li_size, sizeof(li_size));
+    }
+    if (getsockopt(pptrO_channel->mi_a1_fds[0][1], SOL_SOCKET, SO_SNDBUF, &li_size, &lui_length) < 0 ||
+        (size_t) li_size < pptrO_channel->msz_message + 1024) {
+        close(pptrO_channel->mi_a1_fds[0][0]);
+        close(pptrO_channel->mi_a1_fds[1][0]);
+        errno = EMSGSIZE;
+        return -1;
+    }
+    return 0;
+}
+
+static int fi_openTcp(struct ipc_benchChannel *pptrO_channel) {
+    //
+    struct sockaddr_in lO_address;
+    socklen_t          lui_size = sizeof(lO_address);
+    int                li_listen_fd = socket(AF_INET, SOCK_STREAM, 0),
+                       li_connect_fd = socket(AF_INET, SOCK_STREAM, 0),
+                       li_accept_fd = -1,
+                       li_enable = 1;
+    //
+    memset(&lO_address, 0, sizeof(lO_address));
+    lO_address.sin_family = AF_INET;
+    lO_address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    //
+    // any free port: the kernel picks it, getsockname() tells which
+    if (li_listen_fd < 0 || li_connect_fd < 0 ||
+        bind(li_listen_fd, (struct sockaddr *) &lO_address, sizeof(lO_address)) < 0 ||
+        listen(li_listen_fd, 1) < 0 ||
+        getsockname(li_listen_fd, (struct sockaddr *) &lO_address, &lui_size) < 0 ||
+        connect(li_connect_fd, (struct sockaddr *) &lO_address, sizeof(lO_address)) < 0 ||
+        (li_accept_fd = accept(li_listen_fd, NULL, NULL)) < 0) {
+        fv_logErrorEXIT("tcp", li_listen_fd);
+    }
+    close(li_listen_fd);
+    //
+    setsockopt(li_connect_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+    setsockopt(li_accept_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+    //
+    pptrO_channel->mi_a1_fds[0][0] = pptrO_channel->mi_a1_fds[0][1] = li_connect_fd;
+    pptrO_channel->mi_a1_fds[1][0] = pptrO_channel->mi_a1_fds[1][1] = li_accept_fd;
+    //
+    return 0;
+}
+
+static int fi_openPipe(struct ipc_benchChannel *pptrO_channel) {
+    int li_a1_forth[2],
+        li_a1_back[2];
+    //
+    if (pipe(li_a1_forth) < 0 || pipe(li_a1_back) < 0) {
+        return -1;
+    }
+    // a message in one go, as far as fs.pipe-max-size allows (best effort)
+    if (pptrO_channel->msz_message > 65536) {
+        int li_size = pptrO_channel->msz_message > (1 << 20) ? (1 << 20) : (int) pptrO_channel->msz_message;
+        //
+        fcntl(li_a1_forth[1], F_SETPIPE_SZ, li_size);
+        fcntl(li_a1_back[1], F_SETPIPE_SZ, li_size);
+    }
+    pptrO_channel->mi_a1_fds[0][0] = li_a1_back[0];
+    pptrO_channel->mi_a1_fds[0][1] = li_a1_forth[1];
+    pptrO_channel->mi_a1_fds[1][0] = li_a1_forth[0];
+    pptrO_channel->mi_a1_fds[1][1] = li_a1_back[1];
+    //
+    return 0;
+}
+
+static int fi_openMqueue(struct ipc_benchChannel *pptrO_channel) {
+    //
+    // messages up to fs.mqueue.msgsize_max (8 KiB by default), fs.mqueue.msg_max of them queued
+    struct mq_attr lO_attributes;
+    mqd_t          li_a1_queues[2];
+    //
+    memset(&lO_attributes, 0, sizeof(lO_attributes));
+    lO_attributes.mq_maxmsg = 10;
+    lO_attributes.mq_msgsize = pptrO_channel->msz_message;
+    //
+    for (int i = 0; i < 2; ++i) {
+        char lc_a1_name[64];
+        //
+        snprintf(lc_a1_name, sizeof(lc_a1_name), "/c-ipc-bench-%d-%d", (int) getpid(), i);
+        li_a1_queues[i] = mq_open(lc_a1_name, O_RDWR | O_CREAT | O_EXCL, 0600, &lO_attributes);
+        //
+        if (li_a1_queues[i] == (mqd_t) -1) {
+            if (errno == EINVAL) {
+                errno = EMSGSIZE;
+            }
+            if (i == 1) {
+                mq_close(li_a1_queues[0]);
+            }
+            return -1;
+        }
+        // the descriptors live on in both processes, the name is not needed any more
+        mq_unlink(lc_a1_name);
+    }
+    pptrO_channel->mi_a1_fds[0][0] = pptrO_channel->mi_a1_fds[1][1] = li_a1_queues[1];
+    pptrO_channel->mi_a1_fds[0][1] = pptrO_channel->mi_a1_fds[1][0] = li_a1_queues[0];
+    //
+    return 0;
+}
+
+static int fi_openRings(struct ipc_benchChannel *pptrO_channel, int pi_eventfd) {
+    //
+    // room for a few messages in flight, a power of 2
+    size_t lsz_ring = 65536;
+    //
+    while (lsz_ring < 4 * (pptrO_channel->msz_message + sizeof(uint64_t))) {
+        lsz_ring *= 2;
+    }
+    size_t lsz_size = sizeof(struct ipc_benchRing) + lsz_ring;
+    //
+    for (int i = 0; i < 2; ++i) {
+        struct ipc_benchRing *lptrO_ring = mmap(NULL, lsz_size, PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        //
+        if (lptrO_ring == MAP_FAILED) {
+            return -1;
+        }
+        lptrO_ring->mO_data.mi_event_fd = pi_eventfd ? eventfd(0, EFD_CLOEXEC) : -1;
+        lptrO_ring->mO_room.mi_event_fd = pi_eventfd ? eventfd(0, EFD_CLOEXEC) : -1;
+        //
+        if (pi_eventfd && (lptrO_ring->mO_data.mi_event_fd < 0 || lptrO_ring->mO_room.mi_event_fd < 0)) {
+            return -1;
+        }
+        pptrO_channel->mptrO_a1_rings[i] = lptrO_ring;
+    }
+    pptrO_channel->msz_ring = lsz_ring;
+    //
+    return 0;
+}
+
+static int fi_openEventfd(struct ipc_benchChannel *pptrO_channel) {
+    return fi_openRings(pptrO_channel, 1);
+}
+
+static int fi_openFutex(struct ipc_benchChannel *pptrO_channel) {
+    return fi_openRings(pptrO_channel, 0);
+}
+
+static const struct ipc_benchTransport gO_a1_transports[] = {
+    { "tcp",       BENCH_KIND_STREAM,   fi_openTcp },
+    { "unix",      BENCH_KIND_STREAM,   fi_openUnix },
+    { "unixdgram", BENCH_KIND_DATAGRAM, fi_openUnixDgram },
+    { "pipe",      BENCH_KIND_STREAM,   fi_openPipe },
+    { "mqueue",    BENCH_KIND_MQUEUE,   fi_openMqueue },
+    { "eventfd",   BENCH_KIND_RING,     fi_openEventfd },
+    { "futex",     BENCH_KIND_RING,     fi_openFutex }
+};
+
+#define BENCH_TRANSPORTS ((int) (sizeof(gO_a1_transports) / sizeof(gO_a1_transports[0])))
+
+/********************* RINGS *********************/
+
+static void fv_signalNotify(struct ipc_benchSignal *pptrO_signal) {
+    atomic_fetch_add(&pptrO_signal->mui_counter, 1);
+    //
+    // the system call is only paid when the other side is (about to be) asleep
+    if (atomic_load(&pptrO_signal->mui_sleeping)) {
+        if (pptrO_signal->mi_event_fd >= 0) {
+            uint64_t lul_one = 1;
+            //
+            if (write(pptrO_signal->mi_event_fd, &lul_one, sizeof(lul_one)) < 0) {
+                fv_logErrorEXIT("eventfd", -1);
+            }
+        } else {
+            syscall(SYS_futex, &pptrO_signal->mui_counter, FUTEX_WAKE, 1, NULL, NULL, 0);
+        }
+    }
+}
+
+// how many bytes the ring holds (pi_room: 0) or has free (pi_room: 1)
+static size_t fsz_ringLevel(struct ipc_benchRing *pptrO_ring, size_t psz_ring, int pi_room) {
+    size_t lsz_used = atomic_load(&pptrO_ring->mul_tail) - atomic_load(&pptrO_ring->mul_head);
+    //
+    return pi_room ? psz_ring - lsz_used : lsz_used;
+}
+
+// spin a while, then sleep until the ring holds (or has free) at least psz_need bytes
+static void fv_ringWait(struct ipc_benchRing *pptrO_ring, size_t psz_ring, int pi_room, size_t psz_need) {
+    //
+    struct ipc_benchSignal *lptrO_signal = pi_room ? &pptrO_ring->mO_room : &pptrO_ring->mO_data;
+    //
+    for (int i = 0; i < gi_spinIterations; ++i) {
+        if (fsz_ringLevel(pptrO_ring, psz_ring, pi_room) >= psz_need) {
+            return;
+        }
+        fv_cpuRelax();
+    }
+    while (1) {
+        unsigned lui_seen = atomic_load(&lptrO_signal->mui_counter);
+        //
+        // announce the sleep, then look one last time: a notification cannot slip in between
+        atomic_store(&lptrO_signal->mui_sleeping, 1);
+        //
+        if (fsz_ringLevel(pptrO_ring, psz_ring, pi_room) >= psz_need) {
+            break;
+        }
+        if (lptrO_signal->mi_event_fd >= 0) {
+            uint64_t lul_count;
+            //
+            if (read(lptrO_signal->mi_event_fd, &lul_count, sizeof(lul_count)) < 0 && errno != EINTR) {
+                fv_logErrorEXIT("eventfd", -1);
+            }
+        } else {
+            syscall(SYS_futex, &lptrO_signal->mui_counter, FUTEX_WAIT, lui_seen, NULL, NULL, 0);
+        }
+    }
+    atomic_store(&lptrO_signal->mui_sleeping, 0);
+}
+
+// copy between the ring, at position pul_at, and a flat buffer, wrapping around its end
+static void fv_ringCopy(struct ipc_benchRing *pptrO_ring, size_t psz_ring, uint64_t pul_at,
+                        void *pptrv_buffer, size_t psz_length, int pi_into) {
+    size_t lsz_offset = pul_at & (psz_ring - 1),
+           lsz_first = psz_length < psz_ring - lsz_offset ? psz_length : psz_ring - lsz_offset;
+    char  *lptrc_buffer = pptrv_buffer;
+    //
+    if (pi_into) {
+        memcpy(pptrO_ring->mc_a1_data + lsz_offset, lptrc_buffer, lsz_first);
+        memcpy(pptrO_ring->mc_a1_data, lptrc_buffer + lsz_first, psz_length - lsz_first);
+    } else {
+        memcpy(lptrc_buffer, pptrO_ring->mc_a1_data + lsz_offset, lsz_first);
+        memcpy(lptrc_buffer + lsz_first, pptrO_ring->mc_a1_data, psz_length - lsz_first);
+    }
+}
+
+static void fv_ringSend(struct ipc_benchRing *pptrO_ring, size_t psz_ring, const void *pptrv_message, size_t psz_length) {
+    uint64_t lul_length = psz_length;
+    size_t   lsz_need = sizeof(lul_length) + ((psz_length + 7) & ~(size_t) 7);
+    //
+    fv_ringWait(pptrO_ring, psz_ring, 1, lsz_need);
+    //
+    uint64_t lul_tail = atomic_load_explicit(&pptrO_ring->mul_tail, memory_order_relaxed);
+    //
+    fv_ringCopy(pptrO_ring, psz_ring, lul_tail, &lul_length, sizeof(lul_length), 1);
+    fv_ringCopy(pptrO_ring, psz_ring, lul_tail + sizeof(lul_length), (void *) pptrv_message, psz_length, 1);
+    atomic_store(&pptrO_ring->mul_tail, lul_tail + lsz_need);
+    //
+    fv_signalNotify(&pptrO_ring->mO_data);
+}
+
+static void fv_ringReceive(struct ipc_benchRing *pptrO_ring, size_t psz_ring, void *pptrv_message, size_t psz_room) {
+    uint64_t lul_length;
+    //
+    fv_ringWait(pptrO_ring, psz_ring, 0, sizeof(lul_length));
+    //
+    uint64_t lul_head = atomic_load_explicit(&pptrO_ring->mul_head, memory_order_relaxed);
+    //
+    // the producer publishes a message whole: the length says how much is there
+    fv_ringCopy(pptrO_ring, psz_ring, lul_head, &lul_length, sizeof(lul_length), 0);
+    fv_ringCopy(pptrO_ring, psz_ring, lul_head + sizeof(lul_length), pptrv_message,
+                lul_length < psz_room ? lul_length : psz_room, 0);
+    atomic_store(&pptrO_ring->mul_head, lul_head + sizeof(lul_length) + ((lul_length + 7) & ~(uint64_t) 7));
+    //
+    fv_signalNotify(&pptrO_ring->mO_room);
+}
+
+/********************* MESSAGES *********************/
+
+static void fv_benchSend(struct ipc_benchChannel *pptrO_channel, int pi_side, const char *pptrc_message) {
+    //
+    int     li_fd = pptrO_channel->mi_a1_fds[pi_side][1];
+    size_t  lsz_length = pptrO_channel->msz_message;
+    ssize_t li_n;
+    //
+    switch (pptrO_channel->me_kind) {
+        case BENCH_KIND_STREAM:
+            for (size_t lsz_sent = 0; lsz_sent < lsz_length; lsz_sent += li_n) {
+                li_n = write(li_fd, pptrc_message + lsz_sent, lsz_length - lsz_sent);
+                //
+                if (li_n < 0) {
+                    if (errno == EINTR) {
+                        li_n = 0;
+                        continue;
+                    }
+                    fv_logErrorEXIT("write", -1);
+                }
+            }
+            break;
+        case BENCH_KIND_DATAGRAM:
+            if (send(li_fd, pptrc_message, lsz_length, 0) != (ssize_t) lsz_length) {
+                fv_logErrorEXIT("send", -1);
+            }
+            break;
+        case BENCH_KIND_MQUEUE:
+            if (mq_send(li_fd, pptrc_message, lsz_length, 0) < 0) {
+                fv_logErrorEXIT("mq_send", -1);
+            }
+            break;
+        case BENCH_KIND_RING:
+            fv_ringSend(pptrO_channel->mptrO_a1_rings[pi_side], pptrO_channel->msz_ring, pptrc_message, lsz_length);
+            break;
+    }
+}
+
+static void fv_benchReceive(struct ipc_benchChannel *pptrO_channel, int pi_side, char *pptrc_message) {
+    //
+    int     li_fd = pptrO_channel->mi_a1_fds[pi_side][0];
+    size_t  lsz_length = pptrO_channel->msz_message;
+    ssize_t li_n;
+    //
+    switch (pptrO_channel->me_kind) {
+        case BENCH_KIND_STREAM:
+            for (size_t lsz_received = 0; lsz_received < lsz_length; lsz_received += li_n) {
+                li_n = read(li_fd, pptrc_message + lsz_received, lsz_length - lsz_received);
+                //
+                if (li_n < 0 && errno == EINTR) {
+                    li_n = 0;
+                    continue;
+                }
+                if (li_n <= 0) {
+                    fv_logErrorEXIT("read", -1);
+                }
+            }
+            break;
+        case BENCH_KIND_DATAGRAM:
+            if (recv(li_fd, pptrc_message, lsz_length, 0) != (ssize_t) lsz_length) {
+                fv_logErrorEXIT("recv", -1);
+            }
+            break;
+        case BENCH_KIND_MQUEUE:
+            if (mq_receive(li_fd, pptrc_message, lsz_length, NULL) != (ssize_t) lsz_length) {
+                fv_logErrorEXIT("mq_receive", -1);
+            }
+            break;
+        case BENCH_KIND_RING:
+            // side 1 - pi_side sends on its own ring
+            fv_ringReceive(pptrO_channel->mptrO_a1_rings[1 - pi_side], pptrO_channel->msz_ring,
+                           pptrc_message, lsz_length);
+            break;
+    }
+}
+
+static void fv_controlSet(char *pptrc_message, enum ipc_benchControl pe_control) {
+    uint64_t lul_control = pe_control;
+    //
+    memcpy(pptrc_message, &lul_control, sizeof(lul_control));
+}
+
+static enum ipc_benchControl fe_controlGet(const char *cptrc_message) {
+    uint64_t lul_control;
+    //
+    memcpy(&lul_control, cptrc_message, sizeof(lul_control));
+    //
+    return (enum ipc_benchControl) lul_control;
+}
+
+/********************* SIDES *********************/
+
+static void fv_pin(int pi_cpu) {
+    cpu_set_t lO_cpuSet;
+    //
+    CPU_ZERO(&lO_cpuSet);
+    CPU_SET(pi_cpu, &lO_cpuSet);
+    //
+    if (sched_setaffinity(0, sizeof(lO_cpuSet), &lO_cpuSet) < 0) {
+        fv_logErrorEXIT("sched_setaffinity", -1);
+    }
+}
+
+// the echoing side: answers pings, swallows streams, until told to exit
+static void fv_benchEcho(struct ipc_benchChannel *pptrO_channel, char *pptrc_message) {
+    //
+    while (1) {
+        fv_benchReceive(pptrO_channel, 1, pptrc_message);
+        //
+        switch (fe_controlGet(pptrc_message)) {
+            case BENCH_PING:
+            case BENCH_STREAM_END:
+                fv_benchSend(pptrO_channel, 1, pptrc_message);
+                break;
+            case BENCH_STREAM:
+                break;
+            case BENCH_EXIT:
+                return;
+        }
+    }
+}
+
+/*
+ * The measuring side: round trips for pd_seconds, then a stream for as long
+ * Returns the messages streamed per second; the round trips land in gO_histogram
+ */
+static double fd_benchMeasure(struct ipc_benchChannel *pptrO_channel, char *pptrc_message, double pd_seconds) {
+    //
+    uint64_t lul_duration = (uint64_t) (pd_seconds * 1e9),
+             lul_start = ful_now(),
+             lul_now = lul_start;
+    //
+    // warm caches, page tables and the scheduler up first
+    fv_controlSet(pptrc_message, BENCH_PING);
+    //
+    for (int i = 0; i < BENCH_WARMUP && lul_now - lul_start < lul_duration / 10; ++i) {
+        fv_benchSend(pptrO_channel, 0, pptrc_message);
+        fv_benchReceive(pptrO_channel, 0, pptrc_message);
+        lul_now = ful_now();
+    }
+    fv_histogramInit(&gO_histogram);
+    lul_start = lul_now;
+    //
+    while (lul_now - lul_start < lul_duration) {
+        uint64_t lul_sent = lul_now;
+        //
+        fv_benchSend(pptrO_channel, 0, pptrc_message);
+        fv_benchReceive(pptrO_channel, 0, pptrc_message);
+        lul_now = ful_now();
+        fv_histogramRecord(&gO_histogram, lul_now - lul_sent);
+    }
+    //
+    // throughput: the clock stops when the last message is answered, not when it leaves
+    unsigned long lul_messages = 0;
+    //
+    fv_controlSet(pptrc_message, BENCH_STREAM);
+    lul_start = lul_now = ful_now();
+    //
+    while (lul_now - lul_start < lul_duration) {
+        fv_benchSend(pptrO_channel, 0, pptrc_message);
+        ++lul_messages;
+        lul_now = ful_now();
+    }
+    fv_controlSet(pptrc_message, BENCH_STREAM_END);
+    fv_benchSend(pptrO_channel, 0, pptrc_message);
+    fv_benchReceive(pptrO_channel, 0, pptrc_message);
+    ++lul_messages;
+    //
+    double ld_elapsed = (ful_now() - lul_start) / 1e9;
+    //
+    fv_controlSet(pptrc_message, BENCH_EXIT);
+    fv_benchSend(pptrO_channel, 0, pptrc_message);
+    //
+    return lul_messages / ld_elapsed;
+}
+
+static void fv_benchClose(struct ipc_benchChannel *pptrO_channel, int pi_side) {
+    //
+    if (pptrO_channel->me_kind == BENCH_KIND_RING) {
+        for (int i = 0; i < 2; ++i) {
+            struct ipc_benchRing *lptrO_ring = pptrO_channel->mptrO_a1_rings[i];
+            //
+            if (lptrO_ring->mO_data.mi_event_fd >= 0) {
+                close(lptrO_ring->mO_data.mi_event_fd);
+                close(lptrO_ring->mO_room.mi_event_fd);
+            }
+            munmap(lptrO_ring, sizeof(*lptrO_ring) + pptrO_channel->msz_ring);
+        }
+        return;
+    }
+    // both descriptors of a side, and the other side's too, when closing before the fork
+    for (int i = 0; i < 2; ++i) {
+        if (pi_side >= 0 && i != pi_side) {
+            continue;
+        }
+        close(pptrO_channel->mi_a1_fds[i][0]);
+        //
+        if (pptrO_channel->mi_a1_fds[i][1] != pptrO_channel->mi_a1_fds[i][0]) {
+            close(pptrO_channel->mi_a1_fds[i][1]);
+        }
+    }
+}
+
+/*
+ * Run one mechanism at one message size, and print its line
+ * pi_a1_cpus: the measuring side's CPU, then the echoing side's
+ */
+static void fv_benchRun(const struct ipc_benchTransport *pptrO_transport, size_t psz_message,
+                        const int pi_a1_cpus[2], double pd_seconds) {
+    //
+    struct ipc_benchChannel lO_channel;
+    //
+    memset(&lO_channel, 0, sizeof(lO_channel));
+    lO_channel.me_kind = pptrO_transport->me_kind;
+    lO_channel.msz_message = psz_message;
+    //
+    if (pptrO_transport->mpf_open(&lO_channel) < 0) {
+        if (errno != EMSGSIZE) {
+            fv_logErrorEXIT(pptrO_transport->mptrc_name, -1);
+        }
+        printf("{\"transport\":\"%s\",\"bytes\":%zu,\"skipped\":\"message too large for it\"}\n",
+               pptrO_transport->mptrc_name, psz_message);
+        return;
+    }
+    char *lptrc_message = malloc(psz_message);
+    //
+    if (lptrc_message == NULL) {
+        fv_logErrorEXIT("malloc", -1);
+    }
+    memset(lptrc_message, 'x', psz_message);
+    //
+    pid_t li_processID = fork();
+    //
+    if (li_processID < 0) {
+        fv_logErrorEXIT("fork", -1);
+    }
+    if (li_processID == 0) {
+        fv_pin(pi_a1_cpus[1]);
+        //
+        // a socket pair keeps both ends open in both processes otherwise
+        if (lO_channel.me_kind != BENCH_KIND_RING && lO_channel.me_kind != BENCH_KIND_MQUEUE) {
+            fv_benchClose(&lO_channel, 0);
+        }
+        fv_benchEcho(&lO_channel, lptrc_message);
+        _exit(EXIT_SUCCESS);
+    }
+    fv_pin(pi_a1_cpus[0]);
+    //
+    double ld_rate = fd_benchMeasure(&lO_channel, lptrc_message, pd_seconds);
+    //
+    waitpid(li_processID, NULL, 0);
+    fv_benchClose(&lO_channel, -1);
+    free(lptrc_message);
+    //
+    printf("{\"transport\":\"%s\",\"bytes\":%zu,\"cpus\":[%d,%d],\"round_trips\":%llu,"
+           "\"latency_ns\":{\"min\":%llu,\"mean\":%.0f,\"p50\":%llu,\"p90\":%llu,"
+           "\"p99\":%llu,\"p999\":%llu,\"p9999\":%llu,\"max\":%llu},"
+           "\"throughput_mps\":%.1f,\"throughput_MBps\":%.1f}\n",
+           pptrO_transport->mptrc_name, psz_message, pi_a1_cpus[0], pi_a1_cpus[1],
+           (unsigned long long) gO_histogram.mul_total,
+           (unsigned long long) (gO_histogram.mul_total ? gO_histogram.mul_min : 0),
+           gO_histogram.mul_total ? (double) gO_histogram.mul_sum / gO_histogram.mul_total : 0.0,
+           (unsigned long long) ful_histogramPercentile(&gO_histogram, 50),
+           (unsigned long long) ful_histogramPercentile(&gO_histogram, 90),
+           (unsigned long long) ful_histogramPercentile(&gO_histogram, 99),
+           (unsigned long long) ful_histogramPercentile(&gO_histogram, 99.9),
+           (unsigned long long) ful_histogramPercentile(&gO_histogram, 99.99),
+           (unsigned long long) gO_histogram.mul_max,
+           ld_rate, ld_rate * psz_message / 1e6);
+}
+
+void fv_usage(const char *cptrc_program) {
+    fprintf(stderr,
+            "usage %s [-t transport,...] [-s bytes,...] [-d seconds] [-C cpu,cpu]\n"
+            "  -t  mechanisms to measure (default: all): tcp, unix, unixdgram, pipe, mqueue, eventfd, futex\n"
+            "  -s  message sizes, at least 8 bytes (default: " BENCH_SIZES ")\n"
+            "  -d  how long to measure latency, and then throughput, per mechanism and size (default: 1)\n"
+            "  -C  CPUs of the measuring and the echoing process (default: the first two this process may use)\n",
+            cptrc_program);
+}
+
+// qsort() order of the message sizes: ascending
+static int fi_sizeCompare(const void *pptrv_left, const void *pptrv_right) {
+    size_t lsz_left = *(const size_t *) pptrv_left,
+           lsz_right = *(const size_t *) pptrv_right;
+    //
+    return (lsz_left > lsz_right) - (lsz_left < lsz_right);
+}
+
+int main(int argc, char *argv[]) {
+    //
+    const char *lptrc_transports = NULL;
+    char        lc_a1_sizes[256] = BENCH_SIZES;
+    double      ld_seconds = 1;
+    int         li_a1_cpus[2] = { -1, -1 };
+    //
+    int li_option;
+    //
+    while ((li_option = getopt(argc, argv, "t:s:d:C:")) != -1) {
+        switch (li_option) {
+            case 't':
+                lptrc_transports = optarg;
+                break;
+            case 's':
+                snprintf(lc_a1_sizes, sizeof(lc_a1_sizes), "%s", optarg);
+                break;
+            case 'd':
+                ld_seconds = atof(optarg);
+                break;
+            case 'C':
+                if (sscanf(optarg, "%d,%d", &li_a1_cpus[0], &li_a1_cpus[1]) != 2) {
+                    fv_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                fv_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    //
+    size_t lsz_a1_sizes[BENCH_SIZES_MAX];
+    int    li_sizes = 0;
+    //
+    for (char *lptrc_size = strtok(lc_a1_sizes, ","); lptrc_size != NULL; lptrc_size = strtok(NULL, ",")) {
+        long ll_size = atol(lptrc_size);
+        //
+        if (ll_size < (long) sizeof(uint64_t) || li_sizes == BENCH_SIZES_MAX) {
+            fv_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        lsz_a1_sizes[li_sizes++] = ll_size;
+    }
+    // whatever order -s lists them in, runs compare line by line
+    qsort(lsz_a1_sizes, li_sizes, sizeof(lsz_a1_sizes[0]), fi_sizeCompare);
+    // every mechanism named must be known
+    for (const char *lptrc_name = lptrc_transports; lptrc_name != NULL && *lptrc_name != '\0'; ) {
+        size_t lsz_name = strcspn(lptrc_name, ",");
+        int    li_known = 0;
+        //
+        for (int i = 0; i < BENCH_TRANSPORTS; ++i) {
+            li_known |= strlen(gO_a1_transports[i].mptrc_name) == lsz_name &&
+                        strncmp(gO_a1_transports[i].mptrc_name, lptrc_name, lsz_name) == 0;
+        }
+        if (!li_known) {
+            fv_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+        lptrc_name += lsz_name + (lptrc_name[lsz_name] == ',');
+    }
+    if (argc != optind || li_sizes == 0 || ld_seconds <= 0) {
+        fv_usage(argv[0]);
+        //
+        return EXIT_FAILURE;
+    }
+
+
+    // two CPUs of their own: a round trip then crosses cores, as between a client and a server
+    cpu_set_t lO_cpuSet;
+    //
+    if (sched_getaffinity(0, sizeof(lO_cpuSet), &lO_cpuSet) < 0) {
+        fv_logErrorEXIT("sched_getaffinity", -1);
+    }
+    for (int i = 0, j = 0; i < CPU_SETSIZE && li_a1_cpus[1] < 0 && j < 2; ++i) {
+        if (CPU_ISSET(i, &lO_cpuSet)) {
+            li_a1_cpus[j++] = i;
+        }
+    }
+    if (li_a1_cpus[1] < 0) {
+        li_a1_cpus[1] = li_a1_cpus[0];
+    }
+    if (li_a1_cpus[0] == li_a1_cpus[1]) {
+        fprintf(stderr, "Both sides on CPU %d: every round trip includes a context switch\n", li_a1_cpus[0]);
+        gi_spinIterations = 0;
+    }
+
+
+    // one line per mechanism and size, in a stable order: the table's, then ascending sizes
+    for (int i = 0; i < BENCH_TRANSPORTS; ++i) {
+        const char *lptrc_name = gO_a1_transports[i].mptrc_name;
+        //
+        if (lptrc_transports != NULL) {
+            size_t      lsz_name = strlen(lptrc_name);
+            const char *lptrc_found = lptrc_transports;
+            //
+            // a whole item of the list, not part of one ("unix" in "unixdgram")
+            while ((lptrc_found = strstr(lptrc_found, lptrc_name)) != NULL &&
+                   ((lptrc_found != lptrc_transports && lptrc_found[-1] != ',') ||
+                    (lptrc_found[lsz_name] != ',' && lptrc_found[lsz_name] != '\0'))) {
+                lptrc_found += lsz_name;
+            }
+            if (lptrc_found == NULL) {
+                continue;
+            }
+        }
+        for (int j = 0; j < li_sizes; ++j) {
+            fv_benchRun(&gO_a1_transports[i], lsz_a1_sizes[j], li_a1_cpus, ld_seconds);
+        }
+    }
+    //
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,780 @@
+/*
+ * Load generator for the servers
+ * Drives a server with many concurrent connections, spread over several threads,
+ * and measures the latency of every request:
+ *  - closed loop (default): a connection sends its next request as soon as
+ *    the previous one is answered
+ *  - open loop (-r rate): requests fall due at a fixed rate, whether the server
+ *    keeps up or not; latency is counted from the moment a request was DUE, not from
+ *    when it could actually be sent, so a stalled server cannot hide its stall by
+ *    holding the load back (coordinated omission)
+ * Requests are framed (persistent, pipelined connections, as client -p) or, with -x,
+ * plain text with one connection per request, as the interactive client sends them,
+ * for servers that do not speak frames (-m epoll, -m uring, server_connectionOrientedSingle)
+ * The summary is one JSON object on standard output, the latency distribution goes to stderr
+ */
+#define _GNU_SOURCE  // ppoll()
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>  // TCP_NODELAY
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+#include "ipc_common.h"     // BUFFER_SIZE, acknowledgement message
+#include "ipc_frame.h"      // length-prefixed framing
+#include "ipc_histogram.h"  // latency histogram
+#include "ipc_message.h"    // compact binary messages
+
+// requests a connection may have due but unanswered; an open loop falling further behind
+// keeps its schedule and catches up later, so the delay is still counted
+#define LOAD_INFLIGHT_MAX 256
+// queued requests handed to the kernel in one sendmsg()
+#define LOAD_SEND_BATCH   64
+// every reply read of a thread lands in this buffer
+#define LOAD_RECEIVE_SIZE (64 * 1024)
+
+// what every thread is told to do
+struct ipc_loadConfig {
+    struct sockaddr_storage mO_address;
+    socklen_t               mui_addressSize;
+    // plain text requests, one connection each
+    int                     mi_text;
+    // text: the request travels with the SYN (TCP Fast Open)
+    int                     mi_fastOpen;
+    // framed: binary notes instead of request frames, answered with binary receipts
+    int                     mi_binary;
+    // the request as it goes on the wire: a whole frame, or the text message
+    char                   *mptrc_request;
+    size_t                  msz_request;
+    // ns between two requests of one connection, 0 for a closed loop
+    uint64_t                mul_interval;
+    // ns between the first requests of two consecutive connections
+    uint64_t                mul_stagger;
+    uint64_t                mul_start;
+    uint64_t                mul_deadline;
+};
+
+struct ipc_loadThread;
+
+struct ipc_loadConnection {
+    struct ipc_loadThread  *mptrO_thread;
+    // position among all connections of the run
+    unsigned                mui_index;
+    int                     mi_socket_fd;
+    // connect() still in progress: done once the socket is writable
+    int                     mi_connecting;
+    // due times of the requests not answered yet, oldest first
+    uint64_t                mul_a1_due[LOAD_INFLIGHT_MAX];
+    unsigned                mui_head;
+    unsigned                mui_due;
+    // how many of those (the newest ones) are not completely sent yet,
+    // and how much of the first of them is
+    unsigned                mui_unsent;
+    size_t                  msz_sent;
+    // open loop: when the next request falls due
+    uint64_t                mul_nextDue;
+    // framed: replies; text: acknowledgement bytes received
+    struct ipc_frameParser  mO_parser;
+    size_t                  msz_received;
+};
+
+struct ipc_loadThread {
+    pthread_t                    mO_thread;
+    const struct ipc_loadConfig *mptrO_config;
+    struct ipc_loadConnection   *mptrO_a1_connections;
+    unsigned                     mui_connections;
+    // requests this thread may still schedule, UINT64_MAX if unlimited
+    uint64_t                     mul_quota;
+    uint64_t                     mul_errors;
+    uint64_t                     mul_unanswered;
+    // text: turned away by the server's admission control
+    uint64_t                     mul_rejected;
+    struct ipc_histogram         mO_histogram;
+};
+
+static struct ipc_loadConfig gO_config;
+// threads connect, main starts the clock, then they all go
+static pthread_barrier_t     gO_ready,
+                             gO_go;
+
+static uint64_t ful_now(void) {
+    struct timespec lO_time;
+    //
+    clock_gettime(CLOCK_MONOTONIC, &lO_time);
+    //
+    return (uint64_t) lO_time.tv_sec * 1000000000ull + lO_time.tv_nsec;
+}
+
+void fv_logErrorEXIT(const char *cptrc_errorMessage, int pi_socket_fd) {
+    //
+    // print a system error message on stderr
+    perror(cptrc_errorMessage);
+    //
+    if (pi_socket_fd >= 0) {
+        close(pi_socket_fd);
+    }
+    // cause normal process (unsuccessful) termination
+    exit(EXIT_FAILURE);
+}
+
+// the oldest request due was answered
+static void fv_loadAnswered(struct ipc_loadConnection *pptrO_connection) {
+    struct ipc_loadThread *lptrO_thread = pptrO_connection->mptrO_thread;
+    uint64_t               lul_due = pptrO_connection->mul_a1_due[pptrO_connection->mui_head];
+    //
+    fv_histogramRecord(&lptrO_thread->mO_histogram, ful_now() - lul_due);
+    //
+    pptrO_connection->mui_head = (pptrO_connection->mui_head + 1) % LOAD_INFLIGHT_MAX;
+    --pptrO_connection->mui_due;
+}
+
+static int fi_onLoadReply(void *pptrv_connection, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_loadConnection *lptrO_connection = pptrv_connection;
+    //
+    // replies arrive in request order: the first unanswered request was answered
+    uint16_t lus_expected = lptrO_connection->mptrO_thread->mptrO_config->mi_binary ? IPC_FRAME_MESSAGE : IPC_FRAME_ACK;
+    //
+    if (pptrO_header->mus_type != lus_expected || lptrO_connection->mui_due == lptrO_connection->mui_unsent) {
+        errno = EPROTO;
+        return -1;
+    }
+    fv_loadAnswered(lptrO_connection);
+    //
+    return 0;
+}
+
+static const struct ipc_frameHandler gO_loadHandler = {
+    NULL,
+    NULL,
+    fi_onLoadReply
+};
+
+// open a non-blocking socket to the server; connect() may still be in progress (mi_connecting) on return
+static int fi_loadConnect(struct ipc_loadConnection *pptrO_connection) {
+    //
+    const struct ipc_loadConfig *lptrO_config = pptrO_connection->mptrO_thread->mptrO_config;
+    // non-blocking from the start, connect() included: a slow handshake holds up no other connection
+    int                          li_socket_fd = socket(lptrO_config->mO_address.ss_family,
+                                                       SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                                                       0);
+    //
+    if (li_socket_fd < 0) {
+        return -1;
+    }
+    //
+    int li_enable = 1;
+    //
+    // a request must not wait for the previous one to be acknowledged by TCP (Nagle)
+    if (lptrO_config->mO_address.ss_family == AF_INET) {
+        setsockopt(li_socket_fd, IPPROTO_TCP, TCP_NODELAY, &li_enable, sizeof(li_enable));
+        //
+        // connect() returns at once, the SYN leaves with the first send (and the request, given a cookie)
+        if (lptrO_config->mi_fastOpen) {
+            setsockopt(li_socket_fd, IPPROTO_TCP, TCP_FASTOPEN_CONNECT, &li_enable, sizeof(li_enable));
+        }
+    }
+    //
+    pptrO_connection->mi_connecting = 0;
+    //
+    if (connect(li_socket_fd, (const struct sockaddr *) &lptrO_config->mO_address, lptrO_config->mui_addressSize) < 0) {
+        if (errno != EINPROGRESS) {
+            close(li_socket_fd);
+            return -1;
+        }
+        pptrO_connection->mi_connecting = 1;
+    }
+    //
+    if (!lptrO_config->mi_text) {
+        fv_frameParserInit(&pptrO_connection->mO_parser, &gO_loadHandler, pptrO_connection);
+    }
+    pptrO_connection->mi_socket_fd = li_socket_fd;
+    pptrO_connection->msz_sent = 0;
+    pptrO_connection->msz_received = 0;
+    //
+    return 0;
+}
+
+/*
+ * The socket of a connection in progress became writable: find out how connect() ended
+ * Returns 0 once connected, or -1 (with errno set) if it failed
+ */
+static int fi_loadConnected(struct ipc_loadConnection *pptrO_connection) {
+    int       li_error = 0;
+    socklen_t lui_size = sizeof(li_error);
+    //
+    if (getsockopt(pptrO_connection->mi_socket_fd, SOL_SOCKET, SO_ERROR, &li_error, &lui_size) < 0) {
+        return -1;
+    }
+    if (li_error != 0) {
+        errno = li_error;
+        return -1;
+    }
+    pptrO_connection->mi_connecting = 0;
+    //
+    return 0;
+}
+
+/*
+ * The connection broke: its unanswered requests failed
+ * Text connections end with every request anyway; framed ones are opened again
+ */
+static void fv_loadFailed(struct ipc_loadConnection *pptrO_connection) {
+    struct ipc_loadThread *lptrO_thread = pptrO_connection->mptrO_thread;
+    unsigned               lui_failed = lptrO_thread->mptrO_config->mi_text ? 1 : pptrO_connection->mui_due;
+    //
+    lptrO_thread->mul_errors += lui_failed;
+    pptrO_connection->mui_head = (pptrO_connection->mui_head + lui_failed) % LOAD_INFLIGHT_MAX;
+    pptrO_connection->mui_due -= lui_failed;
+    pptrO_connection->mui_unsent = pptrO_connection->mui_due;
+    //
+    close(pptrO_connection->mi_socket_fd);
+    pptrO_connection->mi_socket_fd = -1;
+    //
+    if (!lptrO_thread->mptrO_config->mi_text && fi_loadConnect(pptrO_connection) < 0) {
+        pptrO_connection->mi_socket_fd = -1;
+    }
+}
+
+// queue the requests that fell due by pul_now
+static void fv_loadSchedule(struct ipc_loadConnection *pptrO_connection, uint64_t pul_now) {
+    struct ipc_loadThread       *lptrO_thread = pptrO_connection->mptrO_thread;
+    const struct ipc_loadConfig *lptrO_config = lptrO_thread->mptrO_config;
+    //
+    while (lptrO_thread->mul_quota > 0 && pptrO_connection->mui_due < LOAD_INFLIGHT_MAX) {
+        uint64_t lul_due;
+        //
+        if (lptrO_config->mul_interval == 0) {
+            // closed loop: one request at a time, due the moment the previous one is answered
+            if (pptrO_connection->mui_due > 0) {
+                return;
+            }
+            lul_due = pul_now;
+        } else {
+            if (pptrO_connection->mul_nextDue > pul_now) {
+                return;
+            }
+            lul_due = pptrO_connection->mul_nextDue;
+            pptrO_connection->mul_nextDue += lptrO_config->mul_interval;
+        }
+        //
+        pptrO_connection->mul_a1_due[(pptrO_connection->mui_head + pptrO_connection->mui_due) % LOAD_INFLIGHT_MAX] = lul_due;
+        ++pptrO_connection->mui_due;
+        ++pptrO_connection->mui_unsent;
+        --lptrO_thread->mul_quota;
+    }
+}
+
+// hand as many queued requests as the socket takes to the kernel, in one system call
+static int fi_loadSend(struct ipc_loadConnection *pptrO_connection) {
+    //
+    const struct ipc_loadConfig *lptrO_config = pptrO_connection->mptrO_thread->mptrO_config;
+    struct iovec                 lO_a1_parts[LOAD_SEND_BATCH];
+    unsigned                     lui_parts = 0;
+    //
+    // text: one request per connection, there is never more than one to send
+    while (lui_parts < pptrO_connection->mui_unsent && lui_parts < (lptrO_config->mi_text ? 1u : LOAD_SEND_BATCH)) {
+        // every part points at the same encoded request
+        size_t lsz_skip = lui_parts == 0 ? pptrO_connection->msz_sent : 0;
+        //
+        lO_a1_parts[lui_parts].iov_base = lptrO_config->mptrc_request + lsz_skip;
+        lO_a1_parts[lui_parts].iov_len = lptrO_config->msz_request - lsz_skip;
+        ++lui_parts;
+    }
+    //
+    struct msghdr lO_message;
+    memset(&lO_message, 0, sizeof(lO_message));
+    lO_message.msg_iov = lO_a1_parts;
+    lO_message.msg_iovlen = lui_parts;
+    //
+    ssize_t li_n = sendmsg(pptrO_connection->mi_socket_fd, &lO_message, MSG_NOSIGNAL | MSG_DONTWAIT);
+    //
+    if (li_n < 0) {
+        // Fast Open without a cookie yet: only the SYN left, the request goes once connected
+        if (errno == EINPROGRESS) {
+            pptrO_connection->mi_connecting = 1;
+            return 0;
+        }
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+    }
+    //
+    size_t lsz_sent = pptrO_connection->msz_sent + li_n;
+    //
+    pptrO_connection->mui_unsent -= lsz_sent / lptrO_config->msz_request;
+    pptrO_connection->msz_sent = lsz_sent % lptrO_config->msz_request;
+    //
+    return 0;
+}
+
+static int fi_loadReceive(struct ipc_loadConnection *pptrO_connection, char *pptrc_buffer) {
+    //
+    const struct ipc_loadConfig *lptrO_config = pptrO_connection->mptrO_thread->mptrO_config;
+    //
+    while (1) {
+        ssize_t li_n = read(pptrO_connection->mi_socket_fd, pptrc_buffer, LOAD_RECEIVE_SIZE);
+        //
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+        }
+        if (li_n == 0) {
+            // text: the server closes once it has answered (a key-value result may be short)
+            if (lptrO_config->mi_text && pptrO_connection->msz_received > 0) {
+                fv_loadAnswered(pptrO_connection);
+                close(pptrO_connection->mi_socket_fd);
+                pptrO_connection->mi_socket_fd = -1;
+                return 0;
+            }
+            errno = ECONNRESET;
+            return -1;
+        }
+        //
+        if (lptrO_config->mi_text) {
+            // the server is at its connection limit: the request is dropped, and not timed
+            if (pptrO_connection->msz_received == 0 &&
+                memcmp(pptrc_buffer, IPC_REJECT, (size_t) li_n < strlen(IPC_REJECT) ? (size_t) li_n
+                                                                                    : strlen(IPC_REJECT)) == 0) {
+                ++pptrO_connection->mptrO_thread->mul_rejected;
+                pptrO_connection->mui_head = (pptrO_connection->mui_head + 1) % LOAD_INFLIGHT_MAX;
+                --pptrO_connection->mui_due;
+                close(pptrO_connection->mi_socket_fd);
+                pptrO_connection->mi_socket_fd = -1;
+                return 0;
+            }
+            pptrO_connection->msz_received += li_n;
+            //
+            // the whole acknowledgement is there: no need to wait for the server to close
+            if (pptrO_connection->msz_received >= strlen(IPC_ACKNOWLEDGE)) {
+                fv_loadAnswered(pptrO_connection);
+                close(pptrO_connection->mi_socket_fd);
+                pptrO_connection->mi_socket_fd = -1;
+                return 0;
+            }
+        } else if (fi_frameParserFeed(&pptrO_connection->mO_parser, pptrc_buffer, li_n) != 0) {
+            return -1;
+        }
+    }
+}
+
+void *fptrv_loadThread(void *pptrv_thread) {
+    //
+    struct ipc_loadThread       *lptrO_thread = pptrv_thread;
+    const struct ipc_loadConfig *lptrO_config = lptrO_thread->mptrO_config;
+    struct pollfd               *lptrO_a1_poll = calloc(lptrO_thread->mui_connections, sizeof(struct pollfd));
+    char                        *lptrc_buffer = malloc(LOAD_RECEIVE_SIZE);
+    //
+    if (lptrO_a1_poll == NULL || lptrc_buffer == NULL) {
+        fv_logErrorEXIT("loadgen thread", -1);
+    }
+    //
+    for (unsigned i = 0; i < lptrO_thread->mui_connections; ++i) {
+        struct ipc_loadConnection *lptrO_connection = &lptrO_thread->mptrO_a1_connections[i];
+        //
+        lptrO_connection->mi_socket_fd = -1;
+        //
+        if (!lptrO_config->mi_text && fi_loadConnect(lptrO_connection) < 0) {
+            fv_logErrorEXIT("connect", -1);
+        }
+    }
+    // framed connections are all set up before the run: their handshakes are not measured
+    for (unsigned i = 0; i < lptrO_thread->mui_connections; ++i) {
+        struct ipc_loadConnection *lptrO_connection = &lptrO_thread->mptrO_a1_connections[i];
+        struct pollfd              lO_poll = { lptrO_connection->mi_socket_fd, POLLOUT, 0 };
+        //
+        while (lptrO_connection->mi_connecting) {
+            if (poll(&lO_poll, 1, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fv_logErrorEXIT("poll", -1);
+            }
+            if (fi_loadConnected(lptrO_connection) < 0) {
+                fv_logErrorEXIT("connect", -1);
+            }
+        }
+    }
+    //
+    pthread_barrier_wait(&gO_ready);
+    pthread_barrier_wait(&gO_go);
+    //
+    // open loop: connections take turns, so requests fall due evenly spread, not in bursts
+    for (unsigned i = 0; i < lptrO_thread->mui_connections; ++i) {
+        struct ipc_loadConnection *lptrO_connection = &lptrO_thread->mptrO_a1_connections[i];
+        //
+        lptrO_connection->mul_nextDue = lptrO_config->mul_start + lptrO_connection->mui_index * lptrO_config->mul_stagger;
+    }
+    //
+    while (1) {
+        uint64_t lul_now = ful_now(),
+                 lul_wake = lptrO_config->mul_deadline;
+        unsigned lui_busy = 0;
+        //
+        if (lul_now >= lptrO_config->mul_deadline) {
+            break;
+        }
+        //
+        for (unsigned i = 0; i < lptrO_thread->mui_connections; ++i) {
+            struct ipc_loadConnection *lptrO_connection = &lptrO_thread->mptrO_a1_connections[i];
+            struct pollfd             *lptrO_poll = &lptrO_a1_poll[i];
+            //
+            fv_loadSchedule(lptrO_connection, lul_now);
+            //
+            if (lptrO_config->mul_interval > 0 && lptrO_thread->mul_quota > 0 &&
+                lptrO_connection->mul_nextDue < lul_wake) {
+                lul_wake = lptrO_connection->mul_nextDue;
+            }
+            // text: every request opens its own connection
+            if (lptrO_connection->mi_socket_fd < 0 && lptrO_connection->mui_due > 0 &&
+                fi_loadConnect(lptrO_connection) < 0) {
+                ++lptrO_thread->mul_errors;
+                lptrO_connection->mui_head = (lptrO_connection->mui_head + 1) % LOAD_INFLIGHT_MAX;
+                --lptrO_connection->mui_due;
+                --lptrO_connection->mui_unsent;
+                lul_wake = lul_now;
+            }
+            //
+            lptrO_poll->fd = lptrO_connection->mi_socket_fd;
+            lptrO_poll->events = (lptrO_connection->mi_connecting || lptrO_connection->mui_unsent > 0) ? POLLOUT : POLLIN;
+            // framed replies may come while requests are still being sent
+            if (!lptrO_config->mi_text) {
+                lptrO_poll->events |= POLLIN;
+            }
+            lptrO_poll->revents = 0;
+            lui_busy += lptrO_connection->mui_due;
+        }
+        //
+        // a limited run is over once every request was scheduled and answered
+        if (lptrO_thread->mul_quota == 0 && lui_busy == 0) {
+            break;
+        }
+        //
+        struct timespec lO_timeout;
+        uint64_t        lul_wait = lul_wake > lul_now ? lul_wake - lul_now : 0;
+        //
+        lO_timeout.tv_sec = lul_wait / 1000000000ull;
+        lO_timeout.tv_nsec = lul_wait % 1000000000ull;
+        //
+        if (ppoll(lptrO_a1_poll, lptrO_thread->mui_connections, &lO_timeout, NULL) < 0 && errno != EINTR) {
+            fv_logErrorEXIT("ppoll", -1);
+        }
+        //
+        for (unsigned i = 0; i < lptrO_thread->mui_connections; ++i) {
+            struct ipc_loadConnection *lptrO_connection = &lptrO_thread->mptrO_a1_connections[i];
+            short                      li_events = lptrO_a1_poll[i].revents;
+            //
+            if (li_events == 0 || lptrO_connection->mi_socket_fd < 0) {
+                continue;
+            }
+            if (lptrO_connection->mi_connecting && fi_loadConnected(lptrO_connection) < 0) {
+                fv_loadFailed(lptrO_connection);
+                continue;
+            }
+            if ((li_events & POLLOUT) && lptrO_connection->mui_unsent > 0 &&
+                fi_loadSend(lptrO_connection) < 0) {
+                fv_loadFailed(lptrO_connection);
+                continue;
+            }
+            if ((li_events & (POLLIN | POLLHUP | POLLERR)) &&
+                fi_loadReceive(lptrO_connection, lptrc_buffer) < 0) {
+                fv_loadFailed(lptrO_connection);
+            }
+        }
+    }
+    //
+    for (unsigned i = 0; i < lptrO_thread->mui_connections; ++i) {
+        struct ipc_loadConnection *lptrO_connection = &lptrO_thread->mptrO_a1_connections[i];
+        //
+        lptrO_thread->mul_unanswered += lptrO_connection->mui_due;
+        if (lptrO_connection->mi_socket_fd >= 0) {
+            close(lptrO_connection->mi_socket_fd);
+        }
+    }
+    free(lptrO_a1_poll);
+    free(lptrc_buffer);
+    //
+    return NULL;
+}
+
+void fv_usage(const char *cptrc_program) {
+    fprintf(stderr,
+            "usage %s [-t threads] [-c connections] [-s bytes | -p text] [-r rate] [-d seconds] [-n requests] [-x [-F] | -e]\n"
+            "          hostname port\n"
+            "       %s [options] -u path\n"
+            "  -t  threads generating load (default: 1)\n"
+            "  -c  connections, spread over the threads (default: one per thread)\n"
+            "  -s  request payload size in bytes (default: 64; at most %d with -x)\n"
+            "  -p  send text as every request's payload instead, e.g. \"!GET user:1\" (see server -K)\n"
+            "  -r  open loop: requests per second over all connections (default: closed loop)\n"
+            "  -d  how long to run, in seconds (default: 10)\n"
+            "  -n  stop after this many requests (default: no limit)\n"
+            "  -x  plain text requests, one connection each, for servers without framing\n"
+            "  -F  send each text request with the SYN (TCP Fast Open, see server -F)\n"
+            "  -e  compact binary messages (a note carrying the payload) instead of request frames\n"
+            "  -u  connect to the Unix domain socket at path\n",
+            cptrc_program, cptrc_program, BUFFER_SIZE - 1);
+}
+
+int main(int argc, char *argv[]) {
+    //
+    int                li_threads = 1,
+                       li_connections = 0;
+    long               ll_size = 64;
+    double             ld_rate = 0,
+                       ld_duration = 10;
+    unsigned long long lul_requests = 0;
+    const char        *lptrc_unixPath = NULL;
+    // every request's payload, instead of -s bytes of filler (NULL: filler)
+    const char        *lptrc_text = NULL;
+    //
+    int li_option;
+    //
+    while ((li_option = getopt(argc, argv, "t:c:s:r:d:n:xFeu:p:")) != -1) {
+        switch (li_option) {
+            case 't':
+                li_threads = atoi(optarg);
+                break;
+            case 'c':
+                li_connections = atoi(optarg);
+                break;
+            case 's':
+                ll_size = atol(optarg);
+                break;
+            case 'r':
+                ld_rate = atof(optarg);
+                break;
+            case 'd':
+                ld_duration = atof(optarg);
+                break;
+            case 'n':
+                lul_requests = strtoull(optarg, NULL, 10);
+                break;
+            case 'x':
+                gO_config.mi_text = 1;
+                break;
+            case 'F':
+                gO_config.mi_fastOpen = 1;
+                break;
+            case 'e':
+                gO_config.mi_binary = 1;
+                break;
+            case 'u':
+                lptrc_unixPath = optarg;
+                break;
+            case 'p':
+                lptrc_text = optarg;
+                ll_size = (long) strlen(optarg);
+                break;
+            default:
+                fv_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (li_connections == 0) {
+        li_connections = li_threads;
+    }
+    //
+    if ((argc - optind < 2 && lptrc_unixPath == NULL) ||
+        li_threads < 1 || li_connections < li_threads ||
+        ll_size < 1 || (gO_config.mi_text && ll_size > BUFFER_SIZE - 1) ||
+        (lptrc_text && ll_size != (long) strlen(lptrc_text)) ||
+        (gO_config.mi_fastOpen && (!gO_config.mi_text || lptrc_unixPath != NULL)) ||
+        (gO_config.mi_binary && (gO_config.mi_text ||
+                                 ll_size > IPC_MESSAGE_SIZE_MAX - IPC_MESSAGE_HEADER_SIZE - IPC_MESSAGE_BLOB_SIZE)) ||
+        ld_rate < 0 || ld_duration <= 0) {
+        fv_usage(argv[0]);
+        //
+        return EXIT_FAILURE;
+    }
+
+
+    // where to connect to
+    if (lptrc_unixPath) {
+        struct sockaddr_un *lptrO_address = (struct sockaddr_un *) &gO_config.mO_address;
+        //
+        if (strlen(lptrc_unixPath) >= sizeof(lptrO_address->sun_path)) {
+            errno = ENAMETOOLONG;
+            fv_logErrorEXIT("connect", -1);
+        }
+        lptrO_address->sun_family = AF_UNIX;
+        strcpy(lptrO_address->sun_path, lptrc_unixPath);
+        gO_config.mui_addressSize = sizeof(*lptrO_address);
+    } else {
+        struct sockaddr_in *lptrO_address = (struct sockaddr_in *) &gO_config.mO_address;
+        //
+        lptrO_address->sin_family = AF_INET;
+        lptrO_address->sin_port = htons(atoi(argv[optind + 1]));
+        //
+        if (inet_pton(AF_INET, argv[optind], &lptrO_address->sin_addr) <= 0) {
+            fprintf(stderr, "Invalid address/ Address not supported: %s\n", argv[optind]);
+            return EXIT_FAILURE;
+        }
+        gO_config.mui_addressSize = sizeof(*lptrO_address);
+    }
+
+
+    // every request carries the same payload; encode it once
+    char *lptrc_payload = malloc(ll_size);
+    //
+    gO_config.msz_request = gO_config.mi_text ? (size_t) ll_size : IPC_FRAME_HEADER_SIZE + (size_t) ll_size;
+    //
+    if (gO_config.mi_binary) {
+        gO_config.msz_request += IPC_MESSAGE_HEADER_SIZE + IPC_MESSAGE_BLOB_SIZE;
+    }
+    gO_config.mptrc_request = malloc(gO_config.msz_request);
+    //
+    if (lptrc_payload == NULL || gO_config.mptrc_request == NULL) {
+        fv_logErrorEXIT("malloc", -1);
+    }
+    // a text line; it must not start with the frame magic byte
+    if (lptrc_text) {
+        memcpy(lptrc_payload, lptrc_text, ll_size);
+    } else {
+        memset(lptrc_payload, 'x', ll_size);
+        lptrc_payload[ll_size - 1] = '\n';
+    }
+    //
+    if (gO_config.mi_text) {
+        memcpy(gO_config.mptrc_request, lptrc_payload, ll_size);
+    } else if (gO_config.mi_binary) {
+        // the note right behind its frame header, the payload as its only blob
+        struct ipc_frameHeader lO_header;
+        struct iovec           lO_blob = { lptrc_payload, ll_size };
+        //
+        lO_header.mus_type = IPC_FRAME_MESSAGE;
+        lO_header.mui_requestID = 0;
+        lO_header.mul_length = fsz_messageEncode(gO_config.mptrc_request + IPC_FRAME_HEADER_SIZE,
+                                                 gO_config.msz_request - IPC_FRAME_HEADER_SIZE,
+                                                 IPC_MESSAGE_NOTE, 0, 0, 0, &lO_blob, 1);
+        fv_frameHeaderEncode(&lO_header, (unsigned char *) gO_config.mptrc_request);
+    } else {
+        fsz_frameEncode(gO_config.mptrc_request, gO_config.msz_request,
+                        IPC_FRAME_REQUEST, 0, lptrc_payload, ll_size);
+    }
+    free(lptrc_payload);
+    //
+    if (ld_rate > 0) {
+        gO_config.mul_stagger = (uint64_t) (1e9 / ld_rate);
+        gO_config.mul_interval = gO_config.mul_stagger * li_connections;
+        //
+        if (gO_config.mul_interval == 0) {
+            gO_config.mul_interval = 1;
+        }
+    }
+
+
+    // one descriptor per connection, plus a few
+    struct rlimit lO_limit;
+    //
+    if (getrlimit(RLIMIT_NOFILE, &lO_limit) == 0 && lO_limit.rlim_cur < (rlim_t) li_connections + 64) {
+        lO_limit.rlim_cur = lO_limit.rlim_max < (rlim_t) li_connections + 64 ? lO_limit.rlim_max
+                                                                             : (rlim_t) li_connections + 64;
+        setrlimit(RLIMIT_NOFILE, &lO_limit);
+    }
+    //
+    struct ipc_loadThread     *lptrO_a1_threads = calloc(li_threads, sizeof(struct ipc_loadThread));
+    struct ipc_loadConnection *lptrO_a1_connections = calloc(li_connections, sizeof(struct ipc_loadConnection));
+    //
+    if (lptrO_a1_threads == NULL || lptrO_a1_connections == NULL) {
+        fv_logErrorEXIT("calloc", -1);
+    }
+    pthread_barrier_init(&gO_ready, NULL, li_threads + 1);
+    pthread_barrier_init(&gO_go, NULL, li_threads + 1);
+    //
+    // thread i gets a contiguous share of the connections, and of the requests
+    for (int i = 0, li_first = 0; i < li_threads; ++i) {
+        struct ipc_loadThread *lptrO_thread = &lptrO_a1_threads[i];
+        int                    li_share = li_connections / li_threads + (i < li_connections % li_threads);
+        //
+        lptrO_thread->mptrO_config = &gO_config;
+        lptrO_thread->mptrO_a1_connections = lptrO_a1_connections + li_first;
+        lptrO_thread->mui_connections = li_share;
+        lptrO_thread->mul_quota = lul_requests == 0 ? UINT64_MAX
+                                                    : lul_requests / li_threads + ((unsigned long long) i < lul_requests % li_threads);
+        fv_histogramInit(&lptrO_thread->mO_histogram);
+        //
+        for (int j = 0; j < li_share; ++j) {
+            lptrO_thread->mptrO_a1_connections[j].mptrO_thread = lptrO_thread;
+            lptrO_thread->mptrO_a1_connections[j].mui_index = li_first + j;
+        }
+        li_first += li_share;
+        //
+        if ((errno = pthread_create(&lptrO_thread->mO_thread, NULL, fptrv_loadThread, lptrO_thread)) != 0) {
+            fv_logErrorEXIT("pthread_create", -1);
+        }
+    }
+    //
+    pthread_barrier_wait(&gO_ready);
+    gO_config.mul_start = ful_now();
+    gO_config.mul_deadline = gO_config.mul_start + (uint64_t) (ld_duration * 1e9);
+    pthread_barrier_wait(&gO_go);
+
+
+    struct ipc_histogram *lptrO_histogram = malloc(sizeof(struct ipc_histogram));
+    uint64_t              lul_errors = 0,
+                          lul_unanswered = 0,
+                          lul_rejected = 0;
+    //
+    if (lptrO_histogram == NULL) {
+        fv_logErrorEXIT("malloc", -1);
+    }
+    fv_histogramInit(lptrO_histogram);
+    //
+    for (int i = 0; i < li_threads; ++i) {
+        pthread_join(lptrO_a1_threads[i].mO_thread, NULL);
+        //
+        fv_histogramMerge(lptrO_histogram, &lptrO_a1_threads[i].mO_histogram);
+        lul_errors += lptrO_a1_threads[i].mul_errors;
+        lul_unanswered += lptrO_a1_threads[i].mul_unanswered;
+        lul_rejected += lptrO_a1_threads[i].mul_rejected;
+    }
+    double ld_elapsed = (ful_now() - gO_config.mul_start) / 1e9;
+
+
+    // for people: the whole distribution, in microseconds
+    fv_histogramPrint(lptrO_histogram, stderr, 5, 1000.0);
+    //
+    // for scripts: one JSON object, latencies in nanoseconds
+    printf("{\"protocol\":\"%s\",\"loop\":\"%s\",\"transport\":\"%s\","
+           "\"threads\":%d,\"connections\":%d,\"request_bytes\":%ld,\"rate\":%.1f,"
+           "\"duration_s\":%.3f,\"requests\":%llu,\"errors\":%llu,\"unanswered\":%llu,\"rejected\":%llu,"
+           "\"throughput_rps\":%.1f,"
+           "\"latency_ns\":{\"min\":%llu,\"mean\":%.0f,\"p50\":%llu,\"p90\":%llu,"
+           "\"p99\":%llu,\"p999\":%llu,\"p9999\":%llu,\"max\":%llu}}\n",
+           gO_config.mi_text ? "text" : gO_config.mi_binary ? "binary" : "framed",
+           ld_rate > 0 ? "open" : "closed",
+           lptrc_unixPath ? "unix" : "tcp",
+           li_threads, li_connections, ll_size, ld_rate,
+           ld_elapsed,
+           (unsigned long long) lptrO_histogram->mul_total,
+           (unsigned long long) lul_errors,
+           (unsigned long long) lul_unanswered,
+           (unsigned long long) lul_rejected,
+           lptrO_histogram->mul_total / ld_elapsed,
+           (unsigned long long) (lptrO_histogram->mul_total ? lptrO_histogram->mul_min : 0),
+           lptrO_histogram->mul_total ? (double) lptrO_histogram->mul_sum / lptrO_histogram->mul_total : 0.0,
+           (unsigned long long) ful_histogramPercentile(lptrO_histogram, 50),
+           (unsigned long long) ful_histogramPercentile(lptrO_histogram, 90),
+           (unsigned long long) ful_histogramPercentile(lptrO_histogram, 99),
+           (unsigned long long) ful_histogramPercentile(lptrO_histogram, 99.9),
+           (unsigned long long) ful_histogramPercentile(lptrO_histogram, 99.99),
+           (unsigned long long) lptrO_histogram->mul_max);
+    //
+    free(lptrO_histogram);
+    free(lptrO_a1_threads);
+    free(lptrO_a1_connections);
+    free(gO_config.mptrc_request);
+    //
+    return lul_errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,178 @@
+/*
+ * Load-balancing forwarding proxy for the servers
+ * Listens on a port and relays every connection to one of several backend servers,
+ * e.g. a few server_connectionOrientedConcurrent processes on other ports or hosts,
+ * picked round-robin, by fewest connections, or by consistent hashing of the request key
+ * Text clients and framed clients (client -p, loadgen) pass through it unchanged
+ * References:
+ *  man 2 splice
+ */
+#include <arpa/inet.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "ipc_log.h"    // log lines written by a thread of their own
+#include "ipc_proxy.h"  // the relaying event loop
+
+void fv_logErrorEXIT(const char *cptrc_errorMessage, int pi_socket_fd) {
+    //
+    // print a system error message on stderr, behind the lines still queued
+    IPC_LOGE("%s: %m", cptrc_errorMessage);
+    //
+    if (pi_socket_fd >= 0) {
+        close(pi_socket_fd);
+    }
+    // cause normal process (unsuccessful) termination
+    exit(EXIT_FAILURE);
+}
+
+void fv_usage(const char *cptrc_program) {
+    fprintf(stderr,
+            "usage %s [-p policy] [-i milliseconds] [-k connections] [-T ms[,ms]] [-l level] port host:port...\n"
+            "  -p  how a backend is picked: rr (round-robin, default), least (fewest connections),\n"
+            "      or hash (consistent hashing of the first line, or of a frame's first payload bytes)\n"
+            "  -i  interval between two health checks of a backend (default: 1000)\n"
+            "  -k  idle backend connections kept per backend for framed clients, at most %d (default: 8)\n"
+            "  -T  close a session not relaying within ms milliseconds (default: 10000): its first request\n"
+            "      incomplete, or its backend not connected; or, with the second ms, idle that long while relaying\n"
+            "  -l  log level: error, warn, info (default) or debug\n",
+            cptrc_program, IPC_PROXY_IDLE_MAX);
+}
+
+/*
+ * Parse "host:port", the host as a dotted IPv4 address
+ * Returns 0, or -1 if it is not one
+ */
+static int fi_backendParse(const char *cptrc_text, struct sockaddr_in *pptrO_address) {
+    //
+    char        lc_a1_host[INET_ADDRSTRLEN];
+    const char *lptrc_colon = strrchr(cptrc_text, ':');
+    //
+    if (lptrc_colon == NULL || (size_t) (lptrc_colon - cptrc_text) >= sizeof(lc_a1_host)) {
+        return -1;
+    }
+    memcpy(lc_a1_host, cptrc_text, lptrc_colon - cptrc_text);
+    lc_a1_host[lptrc_colon - cptrc_text] = '\0';
+    //
+    int li_port = atoi(lptrc_colon + 1);
+    //
+    memset(pptrO_address, 0, sizeof(*pptrO_address));
+    pptrO_address->sin_family = AF_INET;
+    pptrO_address->sin_port = htons(li_port);
+    //
+    if (li_port < 1 || li_port > 65535 || inet_pton(AF_INET, lc_a1_host, &pptrO_address->sin_addr) <= 0) {
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    //
+    static struct ipc_proxyConfig lO_config;
+    int                           li_logLevel = IPC_LOG_INFO;
+    //
+    lO_config.me_policy = IPC_PROXY_ROUND_ROBIN;
+    lO_config.mi_checkMilliseconds = 1000;
+    lO_config.mi_idleMax = 8;
+    lO_config.mi_firstMilliseconds = 10000;
+    //
+    int li_option;
+    //
+    while ((li_option = getopt(argc, argv, "p:i:k:T:l:")) != -1) {
+        switch (li_option) {
+            case 'p':
+                if (strcmp(optarg, "rr") == 0) {
+                    lO_config.me_policy = IPC_PROXY_ROUND_ROBIN;
+                } else if (strcmp(optarg, "least") == 0) {
+                    lO_config.me_policy = IPC_PROXY_LEAST_CONNECTIONS;
+                } else if (strcmp(optarg, "hash") == 0) {
+                    lO_config.me_policy = IPC_PROXY_HASH;
+                } else {
+                    fv_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'i':
+                lO_config.mi_checkMilliseconds = atoi(optarg);
+                break;
+            case 'k':
+                lO_config.mi_idleMax = atoi(optarg);
+                break;
+            case 'T':
+                if (sscanf(optarg, "%d,%d", &lO_config.mi_firstMilliseconds, &lO_config.mi_idleMilliseconds) < 1) {
+                    lO_config.mi_firstMilliseconds = -1;
+                }
+                break;
+            case 'l':
+                li_logLevel = fi_logLevelParse(optarg);
+                break;
+            default:
+                fv_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (argc - optind < 2 || argc - optind - 1 > IPC_PROXY_BACKENDS_MAX ||
+        lO_config.mi_checkMilliseconds < 1 ||
+        lO_config.mi_idleMax < 0 || lO_config.mi_idleMax > IPC_PROXY_IDLE_MAX ||
+        lO_config.mi_firstMilliseconds < 1 || lO_config.mi_idleMilliseconds < 0 ||
+        li_logLevel < 0) {
+        fv_usage(argv[0]);
+        //
+        return EXIT_FAILURE;
+    }
+    for (int i = optind + 1; i < argc; ++i) {
+        if (fi_backendParse(argv[i], &lO_config.mO_a1_backends[lO_config.mi_backends++]) < 0) {
+            fprintf(stderr, "Invalid backend (host:port): %s\n", argv[i]);
+            return EXIT_FAILURE;
+        }
+    }
+    //
+    // a peer closing mid-relay must not kill the proxy: splice() cannot be told MSG_NOSIGNAL
+    signal(SIGPIPE, SIG_IGN);
+    //
+    fv_logSetLevel(li_logLevel);
+    //
+    if (fi_logInit() < 0) {
+        fv_logErrorEXIT("logging", -1);
+    }
+
+
+    // the listening socket, as the servers make theirs
+    int li_socketConn_fd = socket(AF_INET, SOCK_STREAM, 0),
+        li_socket_optionValue = 1;
+    //
+    if (li_socketConn_fd < 0) {
+        fv_logErrorEXIT("socket failed", li_socketConn_fd);
+    }
+    if (setsockopt(li_socketConn_fd, SOL_SOCKET, SO_REUSEADDR,
+                   &li_socket_optionValue, sizeof(li_socket_optionValue)) < 0) {
+        fv_logErrorEXIT("setsockopt", li_socketConn_fd);
+    }
+    //
+    struct sockaddr_in lO_addressProxy;
+    memset(&lO_addressProxy, 0, sizeof(lO_addressProxy));
+    lO_addressProxy.sin_family = AF_INET;
+    lO_addressProxy.sin_addr.s_addr = INADDR_ANY;
+    lO_addressProxy.sin_port = htons(atoi(argv[optind]));
+    //
+    if (bind(li_socketConn_fd, (struct sockaddr *) &lO_addressProxy, sizeof(lO_addressProxy)) < 0) {
+        fv_logErrorEXIT("bind failed", li_socketConn_fd);
+    }
+    if (listen(li_socketConn_fd, SOMAXCONN) < 0) {
+        fv_logErrorEXIT("listen", li_socketConn_fd);
+    }
+    IPC_LOGI("proxy on port %s, %d backend(s)", argv[optind], lO_config.mi_backends);
+
+
+    // relay connections forever
+    fi_proxyServe(li_socketConn_fd, &lO_config);
+    //
+    fv_logErrorEXIT("proxy", li_socketConn_fd);
+}
@@ -4,35 +4,81 @@
  * Server in the Internet domain uses TCP/IPv4 protocol
  * The port number is passed as an argument
  * Server runs forever,
- *      forking off separate process for each connection
+ *      forking off separate process for each connection (default mode), or
+ *      serving every connection from a single epoll event loop (-m epoll), or
+ *      handing connections to a pool of pre-forked, CPU-pinned workers (-m prefork), or
+ *      dispatching connections to a pool of threads through work-stealing deques (-m threads), or
+ *      driving accept/recv/send through one io_uring instance (-m uring, built with -DIPC_WITH_URING), or
+ *      serving same-host clients through shared-memory rings instead of TCP (-m shm), or
+ *      relaying messages published by framed clients to the subscribers of their topic (-m broker), or
+ *      acknowledging UDP datagrams in batches, without any connection (-m udp)
+ * With -u, the server listens on a Unix domain socket instead of a TCP port,
+ * and local clients may pass it file descriptors (SCM_RIGHTS) along with their message
+ * Framed clients may also fetch bulk data: a file under the -b directory (sent with sendfile)
+ * or a part of an in-memory region (sent with MSG_ZEROCOPY)
+ * With -R, a new server takes over the listening socket of the running one (hot restart),
+ * which finishes its connections and exits: no connection is refused across the restart
+ * With -K, the server is also a local cache: messages reading !GET, !SET or !DEL are run
+ * against an in-memory key-value store shared by all its workers, and answered with the result
+ * With -O throughput, replies to framed clients are corked (TCP_CORK) until no request is left
+ * to read, so that pipelined replies share segments; by default they leave at once (TCP_NODELAY)
+ * With -T, a connection waiting too long for a message, or for its client to take a reply, is closed
  * References:
  *  https://www.linuxhowtos.org/C_C++/socket.htm
  */
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
+#include <signal.h>
 // #include <sys/types.h>  // definitions of data types, used in system calls by sys/socket.h and netinet/in.h
 #include <sys/socket.h>  // definitions of structures needed for sockets
+#include <sys/un.h>      // structure needed for unix domain addresses
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
 #include <netinet/in.h>  // constants and structures needed for internet domain addresses
 
-// #define PORT 8080
-#define BUFFER_SIZE 1024
+#include "ipc_common.h"  // BUFFER_SIZE, acknowledgement message
+#include "ipc_epoll.h"   // event-loop serving mode
+#include "ipc_broker.h"  // publish/subscribe serving mode
+#include "ipc_prefork.h" // pre-forked worker pool serving mode
+#include "ipc_uring.h"   // io_uring serving mode
+#include "ipc_threadpool.h"  // thread-pool serving mode
+#include "ipc_frame.h"   // length-prefixed framing
+#include "ipc_shm.h"     // shared-memory transport
+#include "ipc_bulk.h"    // zero-copy bulk responses
+#include "ipc_udp.h"     // datagram serving mode
+#include "ipc_pool.h"    // pooled I/O buffers
+#include "ipc_log.h"     // asynchronous logging
+#include "ipc_metrics.h" // counters and latency histograms
+#include "ipc_accept.h"  // accept batching and admission control
+#include "ipc_busypoll.h" // spin-then-block reads, CPU pinning
+#include "ipc_service.h" // simulated service time
+#include "ipc_message.h" // compact binary messages
+#include "ipc_handoff.h" // hot restart
+#include "ipc_kv.h"      // key-value commands
+#include "ipc_output.h"  // gathered replies, TCP_NODELAY or TCP_CORK
+#include "ipc_timer.h"   // idle and write deadlines
 
-void fv_delay() {
-    for (int i = 0; i < 99999; ++i)
-        ;
-}
+// #define PORT 8080
+// default maximum length of the queue of pending connections (the kernel caps it at net.core.somaxconn)
+#define LISTEN_BACKLOG SOMAXCONN
 
 void fv_serve(int);
+void fv_serveFramed(int);
+void fv_servePayload(int);
 
 void fv_logErrorEXIT(const char *cptrc_errorMessage,
                      int pi_socketConn_fd,
                      int pi_socketRW_fd)
 {
     //
-    // print a system error message on stderr
-    perror(cptrc_errorMessage);
+    // print a system error message on stderr, behind the lines still queued
+    IPC_LOGE("%s: %m", cptrc_errorMessage);
     //
     if (pi_socketConn_fd >= 0) {
         close(pi_socketConn_fd);
@@ -46,31 +92,324 @@ void fv_logErrorEXIT(const char *cptrc_errorMessage,
     exit(EXIT_FAILURE);
 }
 
-int main(int argc, char const *argv[]) {
+void fv_usage(const char *cptrc_program) {
+    fprintf(stderr,
+            "Usage %s [-m fork|epoll|prefork|uring|threads|shm|broker|udp] [option...] port | -u path\n"
+            "       %s [-m fork|epoll|prefork|uring|threads|shm] [-w workers] [-c] [-b dir] [-H] [-l level]\n"
+            "          [-k backlog] [-D seconds] [-F queue] [-a limit] [-P us] [-C cpus] [-S time] [-R path]\n"
+            "          [-K megabytes] [-O policy] [-T ms[,ms]] port\n"
+            "       %s [-m fork|epoll|uring|threads] [-b dir] [-H] [-l level] [-k backlog] [-a limit]\n"
+            "          [-P us] [-C cpus] [-S time] [-R path] [-K megabytes] [-O policy] [-T ms[,ms]]\n"
+            "          -u path [-q]\n"
+            "       %s -m broker [-Q messages[,policy]] [-H] [-l level] [-k backlog] [-a limit] [-u path] port\n"
+            "       %s -m udp [-g] [-l level] port\n"
+            "  -m  serving mode (default: fork); uring needs a build with -DIPC_WITH_URING;\n"
+            "      shm serves the shared-memory endpoint /c-ipc-<port> instead of the TCP port;\n"
+            "      broker relays the messages framed clients publish to the subscribers of their topic;\n"
+            "      udp serves datagrams on the UDP port\n"
+            "  -w  number of pre-forked workers or pooled threads (default: one per online CPU)\n"
+            "  -c  steer each worker's socket with SO_INCOMING_CPU\n"
+            "  -u  listen on the Unix domain socket at path instead of a TCP port\n"
+            "  -q  use SOCK_SEQPACKET (message boundaries kept) instead of SOCK_STREAM for -u\n"
+            "  -b  let framed clients fetch the files under dir (default: in-memory data only)\n"
+            "  -g  receive datagrams coalesced (UDP GRO) and send acknowledgements segmented (UDP GSO)\n"
+            "  -H  back the pooled I/O buffers with huge pages (falls back to transparent ones)\n"
+            "  -l  most verbose log lines written: error, warn, info (default) or debug\n"
+            "  -k  length of the queue of pending connections (default: SOMAXCONN)\n"
+            "  -D  TCP_DEFER_ACCEPT: accept a connection only once its first data arrived, waiting up to seconds\n"
+            "  -F  TCP_FASTOPEN: accept data in the SYN, with up to queue such connections pending\n"
+            "  -a  serve at most limit connections at once, reject the others with a short reply\n"
+            "  -P  spin up to us microseconds on a connection before blocking in a read (also SO_BUSY_POLL)\n"
+            "  -C  run on these CPUs only, e.g. 2-3,6 or isolated; pooled threads are pinned one per CPU\n"
+            "  -S  simulated service time per request, in microseconds: us, or uniform:min-max\n"
+            "  -R  hot restart through the Unix domain socket at path: take over the listening socket\n"
+            "      of the server running with the same -R, which drains and exits (fork, threads, epoll)\n"
+            "  -K  answer !GET key, !SET key value and !DEL key messages from an in-memory store of\n"
+            "      about megabytes, shared by all workers (fork, prefork, threads, epoll)\n"
+            "  -O  replies to framed clients: latency (default: sent at once, TCP_NODELAY) or\n"
+            "      throughput (TCP_CORK, sent once no request is left to read) (fork, prefork, threads)\n"
+            "  -T  close a connection waiting longer than ms milliseconds for a message, or than the\n"
+            "      second ms (default: the first) for its client to take a reply (fork, prefork, threads, epoll)\n"
+            "  -Q  messages a subscriber may have waiting (default: 1024), and what happens to one further\n"
+            "      behind: drop (default: it misses the messages that do not fit) or close (broker)\n",
+            cptrc_program, cptrc_program, cptrc_program, cptrc_program, cptrc_program);
+}
+
+int main(int argc, char *argv[]) {
+    //
+    // how accepted connections are served
+    const char *lptrc_mode = "fork";
+    // pre-forked pool size
+    int li_workers = (int) sysconf(_SC_NPROCESSORS_ONLN),
+        li_incomingCpu = 0;
+    // local listener instead of TCP, and its socket type
+    const char *lptrc_unixPath = NULL;
+    int         li_unixType = SOCK_STREAM;
+    // directory of the files served to fetch requests
+    const char *lptrc_bulkRoot = NULL;
+    // UDP generic receive offload / segmentation offload
+    int         li_segmentation = 0;
+    // pooled I/O buffers on huge pages
+    int         li_hugePages = 0;
+    // log lines written (debug lines also need a build with -DIPC_LOG_COMPILED_LEVEL=IPC_LOG_DEBUG)
+    int         li_logLevel = IPC_LOG_INFO;
+    // connection storms: pending-connection queue, listener tuning, connections in service at once (0: no limit)
+    int         li_backlog = LISTEN_BACKLOG,
+                li_deferSeconds = 0,
+                li_fastOpenQueue = 0,
+                li_admissionLimit = 0;
+    // low latency: spin before blocking in a read, CPUs to run on (NULL: any)
+    int         li_spinMicroseconds = 0;
+    const char *lptrc_cpus = NULL;
+    // simulated work per request (NULL: none)
+    const char *lptrc_serviceTime = NULL;
+    // control socket of hot restarts (NULL: none)
+    const char *lptrc_handoffPath = NULL;
+    // memory of the key-value store (0: no store)
+    long        ll_storeMegabytes = 0;
+    // when replies to framed clients leave (NULL: at once)
+    const char *lptrc_outputPolicy = NULL;
+    // connection deadlines, in milliseconds (0: none)
+    int         li_idleMilliseconds = 0,
+                li_writeMilliseconds = -1;
+    // subscriber queues of the broker (0: the default depth), and what a full one does
+    int         li_queueDepth = 0;
+    const char *lptrc_overflow = "drop";
+    //
+    int li_option;
     //
-    if (argc < 2) {
+    while ((li_option = getopt(argc, argv, "m:w:cu:qb:gHl:k:D:F:a:P:C:S:R:K:O:T:Q:")) != -1) {
+        switch (li_option) {
+            case 'm':
+                lptrc_mode = optarg;
+                break;
+            case 'w':
+                li_workers = atoi(optarg);
+                break;
+            case 'c':
+                li_incomingCpu = 1;
+                break;
+            case 'u':
+                lptrc_unixPath = optarg;
+                break;
+            case 'q':
+                li_unixType = SOCK_SEQPACKET;
+                break;
+            case 'b':
+                lptrc_bulkRoot = optarg;
+                break;
+            case 'g':
+                li_segmentation = 1;
+                break;
+            case 'H':
+                li_hugePages = 1;
+                break;
+            case 'l':
+                li_logLevel = fi_logLevelParse(optarg);
+                break;
+            case 'k':
+                li_backlog = atoi(optarg);
+                break;
+            case 'D':
+                li_deferSeconds = atoi(optarg);
+                break;
+            case 'F':
+                li_fastOpenQueue = atoi(optarg);
+                break;
+            case 'a':
+                li_admissionLimit = atoi(optarg);
+                break;
+            case 'P':
+                li_spinMicroseconds = atoi(optarg);
+                break;
+            case 'C':
+                lptrc_cpus = optarg;
+                break;
+            case 'S':
+                lptrc_serviceTime = optarg;
+                break;
+            case 'R':
+                lptrc_handoffPath = optarg;
+                break;
+            case 'K':
+                ll_storeMegabytes = atol(optarg);
+                break;
+            case 'O':
+                lptrc_outputPolicy = optarg;
+                break;
+            case 'T':
+                if (sscanf(optarg, "%d,%d", &li_idleMilliseconds, &li_writeMilliseconds) < 1) {
+                    li_idleMilliseconds = -1;
+                }
+                break;
+            case 'Q':
+                if ((li_queueDepth = atoi(optarg)) < 1) {
+                    li_queueDepth = -1;
+                }
+                if (strchr(optarg, ',') != NULL) {
+                    lptrc_overflow = strchr(optarg, ',') + 1;
+                }
+                break;
+            default:
+                fv_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    //
+    if ((optind >= argc && lptrc_unixPath == NULL) ||
+        li_workers < 1 ||
+        li_logLevel < 0 ||
+        li_backlog < 1 || li_deferSeconds < 0 || li_fastOpenQueue < 0 || li_admissionLimit < 0 ||
+        li_spinMicroseconds < 0 || ll_storeMegabytes < 0 ||
+        li_idleMilliseconds < 0 || li_writeMilliseconds < -1 ||
+        li_queueDepth < 0 || (strcmp(lptrc_overflow, "drop") != 0 && strcmp(lptrc_overflow, "close") != 0) ||
+        fi_serviceInit(lptrc_serviceTime) < 0 ||
+        (lptrc_outputPolicy != NULL && fi_outputSetPolicy(lptrc_outputPolicy) < 0) ||
+        // TCP options
+        ((li_deferSeconds > 0 || li_fastOpenQueue > 0) && lptrc_unixPath != NULL) ||
+        // hot restart: the modes accepting from the one listening socket
+        (lptrc_handoffPath != NULL && strcmp(lptrc_mode, "fork") != 0 &&
+                                      strcmp(lptrc_mode, "threads") != 0 &&
+                                      strcmp(lptrc_mode, "epoll") != 0) ||
+        // key-value store: the modes serving messages through fv_serve() or the epoll loop
+        (ll_storeMegabytes > 0 && (strcmp(lptrc_mode, "uring") == 0 ||
+                                   strcmp(lptrc_mode, "shm") == 0 ||
+                                   strcmp(lptrc_mode, "broker") == 0 ||
+                                   strcmp(lptrc_mode, "udp") == 0)) ||
+        // reply policy: the modes serving framed clients through fv_serveFramed()
+        (lptrc_outputPolicy != NULL && strcmp(lptrc_mode, "fork") != 0 &&
+                                       strcmp(lptrc_mode, "prefork") != 0 &&
+                                       strcmp(lptrc_mode, "threads") != 0) ||
+        // deadlines: the modes serving connections through fv_serve() or the epoll loop
+        (li_idleMilliseconds > 0 && (strcmp(lptrc_mode, "uring") == 0 ||
+                                     strcmp(lptrc_mode, "shm") == 0 ||
+                                     strcmp(lptrc_mode, "broker") == 0 ||
+                                     strcmp(lptrc_mode, "udp") == 0)) ||
+        // Unix domain sockets cannot share a path through SO_REUSEPORT
+        (lptrc_unixPath != NULL && (strcmp(lptrc_mode, "prefork") == 0 ||
+                                    strcmp(lptrc_mode, "shm") == 0 ||
+                                    strcmp(lptrc_mode, "udp") == 0)) ||
+        (li_segmentation && strcmp(lptrc_mode, "udp") != 0) ||
+        // the broker reads frames off a byte stream
+        (strcmp(lptrc_mode, "broker") == 0 && li_unixType == SOCK_SEQPACKET) ||
+        (li_queueDepth > 0 && strcmp(lptrc_mode, "broker") != 0) ||
+        (strcmp(lptrc_mode, "fork") != 0 &&
+         strcmp(lptrc_mode, "epoll") != 0 &&
+         strcmp(lptrc_mode, "broker") != 0 &&
+         strcmp(lptrc_mode, "prefork") != 0 &&
+         strcmp(lptrc_mode, "uring") != 0 &&
+         strcmp(lptrc_mode, "threads") != 0 &&
+         strcmp(lptrc_mode, "shm") != 0 &&
+         strcmp(lptrc_mode, "udp") != 0)) {
         //
-        fprintf(stderr, "Usage %s port\n", argv[0]);
+        fv_usage(argv[0]);
         //
         return EXIT_FAILURE;
     }
+    // the write deadline defaults to the idle one
+    fv_timeoutSet(li_idleMilliseconds, li_writeMilliseconds < 0 ? li_idleMilliseconds : li_writeMilliseconds);
+    //
+    // the port is the only positional argument
+    const char *lptrc_port = lptrc_unixPath ? lptrc_unixPath : argv[optind];
+    //
+    // a client that disconnects mid-reply must not kill the process serving it:
+    // sendfile() and splice() cannot be told MSG_NOSIGNAL
+    signal(SIGPIPE, SIG_IGN);
+    //
+    // before any connection borrows a buffer, so that every slab gets the same backing
+    fv_poolInit(li_hugePages);
+    //
+    // connections are logged through a ring, written out by a thread of its own,
+    // so that a slow terminal never holds up serving them
+    fv_logSetLevel(li_logLevel);
+    //
+    if (fi_logInit() < 0) {
+        fv_logErrorEXIT("logging", -1, -1);
+    }
+    //
+    // <optional>
+    // counters and latency histograms, for any tool on this host to scrape (./client -M)
+    if (fi_metricsInit(lptrc_port) < 0) {
+        IPC_LOGW("Metrics unavailable: %m");
+    }
+    //
+    // <optional>
+    // connections beyond the limit are turned away at once, whichever process accepts them
+    if (fi_admissionInit(li_admissionLimit) < 0) {
+        fv_logErrorEXIT("admission control", -1, -1);
+    }
+    //
+    // <optional>
+    // confined to the chosen CPUs before any worker or thread is started, so that all inherit it
+    if (fi_busyPollInit(li_spinMicroseconds, lptrc_cpus) < 0) {
+        fv_logErrorEXIT("CPU list", -1, -1);
+    }
+    //
+    // <optional>
+    // in a shared mapping made before any worker is forked or started, so that all serve one store
+    if (fi_kvInit((size_t) ll_storeMegabytes << 20) < 0) {
+        fv_logErrorEXIT("key-value store", -1, -1);
+    }
+
+
+    /* [0]
+     * <optional>
+     * Same-host clients only: no socket at all,
+     * messages travel through rings in a shared-memory region named after the port
+     */
+    if (strcmp(lptrc_mode, "shm") == 0) {
+        printf("\n1. Server creating a shared-memory endpoint: ");
+        //
+        // returns only if the region could not be set up
+        fi_shmServe(lptrc_port);
+        //
+        fv_logErrorEXIT("shm", -1, -1);
+    }
 
 
     /* [1]
      * create a new socket: one endpoint for communication
      * communication domain: specifies implementation-dependent address family,
      *  AF_INET: IPv4 protocol
+     *  AF_UNIX: local communication, no TCP/IP processing at all (with -u)
      * socket type: decides semantics of communication over the socket,
      *  SOCK_STREAM: provides TCP - sequenced, reliable, bidirectional, connection-mode byte streams, and may provide a transmission mechanism for out-of-band data
+     *  SOCK_SEQPACKET: like SOCK_STREAM, but every send() arrives as one separate record (AF_UNIX with -q)
+     *  SOCK_DGRAM: provides UDP - connectionless, unreliable datagrams of a fixed maximum length (-m udp)
      * protocol 0: use a default protocol appropriate for the requested socket type
      *  appears on protocol field in the IP header of a packet.
      * returns non-negative socket file descriptor (i.e., array subscript into the file descriptor table)
      */
-    printf("\n1. Server creating a new socket endpoint\nfor communication using default TCP/IPv4 protocol with socket id");
+    int li_datagram = strcmp(lptrc_mode, "udp") == 0;
+    //
+    // <optional>
+    // hot restart: the listening socket of the server running now, if any, already bound and listening
+    int li_inherited_fd = -1;
+    //
+    if (lptrc_handoffPath) {
+        li_inherited_fd = fi_handoffInherit(lptrc_handoffPath);
+        //
+        if (li_inherited_fd < 0 && errno != ENOENT && errno != ECONNREFUSED) {
+            fv_logErrorEXIT("hot restart", -1, -1);
+        }
+    }
     //
-    int li_socketConn_fd = socket(AF_INET,      // internet address domain
-                                  SOCK_STREAM,  // stream socket type
-                                  0),           // default TCP protocol
+    if (li_inherited_fd >= 0) {
+        printf("\n1. Server taking over the listening socket of the running server with socket id");
+    } else if (lptrc_unixPath) {
+        printf("\n1. Server creating a new socket endpoint\nfor local communication using Unix domain %s protocol with socket id",
+               li_unixType == SOCK_SEQPACKET ? "SEQPACKET" : "STREAM");
+    } else if (li_datagram) {
+        printf("\n1. Server creating a new socket endpoint\nfor communication using UDP/IPv4 protocol with socket id");
+    } else {
+        printf("\n1. Server creating a new socket endpoint\nfor communication using default TCP/IPv4 protocol with socket id");
+    }
+    //
+    int li_socketConn_fd = li_inherited_fd >= 0 ? li_inherited_fd :
+                           lptrc_unixPath ? socket(AF_UNIX, li_unixType, 0)
+                                          : socket(AF_INET,      // internet address domain
+                                                   li_datagram ? SOCK_DGRAM : SOCK_STREAM,  // stream socket type
+                                                   0),           // default TCP (or UDP) protocol
         li_socketRW_fd = -1;
     //
     if (li_socketConn_fd < 0) {
@@ -86,16 +425,26 @@ int main(int argc, char const *argv[]) {
      * allows reuse of address and port
      * prevents error, like, “address already in use”
      * Forcefully attaching socket to the port 8080 
+     * option names are not flags: each option needs its own call
+     * SO_REUSEPORT lets several sockets (e.g., pre-forked workers) listen on the same port
      */
     printf("\n2. Manipulating the socket's options: ");
     //
     int li_socket_optionValue = 1;
     //
-    if (setsockopt(li_socketConn_fd,
-                   SOL_SOCKET,  // level
-                   SO_REUSEADDR | SO_REUSEPORT,  // optname
-                   &li_socket_optionValue,        // optval
-                   sizeof(li_socket_optionValue))) {
+    // address reuse is a TCP/IP matter: a stale Unix socket path is removed instead, below
+    // (an inherited socket has its options already)
+    if (lptrc_unixPath == NULL && li_inherited_fd < 0 &&
+        (setsockopt(li_socketConn_fd,
+                    SOL_SOCKET,  // level
+                    SO_REUSEADDR,  // optname
+                    &li_socket_optionValue,        // optval
+                    sizeof(li_socket_optionValue)) ||
+         setsockopt(li_socketConn_fd,
+                    SOL_SOCKET,
+                    SO_REUSEPORT,
+                    &li_socket_optionValue,
+                    sizeof(li_socket_optionValue)))) {
         fv_logErrorEXIT("setsockopt", li_socketConn_fd, li_socketRW_fd);
     }
     //
@@ -106,160 +455,758 @@ int main(int argc, char const *argv[]) {
      * bind the server socket to the current host's address and given port number, on which the server will run
      * specified in addr (custom data structure)
      */
-    printf("\n3. Binding the server socket to the port (%s) at address ", argv[1]);
-    //
-    // structure to store server's internet address information
-    struct sockaddr_in lO_addressServer;    // 16 bytes long
-    // set all values in the buffer to 0
-    bzero((char *) &lO_addressServer,   // pointer to the buffer
-          sizeof(lO_addressServer));    // size of the buffer
-    //
-    // code for the address family
-    lO_addressServer.sin_family = AF_INET;
-    // IP address of the host machine on which the server is running
-    lO_addressServer.sin_addr.s_addr = INADDR_ANY;
-    /*
-     * host-to-network short
-     * store numbers in memory in network byte order (BIG-endian machine)
-     * i.e., with the most significant byte, first
-     * for proper usage of transmitted packets by network protocols
+    /* [2']
+     * <optional>
+     * a Unix domain socket is bound to a path in the file system instead
      */
-    // port number on which the server will listen for and accept connections
-    lO_addressServer.sin_port = htons(atoi(argv[1]));
-    //
-    //
-    if (bind(li_socketConn_fd,
-            (struct sockaddr *) &lO_addressServer,
-             sizeof(lO_addressServer)) < 0) {
-        fv_logErrorEXIT("bind failed", li_socketConn_fd, li_socketRW_fd);
+    if (li_inherited_fd >= 0) {
+        printf("\n3. Server socket bound by the previous server: DONE!\n");
+    } else if (lptrc_unixPath) {
+        printf("\n3. Binding the server socket to the path (%s): ", lptrc_unixPath);
+        //
+        struct sockaddr_un lO_addressLocal;
+        //
+        bzero((char *) &lO_addressLocal, sizeof(lO_addressLocal));
+        lO_addressLocal.sun_family = AF_UNIX;
+        //
+        if (strlen(lptrc_unixPath) >= sizeof(lO_addressLocal.sun_path)) {
+            errno = ENAMETOOLONG;
+            fv_logErrorEXIT("bind failed", li_socketConn_fd, li_socketRW_fd);
+        }
+        strcpy(lO_addressLocal.sun_path, lptrc_unixPath);
+        // a socket file left by an earlier run would make bind() fail
+        unlink(lptrc_unixPath);
+        //
+        if (bind(li_socketConn_fd,
+                 (struct sockaddr *) &lO_addressLocal,
+                 sizeof(lO_addressLocal)) < 0) {
+            fv_logErrorEXIT("bind failed", li_socketConn_fd, li_socketRW_fd);
+        }
+        //
+        printf("DONE!\n");
+    } else {
+        printf("\n3. Binding the server socket to the port (%s) at address ", lptrc_port);
+        //
+        // structure to store server's internet address information
+        struct sockaddr_in lO_addressServer;    // 16 bytes long
+        // set all values in the buffer to 0
+        bzero((char *) &lO_addressServer,   // pointer to the buffer
+              sizeof(lO_addressServer));    // size of the buffer
+        //
+        // code for the address family
+        lO_addressServer.sin_family = AF_INET;
+        // IP address of the host machine on which the server is running
+        lO_addressServer.sin_addr.s_addr = INADDR_ANY;
+        /*
+         * host-to-network short
+         * store numbers in memory in network byte order (BIG-endian machine)
+         * i.e., with the most significant byte, first
+         * for proper usage of transmitted packets by network protocols
+         */
+        // port number on which the server will listen for and accept connections
+        lO_addressServer.sin_port = htons(atoi(lptrc_port));
+        //
+        //
+        if (bind(li_socketConn_fd,
+                (struct sockaddr *) &lO_addressServer,
+                 sizeof(lO_addressServer)) < 0) {
+            fv_logErrorEXIT("bind failed", li_socketConn_fd, li_socketRW_fd);
+        }
+        //
+        printf("%u  %X: DONE!", lO_addressServer.sin_addr.s_addr, lO_addressServer.sin_addr.s_addr);
+        //
+        printf("\nNetwork port #: %u %X\n",
+                lO_addressServer.sin_port,
+                lO_addressServer.sin_port);
+    } // end of TCP/IPv4 binding
+
+
+    /* [3']
+     * <optional>
+     * A datagram socket has no connections to listen for and accept:
+     * serve the datagrams themselves, dozens per system call
+     */
+    if (li_datagram) {
+        printf("\n4. Serving datagrams in batches of up to %d%s...\n",
+               IPC_UDP_BATCH, li_segmentation ? ", with GRO/GSO" : "");
+        //
+        // returns only if receiving fails
+        fi_udpServe(li_socketConn_fd, li_segmentation);
+        //
+        fv_logErrorEXIT("udp", li_socketConn_fd, li_socketRW_fd);
     }
-    //
-    printf("%u  %X: DONE!", lO_addressServer.sin_addr.s_addr, lO_addressServer.sin_addr.s_addr);
-    //
-    printf("\nNetwork port #: %u %X\n",
-            lO_addressServer.sin_port,
-            lO_addressServer.sin_port);
 
 
     /* [3]
      * Put the server socket in a passive mode,
      * it waits for the client to approach the server to make a connection
-     * The backlog queue size (3), defines the maximum length to which the queue of 
+     * The backlog queue size (-k, SOMAXCONN by default), defines the maximum length to which the queue of 
      * pending connections for li_socketConn_fd may grow
      * If a connection request arrives when the queue is full,
      * the client may receive an error with an indication of ECONNREFUSED
+     * (a TCP client's SYN is dropped, and retried a second or more later):
+     * a burst of thousands of connects needs a queue of thousands
      */
     printf("\n4. Server socket is listening...");
     //
     // allows the process to listen on the socket for connections
     // number of connections that can be waiting, while the process is handling a particular connection
-    if (listen(li_socketConn_fd, 3) < 0) {
+    // (an inherited socket listens already, tuned, with its queue of pending connections intact)
+    if (li_inherited_fd < 0 && listen(li_socketConn_fd, li_backlog) < 0) {
         fv_logErrorEXIT("listen", li_socketConn_fd, li_socketRW_fd);
     }
+    //
+    // <optional>
+    // accept only once the client's message is there (-D), or has come with the SYN already (-F)
+    if (li_inherited_fd < 0 && fi_listenerTune(li_socketConn_fd, li_deferSeconds, li_fastOpenQueue) < 0) {
+        fv_logErrorEXIT("setsockopt", li_socketConn_fd, li_socketRW_fd);
+    }
+    //
+    // the directory served to fetch requests is opened once, and shared by every worker forked later
+    if (fi_bulkInit(lptrc_bulkRoot) < 0) {
+        fv_logErrorEXIT("bulk data", li_socketConn_fd, li_socketRW_fd);
+    }
+    //
+    // <optional>
+    // ready to accept: the previous server may stop, and the next one may take over from this one
+    if (lptrc_handoffPath && fi_handoffServe(lptrc_handoffPath, li_socketConn_fd) < 0) {
+        fv_logErrorEXIT("hot restart", li_socketConn_fd, li_socketRW_fd);
+    }
+
+
+    /* [4']
+     * <optional>
+     * Instead of a process per connection,
+     * multiplex all connections over one non-blocking epoll event loop
+     */
+    if (strcmp(lptrc_mode, "epoll") == 0) {
+        printf("\n5. Serving connections from an epoll event loop...\n");
+        //
+        // returns 0 only once the listening socket was handed over, and every connection served
+        if (fi_epollServe(li_socketConn_fd) == 0) {
+            close(li_socketConn_fd);
+            return 0;
+        }
+        fv_logErrorEXIT("epoll", li_socketConn_fd, li_socketRW_fd);
+    }
+    //
+    // or relay published messages from one event loop, each encoded once for all its subscribers
+    if (strcmp(lptrc_mode, "broker") == 0) {
+        printf("\n5. Relaying published messages to their subscribers...\n");
+        //
+        // returns only if the loop could not be set up
+        fi_brokerServe(li_socketConn_fd, li_queueDepth > 0 ? li_queueDepth : IPC_BROKER_QUEUE_DEPTH,
+                       strcmp(lptrc_overflow, "close") == 0 ? IPC_BROKER_CLOSE : IPC_BROKER_DROP);
+        //
+        fv_logErrorEXIT("broker", li_socketConn_fd, li_socketRW_fd);
+    }
+    //
+    // or let the kernel run accept, recv and send from one io_uring submission queue
+    if (strcmp(lptrc_mode, "uring") == 0) {
+        printf("\n5. Serving connections from an io_uring completion loop...\n");
+        //
+        // returns only if the ring could not be set up
+        fi_uringServe(li_socketConn_fd);
+        //
+        fv_logErrorEXIT("io_uring", li_socketConn_fd, li_socketRW_fd);
+    }
+
+
+    /* [4'']
+     * <optional>
+     * Start a fixed pool of workers up front; each one accepts on its own
+     * SO_REUSEPORT socket and serves connections itself, without forking
+     */
+    if (strcmp(lptrc_mode, "prefork") == 0) {
+        printf("\n5. Supervising %d pre-forked workers...\n", li_workers);
+        //
+        if (fi_preforkServe(li_socketConn_fd,
+                            li_backlog,
+                            li_workers,
+                            li_incomingCpu,
+                            fv_serve) < 0) {
+            fv_logErrorEXIT("prefork", li_socketConn_fd, li_socketRW_fd);
+        }
+        //
+        close(li_socketConn_fd);
+        //
+        return 0;
+    }
+
+
+    // <optional>
+    // hand accepted sockets to pooled threads instead of cloning a process each
+    if (strcmp(lptrc_mode, "threads") == 0) {
+        printf("\n5. Dispatching connections to %d pooled threads...\n", li_workers);
+        //
+        // returns 0 only once the listening socket was handed over, and every connection served
+        if (fi_threadPoolServe(li_socketConn_fd, li_workers, fv_serve) == 0) {
+            close(li_socketConn_fd);
+            return 0;
+        }
+        fv_logErrorEXIT("threads", li_socketConn_fd, li_socketRW_fd);
+    }
 
 
     /* [4]
      * Extract the first connection request on the queue of pending connections for the listening socket, li_socketConn_fd
      * Returns a file descriptor referring to a newly created connected socket
+     * accept4() (see fi_acceptBatch()) takes up to IPC_ACCEPT_BATCH of them per wakeup,
+     * so a burst of connects costs one wakeup, not one per connection
      */
     printf("\n5. Accepting a NEW connection: ");
     //
-    // address of the client that connects to the server
-    struct sockaddr_in lO_addressClient;
+    // children are never waited for: let the kernel reap them, so they do not pile up as zombies
+    signal(SIGCHLD, SIG_IGN);
     //
-    // to store size of the client's address
-    socklen_t lui_sizeClient = sizeof(lO_addressClient);
+    // sockets accepted by one wakeup
+    int li_a1_accepted[IPC_ACCEPT_BATCH];
+    //
+    // the listening socket must not block: every wakeup drains its queue
+    if (fi_listenerNonBlocking(li_socketConn_fd) < 0) {
+        fv_logErrorEXIT("fcntl", li_socketConn_fd, li_socketRW_fd);
+    }
     //
     while (1) {
         // block the process untill a client connects to the server
-        // the process wakes up when a connection from a client is successfully established
-        li_socketRW_fd = accept(li_socketConn_fd,
-                                (struct sockaddr *) &lO_addressClient,
-                                &lui_sizeClient);
-        if (li_socketRW_fd < 0) {
+        // the process wakes up when a connection from a client is successfully established,
+        // and takes every connection that is pending by then, not just that one
+        int li_accepted = fi_acceptBatch(li_socketConn_fd, li_a1_accepted, IPC_ACCEPT_BATCH, SOCK_CLOEXEC);
+        //
+        // <optional>
+        // hot restart: the successor accepts from now on
+        if (li_accepted < 0 && errno == ESHUTDOWN) {
+            break;
+        }
+        if (li_accepted < 0) {
             fv_logErrorEXIT("accept", li_socketConn_fd, li_socketRW_fd);
         }
-        //
-        printf("Successful!\n");
-
-        // connection is established between client and server,
-        // they are ready to transfer data
-        // both sides can send and receive info
-        printf("\nDEBUG: Connecting Client's Internet Address Info");
-        printf("\nAddress: %u %X",
-                lO_addressClient.sin_addr.s_addr,
-                lO_addressClient.sin_addr.s_addr);
-        printf("\nNetwork port #: %u %X",
-                lO_addressClient.sin_port,
-                lO_addressClient.sin_port);
-        printf("\nHost port #: %u %X\n",
-                ntohs(lO_addressClient.sin_port),
-                ntohs(lO_addressClient.sin_port));
-
-        // fork off a new child process
-        int li_processID = fork();
-        //
-        if (li_processID < 0) {
-            fv_logErrorEXIT("fork", li_socketConn_fd, li_socketRW_fd);
-        } else if (li_processID == 0) {
-            // close socket in the cloned process
-            close(li_socketConn_fd);
-            // serve the client
-            fv_serve(li_socketRW_fd);
+        for (int i = 0; i < li_accepted; ++i) {
+            li_socketRW_fd = li_a1_accepted[i];
+            //
+            // <optional>
+            // at the limit: turned away before a process is forked for it
+            if (!fi_admissionEnter()) {
+                fv_admissionReject(li_socketRW_fd);
+                continue;
+            }
+            fv_metricsAccept(li_socketRW_fd);
+            //
+            IPC_LOGI("Successful!");
+
+            // connection is established between client and server,
+            // they are ready to transfer data
+            // both sides can send and receive info
+            // (compiled in with -DIPC_LOG_COMPILED_LEVEL=IPC_LOG_DEBUG, shown with -l debug;
+            //  without it, not even the client's address is looked up)
+#if IPC_LOG_COMPILED_LEVEL >= IPC_LOG_DEBUG
+            // address of the client that connects to the server
+            struct sockaddr_in lO_addressClient;
+            //
+            // to store size of the client's address
+            socklen_t lui_sizeClient = sizeof(lO_addressClient);
+            //
+            if (gi_logLevel >= IPC_LOG_DEBUG) {
+                getpeername(li_socketRW_fd, (struct sockaddr *) &lO_addressClient, &lui_sizeClient);
+            }
+            IPC_LOGD("DEBUG: Connecting Client's Internet Address Info\n"
+                     "Address: %u %X\n"
+                     "Network port #: %u %X\n"
+                     "Host port #: %u %X",
+                     lO_addressClient.sin_addr.s_addr,
+                     lO_addressClient.sin_addr.s_addr,
+                     lO_addressClient.sin_port,
+                     lO_addressClient.sin_port,
+                     ntohs(lO_addressClient.sin_port),
+                     ntohs(lO_addressClient.sin_port));
+#endif
+
+            // fork off a new child process
+            int li_processID = fork();
             //
-            close(li_socketRW_fd);
-            // exit child process
-            exit(EXIT_SUCCESS);
-        } else {
-            close(li_socketRW_fd);
+            if (li_processID < 0) {
+                fv_logErrorEXIT("fork", li_socketConn_fd, li_socketRW_fd);
+            } else if (li_processID == 0) {
+                // close socket in the cloned process, and the rest of the batch, left to siblings
+                close(li_socketConn_fd);
+                for (int j = i + 1; j < li_accepted; ++j) {
+                    close(li_a1_accepted[j]);
+                }
+                // serve the client
+                fv_serve(li_socketRW_fd);
+                //
+                fv_metricsClose(li_socketRW_fd);
+                close(li_socketRW_fd);
+                fv_admissionLeave();
+                // exit child process
+                exit(EXIT_SUCCESS);
+            } else {
+                close(li_socketRW_fd);
+            }
         }
-    } // end of infinite while loop
+    } // end of accept loop, left only by a hot restart
 
     close(li_socketConn_fd);
+    //
+    // the children serving connections finish on their own; with SIGCHLD ignored,
+    // wait() returns (ECHILD) once the last of them has exited
+    while (wait(NULL) > 0 || errno == EINTR)
+        ;
 
-    fprintf(stderr, "Socket: Read/Write(%d)\tConnect(%d)",
-            li_socketRW_fd, li_socketConn_fd);
-
-    // program never gets here
     return 0;
 }
 
+/*
+ * A blocking read or write past its deadline (-T) fails with EAGAIN: reported as ETIMEDOUT
+ * Returns whether that is what happened
+ */
+static int fi_timedOut(void) {
+    //
+    if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        errno = ETIMEDOUT;
+    }
+    return errno == ETIMEDOUT;
+}
+
 /********************* SERVE *********************
  There is a separate instance of this function 
  for each connection.  It handles all communication
  once a connnection has been established.
+ On errors it returns, leaving the socket to the
+ caller: it may run in a pooled thread or worker
+ that must outlive the connection.
  *************************************************/
 void fv_serve(int pi_socketRW_fd) {
-    // server reads character from the socket connection into this buffer
-    char lc_a1_buffer[BUFFER_SIZE] = {0};
-    // initialize buffer to 0
-    // bzero(lc_a1_buffer, BUFFER_SIZE);
+    //
+    fv_busyPollSocket(pi_socketRW_fd);
+    // <optional>
+    // a client that connects and never sends holds this process or thread only so long (with -T)
+    fv_timeoutSocket(pi_socketRW_fd);
+    //
+    // a client speaking the framed protocol announces itself with the frame magic byte,
+    // any other first byte starts a plain text message
+    unsigned char luc_firstByte;
+    ssize_t       li_peeked = fl_busyPollRecv(pi_socketRW_fd, &luc_firstByte, 1, MSG_PEEK);
+    //
+    // whatever failed the peek (deadline or reset) would fail the read as well
+    if (li_peeked < 0) {
+        fi_timedOut();
+        IPC_LOGE("ERROR reading from socket: %m");
+        fv_metricsError(errno);
+        return;
+    }
+    if (li_peeked == 1 && luc_firstByte == IPC_FRAME_MAGIC) {
+        fv_serveFramed(pi_socketRW_fd);
+        return;
+    }
+    //
+    // server reads character from the socket connection into this buffer,
+    // borrowed from the pool: no memset(), the message is NUL-terminated where it ends
+    struct ipc_buffer *lptrO_buffer = fptrO_bufferGet(BUFFER_SIZE);
+    //
+    if (lptrO_buffer == NULL) {
+        IPC_LOGE("ERROR allocating buffer: %m");
+        return;
+    }
     // read message from the socket connection
     // li_n: number of characters read
     // NOTE: read() will block until there is something for it to read in the socket,
     //       i.e., after the client has executed a write()
-    fv_delay();
-    int li_n = read(pi_socketRW_fd, lc_a1_buffer, BUFFER_SIZE - 1);
+    // recvmsg() reads like read(), but also collects descriptors that a local
+    // (Unix domain) client attached to its message as ancillary data
+    // (with -P, it first spins a while on the socket instead of sleeping at once)
+    struct iovec  lO_data = { lptrO_buffer->mptrc_data, BUFFER_SIZE - 1 };
+    union {
+        struct cmsghdr mO_align;
+        char           mc_a1_space[CMSG_SPACE(sizeof(int))];
+    }             lO_control;
+    struct msghdr lO_message;
+    //
+    bzero(&lO_message, sizeof(lO_message));
+    lO_message.msg_iov = &lO_data;
+    lO_message.msg_iovlen = 1;
+    lO_message.msg_control = lO_control.mc_a1_space;
+    lO_message.msg_controllen = sizeof(lO_control.mc_a1_space);
+    //
+    int li_n = fl_busyPollRecvmsg(pi_socketRW_fd, &lO_message, MSG_CMSG_CLOEXEC);
     //
     if (li_n < 0) {
-        fv_logErrorEXIT("ERROR reading from socket",
-                        -1, pi_socketRW_fd);
+        fi_timedOut();
+        IPC_LOGE("ERROR reading from socket: %m");
+        fv_metricsError(errno);
+        fv_bufferRelease(lptrO_buffer);
+        return;
     }
+    fv_metricsRead(pi_socketRW_fd, li_n);
+    //
+    lptrO_buffer->mptrc_data[li_n] = '\0';
+    IPC_LOGI("[Client]: %s", lptrO_buffer->mptrc_data);
+    //
+    // <optional>
+    // a key-value command gets its result instead of the acknowledgement (with -K)
+    char   lc_a1_reply[BUFFER_SIZE];
+    size_t lsz_reply = fsz_kvExecute(lptrO_buffer->mptrc_data, li_n, lc_a1_reply, sizeof(lc_a1_reply));
     //
-    printf("[Client]: %s\n", lc_a1_buffer);
-    fv_delay();
+    fv_bufferRelease(lptrO_buffer);
+    //
+    // SCM_RIGHTS: the client shared a payload by descriptor instead of copying it through the socket
+    for (struct cmsghdr *lptrO_header = CMSG_FIRSTHDR(&lO_message);
+         lptrO_header != NULL;
+         lptrO_header = CMSG_NXTHDR(&lO_message, lptrO_header)) {
+        if (lptrO_header->cmsg_level == SOL_SOCKET && lptrO_header->cmsg_type == SCM_RIGHTS) {
+            int li_payload_fd;
+            memcpy(&li_payload_fd, CMSG_DATA(lptrO_header), sizeof(li_payload_fd));
+            //
+            fv_servePayload(li_payload_fd);
+            //
+            close(li_payload_fd);
+        }
+    }
+    if (lO_message.msg_flags & MSG_CTRUNC) {
+        IPC_LOGW("ERROR: client passed more descriptors than accepted, extra ones dropped");
+    }
+    // the work a real server would do for the message (with -S)
+    fv_serviceSimulate();
     // write message to the client
     // li_n: number of characters written
     // last argument: size of the message
-    char *lptrc_acknowledge = "I received your message.";
+    char *lptrc_acknowledge = IPC_ACKNOWLEDGE;
+    //
+    if (lsz_reply == 0) {
+        lsz_reply = strlen(lptrc_acknowledge);
+    } else {
+        lptrc_acknowledge = lc_a1_reply;
+    }
     // li_n = write(li_socketRW_fd, lptrc_acknowledge, strlen(lptrc_acknowledge));
-    li_n = send(pi_socketRW_fd, lptrc_acknowledge, strlen(lptrc_acknowledge), 0);
+    li_n = send(pi_socketRW_fd, lptrc_acknowledge, lsz_reply, 0);
     //
     if (li_n < 0) {
-        fv_logErrorEXIT("ERROR writing to socket",
-                        -1, pi_socketRW_fd);
+        fi_timedOut();
+        IPC_LOGE("ERROR writing to socket: %m");
+        fv_metricsError(errno);
+        return;
+    }
+    fv_metricsSend(pi_socketRW_fd, li_n, 1);
+    //
+    IPC_LOGI("Acknowledgement message sent");
+}
+
+/********************* PAYLOAD *********************
+ A local client may hand over a file descriptor with
+ its message: the payload is mapped, not copied.
+ *************************************************/
+void fv_servePayload(int pi_payload_fd) {
+    //
+    struct stat lO_status;
+    //
+    if (fstat(pi_payload_fd, &lO_status) < 0) {
+        IPC_LOGE("ERROR inspecting passed descriptor: %m");
+        return;
+    }
+    if (!S_ISREG(lO_status.st_mode) || lO_status.st_size == 0) {
+        IPC_LOGI("[Client payload]: descriptor %d, not a regular file with content", pi_payload_fd);
+        return;
+    }
+    //
+    const char *lptrc_payload = mmap(NULL, lO_status.st_size, PROT_READ, MAP_SHARED, pi_payload_fd, 0);
+    //
+    if (lptrc_payload == MAP_FAILED) {
+        IPC_LOGE("ERROR mapping passed descriptor: %m");
+        return;
+    }
+    //
+    int li_preview = lO_status.st_size < 64 ? (int) lO_status.st_size : 64;
+    IPC_LOGI("[Client payload]: %lld bytes shared by descriptor: %.*s%s",
+             (long long) lO_status.st_size, li_preview, lptrc_payload,
+             lO_status.st_size > li_preview ? "..." : "");
+    //
+    munmap((void *) lptrc_payload, lO_status.st_size);
+}
+
+/****************** SERVE FRAMED ******************
+ Serves a client speaking the framed protocol:
+ any number of requests, each of any size, on the
+ same connection, until the client closes it.
+ Payloads are streamed through one pooled read
+ buffer; only their first BUFFER_SIZE-1 bytes are
+ kept, to be printed.
+ Clients may pipeline requests: they are answered
+ in order, and all replies due after one read are
+ queued as header and payload fragments that leave
+ together in a single sendmsg(); with -O throughput
+ they are also held back (TCP_CORK) until no request
+ is left to read.
+ A fetch request is answered with bulk data
+ instead, sent without copying it (see ipc_bulk.h).
+ A binary message is answered with a binary
+ receipt; it is read in place, in the read buffer,
+ unless it came split across reads.
+ A key-value command (-K) is answered with its
+ result instead of the acknowledgement.
+ *************************************************/
+
+// bytes taken from the socket per read(): large payloads need fewer system calls
+#define FRAMED_READ_SIZE  (16 * BUFFER_SIZE)
+
+// state of one framed connection, shared with the parser's handlers
+struct ipc_framedSession {
+    int      mi_socketRW_fd;
+    // beginning of the request in progress, NUL-terminated
+    char     mc_a1_preview[BUFFER_SIZE];
+    size_t   msz_preview;
+    // replies not sent yet, and how many
+    struct ipc_output mO_output;
+    unsigned          mui_batchFrames;
+    // binary message in progress: where it lies, in the read buffer or gathered in mptrO_assembly
+    const char        *mptrc_message;
+    struct ipc_buffer *mptrO_assembly;
+    size_t             msz_assembled;
+};
+
+static int fi_batchFlush(struct ipc_framedSession *pptrO_session) {
+    //
+    size_t lsz_queued = fsz_outputQueued(&pptrO_session->mO_output);
+    //
+    if (lsz_queued == 0) {
+        return 0;
+    }
+    if (fi_outputFlush(&pptrO_session->mO_output) < 0) {
+        return -1;
+    }
+    fv_metricsSend(pptrO_session->mi_socketRW_fd, lsz_queued, pptrO_session->mui_batchFrames);
+    //
+    IPC_LOGI("%u acknowledgement(s) sent", pptrO_session->mui_batchFrames);
+    pptrO_session->mui_batchFrames = 0;
+    //
+    return 0;
+}
+
+/*
+ * Queue a reply frame behind the earlier ones, sending them first if there is no room
+ * pi_stable: the payload stays valid until the next flush (e.g., a constant), so it need not be copied
+ */
+static int fi_batchQueue(struct ipc_framedSession *pptrO_session,
+                         uint16_t                  pus_type,
+                         uint32_t                  pui_requestID,
+                         const void               *pptrv_payload,
+                         size_t                    psz_length,
+                         int                       pi_stable) {
+    //
+    struct ipc_frameHeader lO_header;
+    unsigned char          luc_a1_header[IPC_FRAME_HEADER_SIZE];
+    int                    li_referenced = pi_stable && psz_length > IPC_OUTPUT_COPY_MAX;
+    //
+    lO_header.mus_type = pus_type;
+    lO_header.mui_requestID = pui_requestID;
+    lO_header.mul_length = psz_length;
+    fv_frameHeaderEncode(&lO_header, luc_a1_header);
+    //
+    if (!fi_outputFits(&pptrO_session->mO_output,
+                       IPC_FRAME_HEADER_SIZE + (li_referenced ? 0 : psz_length), li_referenced) &&
+        fi_batchFlush(pptrO_session) < 0) {
+        return -1;
     }
+    if (fi_outputAppend(&pptrO_session->mO_output, luc_a1_header, IPC_FRAME_HEADER_SIZE, 0) < 0 ||
+        fi_outputAppend(&pptrO_session->mO_output, pptrv_payload, psz_length, pi_stable) < 0) {
+        return -1;
+    }
+    ++pptrO_session->mui_batchFrames;
+    //
+    return 0;
+}
+
+static int fi_onRequestHeader(void *pptrv_session, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_framedSession *lptrO_session = pptrv_session;
+    //
+    if (pptrO_header->mus_type != IPC_FRAME_REQUEST &&
+        pptrO_header->mus_type != IPC_FRAME_FETCH &&
+        pptrO_header->mus_type != IPC_FRAME_MESSAGE) {
+        errno = EPROTO;
+        return -1;
+    }
+    if (pptrO_header->mus_type == IPC_FRAME_MESSAGE && pptrO_header->mul_length > IPC_MESSAGE_SIZE_MAX) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    lptrO_session->msz_preview = 0;
+    lptrO_session->mptrc_message = NULL;
+    lptrO_session->msz_assembled = 0;
     //
-    printf("Acknowledgement message sent\n");
-    fv_delay();
+    return 0;
+}
+
+static int fi_onRequestPayload(void                         *pptrv_session,
+                               const struct ipc_frameHeader *pptrO_header,
+                               const char                   *pptrc_chunk,
+                               size_t                        psz_chunk) {
+    struct ipc_framedSession *lptrO_session = pptrv_session;
+    size_t                    lsz_room = BUFFER_SIZE - 1 - lptrO_session->msz_preview;
+    //
+    if (pptrO_header->mus_type == IPC_FRAME_MESSAGE) {
+        // usually the whole message came with one read: it is used where it lies
+        if (lptrO_session->msz_assembled == 0 && psz_chunk == pptrO_header->mul_length) {
+            lptrO_session->mptrc_message = pptrc_chunk;
+            return 0;
+        }
+        // split across reads: gathered in a buffer kept for the rest of the session
+        if (lptrO_session->mptrO_assembly == NULL &&
+            (lptrO_session->mptrO_assembly = fptrO_bufferGet(IPC_MESSAGE_SIZE_MAX)) == NULL) {
+            return -1;
+        }
+        memcpy(lptrO_session->mptrO_assembly->mptrc_data + lptrO_session->msz_assembled, pptrc_chunk, psz_chunk);
+        lptrO_session->msz_assembled += psz_chunk;
+        lptrO_session->mptrc_message = lptrO_session->mptrO_assembly->mptrc_data;
+        //
+        return 0;
+    }
+    if (psz_chunk > lsz_room) {
+        psz_chunk = lsz_room;
+    }
+    memcpy(lptrO_session->mc_a1_preview + lptrO_session->msz_preview, pptrc_chunk, psz_chunk);
+    lptrO_session->msz_preview += psz_chunk;
+    //
+    return 0;
+}
+
+// a binary note: its fields are read in place, and answered with a receipt
+static int fi_onMessage(struct ipc_framedSession *pptrO_session, const struct ipc_frameHeader *pptrO_header) {
+    const char *lptrc_message = pptrO_session->mptrc_message;
+    //
+    if (fi_messageValidate(lptrc_message, pptrO_header->mul_length) < 0 ||
+        fus_messageKind(lptrc_message) != IPC_MESSAGE_NOTE) {
+        errno = EPROTO;
+        return -1;
+    }
+    const char *lptrc_text = "";
+    size_t      lsz_text = 0;
+    //
+    if (fus_messageBlobs(lptrc_message) > 0) {
+        lptrc_text = fptrc_messageBlob(lptrc_message, 0, &lsz_text);
+    }
+    IPC_LOGI("[Client #%u]: note %llu: %.*s", pptrO_header->mui_requestID,
+             (unsigned long long) ful_messageSequence(lptrc_message),
+             (int) (lsz_text < BUFFER_SIZE - 1 ? lsz_text : BUFFER_SIZE - 1), lptrc_text);
+    //
+    // the sender's timestamp goes back unchanged: it measures its round trip with it
+    unsigned char luc_a1_receipt[IPC_MESSAGE_HEADER_SIZE];
+    //
+    fsz_messageEncode(luc_a1_receipt, sizeof(luc_a1_receipt),
+                      IPC_MESSAGE_RECEIPT, 0,
+                      ful_messageSequence(lptrc_message),
+                      ful_messageTimestamp(lptrc_message),
+                      NULL, 0);
+    //
+    return fi_batchQueue(pptrO_session, IPC_FRAME_MESSAGE, pptrO_header->mui_requestID,
+                         luc_a1_receipt, sizeof(luc_a1_receipt), 0);
+}
+
+static int fi_onRequestEnd(void *pptrv_session, const struct ipc_frameHeader *pptrO_header) {
+    struct ipc_framedSession *lptrO_session = pptrv_session;
+    //
+    lptrO_session->mc_a1_preview[lptrO_session->msz_preview] = '\0';
+    // the work a real server would do for the request (with -S)
+    fv_serviceSimulate();
+    //
+    if (pptrO_header->mus_type == IPC_FRAME_MESSAGE) {
+        return fi_onMessage(lptrO_session, pptrO_header);
+    }
+    if (pptrO_header->mus_type == IPC_FRAME_FETCH) {
+        IPC_LOGI("[Client #%u]: fetch %s", pptrO_header->mui_requestID, lptrO_session->mc_a1_preview);
+        //
+        // the data goes out behind the acknowledgements queued before it, in order
+        if (fi_batchFlush(lptrO_session) < 0) {
+            return -1;
+        }
+        // a name cut short by the preview buffer, or with a NUL inside, names nothing
+        return fi_bulkServe(lptrO_session->mi_socketRW_fd,
+                            pptrO_header->mui_requestID,
+                            pptrO_header->mul_length == strlen(lptrO_session->mc_a1_preview)
+                                ? lptrO_session->mc_a1_preview : "");
+    }
+    //
+    if (pptrO_header->mul_length > lptrO_session->msz_preview) {
+        IPC_LOGI("[Client #%u]: %s... (%llu bytes)", pptrO_header->mui_requestID, lptrO_session->mc_a1_preview,
+                 (unsigned long long) pptrO_header->mul_length);
+    } else {
+        IPC_LOGI("[Client #%u]: %s", pptrO_header->mui_requestID, lptrO_session->mc_a1_preview);
+    }
+    //
+    // <optional>
+    // a key-value command, whole in the preview, is answered with its result (with -K)
+    if (pptrO_header->mul_length == lptrO_session->msz_preview) {
+        char   lc_a1_reply[BUFFER_SIZE];
+        size_t lsz_reply = fsz_kvExecute(lptrO_session->mc_a1_preview, lptrO_session->msz_preview,
+                                         lc_a1_reply, sizeof(lc_a1_reply));
+        //
+        if (lsz_reply > 0) {
+            return fi_batchQueue(lptrO_session, IPC_FRAME_ACK, pptrO_header->mui_requestID,
+                                 lc_a1_reply, lsz_reply, 0);
+        }
+    }
+    return fi_batchQueue(lptrO_session, IPC_FRAME_ACK, pptrO_header->mui_requestID,
+                         IPC_ACKNOWLEDGE, strlen(IPC_ACKNOWLEDGE), 1);
+}
+
+static const struct ipc_frameHandler gO_requestHandler = {
+    fi_onRequestHeader,
+    fi_onRequestPayload,
+    fi_onRequestEnd
+};
+
+void fv_serveFramed(int pi_socketRW_fd) {
+    //
+    struct ipc_framedSession lO_session;
+    struct ipc_frameParser   lO_parser;
+    // read buffer, borrowed from the pool for the whole session
+    struct ipc_buffer       *lptrO_buffer = fptrO_bufferGet(FRAMED_READ_SIZE);
+    //
+    if (lptrO_buffer == NULL) {
+        IPC_LOGE("ERROR allocating buffer: %m");
+        return;
+    }
+    lO_session.mi_socketRW_fd = pi_socketRW_fd;
+    lO_session.msz_preview = 0;
+    fv_outputInit(&lO_session.mO_output, pi_socketRW_fd);
+    lO_session.mui_batchFrames = 0;
+    lO_session.mptrc_message = NULL;
+    lO_session.mptrO_assembly = NULL;
+    lO_session.msz_assembled = 0;
+    fv_frameParserInit(&lO_parser, &gO_requestHandler, &lO_session);
+    //
+    unsigned char luc_pending;
+    //
+    while (1) {
+        // frames may arrive split or glued together, the parser copes with both
+        int li_n = fl_busyPollRecv(pi_socketRW_fd, lptrO_buffer->mptrc_data, FRAMED_READ_SIZE, 0);
+        //
+        if (li_n == 0) {
+            // client closed the connection
+            break;
+        }
+        if (li_n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fi_timedOut();
+            IPC_LOGE("ERROR reading from socket: %m");
+            fv_metricsError(errno);
+            break;
+        }
+        fv_metricsRead(pi_socketRW_fd, li_n);
+        //
+        // answer every request completed by this read with one sendmsg(); corked replies
+        // wait for the next read, unless there is none to make yet: the client waits for them
+        if (fi_frameParserFeed(&lO_parser, lptrO_buffer->mptrc_data, li_n) != 0 ||
+            fi_batchFlush(&lO_session) < 0 ||
+            (lO_session.mO_output.mi_corked &&
+             recv(pi_socketRW_fd, &luc_pending, 1, MSG_PEEK | MSG_DONTWAIT) < 0 &&
+             fi_outputPush(&lO_session.mO_output) < 0)) {
+            fi_timedOut();
+            IPC_LOGE("ERROR serving frame: %m");
+            fv_metricsError(errno);
+            break;
+        }
+    }
+    fv_bufferRelease(lO_session.mptrO_assembly);
+    fv_bufferRelease(lptrO_buffer);
 }